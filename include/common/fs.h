@@ -40,7 +40,11 @@ typedef struct FsFile {
 bool fs_real_path(const char* path, FsPath* out);
 FsFile* fs_open(const char* path, bool create, bool overwrite);
 usize fs_read(FsFile* f, void* buf, usize len);
+usize fs_write(FsFile* f, const void* buf, usize len);
 string fs_read_entire(FsFile* f);
+// read-only, stays valid after the file is closed
+string fs_map_entire(FsFile* f);
+void fs_unmap(string mapped);
 void fs_close(FsFile* f);
 void fs_destroy(FsFile* f);
 
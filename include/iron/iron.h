@@ -98,6 +98,7 @@ typedef float    f32;
 // -------------------------------------
 
 typedef struct FeInst FeInst;
+typedef u32 FeInstRef; // see fe_inst_at
 typedef struct FeBlock FeBlock;
 typedef struct FeSymbol FeSymbol;
 typedef struct FeFunc FeFunc;
@@ -198,6 +199,8 @@ typedef struct FeRecordField {
 } FeRecordField;
 
 // if ty is not a complex type, cty should be nullptr
+FeComplexTy* fe_ty_record_new(u32 fields_len);
+FeComplexTy* fe_ty_array_new(u32 array_len, FeTy elem_ty, FeComplexTy* elem_cty);
 usize fe_ty_get_size(FeTy ty, FeComplexTy* cty);
 usize fe_ty_get_align(FeTy ty, FeComplexTy* cty);
 
@@ -286,6 +289,15 @@ typedef struct FeFuncSig {
     FeFuncParam params[];
 } FeFuncSig;
 
+// analyses that can be cached on a function, see fe_analysis_require
+typedef enum: u8 {
+    FE_ANALYSIS_LIVENESS   = 1 << 0, // FeBlock.live
+    FE_ANALYSIS_DOMINATORS = 1 << 1, // FeBlock.idom, FeBlock.dom_depth
+    FE_ANALYSIS_LOOPS      = 1 << 2, // FeBlock.loop_header, FeBlock.loop_depth
+
+    FE_ANALYSIS_ALL = FE_ANALYSIS_LIVENESS | FE_ANALYSIS_DOMINATORS | FE_ANALYSIS_LOOPS,
+} FeAnalysisSet;
+
 typedef struct FeFunc {
     FeFuncSig* sig;
     FeSymbol* sym;
@@ -294,6 +306,7 @@ typedef struct FeFunc {
     u32 max_id;
     u32 max_block_id;
     FeInstPool* ipool;
+    bool owns_ipool; // from fe_opt_relayout, goes away with the function
     FeVRegBuffer* vregs;
 
     FeInst** params; // gets length of params from signature
@@ -307,6 +320,7 @@ typedef struct FeFunc {
     FeStackItem* stack_top; // most-positive offset from stack pointer
     FeStackItem* stack_bottom;
 
+    FeAnalysisSet analyses; // which of the cached analyses are up to date
 } FeFunc;
 
 typedef struct FeSymTab {
@@ -374,8 +388,20 @@ typedef struct FeBlock {
     FeBlock** pred;
     FeBlock** succ;
 
+    // pred and succ point here until they outgrow it
+    FeBlock* pred_inline[2];
+    FeBlock* succ_inline[2];
+
     // liveness info
     FeBlockLiveness* live;
+
+    // dominator tree, idom is null for the entry and unreachable blocks
+    FeBlock* idom;
+    u32 dom_depth;
+
+    // innermost natural loop this block is in, null if none
+    FeBlock* loop_header;
+    u32 loop_depth;
 } FeBlock;
 
 #define for_funcs(f, modptr) \
@@ -385,10 +411,10 @@ typedef struct FeBlock {
     for (FeBlock* block = (funcptr)->entry_block; block != nullptr; block = block->list_next)
 
 #define for_inst(inst, blockptr) \
-    for (FeInst* inst = (blockptr)->bookend->next, *_next_ = inst->next; inst->kind != FE__BOOKEND; inst = _next_, _next_ = _next_->next)
+    for (FeInst* inst = fe_inst_next((blockptr)->bookend), *_next_ = fe_inst_next(inst); inst->kind != FE__BOOKEND; inst = _next_, _next_ = fe_inst_next(_next_))
 
 #define for_inst_reverse(inst, blockptr) \
-    for (FeInst* inst = (blockptr)->bookend->prev, *_prev_ = inst->prev; inst->kind != FE__BOOKEND; inst = _prev_, _prev_ = _prev_->prev)
+    for (FeInst* inst = fe_inst_prev((blockptr)->bookend), *_prev_ = fe_inst_prev(inst); inst->kind != FE__BOOKEND; inst = _prev_, _prev_ = fe_inst_prev(_prev_))
 
 typedef u16 FeInstKind;
 typedef enum: FeInstKind {
@@ -415,6 +441,7 @@ typedef enum: FeInstKind {
     FE_IADD,
     FE_ISUB,
     FE_IMUL, 
+    FE_IMULH, FE_UMULH, // upper half of the double-width product
     FE_IDIV, FE_UDIV,
     FE_IREM, FE_UREM,
     FE_AND,
@@ -483,6 +510,10 @@ typedef enum: FeInstKind {
     // FeInstCall
     // {last_mem, ptr, src1, src2, ...}
     FE_CALL,
+    // FeInstCall
+    // {last_mem, ptr, src1, src2, ...}
+    // call in tail position, returns the callee's results directly
+    FE_TAILCALL,
 
     // FeInstInlineAsm
     // {?last_mem, in1, in2, ...} -> {out1, out2, ...}
@@ -508,44 +539,105 @@ typedef enum: FeInstKind {
     FE__INST_END,
 } FeInstKindGeneric;
 
-// if possible, bit-pack uses
-#ifdef FE_HOST_X64
-    typedef struct FeInstUse {
-        u64 idx : 16; // shouldn't need more than this...
-        i64 ptr : 48;
-    } FeInstUse;
-    static_assert(sizeof(FeInstUse) == 8);
-    #define FE_USE_PTR(use) ((FeInst*)(i64)(use).ptr)
-#else
-    typedef struct FeInstUse {
-        usize idx;
-        FeInst* ptr;
-    } FeInstUse;
-    #define FE_USE_PTR(use) (use).ptr
-#endif
+// every instruction pool carves its chunks out of one big reserved
+// range, so an instruction (or one of its lists) can be named by its
+// 8-byte slot index into that range. ref 0 is never handed out, so it's null.
+extern usize* fe__inst_space;
+
+static inline FeInst* fe_inst_at(FeInstRef ref) {
+    return ref == 0 ? nullptr : (FeInst*)&fe__inst_space[ref];
+}
+
+static inline FeInstRef fe_inst_ref(const void* inst_or_list) {
+    return inst_or_list == nullptr ? 0 : (FeInstRef)((const usize*)inst_or_list - fe__inst_space);
+}
+
+typedef struct FeInstUse {
+    FeInstRef inst;
+    u32 idx; // which input of 'inst'
+} FeInstUse;
+#define FE_USE_PTR(use) fe_inst_at((use).inst)
 
 typedef struct FeInst {
     FeInstKind kind;
     FeTy ty;
-    
-    u16 use_len;
-    u16 use_cap;
+    // list capacities, see fe_inst_in_cap and fe_inst_use_cap
+    u8 caps;
+
     u16 in_len;
-    u16 in_cap;
+    u16 use_len;
 
-    u32 flags;
     u32 id;
     FeVReg vr_def;
-    
-    FeInstUse* uses;
-    FeInst** inputs;
 
     // CIRCULAR
-    FeInst* prev;
-    FeInst* next;
+    FeInstRef prev;
+    FeInstRef next;
 
+    FeInstRef inputs; // FeInstRef[in_cap]
+    FeInstRef uses;   // FeInstUse[use_cap]
+
+    // up to three inputs are stored inline, right after the extra data.
+    // the first two uses are stored inline after those.
     usize extra[];
 } FeInst;
+static_assert(sizeof(FeInst) == 32);
+
+// the low nibble of 'caps' is the input list's capacity as 2 << n,
+// or one of these if the inputs live inside the instruction itself.
+// the high nibble is the use list's capacity, also as 2 << n,
+// or FE__USE_CAP_INLINE for the two inline uses.
+#define FE__IN_CAP_INLINE_2 14
+#define FE__IN_CAP_INLINE_4 15
+#define FE__IN_CAP_MAX (2 << 13)
+#define FE__USE_CAP_INLINE 15
+#define FE__USE_CAP_MAX (2 << 14)
+
+static inline usize fe_inst_in_cap(const FeInst* inst) {
+    u8 n = inst->caps & 0xF;
+    if (inst->inputs == 0) {
+        return 0;
+    }
+    if (n >= FE__IN_CAP_INLINE_2) {
+        return n == FE__IN_CAP_INLINE_2 ? 2 : 4;
+    }
+    return (usize)2 << n;
+}
+
+static inline bool fe_inst_in_inline(const FeInst* inst) {
+    return inst->inputs != 0 && (inst->caps & 0xF) >= FE__IN_CAP_INLINE_2;
+}
+
+static inline bool fe_inst_uses_inline(const FeInst* inst) {
+    return (inst->caps >> 4) == FE__USE_CAP_INLINE;
+}
+
+static inline usize fe_inst_use_cap(const FeInst* inst) {
+    if (fe_inst_uses_inline(inst)) {
+        return 2;
+    }
+    return (usize)2 << (inst->caps >> 4);
+}
+
+static inline FeInst* fe_inst_next(const FeInst* inst) {
+    return fe_inst_at(inst->next);
+}
+
+static inline FeInst* fe_inst_prev(const FeInst* inst) {
+    return fe_inst_at(inst->prev);
+}
+
+static inline FeInstRef* fe_inst_inputs(const FeInst* inst) {
+    return (FeInstRef*)&fe__inst_space[inst->inputs];
+}
+
+static inline FeInst* fe_inst_input(const FeInst* inst, usize n) {
+    return fe_inst_at(fe_inst_inputs(inst)[n]);
+}
+
+static inline FeInstUse* fe_inst_uses(const FeInst* inst) {
+    return (FeInstUse*)&fe__inst_space[inst->uses];
+}
 
 typedef enum : u8 {
     FE_ASM_SCRATCH = 0b00, // used when an register needs to be picked but is neither IN nor OUT
@@ -727,6 +819,9 @@ FeFunc* fe_func_new(
     FeInstPool* ipool,
     FeVRegBuffer* vregs);
 void fe_func_destroy(FeFunc* f);
+// doesn't unlink instructions one by one, it resets the whole pool.
+// only use it if nothing else is allocating out of the function's pool.
+void fe_func_destroy_fast(FeFunc* f);
 FeInst* fe_func_param(FeFunc* f, u16 index);
 
 FeInst* fe_insert_before(FeInst* point, FeInst* i);
@@ -757,6 +852,7 @@ FeInstChain fe_chain_new(FeInst* initial);
 FeInstChain fe_chain_append_end(FeInstChain chain, FeInst* i);
 FeInstChain fe_chain_append_begin(FeInstChain chain, FeInst* i);
 FeInstChain fe_chain_concat(FeInstChain front, FeInstChain back);
+FeInstChain fe_chain_from_block(FeBlock* block);
 void fe_insert_chain_before(FeInst* point, FeInstChain chain);
 void fe_insert_chain_after(FeInst* point, FeInstChain chain);
 void fe_chain_replace_pos(FeInst* from, FeInstChain to);
@@ -798,9 +894,11 @@ void fe_branch_set_false(FeFunc* f, FeInst* branch, FeBlock* block);
 void fe_jump_set_target(FeFunc* f, FeInst* jump, FeBlock* block);
 void fe_phi_add_src(FeFunc* f, FeInst* phi, FeInst* src_value, FeBlock* src_block);
 void fe_phi_remove_src(FeFunc* f, FeInst* phi, u16 n);
+void fe_phi_remove_srcs_from(FeFunc* f, FeBlock* block, FeBlock* src_block);
 
 const char* fe_inst_name(const FeTarget* target, FeInstKind kind);
 const char* fe_ty_name(FeTy ty);
+const char* fe_cconv_name(FeCallConv cconv);
 
 FeBlock** fe_list_terminator_successors(const FeTarget* t, FeInst* term, usize* len_out);
 
@@ -818,37 +916,77 @@ FeTy fe_proj_ty(FeInst* tuple, usize index);
 // worklist
 // -------------------------------------
 
+typedef enum : u8 {
+    FE_ISET_BY_ID, // lowest id first
+    FE_ISET_LIFO,
+    FE_ISET_FIFO,
+} FeInstSetOrder;
+
+typedef struct FeInstSetEntry {
+    FeInst* inst;
+    u32 id;
+} FeInstSetEntry;
+
+// worklist of instructions, each one is in there at most once
 typedef struct FeInstSet {
-    FeInst** insts;
-    usize* exists;
-    u32 id_start;
-    u32 id_end;
+    usize* exists; // one bit per id
+    union {
+        FeInst** insts; // FE_ISET_BY_ID, indexed by id
+        // FE_ISET_LIFO/FIFO. removed insts stay in here and may already
+        // be destroyed, so pop checks the id without touching the inst
+        FeInstSetEntry* queue;
+    };
+    u32 words;  // in 'exists'
+    u32 cursor; // FE_ISET_BY_ID: no bits are set in words below this
+    u32 cap;    // of 'insts' or 'queue'
+    u32 head;   // FE_ISET_LIFO/FIFO
+    u32 len;    // FE_ISET_LIFO/FIFO
+    FeInstSetOrder order;
 } FeInstSet;
 
-void fe_iset_init(FeInstSet* iset);
+void fe_iset_init(FeInstSet* iset, FeFunc* f, FeInstSetOrder order);
 void fe_iset_push(FeInstSet* iset, FeInst* inst);
 FeInst* fe_iset_pop(FeInstSet* iset);
+bool fe_iset_contains(FeInstSet* iset, FeInst* inst);
+void fe_iset_remove(FeInstSet* iset, FeInst* inst);
 void fe_iset_destroy(FeInstSet* iset);
 
 // -------------------------------------
 // allocation
 // -------------------------------------
 
-#define FE__IPOOL_INST_FREE_SPACES_LEN (FE__INST_EXTRA_MAX_SIZE / sizeof(usize) + 1)
+#define FE__INST_INLINE_INPUTS_MAX_SIZE (sizeof(FeInstRef) * 4)
+#define FE__IPOOL_INST_FREE_SPACES_LEN ((FE__INST_EXTRA_MAX_SIZE + FE__INST_INLINE_INPUTS_MAX_SIZE) / sizeof(usize) + 1)
 typedef struct Fe__InstPoolChunk Fe__InstPoolChunk;
 typedef struct Fe__InstPoolFreeSpace Fe__InstPoolFreeSpace;
 typedef struct FeInstPool {
     Fe__InstPoolChunk* top;
-    Fe__InstPoolFreeSpace* inst_free_spaces[FE__INST_EXTRA_MAX_SIZE];
+    Fe__InstPoolChunk* spare; // from fe_ipool_reserve, used before getting new ones
+    Fe__InstPoolFreeSpace* inst_free_spaces[FE__IPOOL_INST_FREE_SPACES_LEN];
+    u64 inst_free_mask; // which of inst_free_spaces aren't empty
 
     Fe__InstPoolFreeSpace* lists_pow_2[10]; // 1, 2, 4, 8, 16, 32, 64, 128, 256, 512
+
+    usize allocated; // bytes handed out since init, freed or not
 } FeInstPool;
+static_assert(FE__IPOOL_INST_FREE_SPACES_LEN <= 64);
 
 void fe_ipool_init(FeInstPool* pool);
-FeInst* fe_ipool_alloc(FeInstPool* pool, usize extra_size);
+// 'tail_size' is everything after the header: the extra data and any inline inputs.
+// the inline use list goes after that, and the instruction starts out using it.
+FeInst* fe_ipool_alloc(FeInstPool* pool, usize tail_size);
 void fe_ipool_free(FeInstPool* pool, FeInst* inst);
 usize fe_ipool_free_manual(FeInstPool* pool, FeInst* inst);
 void fe_ipool_destroy(FeInstPool* pool);
+// free everything in the pool at once, it can be used again afterward
+void fe_ipool_reset(FeInstPool* pool);
+// get enough chunks for the next 'size' bytes up front, so a big batch
+// of allocations doesn't stop to find one every few hundred instructions.
+// ones that aren't cached are committed all at once.
+void fe_ipool_reserve(FeInstPool* pool, usize size);
+// hand the chunks this thread has cached back to every other thread.
+// it happens on its own when the thread exits, where C11 threads are around.
+void fe_ipool_thread_flush();
 
 // list allocation!
 void* fe_ipool_list_alloc(FeInstPool* pool, usize list_cap);
@@ -907,9 +1045,40 @@ FeVerifyReportList fe_verify_module(FeModule* m);
 void fe_opt_local(FeFunc* f);
 void fe_opt_tdce(FeFunc* f);
 void fe_opt_compact_ids(FeFunc* f);
+// moves 'f' into 'pool' in reverse postorder. the old instructions
+// are freed back into the pool they came from.
+void fe_func_relayout(FeFunc* f, FeInstPool* pool);
+// fe_func_relayout into a new pool that 'f' owns from then on
+void fe_opt_relayout(FeFunc* f);
+void fe_opt_sccp(FeFunc* f);
+void fe_opt_cfg_simplify(FeFunc* f);
+
+// inline calls whose callee is at most 'threshold' instructions
+// bigger than the call itself
+#define FE_INLINE_THRESHOLD_DEFAULT 24
+void fe_opt_inline(FeModule* mod, usize threshold);
+// deletes local functions and data that nothing outside the module can
+// reach, and externs nothing uses. sections that lose their last symbol
+// to this are freed, ones that were already empty are left alone. run it
+// before codegen. returns how many symbols went away.
+usize fe_opt_dead_symbols(FeModule* mod);
+void fe_opt_tailcall(FeFunc* f);
+
+bool fe__const_eval_binop(FeInstKind kind, FeTy ty, u64 lhs, u64 rhs, u64* result);
 
 void fe_opt_post_regalloc(FeFunc* f);
 
+// compute whatever in 'set' isn't already cached on 'f'.
+// passes run by hand don't keep f->analyses up to date,
+// invalidate what they break before asking again.
+void fe_analysis_require(FeFunc* f, FeAnalysisSet set);
+void fe_analysis_invalidate(FeFunc* f, FeAnalysisSet set);
+// needs FE_ANALYSIS_DOMINATORS
+bool fe_block_dominates(FeBlock* a, FeBlock* b);
+
+usize fe__block_rpo(FeFunc* f, FeBlock** order, usize block_count);
+void fe__liveness_free(FeBlockLiveness* lv);
+
 // -------------------------------------
 // IO utilities
 // -------------------------------------
@@ -948,6 +1117,41 @@ void fe__emit_ir_stack_label(FeDataBuffer* db, FeStackItem* item);
 void fe__emit_ir_block_label(FeDataBuffer* db, FeFunc* f, FeBlock* ref);
 void fe__emit_ir_ref(FeDataBuffer* db, FeFunc* f, FeInst* ref);
 
+typedef struct FeIrParseError {
+    u32 line;
+    u32 col;
+    char message[128];
+} FeIrParseError;
+
+// read functions printed by fe_emit_ir_func (fancy off) into mod.
+// only target-independent IR.
+// returns false and fills out err if the text is bad, which includes blocks
+// that don't end in a terminator and constants too big for their type.
+bool fe_parse_ir(FeModule* mod, const char* src, usize len, FeInstPool* ipool, FeVRegBuffer* vregs, FeIrParseError* err);
+
+// compact binary form of a whole module, for caching IR between runs.
+// only target-independent IR. instruction and block ids are kept.
+void fe_module_write(FeDataBuffer* db, FeModule* mod);
+// symbol and section names point into data, so it has to stay around
+// (and mapped, if it's a file) as long as the module does.
+// returns nullptr if data isn't a module fe_module_write made,
+// in which case ipool has been reset.
+FeModule* fe_module_read(const u8* data, usize len, FeInstPool* ipool, FeVRegBuffer* vregs);
+
+// moves everything in 'src' into 'dst' and frees 'src'. externs resolve
+// against definitions, weak definitions lose to strong ones, and locals
+// that clash get renamed. only target-independent IR.
+// if both define the same symbol, returns the one from 'src' and
+// neither module is touched.
+FeSymbol* fe_module_link(FeModule* dst, FeModule* src);
+// makes every global or weak symbol local, except the ones named in 'exports'
+void fe_module_internalize(FeModule* mod, const char* const* exports, usize exports_len);
+// splits 'mod' into up to 'max_units' new modules, balanced by instruction
+// count, and returns how many it made. locals used across units become
+// global. 'mod' is left empty. functions keep their instruction pools,
+// give each unit its own (see fe_func_relayout) before running them in parallel.
+usize fe_module_partition(FeModule* mod, FeModule** units, usize max_units);
+
 // crash at runtime with a stack trace (if available)
 [[noreturn]] void fe_runtime_crash(const char* error, ...);
 
@@ -1009,10 +1213,12 @@ typedef struct FeTarget {
     FeTy ptr_ty;
 
     // const char* (*inst_name)(FeInstKind kind, bool ir);
-    FeInst** (*list_inputs)(FeInst* inst, usize* len_out);
+    FeInstRef* (*list_inputs)(FeInst* inst, usize* len_out);
     FeBlock** (*list_targets)(FeInst* term, usize* len_out);
 
     FeInstChain (*isel)(FeFunc* f, FeBlock* block, FeInst* inst);
+    // whether isel can turn a call with this signature into an FE_TAILCALL
+    bool (*can_tail_call)(FeFuncSig* sig);
     void (*pre_regalloc_opt)(FeFunc* f);
     void (*final_touchups)(FeFunc* f);
 
@@ -1039,8 +1245,69 @@ void fe_vrbuf_destroy(FeVRegBuffer* buf);
 FeVReg fe_vreg_new(FeVRegBuffer* buf, FeInst* def, FeBlock* def_block, u8 class);
 FeVirtualReg* fe_vreg(FeVRegBuffer* buf, FeVReg vr);
 
+// fe_codegen, one step at a time
+void fe_codegen_isel(FeFunc* f);
+void fe_codegen_vregs(FeFunc* f);
 void fe_codegen(FeFunc* f);
 
+// -------------------------------------
+// pass manager
+// -------------------------------------
+
+typedef struct FePass {
+    const char* name;
+    void (*run)(FeFunc* f);
+    FeAnalysisSet required;    // brought up to date before 'run'
+    FeAnalysisSet invalidates; // what 'run' leaves out of date
+} FePass;
+
+extern const FePass fe_pass_local;
+extern const FePass fe_pass_tdce;
+extern const FePass fe_pass_compact_ids;
+extern const FePass fe_pass_sccp;
+extern const FePass fe_pass_cfg_simplify;
+extern const FePass fe_pass_tailcall;
+extern const FePass fe_pass_isel;
+extern const FePass fe_pass_relayout;
+extern const FePass fe_pass_vregs;
+extern const FePass fe_pass_regalloc;
+extern const FePass fe_pass_post_regalloc;
+
+// looks up one of the above by name, nullptr if there isn't one
+const FePass* fe_pass_by_name(const char* name);
+
+// one pass over one function
+typedef struct FePassStats {
+    const FePass* pass;
+    u32 index; // in the pipeline
+    FeSymbol* sym;
+    u32 insts_before;
+    u32 insts_after;
+    usize alloc_bytes;  // out of the function's instruction pool
+    f64 analysis_time;  // seconds spent on 'required'
+    f64 time;           // seconds spent in 'run'
+} FePassStats;
+
+typedef struct FePassManager {
+    const FePass** passes;
+    u32 len;
+    u32 cap;
+
+    FePassStats* stats;
+    u32 stats_len;
+    u32 stats_cap;
+} FePassManager;
+
+void fe_pm_init(FePassManager* pm);
+void fe_pm_destroy(FePassManager* pm);
+void fe_pm_add(FePassManager* pm, const FePass* pass);
+// everything fe_codegen does, in order
+void fe_pm_add_codegen(FePassManager* pm);
+void fe_pm_run(FePassManager* pm, FeFunc* f);
+void fe_pm_run_module(FePassManager* pm, FeModule* mod);
+// every run, then the totals for each pass in the pipeline
+void fe_pm_dump_json(FePassManager* pm, FeDataBuffer* db);
+
 #ifdef __cplusplus
 }
 #endif
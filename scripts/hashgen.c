@@ -9,55 +9,73 @@
 #include "common/str.c"
 #include "common/vec.c"
 
-usize hashfunc(const char* key, usize key_len, usize offset, usize mult, usize table_size) {
-    usize hash = offset;
-
-    for (usize i = 0; i < key_len; ++i) {
-        hash ^= key[i];
+// generates a perfect hash table for a list of keywords, as a header for
+// the lexers to include. the makefile runs this, like:
+//     hashgen keywords.txt name TOK_KW_ > name.h
+// a keyword's code is the prefix followed by the keyword in uppercase.
+
+#define HASH_OFFSET 2166136261u
+
+// multiplicative, so the top bits are the good ones
+static u32 hashfunc(string key, u32 mult, u32 bits) {
+    u32 hash = HASH_OFFSET;
+    for_n(i, 0, key.len) {
+        hash ^= (u8)key.raw[i];
         hash *= mult;
     }
-    return hash % table_size;
+    return hash >> (32 - bits);
 }
 
 #define func_text \
-    "usize hashfunc(const char* key, usize key_len) {\n" \
-    "    usize hash = %zu;\n" \
-    "\n" \
-    "    for (usize i = 0; i < key_len; ++i) {\n" \
-    "        hash ^= key[i];\n" \
-    "        hash *= %zu;\n" \
+    "static inline u32 %s_hash(const char* key, usize len) {\n" \
+    "    u32 hash = %uu;\n" \
+    "    for (usize i = 0; i < len; ++i) {\n" \
+    "        hash ^= (u8)key[i];\n" \
+    "        hash *= %uu;\n" \
     "    }\n" \
-    "    return hash %% %zu;\n" \
+    "    return hash >> (32 - %u);\n" \
     "}\n" \
+    "\n" \
+    "// the keyword's code, or 'otherwise' if it isn't one\n" \
+    "static inline u16 %s_lookup(const char* key, usize len, u16 otherwise) {\n" \
+    "    if (len > %zu) {\n" \
+    "        return otherwise;\n" \
+    "    }\n" \
+    "    u32 index = %s_hash(key, len);\n" \
+    "    if (%s_table[index].len != len || memcmp(%s_table[index].key, key, len) != 0) {\n" \
+    "        return otherwise;\n" \
+    "    }\n" \
+    "    return %s_table[index].code;\n" \
+    "}\n"
 
 Vec(string) keywords = {};
 
 int main(int argc, char** argv) {
-
-    keywords = vec_new(string, 256);
-    // intake keywords file
-
-    if (argc <= 1) {
-        printf("provide a file name.\n");
-        return 1;
-    }
-    
-    if (argc <= 2) {
-        printf("provide a max number for search parameters.\n");
+    if (argc <= 3) {
+        printf("usage: hashgen keywords.txt name CODE_PREFIX_\n");
         return 1;
     }
+    const char* name = argv[2];
+    const char* prefix = argv[3];
 
     FsFile* file = fs_open(argv[1], false, false);
+    if (file == nullptr) {
+        printf("cannot open file %s\n", argv[1]);
+        return 1;
+    }
     string text = fs_read_entire(file);
     text = string_concat(text, strlit("\n"));
+    fs_destroy(file);
 
+    // one keyword per line, blank lines are fine
+    keywords = vec_new(string, 256);
+    usize max_len = 0;
     usize i = 0;
     while (i < text.len) {
         if (isspace(text.raw[i])) {
             ++i;
             continue;
         }
-        // scan a keyword
         usize start = i;
         while (!isspace(text.raw[i])) {
             ++i;
@@ -67,55 +85,57 @@ int main(int argc, char** argv) {
             .len = i - start
         };
         vec_append(&keywords, kw);
+        max_len = max(max_len, kw.len);
     }
 
-    // for_n(i, 0, keywords.len) {
-    //     printf("["str_fmt"]\n", str_arg(keywords.at[i]));
-    // }
+    // a quarter full or less, so a multiplier that works turns up quickly
+    u32 bits = 2;
+    while (((usize)1 << bits) < keywords.len * 4) {
+        bits++;
+    }
 
-    const usize max_range = atoll(argv[2]);
+    for (;; bits++) {
+        usize table_size = (usize)1 << bits;
+        bool* occupied = malloc(sizeof(bool) * table_size);
 
-    // for_n(table_size, keywords.len, 100000000) {
-    
-    // work backwards
-    for (isize table_size = (isize)(keywords.len * 2.5); table_size != keywords.len; table_size--) {
-        next_table_size:
+        for (u32 mult = 3; mult < (1u << 24); mult += 2) {
+            memset(occupied, 0, sizeof(bool) * table_size);
+            for_n(i, 0, keywords.len) {
+                u32 index = hashfunc(keywords.at[i], mult, bits);
+                if (occupied[index]) {
+                    goto next_config;
+                }
+                occupied[index] = true;
+            }
 
-        bool* occupied = malloc(sizeof(bool) * table_size);
-        memset(occupied, 0, sizeof(bool) * table_size);
-
-        
-        // for_n(mult, 1, max_range) {
-        //     for_n(offset, 1, max_range) {
-
-        for_n(offset, 1, max_range) {
-            for_n(mult, 1, max_range) {
-                // try this table configuration.
-                for_n(i, 0, keywords.len) {
-                    string kw = keywords.at[i];
-                    usize index = hashfunc(kw.raw, kw.len, offset, mult, table_size);
-                    if (occupied[index]) {
-                        goto next_config;
-                    }
-                    occupied[index] = true;
+            // config works!!!
+            printf("// generated by scripts/hashgen.c from %s, don't edit\n\n", argv[1]);
+            printf("#include <string.h>\n\n");
+            printf("#define ");
+            for (const char* c = name; *c != '\0'; c++) {
+                putchar(toupper(*c));
+            }
+            printf("_LEN %zu\n\n", keywords.len);
+            printf("static const struct {\n");
+            printf("    char key[%zu];\n", max_len);
+            printf("    u8 len;\n");
+            printf("    u16 code;\n");
+            printf("} %s_table[%zu] = {\n", name, table_size);
+            for_n(i, 0, keywords.len) {
+                string kw = keywords.at[i];
+                printf("    [%u] = {\""str_fmt"\", %zu, %s", hashfunc(kw, mult, bits), str_arg(kw), (usize)kw.len, prefix);
+                for_n(j, 0, kw.len) {
+                    putchar(toupper(kw.raw[j]));
                 }
-                // config works!!!
-                // printf("for keywords:");
-                // for_n(i, 0, keywords.len) {
-                //     string kw = keywords.at[i];
-                //     printf("  "str_fmt" -> %llu\n", str_arg(kw), hashfunc(kw.raw, kw.len, offset, mult, table_size));
-                // }
-                printf("CONFIG FOUND FOR LENGTH %zi:\n" func_text"\n", table_size, offset, mult, table_size);
-                // return 0;
-                table_size--;
-                goto next_table_size;
-                    
-                next_config:
-                memset(occupied, 0, sizeof(bool) * table_size);
+                printf("},\n");
             }
+            printf("};\n\n");
+            printf(func_text, name, HASH_OFFSET, mult, bits, name, max_len, name, name, name, name);
+            return 0;
+
+            next_config:
+            continue;
         }
-        printf("tried table size %llu\n", table_size);
+        free(occupied);
     }
-
-    fs_close(file);
 }
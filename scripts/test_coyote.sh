@@ -0,0 +1,102 @@
+#!/bin/sh
+# runs the frontend regression tests in tests/coyote/<dir>/ and compares
+# what coyote prints against <case>.expected.
+#
+# every .jkl right in a test directory is a case, anything in its
+# subdirectories is only there to be included. each line of <dir>/args is
+# one coyote run on the case, their output goes one after the other. if
+# coyote fails, the exit code goes after the output and the rest of the
+# runs are skipped. colors get stripped, so errors can be tested too.
+#
+# a run whose args start with --client goes through coyote --client. if
+# the directory has a file called server, a compile server runs while its
+# cases do, otherwise the client has nobody to talk to and compiles on its
+# own. the socket is always one of ours, never a server the user has going.
+#
+# the directory gets copied somewhere else first, so nothing coyote
+# writes next to the inputs ends up in the tree.
+# UPDATE=1 rewrites the expected files instead of checking them.
+
+COYOTE=${1:-bin/coyote}
+COYOTE=$(cd "$(dirname "$COYOTE")" && pwd)/$(basename "$COYOTE")
+TESTS=$(cd "$(dirname "$0")/../tests/coyote" && pwd)
+TMP=$(mktemp -d)
+server=""
+trap '[ -n "$server" ] && kill "$server"; rm -rf "$TMP"' EXIT
+export COYOTE_SOCKET="$TMP/sock"
+ESC=$(printf '\033')
+
+failed=0
+total=0
+
+fail() {
+    echo "FAIL $1: $2"
+    failed=$((failed + 1))
+}
+
+# run_case <args file> <input>, from inside the copied directory
+run_case() {
+    printf '\n' | cat "$1" - 2>/dev/null | grep -v '^$' > "$TMP/runs"
+    [ -s "$TMP/runs" ] || echo " " > "$TMP/runs"
+    runs=$(wc -l < "$TMP/runs")
+
+    while read -r args; do
+        [ "$runs" -gt 1 ] && echo "run: $args"
+        case "$args" in
+        --client*) "$COYOTE" --client "$2" ${args#--client} > "$TMP/run" 2>&1 ;;
+        *) "$COYOTE" "$2" $args > "$TMP/run" 2>&1 ;;
+        esac
+        code=$?
+        sed "s/$ESC\[[0-9;]*m//g" "$TMP/run"
+        if [ "$code" -ne 0 ]; then
+            echo "exit $code"
+            break
+        fi
+    done < "$TMP/runs"
+}
+
+start_server() {
+    "$COYOTE" --server > "$TMP/server.log" 2>&1 &
+    server=$!
+    tries=0
+    while [ ! -S "$COYOTE_SOCKET" ] && kill -0 "$server" 2>/dev/null && [ "$tries" -lt 100 ]; do
+        sleep 0.1
+        tries=$((tries + 1))
+    done
+}
+
+# stop_server <dir name>
+stop_server() {
+    if ! kill "$server" 2>/dev/null; then
+        fail "$1" "the compile server went away"
+        cat "$TMP/server.log"
+    fi
+    wait "$server" 2>/dev/null
+    server=""
+    rm -f "$COYOTE_SOCKET"
+}
+
+for dir in "$TESTS"/*/; do
+    dir=${dir%/}
+    [ -e "$dir/server" ] && start_server
+    for case_path in "$dir"/*.jkl; do
+        [ -e "$case_path" ] || continue
+        name=${case_path#"$TESTS"/}
+        input=$(basename "$case_path")
+        total=$((total + 1))
+
+        rm -rf "$TMP/work"
+        cp -r "$dir" "$TMP/work"
+        (cd "$TMP/work" && run_case "$dir/args" "$input") > "$TMP/out"
+        if [ -n "$UPDATE" ]; then
+            cp "$TMP/out" "$case_path.expected"
+        elif ! diff -u "$case_path.expected" "$TMP/out" > "$TMP/diff" 2>&1; then
+            fail "$name" "output doesn't match $name.expected"
+            cat "$TMP/diff"
+        fi
+    done
+    [ -n "$server" ] && stop_server "${dir#"$TESTS"/}"
+done
+
+echo "$((total - failed))/$total passed"
+[ "$failed" -eq 0 ]
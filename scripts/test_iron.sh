@@ -0,0 +1,118 @@
+#!/bin/sh
+# runs the iron regression tests in tests/iron/<dir>/ and compares what
+# fe-opt prints against <case>.expected.
+#
+# a case is either one input (foo.fir, foo.bin) or a directory of them
+# (foo/*.fir, in order) that gets linked together. each line of <dir>/args
+# is one fe-opt run, the first gets the inputs and the rest get whatever
+# the one before printed. a case directory can have its own args instead.
+# with -u the units get printed one after the other. if fe-opt fails, the
+# exit code goes at the end of the output, so errors can be tested too.
+#
+# every input that fe-opt reads without complaint also has to survive
+# print -> parse -> print and text -> binary -> text unchanged.
+# UPDATE=1 rewrites the expected files instead of checking them.
+
+FE_OPT=${1:-bin/fe-opt}
+FE_OPT=$(cd "$(dirname "$FE_OPT")" && pwd)/$(basename "$FE_OPT")
+TESTS=$(cd "$(dirname "$0")/../tests/iron" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+failed=0
+total=0
+
+fail() {
+    echo "FAIL $1: $2"
+    failed=$((failed + 1))
+}
+
+# run_case <args file> <inputs...>, from inside the case's directory
+run_case() {
+    args_file=$1
+    shift
+    printf '\n' | cat "$args_file" - 2>/dev/null | grep -v '^$' > "$TMP/runs"
+    [ -s "$TMP/runs" ] || echo " " > "$TMP/runs"
+    runs=$(wc -l < "$TMP/runs")
+
+    run=0
+    while read -r args; do
+        run=$((run + 1))
+        unit_out=""
+        case " $args " in
+        *" -u "*) unit_out="-o $TMP/unit" ;;
+        esac
+        rm -f "$TMP"/unit.*
+        "$FE_OPT" $args $unit_out "$@" > "$TMP/run" 2>&1
+        code=$?
+        for unit in $(ls "$TMP"/unit.* 2>/dev/null | sort -t. -k2 -n); do
+            echo "unit ${unit##*.}:" >> "$TMP/run"
+            cat "$unit" >> "$TMP/run"
+        done
+        if [ "$code" -ne 0 ]; then
+            echo "exit $code" >> "$TMP/run"
+            break
+        fi
+        if [ "$run" -lt "$runs" ]; then
+            cp "$TMP/run" "$TMP/stage$run.fir"
+            set -- "$TMP/stage$run.fir"
+        fi
+    done < "$TMP/runs"
+    cat "$TMP/run"
+}
+
+# round_trip <input>
+round_trip() {
+    "$FE_OPT" "$1" > "$TMP/a.fir" 2>/dev/null || return 0
+    if ! "$FE_OPT" "$TMP/a.fir" > "$TMP/b.fir" 2>&1 || ! cmp -s "$TMP/a.fir" "$TMP/b.fir"; then
+        echo "print -> parse -> print changed $1"
+        return 1
+    fi
+    if ! "$FE_OPT" -b -o "$TMP/t.bin" "$1" > /dev/null 2>&1 \
+        || ! "$FE_OPT" "$TMP/t.bin" > "$TMP/c.fir" 2>&1 \
+        || ! cmp -s "$TMP/a.fir" "$TMP/c.fir"
+    then
+        echo "text -> binary -> text changed $1"
+        return 1
+    fi
+}
+
+for dir in "$TESTS"/*/; do
+    dir=${dir%/}
+    for case_path in "$dir"/*; do
+        name=${case_path#"$TESTS"/}
+        args_file="$dir/args"
+        if [ -d "$case_path" ]; then
+            [ -e "$case_path/args" ] && args_file="$case_path/args"
+            inputs=$(cd "$case_path" && ls *.fir *.bin 2>/dev/null)
+            work=$case_path
+        else
+            case "$case_path" in
+            *.fir|*.bin) ;;
+            *) continue ;;
+            esac
+            inputs=$(basename "$case_path")
+            work=$dir
+        fi
+        total=$((total + 1))
+
+        (cd "$work" && run_case "$args_file" $inputs) > "$TMP/out"
+        if [ -n "$UPDATE" ]; then
+            cp "$TMP/out" "$case_path.expected"
+        elif ! diff -u "$case_path.expected" "$TMP/out" > "$TMP/diff" 2>&1; then
+            fail "$name" "output doesn't match $name.expected"
+            cat "$TMP/diff"
+            continue
+        fi
+
+        for input in $inputs; do
+            if ! msg=$(cd "$work" && round_trip "$input"); then
+                fail "$name" "$msg"
+                break
+            fi
+        done
+    done
+done
+
+echo "$((total - failed))/$total passed"
+[ "$failed" -eq 0 ]
@@ -7,6 +7,7 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 
@@ -20,7 +21,7 @@ FsFile* fs_open(const char* path, bool create, bool overwrite) {
     FsFile* f = malloc(sizeof(FsFile));
     if (create) {
         if (overwrite) {
-            f->handle = open(path, O_WRONLY | O_CREAT);
+            f->handle = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
         } else {
             f->handle = open(path, O_WRONLY);
         }
@@ -46,11 +47,29 @@ usize fs_read(FsFile* f, void* buf, usize len) {
     return num_read;
 }
 
+usize fs_write(FsFile* f, const void* buf, usize len) {
+    isize num_written = write(f->handle, buf, len);
+    if (num_written == -1) return 0;
+    return num_written;
+}
+
 string fs_read_entire(FsFile* f) {
     string s = string_alloc(f->size);
     read(f->handle, s.raw, s.len);
     return s;
 }
+
+string fs_map_entire(FsFile* f) {
+    if (f->size == 0) return (string){0};
+    void* at = mmap(nullptr, f->size, PROT_READ, MAP_PRIVATE, f->handle, 0);
+    if (at == MAP_FAILED) return (string){0};
+    return (string){.raw = at, .len = f->size};
+}
+
+void fs_unmap(string mapped) {
+    if (mapped.raw == nullptr) return;
+    munmap(mapped.raw, mapped.len);
+}
 void fs_close(FsFile* f) {
     close(f->handle);
     f->handle = -1;
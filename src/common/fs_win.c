@@ -74,6 +74,28 @@ string fs_read_entire(FsFile* f) {
     return buf;
 }
 
+usize fs_write(FsFile* f, const void* buf, usize len) {
+    DWORD num_written = 0;
+    WriteFile((HANDLE)f->handle, buf, len, &num_written, nullptr);
+    return num_written;
+}
+
+string fs_map_entire(FsFile* f) {
+    if (f->size == 0) return (string){0};
+    HANDLE mapping = CreateFileMappingA((HANDLE)f->handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) return (string){0};
+    void* at = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    // the view keeps the mapping alive
+    CloseHandle(mapping);
+    if (at == nullptr) return (string){0};
+    return (string){.raw = at, .len = f->size};
+}
+
+void fs_unmap(string mapped) {
+    if (mapped.raw == nullptr) return;
+    UnmapViewOfFile(mapped.raw);
+}
+
 void fs_close(FsFile* f) {
     CloseHandle((HANDLE)f->handle);
     f->handle = (isize)INVALID_HANDLE_VALUE;
@@ -131,35 +131,13 @@ string tok_span(Token t) {
     };
 }
 
-// perfect hash function
-// WARNING: THIS HAS TO BE REMADE EVERY TIME A KEYWORD IS ADDED
-// USE SCRIPTS/HASHGEN FOR THIS
-usize hashfunc(const char* key, usize key_len) {
-    usize hash = 4311;
-
-    for (usize i = 0; i < key_len; ++i) {
-        hash ^= key[i];
-        hash *= 975;
-    }
-    return hash % 121;
-}
-
-
-static const char* keyword_table[121];
-static u8 keyword_len_table[121];
-static u8 keyword_code_table[121];
+// see scripts/jackal_keywords.txt, the makefile generates this
+#include "jackal_keywords.h"
+static_assert(JACKAL_KEYWORDS_LEN == TOK__KEYWORDS_END - TOK__KEYWORDS_BEGIN - 1,
+    "scripts/jackal_keywords.txt doesn't match the keyword tokens");
 
 static u8 lex_categorize_keyword(char* s, size_t len) {
-    u8 index = hashfunc(s, len);
-
-    if (keyword_len_table[index] != len) {
-        return TOK_IDENTIFIER;
-    }
-    if (strncmp(keyword_table[index], s, len) != 0) {
-        return TOK_IDENTIFIER;
-    }
-
-    return keyword_code_table[index];
+    return jackal_keywords_lookup(s, len, TOK_IDENTIFIER);
 }
 
 static bool is_alphabetic(char c) {
@@ -189,7 +167,7 @@ static bool is_whitespace(char c) {
 }
 
 static Lexer lexer_from_string(string src) {
-    Lexer l;
+    Lexer l = {0};
     l.cursor = 0;
     l.src = src;
     if (src.len == 0) {
@@ -339,7 +317,7 @@ static Token lex_next_raw(Lexer* l) {
         case '>':
             if (peek(l, 1) == '>') {
                 if (peek(l, 2) == '=')
-                    return construct_and_advance(l, TOK_RSHIFT_EQ, 2);
+                    return construct_and_advance(l, TOK_RSHIFT_EQ, 3);
                 else
                     return construct_and_advance(l, TOK_RSHIFT, 2);
             } 
@@ -422,6 +400,47 @@ static Token lex_with_preproc(Lexer* l, Vec(Token)* tokens, PreprocScope* scope)
 
 Vec(Token) macro_arg_pool;
 Vec(PreprocVal) preproc_val_pool;
+// pre-lexed complex strings (define/macro bodies and macro arguments)
+Vec(Token) preproc_token_pool;
+
+// lexer over a range of the token pool
+static Lexer replay_lexer(Arena* arena, u32 index, u32 len) {
+    Lexer l = {0};
+    l.arena = arena;
+    l.replay = true;
+    l.tok_cursor = index;
+    l.tok_end = index + len;
+    l.eof = len == 0;
+    // eof tokens point right after the last token
+    if (len != 0) {
+        Token last = preproc_token_pool.at[index + len - 1];
+        l.src.raw = tok_raw(last) + last.len;
+    }
+    return l;
+}
+
+static Token next_raw(Lexer* l) {
+    if (!l->replay) {
+        return lex_next_raw(l);
+    }
+    if (l->tok_cursor == l->tok_end) {
+        l->eof = true;
+        return eof_token(l);
+    }
+    return preproc_token_pool.at[l->tok_cursor++];
+}
+
+// where the lexer currently is in the source text
+static char* lexer_position(Lexer* l) {
+    if (l->replay) {
+        if (l->tok_cursor == 0) {
+            return l->src.raw;
+        }
+        Token last = preproc_token_pool.at[l->tok_cursor - 1];
+        return tok_raw(last) + last.len;
+    }
+    return &l->src.raw[l->cursor];
+}
 
 static bool replacement_exists_immediate(string key, PreprocScope* scope) {
     if (scope == nullptr) return false;
@@ -458,27 +477,43 @@ static void put_replacement_value(string key, PreprocScope* scope, PreprocVal va
     strmap_put(&scope->map, key, (void*)(preproc_val_pool.len - 1));
 }
 
-static CompactString preproc_collect_complex_string(Lexer* l) {
-    string span;
-    span.raw = &l->src.raw[l->cursor];
-    span.len = l->cursor;
+static void preproc_collect_complex_string(Lexer* l, PreprocVal* v) {
+    u32 index = preproc_token_pool.len;
 
     usize bracket_depth = 1;
-    while (bracket_depth != 0) {    
-        Token t = lex_next_raw(l);
+    for (Token t = next_raw(l);; t = next_raw(l)) {
         switch (t.kind) {
         case TOK_OPEN_BRACKET:  ++bracket_depth; break;
         case TOK_CLOSE_BRACKET: --bracket_depth; break;
+        case TOK_EOF:           TODO("error: unterminated [");
         default:
             break;
         }
+        if (bracket_depth == 0) {
+            break;
+        }
+        vec_append(&preproc_token_pool, t);
     }
 
-    span.len = l->cursor - span.len - 1;
-    if (span.len > COMPACT_STR_MAX_LEN) {
-        TODO("error: string too long");
+    v->tokens.index = index;
+    v->tokens.len = preproc_token_pool.len - index;
+}
+
+// complex strings only keep their tokens, but those still
+// point at one contiguous piece of source text
+static string preproc_val_text(PreprocVal v) {
+    if (v.kind != PPVAL_COMPLEX_STRING) {
+        return from_compact(v.string);
     }
-    return to_compact(span);
+    if (v.tokens.len == 0) {
+        return (string){.raw = nullptr, .len = 0};
+    }
+    Token first = preproc_token_pool.at[v.tokens.index];
+    Token last = preproc_token_pool.at[v.tokens.index + v.tokens.len - 1];
+    return (string){
+        .raw = tok_raw(first),
+        .len = (usize)(tok_raw(last) + last.len) - (usize)tok_raw(first),
+    };
 }
 
 static i64 eval_integer(Token t) {
@@ -500,14 +535,14 @@ static i64 eval_integer(Token t) {
 
 static PreprocVal preproc_collect_value(Lexer* l, PreprocScope* scope) {
     PreprocVal v = {0};
-    Token t = lex_next_raw(l);
+    Token t = next_raw(l);
     v.raw = t.raw;
     v.len = t.len;
 
     switch (t.kind) {
     case TOK_OPEN_BRACKET:
         v.kind = PPVAL_COMPLEX_STRING;
-        v.string = preproc_collect_complex_string(l);
+        preproc_collect_complex_string(l, &v);
         break;
     case TOK_IDENTIFIER:
         ;
@@ -524,11 +559,11 @@ static PreprocVal preproc_collect_value(Lexer* l, PreprocScope* scope) {
         break;
     case TOK_OPEN_PAREN:
         ;
-        Token op = lex_next_raw(l);
+        Token op = next_raw(l);
 
         if (op.kind == TOK_IDENTIFIER) {
             if (string_eq(tok_span(op), strlit("DEFINED"))) {
-                Token ident = lex_next_raw(l);
+                Token ident = next_raw(l);
                 if (ident.kind != TOK_IDENTIFIER) {
                     TODO("error: expected identifier");
                 }
@@ -541,15 +576,18 @@ static PreprocVal preproc_collect_value(Lexer* l, PreprocScope* scope) {
                     TODO("error: expected string");
                 }
 
+                string lhs_text = preproc_val_text(lhs);
+                string rhs_text = preproc_val_text(rhs);
+
                 string newstr;
-                newstr.len = lhs.string.len + rhs.string.len;
+                newstr.len = lhs_text.len + rhs_text.len;
                 newstr.raw = arena_alloc(l->arena, newstr.len, 1);
                 if (newstr.len > COMPACT_STR_MAX_LEN) {
                     TODO("error: string too long");
                 }
 
-                memcpy(newstr.raw, (void*)(i64)lhs.string.raw, lhs.string.len);
-                memcpy(newstr.raw + lhs.string.len, (void*)(i64)rhs.string.raw, rhs.string.len);
+                memcpy(newstr.raw, lhs_text.raw, lhs_text.len);
+                memcpy(newstr.raw + lhs_text.len, rhs_text.raw, rhs_text.len);
 
                 v.kind = PPVAL_STRING;
                 v.string = to_compact(newstr);
@@ -561,7 +599,7 @@ static PreprocVal preproc_collect_value(Lexer* l, PreprocScope* scope) {
                     TODO("error: expected string");
                 }
                 v.kind = PPVAL_INTEGER;
-                v.integer = string_cmp(from_compact(lhs.string), from_compact(rhs.string));
+                v.integer = string_cmp(preproc_val_text(lhs), preproc_val_text(rhs));
             } else {
                 TODO("error: invalid operator");
             }
@@ -614,7 +652,7 @@ static PreprocVal preproc_collect_value(Lexer* l, PreprocScope* scope) {
             TODO("error: invalid operator");
         }
 
-        if (lex_next_raw(l).kind != TOK_CLOSE_PAREN) {
+        if (next_raw(l).kind != TOK_CLOSE_PAREN) {
             TODO("error: expected )");
         }
         break;
@@ -632,7 +670,7 @@ static PreprocVal preproc_collect_value(Lexer* l, PreprocScope* scope) {
 
 static void preproc_define(Lexer* l, PreprocScope* scope) {
     // consume name
-    Token name = lex_next_raw(l);
+    Token name = next_raw(l);
     if (name.kind != TOK_IDENTIFIER) {
         TODO("error: expected identifier");
     }
@@ -653,7 +691,7 @@ static void preproc_define(Lexer* l, PreprocScope* scope) {
 
 static void preproc_undefine(Lexer* l, PreprocScope* scope) {
     // consume name
-    Token name = lex_next_raw(l);
+    Token name = next_raw(l);
     if (name.kind != TOK_IDENTIFIER) {
         TODO("error: expected identifier");
     }
@@ -663,7 +701,7 @@ static void preproc_undefine(Lexer* l, PreprocScope* scope) {
 
 static void preproc_macro(Lexer* l, PreprocScope* scope) {
     // consume name
-    Token name = lex_next_raw(l);
+    Token name = next_raw(l);
     if (name.kind != TOK_IDENTIFIER) {
         TODO("error: expected identifier");
     }
@@ -672,14 +710,14 @@ static void preproc_macro(Lexer* l, PreprocScope* scope) {
         TODO("error: redefinition in current scope");
     }
 
-    if (lex_next_raw(l).kind != TOK_OPEN_PAREN) {
+    if (next_raw(l).kind != TOK_OPEN_PAREN) {
         TODO("error: expected (");
     }
 
     // consume param list
     usize params_len = 0;
     usize macro_params_index = macro_arg_pool.len;
-    for (Token t = lex_next_raw(l); t.kind != TOK_CLOSE_PAREN; t = lex_next_raw(l)) {
+    for (Token t = next_raw(l); t.kind != TOK_CLOSE_PAREN; t = next_raw(l)) {
         if (t.kind != TOK_IDENTIFIER) {
             TODO("error: expected identifier");
         }
@@ -687,7 +725,7 @@ static void preproc_macro(Lexer* l, PreprocScope* scope) {
         ++params_len;
         vec_append(&macro_arg_pool, t);
 
-        t = lex_next_raw(l);
+        t = next_raw(l);
         if (t.kind != TOK_COMMA) {
             if (t.kind == TOK_CLOSE_PAREN) {
                 break;
@@ -738,7 +776,7 @@ static void preproc_if(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
         }
         u32 depth = 1;
         while (last.kind != TOK_KW_END || depth != 0) {
-            last = lex_next_raw(l);
+            last = next_raw(l);
             if (last.kind == TOK_EOF) {
                 TODO("unexpected EOF");
                 return;
@@ -746,7 +784,7 @@ static void preproc_if(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
             if (last.kind != TOK_HASH) {
                 continue;
             }
-            last = lex_next_raw(l);
+            last = next_raw(l);
             switch (last.kind) {
             case TOK_KW_IF:
                 depth++;
@@ -765,14 +803,14 @@ static void preproc_if(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
         u32 depth = 1;
         Token t;
         while (depth != 0) {
-            t = lex_next_raw(l);
+            t = next_raw(l);
             if (t.kind == TOK_EOF) {
                 break;
             } else if (t.kind != TOK_HASH) {
                 continue;
             }
 
-            t = lex_next_raw(l);
+            t = next_raw(l);
             switch (t.kind) {
             case TOK_KW_IF:
                 depth++;
@@ -814,15 +852,24 @@ static void preproc_if(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
 static void preproc_include(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
     // next thing should be a string literal.
 
-    Token path = lex_next_raw(l);
+    Token path = next_raw(l);
     
 }
 
-static Token preproc_dispatch(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
+enum {
+    PP_NONE,
+    PP_INCLUDE,
+    PP_DEFINE,
+    PP_UNDEFINE,
+    PP_MACRO,
+};
 
-    // todo: add preproc keywords to the hash table
+// see scripts/preproc_directives.txt
+#include "preproc_directives.h"
 
-    Token t = lex_next_raw(l);
+static Token preproc_dispatch(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
+
+    Token t = next_raw(l);
     switch (t.kind) {
     case TOK_KW_IF:
         preproc_if(l, tokens, scope);
@@ -836,16 +883,22 @@ static Token preproc_dispatch(Lexer* l, Vec(Token)* tokens, PreprocScope* scope)
     }
     
     string span = tok_span(t);
-    if (string_eq(span, strlit("INCLUDE"))) {
+    switch (preproc_directives_lookup(span.raw, span.len, PP_NONE)) {
+    case PP_INCLUDE:
         preproc_include(l, tokens, scope);
-    } else if (string_eq(span, strlit("DEFINE"))) {
+        break;
+    case PP_DEFINE:
         preproc_define(l, scope);
-    } else if (string_eq(span, strlit("UNDEFINE"))) {
+        break;
+    case PP_UNDEFINE:
         preproc_undefine(l, scope);
-    } else if (string_eq(span, strlit("MACRO"))) {
+        break;
+    case PP_MACRO:
         preproc_macro(l, scope);
-    } else {
+        break;
+    default:
         // TODO("error: unrecognized directive");
+        break;
     }
     return (Token){}; // its fine lol
 }
@@ -856,7 +909,7 @@ usize emit_depth = 0;
 static PreprocScope global_scope;
 static PreprocScope local_scopes[MAX_EMIT_DEPTH];
 
-static void emit_preproc_val(PreprocVal val, Vec(Token)* tokens, PreprocScope* scope) {
+static void emit_preproc_val(Lexer* l, PreprocVal val, Vec(Token)* tokens, PreprocScope* scope) {
     ++emit_depth;
     if (emit_depth > MAX_EMIT_DEPTH) {
         TODO("error: max define/macro depth reached");
@@ -876,7 +929,7 @@ static void emit_preproc_val(PreprocVal val, Vec(Token)* tokens, PreprocScope* s
         break;
     case PPVAL_COMPLEX_STRING:
         ;
-        Lexer local_lexer = lexer_from_string(from_compact(val.string));
+        Lexer local_lexer = replay_lexer(l->arena, val.tokens.index, val.tokens.len);
         // PreprocScope _local_scope_ = {};
         // PreprocScope* local_scope = &_local_scope_;
         PreprocScope* local_scope = &local_scopes[emit_depth - 1];
@@ -907,39 +960,34 @@ static void emit_preproc_val(PreprocVal val, Vec(Token)* tokens, PreprocScope* s
     --emit_depth;
 }
 
-static CompactString collect_macro_arg(Lexer* l, PreprocScope* scope) {
-    string span;
-    span.raw = &l->src.raw[l->cursor];
-    span.len = l->cursor;
-    usize cap = 0;
+// returns the token that ended the argument, either , or )
+static Token collect_macro_arg(Lexer* l, PreprocVal* arg) {
+    // an argument to a macro used inside another body is
+    // already in the pool, just point at it
+    u32 index = l->replay ? l->tok_cursor : preproc_token_pool.len;
 
     usize bracket_depth = 0;
-    for (Token t = lex_next_raw(l);; t = lex_next_raw(l)) {
-        
+    Token t = next_raw(l);
+    for (;; t = next_raw(l)) {
         if (bracket_depth == 0 && (t.kind == TOK_COMMA || t.kind == TOK_CLOSE_PAREN)) {
             break;
         }
 
-
         switch (t.kind) {
-        // case TOK_IDENTIFIER:
-            // if (!replacement_exists(tok_span(t), scope)) {
-            //     break;
-            // }
-            // // we have to expand this. break out the backing buffer if necessary
-            // if (cap == 0) {
-
-            // }
         case TOK_OPEN_PAREN: ++bracket_depth; break;
         case TOK_CLOSE_PAREN: --bracket_depth; break;
+        case TOK_EOF: TODO("error: unterminated macro arguments");
         }
-    }
 
-    span.len = l->cursor - span.len - 1;
-    if (span.len > COMPACT_STR_MAX_LEN) {
-        TODO("error: argument too long");
+        if (!l->replay) {
+            vec_append(&preproc_token_pool, t);
+        }
     }
-    return to_compact(span);
+
+    u32 end = l->replay ? l->tok_cursor - 1 : preproc_token_pool.len;
+    arg->tokens.index = index;
+    arg->tokens.len = end - index;
+    return t;
 }
 
 static void collect_macro_args_and_emit(Lexer* l, PreprocVal macro, Vec(Token)* tokens, PreprocScope* scope) {
@@ -961,28 +1009,29 @@ static void collect_macro_args_and_emit(Lexer* l, PreprocVal macro, Vec(Token)*
 
     // collect args as complex strings, define them in the new scope
 
-    Token t = lex_next_raw(l);
+    Token t = next_raw(l);
     if (t.kind != TOK_OPEN_PAREN) {
         TODO("error: expected (");
     }
 
     usize saved_ppv_len = preproc_val_pool.len;
+    usize saved_tok_len = preproc_token_pool.len;
 
     if (macro.macro.params_len == 0) {
-        Token t = lex_next_raw(l);
+        Token t = next_raw(l);
         if (t.kind != TOK_CLOSE_PAREN) {
             TODO("error: too many parameters");
         }
     } else {
         // consume arg list
         usize arg_len = 0;
-        while (l->src.raw[l->cursor - 1] != ')') {
-            CompactString arg_span = collect_macro_arg(l, scope);
+        Token end = {.kind = TOK_COMMA};
+        while (end.kind != TOK_CLOSE_PAREN) {
             PreprocVal arg = {
                 .kind = PPVAL_COMPLEX_STRING,
                 .is_macro_arg = true,
-                .string = arg_span,
             };
+            end = collect_macro_arg(l, &arg);
 
             if (arg_len >= macro.macro.params_len) {
                 TODO("error: too many parameters, expected %u", macro.macro.params_len);
@@ -994,11 +1043,12 @@ static void collect_macro_args_and_emit(Lexer* l, PreprocVal macro, Vec(Token)*
     }
 
     PreprocVal body = preproc_val_pool.at[macro.macro.body_index];
-    Lexer local_lexer = lexer_from_string(from_compact(body.string));
+    Lexer local_lexer = replay_lexer(l->arena, body.tokens.index, body.tokens.len);
     lex_with_preproc(&local_lexer, tokens, local_scope);
 
     strmap_destroy(&local_scope->map);
     preproc_val_pool.len = saved_ppv_len; // allow reuse of pool space
+    preproc_token_pool.len = saved_tok_len;
     --emit_depth;
 }
 
@@ -1023,8 +1073,8 @@ static Token preproc_token_no_span(u8 kind) {
 
 // returns the last token it sees.
 static Token lex_with_preproc(Lexer* l, Vec(Token)* tokens, PreprocScope* scope) {
-    Token t = lex_next_raw(l);
-    for (; t.kind != TOK_EOF; t = lex_next_raw(l)) {
+    Token t = next_raw(l);
+    for (; t.kind != TOK_EOF; t = next_raw(l)) {
         switch (t.kind) {
         case TOK_IDENTIFIER:
             ;
@@ -1037,13 +1087,13 @@ static Token lex_with_preproc(Lexer* l, Vec(Token)* tokens, PreprocScope* scope)
                     // from_span.raw = (char*)(i64)val.raw;
                     vec_append(tokens, preproc_token(TOK_PREPROC_MACRO_PASTE, from_compact(val.source)));
                     collect_macro_args_and_emit(l, val, tokens, scope);
-                    span.len = (usize)l->cursor - (usize)span.raw + (usize)l->src.raw;
+                    span.len = (usize)lexer_position(l) - (usize)span.raw;
                     vec_append(tokens, preproc_token(TOK_PREPROC_PASTE_END, span));
                 } else {
                     if (!val.is_macro_arg) {
                         vec_append(tokens, preproc_token(TOK_PREPROC_DEFINE_PASTE, from_compact(val.source)));
                     }
-                    emit_preproc_val(val, tokens, scope);
+                    emit_preproc_val(l, val, tokens, scope);
                     if (!val.is_macro_arg) {
                         vec_append(tokens, preproc_token(TOK_PREPROC_PASTE_END, span));
                     }
@@ -1072,24 +1122,13 @@ static Token lex_with_preproc(Lexer* l, Vec(Token)* tokens, PreprocScope* scope)
 }
 
 Parser lex_entrypoint(SrcFile* f) {
-    // init keyword perfect hash table
-    for (usize i = TOK__KEYWORDS_BEGIN + 1; i < TOK__KEYWORDS_END; ++i) {
-        const char* keyword = token_kind[i];
-        u8 hash = hashfunc(keyword, strlen(keyword));
-        if (keyword_table[hash]) {
-            TODO("keyword table hash collision");
-        }
-        keyword_table[hash] = keyword;
-        keyword_len_table[hash] = strlen(keyword);
-        keyword_code_table[hash] = i;
-    }
-
     Arena arena;
     arena_init(&arena);
 
     // init macro info arena
     macro_arg_pool = vec_new(Token, 128);
     preproc_val_pool = vec_new(PreprocVal, 128);
+    preproc_token_pool = vec_new(Token, 512);
     
     Vec(Token) tokens = vec_new(Token, 512);
     Lexer l = lexer_from_string(f->src);
@@ -1103,6 +1142,7 @@ Parser lex_entrypoint(SrcFile* f) {
     strmap_destroy(&global_scope.map);
     vec_destroy(&preproc_val_pool);
     vec_destroy(&macro_arg_pool);
+    vec_destroy(&preproc_token_pool);
 
     vec_shrink(&tokens);
 
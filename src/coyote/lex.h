@@ -74,6 +74,11 @@
 typedef struct {
     string src;
     string path;
+
+    // offset of the first character of each line,
+    // built the first time a diagnostic needs it
+    u32* line_starts;
+    u32 lines_len;
 } SrcFile;
 
 typedef struct {
@@ -82,6 +87,13 @@ typedef struct {
     char current;
     bool eof;
     Arena* arena;
+
+    // replaying an already-lexed macro/define body or macro argument.
+    // tokens come from [tok_cursor, tok_end) of the preprocessor's
+    // token pool instead of from src.
+    bool replay;
+    u32 tok_cursor;
+    u32 tok_end;
 } Lexer;
 
 #define LEX_MAX_TOKEN_LEN 127
@@ -213,8 +225,21 @@ typedef struct FlagSet {
     bool xrsdk: 1;
     bool error_on_warn: 1;
     bool preproc: 1;
+    bool dump: 1;
+    u16 jobs; // threads to parse function bodies on
 } FlagSet;
 
+// a paste token (or the end of one) and the innermost
+// paste it sits inside of, so token_error can find the
+// macros around a token without rescanning everything
+typedef struct {
+    u32 index;  // into Parser.tokens
+    u32 parent; // into Parser.pastes, or PASTE_NONE
+    u32 depth;  // nesting depth right after this token
+} PasteMark;
+
+#define PASTE_NONE UINT32_MAX
+
 typedef struct {
     Token current;
     Token* tokens;
@@ -226,6 +251,10 @@ typedef struct {
 
     VecPtr(SrcFile) sources;
 
+    // built the first time token_error gets called
+    PasteMark* pastes;
+    u32 pastes_len;
+
     Entity* current_function;
 
     struct Stmt* recent_while;
@@ -234,6 +263,9 @@ typedef struct {
     Arena entities;
 
     FlagSet flags;
+
+    // precompiled header image to start from, see parse.c
+    string pch;
 } Parser;
 
 Vec_typedef(Token);
@@ -284,6 +316,11 @@ typedef struct {
     union {
         CompactString string;
         i64 integer;
+        // PPVAL_COMPLEX_STRING, lexed once when it's defined
+        struct {
+            u32 index;
+            u32 len;
+        } tokens;
         struct {
             u64 params_index: 24;
             u64 params_len : 8;
@@ -302,8 +339,7 @@ typedef enum : u8 {
 
 typedef struct {
     ReportKind kind;
-    string src; 
-    string path; 
+    SrcFile* file;
     string snippet; 
     string msg;
 
@@ -5,14 +5,22 @@
 #include "common/util.h"
 #include "lex.h"
 #include "parse.h"
+#include "server.h"
 
 #include "iron/iron.h"
 
 thread_local const char* filepath = nullptr;
 thread_local FlagSet flags = {};
+thread_local const char* pch_path = nullptr;
 
 static void print_help() {
     puts("coyote path/file.jkl [options]");
+    puts("coyote --server      Run a compile server, so headers stay parsed");
+    puts("                     between compiles. It listens on $COYOTE_SOCKET,");
+    puts("                     or a per-user socket in the temp directory.");
+    puts("coyote --client path/file.jkl [options]");
+    puts("                     Compile on the server, or right here if there");
+    puts("                     isn't one running.");
     puts(" --help              Display this info.");
     puts(" --version           Display version and copyright information.");
     puts(" --xrsdk             Warn on code that would not compile with the");
@@ -21,6 +29,12 @@ static void print_help() {
     puts(" --preproc,          Only perform the preprocessor. This strips");
     puts("                     all hygenic macro scope information and may");
     puts("                     not produce re-compilable code.");
+    puts(" --dump              Print the declarations and function bodies");
+    puts("                     that got parsed.");
+    puts(" --jobs=N            Parse function bodies on N threads.");
+    puts(" --pch=path/hdr.jkl  Parse a header's declarations ahead of the");
+    puts("                     file, reusing path/hdr.jkl.pch if it's");
+    puts("                     still up to date.");
     puts(" --incdir=/path/     Add a directory to search for INCLUDE");
     puts("                     directives with '<inc>/'");
     puts(" --libdir=/path/     Add a directory to search for INCLUDE");
@@ -40,36 +54,225 @@ static void print_version() {
     printf("Coyote v%d.%d using Iron v%d.%d\n", COYOTE_MAJOR, COYOTE_MINOR, FE_VERSION_MAJOR, FE_VERSION_MINOR);
 }
 
-static void parse_args(int argc, char** argv) {
+typedef enum {
+    ARGS_OK,
+    ARGS_HELP,
+    ARGS_VERSION,
+    ARGS_UNKNOWN,
+} ArgsResult;
+
+// the server reads a request's args too, so this doesn't exit on its own
+static ArgsResult parse_args(int argc, char** argv, char** stopped_at) {
+    filepath = nullptr;
+    flags = (FlagSet){};
+    pch_path = nullptr;
+
     if (argc == 1) {
-        print_help();
-        exit(0);
+        return ARGS_HELP;
     }
     filepath = argv[1];
     for_n(i, 2, argc) {
         char* arg = argv[i];
+        *stopped_at = arg;
         if (strcmp(arg, "--help") == 0) {
-            print_help();
-            exit(0);
+            return ARGS_HELP;
         } else if (strcmp(arg, "--version") == 0) {
-            print_version();
-            exit(0);
+            return ARGS_VERSION;
         } else if (strcmp(arg, "--xrsdk") == 0) {
             flags.xrsdk = true;
         } else if (strcmp(arg, "--preproc") == 0) {
             flags.preproc = true;
+        } else if (strcmp(arg, "--dump") == 0) {
+            flags.dump = true;
         } else if (strcmp(arg, "--error-on-warn") == 0) {
             flags.error_on_warn = true;
+        } else if (strncmp(arg, "--jobs=", 7) == 0) {
+            flags.jobs = strtoul(arg + 7, nullptr, 10);
+        } else if (strncmp(arg, "--pch=", 6) == 0) {
+            pch_path = arg + 6;
         } else {
-            printf("unknown flag '%s'\n", arg);
-            exit(1);
+            return ARGS_UNKNOWN;
         }
     }
+    return ARGS_OK;
 }
 
-int main(int argc, char** argv) {
+// headers and the files their images were built from, seen so far, and
+// the last image each header had. only the server ever sees more than a
+// few, and every compile it forks off inherits them. entries don't move,
+// an image's deps get cached while the header's entry is still in use.
+typedef struct {
+    FsPath path;
+    usize id;
+    usize size;
+    usize last_modified;
+    string src;
+    u64 hash; // pch_hash of src
+    string image;
+} CachedHeader;
+
+VecPtr_typedef(CachedHeader);
+static VecPtr(CachedHeader) header_cache;
+
+// the file's source, reread only if the file changed since the last time.
+// the image stays, it's only replaced once there's a valid one to replace
+// it with, see find_pch
+static CachedHeader* cache_header(const char* path) {
+    FsFile* file = fs_open(path, false, false);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    if (header_cache.at == nullptr) {
+        header_cache = vecptr_new(CachedHeader, 4);
+    }
+
+    CachedHeader* c = nullptr;
+    for_vec(CachedHeader** entry, &header_cache) {
+        if ((*entry)->path.len == file->path.len && strncmp((*entry)->path.raw, file->path.raw, file->path.len) == 0) {
+            c = *entry;
+            break;
+        }
+    }
+    if (c == nullptr) {
+        c = malloc(sizeof(CachedHeader));
+        *c = (CachedHeader){.path = file->path};
+        vec_append(&header_cache, c);
+    } else if (c->id != file->id || c->size != file->size || c->last_modified != file->last_modified) {
+        string_free(c->src);
+        c->src = (string){};
+    }
+
+    if (c->src.raw == nullptr) {
+        c->src = fs_read_entire(file);
+        c->hash = pch_hash(c->src);
+        c->id = file->id;
+        c->size = file->size;
+        c->last_modified = file->last_modified;
+    }
+    fs_destroy(file);
+    return c;
+}
+
+// whether a file an image was built from still reads the same
+static bool dep_current(string path, u64 hash) {
+    char cpath[PATH_MAX];
+    if (path.len >= sizeof(cpath)) {
+        return false;
+    }
+    memcpy(cpath, path.raw, path.len);
+    cpath[path.len] = '\0';
+    CachedHeader* c = cache_header(cpath);
+    return c != nullptr && c->hash == hash;
+}
+
+// the header's image for the current flags, if there's an up to date one
+// in memory or on disk. doesn't try to make one, the server calls this.
+static string find_pch(CachedHeader* c, const char* image_path, u64 key) {
+    if (pch_valid(c->image, key, dep_current)) {
+        return c->image;
+    }
+
+    FsFile* image_file = fs_open(image_path, false, false);
+    if (image_file == nullptr) {
+        return (string){};
+    }
+    string image = fs_map_entire(image_file);
+    fs_destroy(image_file);
+    if (!pch_valid(image, key, dep_current)) {
+        fs_unmap(image);
+        return (string){};
+    }
+    // forks of the server that were using the old one have their own copy
+    if (c->image.raw != nullptr) {
+        pch_prepare((string){});
+    }
+    fs_unmap(c->image);
+    c->image = image;
+    return image;
+}
+
+// find the header's image and import it here, once, so every
+// compile forked off after this starts out with it
+static void prepare_request(int argc, char** argv) {
+    char* stopped_at;
+    if (parse_args(argc, argv, &stopped_at) != ARGS_OK || pch_path == nullptr) {
+        return;
+    }
+    CachedHeader* c = cache_header(pch_path);
+    if (c == nullptr) {
+        return;
+    }
+    char image_path[PATH_MAX];
+    snprintf(image_path, sizeof(image_path), "%s.pch", pch_path);
+    string image = find_pch(c, image_path, pch_key(c->src, flags));
+    if (image.raw != nullptr) {
+        pch_prepare(image);
+    }
+}
+
+// map in the header's image, or parse the header and save a new one
+// if there isn't one for this exact header and set of flags
+static string load_pch(const char* path) {
+    CachedHeader* c = cache_header(path);
+    if (c == nullptr) {
+        printf("cannot open file %s\n", path);
+        exit(1);
+    }
+    u64 key = pch_key(c->src, flags);
 
-    parse_args(argc, argv);
+    char image_path[PATH_MAX];
+    snprintf(image_path, sizeof(image_path), "%s.pch", path);
+
+    string image = find_pch(c, image_path, key);
+    if (image.raw != nullptr) {
+        return image;
+    }
+
+    SrcFile* f = malloc(sizeof(SrcFile));
+    *f = (SrcFile){
+        .src = c->src,
+        .path = fs_from_path(&c->path),
+    };
+    Parser p = lex_entrypoint(f);
+    p.flags = flags;
+    parse_unit(&p);
+    image = pch_build(&p, key);
+
+    // not being able to save it is fine, it just gets parsed again next time.
+    // it goes in under another name first, other compiles might have it mapped.
+    char temp_path[PATH_MAX + 4];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", image_path);
+    FsFile* out = fs_open(temp_path, true, true);
+    if (out != nullptr) {
+        bool written = fs_write(out, image.raw, image.len) == image.len;
+        fs_destroy(out);
+        // windows won't rename over an existing file
+        if (written && rename(temp_path, image_path) != 0) {
+            remove(image_path);
+            written = rename(temp_path, image_path) == 0;
+        }
+        if (!written) {
+            remove(temp_path);
+        }
+    }
+    return image;
+}
+
+static int compile(int argc, char** argv) {
+    char* stopped_at;
+    switch (parse_args(argc, argv, &stopped_at)) {
+    case ARGS_OK:
+        break;
+    case ARGS_HELP:
+        print_help();
+        return 0;
+    case ARGS_VERSION:
+        print_version();
+        return 0;
+    case ARGS_UNKNOWN:
+        printf("unknown flag '%s'\n", stopped_at);
+        return 1;
+    }
 
     FsFile* file = fs_open(filepath, false, false);
     if (file == nullptr) {
@@ -82,8 +285,14 @@ int main(int argc, char** argv) {
         .path = fs_from_path(&file->path),
     };
 
+    string pch = {};
+    if (pch_path != nullptr) {
+        pch = load_pch(pch_path);
+    }
+
     Parser p = lex_entrypoint(&f);
     p.flags = flags;
+    p.pch = pch;
     
     // p.flags.xrsdk = true;
     // p.flags.error_on_warn = true;
@@ -113,4 +322,27 @@ int main(int argc, char** argv) {
     }
 
     CompilationUnit cu = parse_unit(&p);
+    if (flags.dump) {
+        dump_unit(&cu);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        return server_run(server_socket_path(), (ServerHooks){
+            .prepare = prepare_request,
+            .compile = compile,
+        });
+    }
+    if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+        int code = client_run(server_socket_path(), argc - 2, argv + 2);
+        if (code != -1) {
+            return code;
+        }
+        // nobody's serving, do it here
+        argv[1] = argv[0];
+        return compile(argc - 1, argv + 1);
+    }
+    return compile(argc, argv);
 }
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <threads.h>
 
 #include "parse.h"
 #include "common/str.h"
@@ -26,24 +27,62 @@ static void vec_char_append_many(Vec(char)* vec, const char* data, usize len) {
     }
 }
 
-thread_local static struct {
+// the type buffer is shared by every thread working on a unit
+// (see parse_deferred_bodies). TyIndex is 16 bits, so the whole
+// index space gets allocated up front and nothing ever moves.
+// anything that creates a type or fills a cache takes ty_lock.
+static struct {
     TyBufSlot* at;
     TyIndex* ptrs;
+    TyIndex* canon; // see ty_canon
     u32 len;
     u32 cap;
-} tybuf = {nullptr, nullptr, 0, 0};
+    u32 last; // most recent allocation, see ty_intern
+} tybuf = {nullptr, nullptr, nullptr, 0, 0, 0};
 
 #define TY(index, T) ((T*)&tybuf.at[index])
 #define TY_KIND(index) ((TyBase*)&tybuf.at[index])->kind
 
+#define TYBUF_CAP (UINT16_MAX + 1)
+#define TYBUF_BUILTIN_END (TY_UQUAD + TY_PTR + 1)
+
+static mtx_t ty_lock;     // recursive
+static mtx_t report_lock; // keeps diagnostics from interleaving
+static once_flag locks_once = ONCE_FLAG_INIT;
+static bool ty_threaded;  // only bother locking while workers are running
+
+static void init_locks() {
+    mtx_init(&ty_lock, mtx_plain | mtx_recursive);
+    mtx_init(&report_lock, mtx_plain);
+}
+
+static inline void ty_lock_acquire() {
+    if (ty_threaded) {
+        mtx_lock(&ty_lock);
+    }
+}
+
+static inline void ty_lock_release() {
+    if (ty_threaded) {
+        mtx_unlock(&ty_lock);
+    }
+}
+
+static void ty_intern_reset();
+
 void ty_init() {
+    call_once(&locks_once, init_locks);
+
     tybuf.len = 0;
     if (tybuf.at == nullptr) {
-        tybuf.cap = 1024;
+        tybuf.cap = TYBUF_CAP;
         tybuf.at = malloc(sizeof(tybuf.at[0]) * tybuf.cap);
         tybuf.ptrs = malloc(sizeof(tybuf.ptrs[0]) * tybuf.cap);
+        tybuf.canon = malloc(sizeof(tybuf.canon[0]) * tybuf.cap);
     }
     memset(tybuf.ptrs, 0, sizeof(tybuf.ptrs[0]) * tybuf.cap);
+    memset(tybuf.canon, 0, sizeof(tybuf.canon[0]) * tybuf.cap);
+    ty_intern_reset();
     
     for_n_eq(i, TY_VOID, TY_UQUAD) {
         TY(i,  TyBase)->kind = i;
@@ -53,27 +92,31 @@ void ty_init() {
         TY(i + TY_PTR,  TyPtr)->to = i;
         tybuf.ptrs[i] = i + TY_PTR;
     }
-    tybuf.len = TY_UQUAD + TY_PTR + 1;
+    tybuf.len = TYBUF_BUILTIN_END;
 }
 
 #define ty_allocate(T) ty__allocate(sizeof(T), alignof(T) == 8)
 static TyIndex ty__allocate(usize size, bool align64) {
-    usize old_len = tybuf.len;
+    ty_lock_acquire();
 
     usize slots = size / sizeof(TyBufSlot);
-    if (align64 && (tybuf.len & 1)) {
-        tybuf.len += 1; // pad to 64
-    }
+    usize pad = align64 && (tybuf.len & 1); // pad to 64
     
-    if_unlikely (tybuf.len + slots > tybuf.cap) {
-        tybuf.cap += tybuf.cap << 1;
-        tybuf.at = realloc(tybuf.at, sizeof(tybuf.at[0]) * tybuf.cap);
-        tybuf.ptrs = realloc(tybuf.ptrs, sizeof(tybuf.ptrs[0]) * tybuf.cap);
-        memset(&tybuf.ptrs[old_len], 0, sizeof(tybuf.ptrs[0]) * (tybuf.cap - old_len));
+    if_unlikely (tybuf.len + pad + slots > tybuf.cap) {
+        CRASH("out of type space");
+    }
+
+    if (pad) {
+        // zeroed so it reads as TY__INVALID, see ty_slots
+        tybuf.at[tybuf.len] = (TyBufSlot){0};
+        tybuf.len += 1;
     }
 
     usize pos = tybuf.len;
     tybuf.len += slots;
+    tybuf.last = pos;
+
+    ty_lock_release();
     return pos;
 }
 
@@ -85,17 +128,177 @@ static TyIndex ty_get_ptr(TyIndex t) {
     if (t < TY_PTR) {
         return t + TY_PTR;
     }
-    if (tybuf.ptrs[t] == 0) {
+    ty_lock_acquire();
+    TyIndex ptr = tybuf.ptrs[t];
+    if (ptr == 0) {
         // we have to create a pointer type since none exists.
-        TyIndex ptr = ty_allocate(TyPtr);
+        ptr = ty_allocate(TyPtr);
         TY(ptr, TyPtr)->kind = TY_PTR;
         TY(ptr, TyPtr)->to = t;
         
         tybuf.ptrs[t] = ptr;
-        return ptr;
-    } else {
-        return tybuf.ptrs[t];
     }
+    ty_lock_release();
+    return ptr;
+}
+
+// arrays and functions are hash-consed, so structurally identical
+// ones share a TyIndex. pointers already are through tybuf.ptrs.
+
+static struct {
+    TyIndex* at; // 0 is an empty slot
+    u32 len;
+    u32 cap;
+} tyintern = {nullptr, 0, 0};
+
+static void ty_intern_reset() {
+    if (tyintern.at == nullptr) {
+        tyintern.cap = 256;
+        tyintern.at = malloc(sizeof(tyintern.at[0]) * tyintern.cap);
+    }
+    memset(tyintern.at, 0, sizeof(tyintern.at[0]) * tyintern.cap);
+    tyintern.len = 0;
+}
+
+static u32 ty_hash_mix(u32 h, u64 val) {
+    h ^= val;
+    h *= 0x01000193;
+    h ^= h >> 15;
+    return h;
+}
+
+static u32 ty_hash_string(u32 h, CompactString str) {
+    string s = from_compact(str);
+    for_n(i, 0, s.len) {
+        h = ty_hash_mix(h, (u8)s.raw[i]);
+    }
+    return h;
+}
+
+static bool ty_fn_is_variadic_param(TyFn* fn, usize i) {
+    return fn->variadic && i == fn->len - 1;
+}
+
+static u32 ty_hash(TyIndex t) {
+    u32 h = ty_hash_mix(0x811c9dc5, TY_KIND(t));
+    switch (TY_KIND(t)) {
+    case TY_ARRAY:
+        h = ty_hash_mix(h, TY(t, TyArray)->to);
+        h = ty_hash_mix(h, TY(t, TyArray)->len);
+        return h;
+    case TY_FN:
+        ;
+        TyFn* fn = TY(t, TyFn);
+        h = ty_hash_mix(h, fn->len);
+        h = ty_hash_mix(h, fn->variadic | (fn->is_noreturn << 1));
+        h = ty_hash_mix(h, fn->ret_ty);
+        for_n(i, 0, fn->len) {
+            Ty_FnParam* param = &fn->params[i];
+            if (ty_fn_is_variadic_param(fn, i)) {
+                h = ty_hash_string(h, param->varargs.argv);
+                h = ty_hash_string(h, param->varargs.argc);
+            } else {
+                h = ty_hash_mix(h, param->ty | (param->out << 16));
+                h = ty_hash_string(h, param->name);
+            }
+        }
+        return h;
+    default:
+        UNREACHABLE;
+    }
+}
+
+// are these the same type, assuming their components are interned
+static bool ty_same(TyIndex a, TyIndex b) {
+    if (TY_KIND(a) != TY_KIND(b)) {
+        return false;
+    }
+    switch (TY_KIND(a)) {
+    case TY_ARRAY:
+        return TY(a, TyArray)->to == TY(b, TyArray)->to 
+            && TY(a, TyArray)->len == TY(b, TyArray)->len;
+    case TY_FN:
+        ;
+        TyFn* fn_a = TY(a, TyFn);
+        TyFn* fn_b = TY(b, TyFn);
+        if (fn_a->len != fn_b->len || fn_a->variadic != fn_b->variadic 
+            || fn_a->is_noreturn != fn_b->is_noreturn || fn_a->ret_ty != fn_b->ret_ty
+        ) {
+            return false;
+        }
+        for_n(i, 0, fn_a->len) {
+            Ty_FnParam* pa = &fn_a->params[i];
+            Ty_FnParam* pb = &fn_b->params[i];
+            if (ty_fn_is_variadic_param(fn_a, i)) {
+                if (!string_eq(from_compact(pa->varargs.argv), from_compact(pb->varargs.argv))
+                    || !string_eq(from_compact(pa->varargs.argc), from_compact(pb->varargs.argc))
+                ) {
+                    return false;
+                }
+            } else if (pa->ty != pb->ty || pa->out != pb->out 
+                || !string_eq(from_compact(pa->name), from_compact(pb->name))
+            ) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        UNREACHABLE;
+    }
+}
+
+// 't' gets thrown away if an identical type already exists,
+// unless another thread has allocated something after it.
+static TyIndex ty__intern(TyIndex t) {
+    if_unlikely (tyintern.len * 2 >= tyintern.cap) {
+        // rehash
+        TyIndex* old = tyintern.at;
+        u32 old_cap = tyintern.cap;
+        tyintern.cap <<= 1;
+        tyintern.at = malloc(sizeof(tyintern.at[0]) * tyintern.cap);
+        memset(tyintern.at, 0, sizeof(tyintern.at[0]) * tyintern.cap);
+        for_n(i, 0, old_cap) {
+            if (old[i] == 0) {
+                continue;
+            }
+            u32 slot = ty_hash(old[i]) & (tyintern.cap - 1);
+            while (tyintern.at[slot] != 0) {
+                slot = (slot + 1) & (tyintern.cap - 1);
+            }
+            tyintern.at[slot] = old[i];
+        }
+        free(old);
+    }
+
+    u32 slot = ty_hash(t) & (tyintern.cap - 1);
+    while (tyintern.at[slot] != 0) {
+        TyIndex existing = tyintern.at[slot];
+        if (ty_same(existing, t)) {
+            if (tybuf.last == t) {
+                tybuf.len = t;
+            }
+            return existing;
+        }
+        slot = (slot + 1) & (tyintern.cap - 1);
+    }
+    tyintern.at[slot] = t;
+    tyintern.len++;
+    return t;
+}
+
+static TyIndex ty_intern(TyIndex t) {
+    ty_lock_acquire();
+    t = ty__intern(t);
+    ty_lock_release();
+    return t;
+}
+
+static TyIndex ty_get_array(TyIndex to, u32 len) {
+    TyIndex arr = ty_allocate(TyArray);
+    TY(arr, TyArray)->kind = TY_ARRAY;
+    TY(arr, TyArray)->to = to;
+    TY(arr, TyArray)->len = len;
+    return ty_intern(arr);
 }
 
 // gross
@@ -165,6 +368,10 @@ static void _ty_name(Vec(char)* v, TyIndex t) {
     case TY_FN: {
         vec_char_append_str(v, "FN(");
         TyFn* fn = TY(t, TyFn);
+        if (fn->len == 0) {
+            vec_char_append_str(v, ")");
+            goto ret_ty;
+        }
         for_n(i, 0, fn->len - 1) {
             Ty_FnParam* param = &fn->params[i];
             vec_char_append_str(v, param->out ? "OUT " : "");
@@ -193,6 +400,7 @@ static void _ty_name(Vec(char)* v, TyIndex t) {
         }
 
         vec_char_append_str(v, ")");
+    ret_ty:
         if (fn->ret_ty != TY_VOID) {
             vec_char_append_str(v, ": ");
             _ty_name(v, fn->ret_ty);
@@ -341,83 +549,86 @@ static usize ty_align(TyIndex t) {
     TODO("AAAA");
 }
 
-static bool ty_equal(TyIndex t1, TyIndex t2) {
-    if_likely (t1 == t2) {
-        return true;
-    }
-    t1 = ty_unwrap_alias(t1);
-    t2 = ty_unwrap_alias(t2);
-    if_likely (t1 == t2) {
-        return true;
-    }
-
-    if_unlikely (TY_KIND(t1) == TY_PTR && TY_KIND(t2) == TY_PTR) {
-        return ty_equal(TY(t1, TyPtr)->to, TY(t2, TyPtr)->to);
+// the representative of every type that ty_equal considers the same
+// as 't': aliases are looked through and FN types forget NORETURN.
+// incomplete aliases can still change, so nothing that depends on
+// one gets cached.
+static TyIndex ty__canon(TyIndex t, bool* complete) {
+    if_likely (t < TY_PTR) {
+        return t;
     }
-
-    if_unlikely (TY_KIND(t1) == TY_ARRAY && TY_KIND(t2) == TY_ARRAY) {
-        TyArray* t1_array = TY(t1, TyArray);
-        TyArray* t2_array = TY(t2, TyArray);
-        return t1_array->len == t2_array->len && ty_equal(t1_array->to, t2_array->to);
+    if (tybuf.canon[t] != 0) {
+        return tybuf.canon[t];
     }
 
-    // function type checking
-    if_unlikely (TY_KIND(t1) == TY_FN && TY_KIND(t2) == TY_FN) {
-        TyFn* fn1 = TY(t1, TyFn);
-        TyFn* fn2 = TY(t2, TyFn);
-
-        if (fn1->len != fn2->len || fn1->variadic != fn2->variadic) {
-            return false;
-        }
-
-        if (!ty_equal(fn1->ret_ty, fn2->ret_ty)) {
-            return false;
-        }
-
-        for_n(i, 0, fn1->len - 1) {
-            Ty_FnParam p1 = fn1->params[i];
-            Ty_FnParam p2 = fn2->params[i];
-            
-            if (p1.out != p2.out) {
-                return false;
-            }
-            if (!ty_equal(p1.ty, p2.ty)) {
-                return false;
-            }
-            if (!string_eq(from_compact(p1.name), from_compact(p2.name))) {
-                return false;
+    bool this_complete = true;
+    TyIndex c = t;
+    switch (TY_KIND(t)) {
+    case TY_ALIAS:
+        c = ty__canon(TY(t, TyAlias)->aliasing, &this_complete);
+        break;
+    case TY_ALIAS_INCOMPLETE:
+        this_complete = false;
+        break;
+    case TY_PTR:
+        c = ty_get_ptr(ty__canon(TY(t, TyPtr)->to, &this_complete));
+        break;
+    case TY_ARRAY:
+        c = ty_get_array(ty__canon(TY(t, TyArray)->to, &this_complete), TY(t, TyArray)->len);
+        break;
+    case TY_FN:
+        ;
+        u8 len = TY(t, TyFn)->len;
+        bool variadic = TY(t, TyFn)->variadic;
+        TyIndex ret_ty = ty__canon(TY(t, TyFn)->ret_ty, &this_complete);
+        TyIndex param_tys[TY_FN_MAX_PARAMS];
+        for_n(i, 0, len) {
+            if (!(variadic && i == len - 1)) {
+                param_tys[i] = ty__canon(TY(t, TyFn)->params[i].ty, &this_complete);
             }
         }
 
-        if (fn1->variadic) {
-            Ty_FnParam p1 = fn1->params[fn1->len - 1];
-            Ty_FnParam p2 = fn2->params[fn1->len - 1];
-            if (!string_eq(from_compact(p1.varargs.argv), from_compact(p2.varargs.argv))) {
-                return false;
-            }
-            if (!string_eq(from_compact(p1.varargs.argc), from_compact(p2.varargs.argc))) {
-                return false;
-            }
-        } else if (fn1->len != 0) {
-            Ty_FnParam p1 = fn1->params[fn1->len - 1];
-            Ty_FnParam p2 = fn2->params[fn1->len - 1];
-            
-            if (p1.out != p2.out) {
-                return false;
-            }
-            if (!ty_equal(p1.ty, p2.ty)) {
-                return false;
-            }
-            if (!string_eq(from_compact(p1.name), from_compact(p2.name))) {
-                return false;
+        // everything the candidate needs is allocated by now
+        c = ty__allocate(sizeof(TyFn) + sizeof(Ty_FnParam) * len, max(alignof(TyFn), alignof(Ty_FnParam)) == 8);
+        TyFn* fn = TY(c, TyFn);
+        memcpy(fn, TY(t, TyFn), sizeof(TyFn) + sizeof(Ty_FnParam) * len);
+        fn->is_noreturn = false;
+        fn->ret_ty = ret_ty;
+        for_n(i, 0, len) {
+            if (!(variadic && i == len - 1)) {
+                fn->params[i].ty = param_tys[i];
             }
         }
-        return true; // guess they are equal after all...
+        c = ty_intern(c);
+        break;
+    default:
+        // records and enums are nominal
+        break;
+    }
+
+    if (this_complete) {
+        tybuf.canon[t] = c;
+        tybuf.canon[c] = c;
+    } else {
+        *complete = false;
     }
+    return c;
+}
 
-    return t1 == t2;
+static TyIndex ty_canon(TyIndex t) {
+    bool complete;
+    ty_lock_acquire();
+    t = ty__canon(t, &complete);
+    ty_lock_release();
+    return t;
 }
 
+static bool ty_equal(TyIndex t1, TyIndex t2) {
+    if_likely (t1 == t2) {
+        return true;
+    }
+    return ty_canon(t1) == ty_canon(t2);
+}
 
 static bool ty_can_cast(TyIndex dst, TyIndex src, bool src_is_constant) {
     if (ty_equal(dst, src)) {
@@ -485,10 +696,82 @@ void exit_scope(Parser* p) {
     p->current_scope = p->current_scope->super;
 }
 
+// ast storage, see Ast in parse.h
+
+thread_local static Ast ast;
+
+#define EXPR_KIND(e)  ast.exprs.kind[e]
+#define EXPR_TY(e)    ast.exprs.ty[e]
+#define EXPR_TOKEN(e) ast.exprs.token_index[e]
+#define EXPR(e)       ast.exprs.data[e]
+
+#define STMT_KIND(s)    ast.stmts.kind[s]
+#define STMT_RETKIND(s) ast.stmts.retkind[s]
+#define STMT_TOKEN(s)   ast.stmts.token_index[s]
+#define STMT(s)         ast.stmts.data[s]
+
+#define EXTRA(i) ast.extra.at[i]
+
+// careful, anything that creates a node can move these arrays,
+// so something like 'EXPR(e).unary = parse_expr(p)' is wrong.
+// parse into a local first.
+
+static void ast_init() {
+    ast.exprs.cap = 1024;
+    ast.exprs.kind        = malloc(sizeof(ast.exprs.kind[0]) * ast.exprs.cap);
+    ast.exprs.ty          = malloc(sizeof(ast.exprs.ty[0]) * ast.exprs.cap);
+    ast.exprs.token_index = malloc(sizeof(ast.exprs.token_index[0]) * ast.exprs.cap);
+    ast.exprs.data        = malloc(sizeof(ast.exprs.data[0]) * ast.exprs.cap);
+    ast.exprs.len = 1; // skip EXPR_NONE
+
+    ast.stmts.cap = 256;
+    ast.stmts.kind        = malloc(sizeof(ast.stmts.kind[0]) * ast.stmts.cap);
+    ast.stmts.retkind     = malloc(sizeof(ast.stmts.retkind[0]) * ast.stmts.cap);
+    ast.stmts.token_index = malloc(sizeof(ast.stmts.token_index[0]) * ast.stmts.cap);
+    ast.stmts.data        = malloc(sizeof(ast.stmts.data[0]) * ast.stmts.cap);
+    ast.stmts.len = 1; // skip STMT_NONE
+
+    ast.extra.cap = 1024;
+    ast.extra.at = malloc(sizeof(ast.extra.at[0]) * ast.extra.cap);
+    ast.extra.len = 0;
+}
+
+static void ast_grow_exprs() {
+    ast.exprs.cap <<= 1;
+    ast.exprs.kind        = realloc(ast.exprs.kind, sizeof(ast.exprs.kind[0]) * ast.exprs.cap);
+    ast.exprs.ty          = realloc(ast.exprs.ty, sizeof(ast.exprs.ty[0]) * ast.exprs.cap);
+    ast.exprs.token_index = realloc(ast.exprs.token_index, sizeof(ast.exprs.token_index[0]) * ast.exprs.cap);
+    ast.exprs.data        = realloc(ast.exprs.data, sizeof(ast.exprs.data[0]) * ast.exprs.cap);
+}
+
+static void ast_grow_stmts() {
+    ast.stmts.cap <<= 1;
+    ast.stmts.kind        = realloc(ast.stmts.kind, sizeof(ast.stmts.kind[0]) * ast.stmts.cap);
+    ast.stmts.retkind     = realloc(ast.stmts.retkind, sizeof(ast.stmts.retkind[0]) * ast.stmts.cap);
+    ast.stmts.token_index = realloc(ast.stmts.token_index, sizeof(ast.stmts.token_index[0]) * ast.stmts.cap);
+    ast.stmts.data        = realloc(ast.stmts.data, sizeof(ast.stmts.data[0]) * ast.stmts.cap);
+}
+
+// expression nodes can be thrown away and rebuilt,
+// like when folding constants or evaluating SIZEOFVALUE
+typedef struct {
+    u32 exprs;
+    u32 extra;
+} AstState;
+
+static AstState ast_save() {
+    return (AstState){ast.exprs.len, ast.extra.len};
+}
+
+static void ast_restore(AstState state) {
+    ast.exprs.len = state.exprs;
+    ast.extra.len = state.extra;
+}
+
 // general dynamic buffer for parsing shit
 
-VecPtr_typedef(void);
-static thread_local VecPtr(void) dynbuf;
+Vec_typedef(u32);
+static thread_local Vec(u32) dynbuf;
 
 static inline usize dynbuf_start() {
     return dynbuf.len;
@@ -502,19 +785,165 @@ static inline usize dynbuf_len(usize start) {
     return dynbuf.len - start;
 }
 
-static inline void** dynbuf_to_arena(Parser* p, usize start) {
+static u32 extra_alloc(usize len) {
+    if_unlikely (ast.extra.len + len > ast.extra.cap) {
+        while (ast.extra.len + len > ast.extra.cap) {
+            ast.extra.cap <<= 1;
+        }
+        ast.extra.at = realloc(ast.extra.at, sizeof(ast.extra.at[0]) * ast.extra.cap);
+    }
+    u32 pos = ast.extra.len;
+    ast.extra.len += len;
+    return pos;
+}
+
+// move everything since 'start' into the extra pool
+static u32 dynbuf_to_extra(usize start) {
     usize len = dynbuf.len - start;
-    void** items = arena_alloc(&p->arena, len * sizeof(items[0]), alignof(void*));
-    memcpy(items, &dynbuf.at[start], len * sizeof(items[0]));
-    return items;
+    u32 pos = extra_alloc(len);
+    memcpy(&ast.extra.at[pos], &dynbuf.at[start], len * sizeof(dynbuf.at[0]));
+    return pos;
+}
+
+// move another thread's nodes onto the end of ours. every index
+// inside them shifts over by however many nodes we already had.
+typedef struct {
+    u32 exprs;
+    u32 stmts;
+    u32 extra;
+} AstOffsets;
+
+static void ast_rebase_list(StmtList* list, AstOffsets off) {
+    list->stmts += off.extra;
+    for_n(i, 0, list->len) {
+        EXTRA(list->stmts + i) += off.stmts;
+    }
+}
+
+#define REBASE(index, by) if ((index) != 0) (index) += (by)
+
+static AstOffsets ast_adopt(Ast* from) {
+    AstOffsets off = {ast.exprs.len - 1, ast.stmts.len - 1, ast.extra.len};
+    u32 exprs_len = from->exprs.len - 1;
+    u32 stmts_len = from->stmts.len - 1;
+
+    while (ast.exprs.len + exprs_len > ast.exprs.cap) {
+        ast_grow_exprs();
+    }
+    while (ast.stmts.len + stmts_len > ast.stmts.cap) {
+        ast_grow_stmts();
+    }
+
+    u32 e0 = ast.exprs.len;
+    memcpy(&ast.exprs.kind[e0], &from->exprs.kind[1], sizeof(ast.exprs.kind[0]) * exprs_len);
+    memcpy(&ast.exprs.ty[e0], &from->exprs.ty[1], sizeof(ast.exprs.ty[0]) * exprs_len);
+    memcpy(&ast.exprs.token_index[e0], &from->exprs.token_index[1], sizeof(ast.exprs.token_index[0]) * exprs_len);
+    memcpy(&ast.exprs.data[e0], &from->exprs.data[1], sizeof(ast.exprs.data[0]) * exprs_len);
+    ast.exprs.len += exprs_len;
+
+    u32 s0 = ast.stmts.len;
+    memcpy(&ast.stmts.kind[s0], &from->stmts.kind[1], sizeof(ast.stmts.kind[0]) * stmts_len);
+    memcpy(&ast.stmts.retkind[s0], &from->stmts.retkind[1], sizeof(ast.stmts.retkind[0]) * stmts_len);
+    memcpy(&ast.stmts.token_index[s0], &from->stmts.token_index[1], sizeof(ast.stmts.token_index[0]) * stmts_len);
+    memcpy(&ast.stmts.data[s0], &from->stmts.data[1], sizeof(ast.stmts.data[0]) * stmts_len);
+    ast.stmts.len += stmts_len;
+
+    extra_alloc(from->extra.len);
+    memcpy(&ast.extra.at[off.extra], from->extra.at, sizeof(ast.extra.at[0]) * from->extra.len);
+
+    for_n(e, e0, ast.exprs.len) {
+        ExprData* data = &EXPR(e);
+        switch (EXPR_KIND(e)) {
+        case EXPR_ADD ... EXPR_GREATER:
+        case EXPR_PTR_INDEX:
+        case EXPR_ARRAY_INDEX:
+            REBASE(data->binary.lhs, off.exprs);
+            REBASE(data->binary.rhs, off.exprs);
+            break;
+        case EXPR_ADDROF:
+        case EXPR_NEG:
+        case EXPR_NOT:
+        case EXPR_BOOL_NOT:
+        case EXPR_SIZEOFVALUE:
+        case EXPR_OUT_ARG:
+        case EXPR_CAST:
+        case EXPR_DEREF:
+            REBASE(data->unary, off.exprs);
+            break;
+        case EXPR_INDEXED_ITEM:
+            REBASE(data->indexed_item.value, off.exprs);
+            break;
+        case EXPR_DEREF_MEMBER:
+        case EXPR_MEMBER:
+            REBASE(data->member_access.aggregate, off.exprs);
+            break;
+        case EXPR_COMPOUND_LITERAL:
+            data->compound_lit.values += off.extra;
+            for_n(i, 0, data->compound_lit.len) {
+                REBASE(EXTRA(data->compound_lit.values + i), off.exprs);
+            }
+            break;
+        case EXPR_BLOB_LITERAL:
+            // the runs are relative to the data, nothing inside moves
+            data->blob.bytes += off.extra;
+            data->blob.runs += off.extra;
+            break;
+        case EXPR_CALL:
+            data->call.args += off.extra;
+            // the callee comes first
+            for_n(i, 0, data->call.args_len + 1) {
+                REBASE(EXTRA(data->call.args + i), off.exprs);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    for_n(s, s0, ast.stmts.len) {
+        StmtData* data = &STMT(s);
+        switch (STMT_KIND(s)) {
+        case STMT_EXPR:
+        case STMT_RETURN:
+            REBASE(data->expr, off.exprs);
+            break;
+        case STMT_VAR_DECL:
+            REBASE(data->var_decl.expr, off.exprs);
+            data->var_decl.var->decl = s;
+            break;
+        case STMT_ASSIGN ... STMT_ASSIGN_RSH:
+            REBASE(data->assign.lhs, off.exprs);
+            REBASE(data->assign.rhs, off.exprs);
+            break;
+        case STMT_IF:
+            REBASE(data->if_.cond, off.exprs);
+            REBASE(data->if_.else_, off.stmts);
+            ast_rebase_list(&data->if_.block, off);
+            break;
+        case STMT_BLOCK:
+            ast_rebase_list(&data->block, off);
+            break;
+        case STMT_WHILE:
+            REBASE(data->while_.cond, off.exprs);
+            ast_rebase_list(&data->while_.block, off);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return off;
 }
 
+#undef REBASE
+
 Entity* new_entity(Parser* p, string ident, EntityKind kind) {
     Entity* entity = arena_alloc(&p->entities, sizeof(Entity), alignof(Entity));
     *entity = (Entity){0};
     entity->name = to_compact(ident);
     entity->kind = kind;
     entity->ty = TY__INVALID;
+    entity->declared_at = p->cursor;
     strmap_put(&p->current_scope->map, ident, entity);
     return entity;
 }
@@ -524,6 +953,11 @@ Entity* get_entity(Parser* p, string key) {
     while (scope) {
         Entity* entity = strmap_get(&scope->map, key);
         if (entity != STRMAP_NOT_FOUND) {
+            // function bodies are parsed after all the globals,
+            // so hide the ones that come later in the source
+            if (scope == p->global_scope && entity->declared_at > p->cursor) {
+                return nullptr;
+            }
             return entity;
         }
         scope = scope->super;
@@ -546,59 +980,120 @@ static SrcFile* where_from(Parser* ctx, string span) {
     return nullptr;
 }
 
-static usize preproc_depth(Parser* ctx, u32 index) {
-    usize depth = 0;
-    for_n(i, 0, index) {
-        Token t = ctx->tokens[i];
-        switch (t.kind) {
+// record every paste token along with the paste it's nested in
+static void build_paste_index(Parser* ctx) {
+    u32 count = 0;
+    for_n (i, 0, ctx->tokens_len) {
+        switch (ctx->tokens[i].kind) {
         case TOK_PREPROC_MACRO_PASTE:
         case TOK_PREPROC_DEFINE_PASTE:
         case TOK_PREPROC_INCLUDE_PASTE:
-            depth++;
+        case TOK_PREPROC_PASTE_END:
+            count++;
+            break;
+        }
+    }
+
+    ctx->pastes = arena_alloc(&ctx->arena, sizeof(PasteMark) * (count + 1), alignof(PasteMark));
+    ctx->pastes_len = 0;
+
+    u32 open = PASTE_NONE;
+    u32 depth = 0;
+    for_n (i, 0, ctx->tokens_len) {
+        PasteMark* mark = &ctx->pastes[ctx->pastes_len];
+        switch (ctx->tokens[i].kind) {
+        case TOK_PREPROC_MACRO_PASTE:
+        case TOK_PREPROC_DEFINE_PASTE:
+        case TOK_PREPROC_INCLUDE_PASTE:
+            mark->index = i;
+            mark->parent = open;
+            mark->depth = ++depth;
+            open = ctx->pastes_len++;
             break;
         case TOK_PREPROC_PASTE_END:
-            depth--;
+            if (open != PASTE_NONE) {
+                open = ctx->pastes[open].parent;
+                depth--;
+            }
+            mark->index = i;
+            mark->parent = open;
+            mark->depth = depth;
+            ctx->pastes_len++;
             break;
         }
     }
-    return depth;
+}
+
+// the last paste mark before token 'index', or PASTE_NONE
+static u32 paste_before(Parser* ctx, u32 index) {
+    if (ctx->pastes == nullptr) {
+        build_paste_index(ctx);
+    }
+
+    u32 low = 0;
+    u32 high = ctx->pastes_len;
+    while (low < high) {
+        u32 mid = low + (high - low) / 2;
+        if (ctx->pastes[mid].index < index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low == 0 ? PASTE_NONE : low - 1;
+}
+
+static usize preproc_depth(Parser* ctx, u32 index) {
+    u32 mark = paste_before(ctx, index);
+    return mark == PASTE_NONE ? 0 : ctx->pastes[mark].depth;
+}
+
+// innermost paste that token 'index' is expanded from, or PASTE_NONE
+static u32 enclosing_paste(Parser* ctx, u32 index) {
+    u32 mark = paste_before(ctx, index);
+    if (mark == PASTE_NONE) {
+        return PASTE_NONE;
+    }
+    if (ctx->tokens[ctx->pastes[mark].index].kind == TOK_PREPROC_PASTE_END) {
+        return ctx->pastes[mark].parent;
+    }
+    return mark;
 }
 
 void token_error(Parser* ctx, ReportKind kind, u32 start_index, u32 end_index, const char* msg) {
+    // function bodies might be getting parsed on other threads.
+    // an error exits while holding the lock so nothing else gets printed after it
+    call_once(&locks_once, init_locks);
+    mtx_lock(&report_lock);
+
     // find out if we're in a macro somewhere
     bool inside_preproc = preproc_depth(ctx, start_index) != 0 || preproc_depth(ctx, end_index) != 0;
 
     Vec_typedef(ReportLine);
     Vec(ReportLine) reports = vec_new(ReportLine, 8);
 
-    i32 unmatched_ends = 0;
-    for (i64 i = (i64)start_index; i > 0; --i) {
-        Token t = ctx->tokens[i];
+    // walk out through every paste around the start token.
+    // start_index counts as inside a paste that begins on it
+    for (
+        u32 mark = enclosing_paste(ctx, start_index + 1);
+        mark != PASTE_NONE;
+        mark = ctx->pastes[mark].parent
+    ) {
+        Token t = ctx->tokens[ctx->pastes[mark].index];
+        if (ctx->pastes[mark].index == 0 || t.kind == TOK_PREPROC_INCLUDE_PASTE) {
+            continue;
+        }
 
+        SrcFile* from = where_from(ctx, tok_span(t));
+        if (!from) {
+            CRASH("unable to locate macro paste span source file");
+        }
         ReportLine report = {};
         report.kind = REPORT_NOTE;
-
-        switch (t.kind) {
-        case TOK_PREPROC_DEFINE_PASTE:
-        case TOK_PREPROC_MACRO_PASTE:
-            if (unmatched_ends != 0) {
-                unmatched_ends--;
-                break;
-            }
-            SrcFile* from = where_from(ctx, tok_span(t));
-            if (!from) {
-                CRASH("unable to locate macro paste span source file");
-            }
-            report.msg = strprintf("using macro '"str_fmt"'", str_arg(tok_span(t)));
-            report.path = from->path;
-            report.src = from->src;
-            report.snippet = tok_span(t);
-            vec_append(&reports, report);
-            break;
-        case TOK_PREPROC_PASTE_END:
-            unmatched_ends++;
-            break;
-        }
+        report.msg = strprintf("using macro '"str_fmt"'", str_arg(tok_span(t)));
+        report.file = from;
+        report.snippet = tok_span(t);
+        vec_append(&reports, report);
     }
 
     // find main line snippet
@@ -609,9 +1104,11 @@ void token_error(Parser* ctx, ReportKind kind, u32 start_index, u32 end_index, c
         // }
 
         string main_highlight = {};
-        for_n(i, end_index, ctx->tokens_len) {
-            Token t = ctx->tokens[i];
-            if (t.kind == TOK_PREPROC_PASTE_END && preproc_depth(ctx, i + 1) == 0) {
+        u32 first = paste_before(ctx, end_index);
+        for (u32 i = first == PASTE_NONE ? 0 : first; i < ctx->pastes_len; ++i) {
+            PasteMark* mark = &ctx->pastes[i];
+            Token t = ctx->tokens[mark->index];
+            if (mark->index >= end_index && t.kind == TOK_PREPROC_PASTE_END && mark->depth == 0) {
                 main_highlight = tok_span(t);
                 break;
             }
@@ -685,8 +1182,7 @@ void token_error(Parser* ctx, ReportKind kind, u32 start_index, u32 end_index, c
         ReportLine rep = {
             .kind = kind,
             .msg = str(msg),
-            .path = main_file->path,
-            .src = main_file->src,
+            .file = main_file,
             .snippet = main_highlight,
 
             .reconstructed_line = src,
@@ -708,9 +1204,8 @@ void token_error(Parser* ctx, ReportKind kind, u32 start_index, u32 end_index, c
         ReportLine rep = {
             .kind = kind,
             .msg = str(msg),
-            .path = main_file->path,
+            .file = main_file,
             .snippet = span,
-            .src = main_file->src,
         };
 
         report_line(&rep);
@@ -719,6 +1214,7 @@ void token_error(Parser* ctx, ReportKind kind, u32 start_index, u32 end_index, c
     if (kind == REPORT_ERROR) {
         exit(1);
     }
+    mtx_unlock(&report_lock);
 }
 
 static void advance(Parser* p) {
@@ -796,14 +1292,15 @@ static void expect(Parser* p, u8 kind) {
     }
 }
 
-#define new_expr(p, kind, ty, field) \
-    new_expr_(p, kind, ty, offsetof(Expr, extra) + sizeof(((Expr*)nullptr)->field))
-
-static Expr* new_expr_(Parser* p, u8 kind, TyIndex ty, usize size) {
-    Expr* expr = arena_alloc(&p->arena, size, alignof(Expr));
-    expr->kind = kind;
-    expr->ty = ty;
-    expr->token_index = p->cursor;
+static ExprIndex new_expr(Parser* p, ExprKind kind, TyIndex ty) {
+    if_unlikely (ast.exprs.len == ast.exprs.cap) {
+        ast_grow_exprs();
+    }
+    ExprIndex expr = ast.exprs.len++;
+    EXPR_KIND(expr) = kind;
+    EXPR_TY(expr) = ty;
+    EXPR_TOKEN(expr) = p->cursor;
+    EXPR(expr) = (ExprData){0};
     return expr;
 }
 
@@ -880,8 +1377,8 @@ i64 eval_integer(Parser* p, Token t, u32 index) {
     return is_negative ? -val : val;
 }
 
-u32 expr_leftmost_token(Expr* expr) {
-    switch (expr->kind) {
+u32 expr_leftmost_token(ExprIndex expr) {
+    switch (EXPR_KIND(expr)) {
     case EXPR_LITERAL:
     case EXPR_STR_LITERAL:
     case EXPR_NOT:
@@ -889,14 +1386,15 @@ u32 expr_leftmost_token(Expr* expr) {
     case EXPR_ENTITY:
     case EXPR_CALL:
     case EXPR_COMPOUND_LITERAL:
+    case EXPR_BLOB_LITERAL:
     case EXPR_INDEXED_ITEM:
     case EXPR_EMPTY_COMPOUND_LITERAL:
-        return expr->token_index;
+        return EXPR_TOKEN(expr);
     case EXPR_DEREF:
-        return expr_leftmost_token(expr->unary);
+        return expr_leftmost_token(EXPR(expr).unary);
     case EXPR_DEREF_MEMBER:
     case EXPR_MEMBER:
-        return expr_leftmost_token(expr->member_access.aggregate);
+        return expr_leftmost_token(EXPR(expr).member_access.aggregate);
     case EXPR_ADD:
     case EXPR_SUB:
     case EXPR_MUL:
@@ -907,14 +1405,14 @@ u32 expr_leftmost_token(Expr* expr) {
     case EXPR_XOR:
     case EXPR_LSH:
     case EXPR_RSH:
-        return expr_leftmost_token(expr->binary.lhs);
+        return expr_leftmost_token(EXPR(expr).binary.lhs);
     default:
-        TODO("unknown expr kind %u", expr->kind);
+        TODO("unknown expr kind %u", EXPR_KIND(expr));
     }
 }
 
-u32 expr_rightmost_token(Expr* expr) {
-    switch (expr->kind) {
+u32 expr_rightmost_token(ExprIndex expr) {
+    switch (EXPR_KIND(expr)) {
     case EXPR_LITERAL:
     case EXPR_STR_LITERAL:
     case EXPR_DEREF:
@@ -924,12 +1422,13 @@ u32 expr_rightmost_token(Expr* expr) {
     case EXPR_CALL:
     case EXPR_INDEXED_ITEM:
     case EXPR_COMPOUND_LITERAL:
-        return expr->token_index;
+    case EXPR_BLOB_LITERAL:
+        return EXPR_TOKEN(expr);
     case EXPR_EMPTY_COMPOUND_LITERAL:
-        return expr->token_index + 1;
+        return EXPR_TOKEN(expr) + 1;
     case EXPR_NOT:
     case EXPR_ADDROF:
-        return expr_rightmost_token(expr->unary);
+        return expr_rightmost_token(EXPR(expr).unary);
     case EXPR_ADD:
     case EXPR_SUB:
     case EXPR_MUL:
@@ -940,9 +1439,9 @@ u32 expr_rightmost_token(Expr* expr) {
     case EXPR_XOR:
     case EXPR_LSH:
     case EXPR_RSH:
-        return expr_rightmost_token(expr->binary.rhs);
+        return expr_rightmost_token(EXPR(expr).binary.rhs);
     default:
-        TODO("unknown expr kind %u", expr->kind);
+        TODO("unknown expr kind %u", EXPR_KIND(expr));
     }
 }
 
@@ -1010,21 +1509,21 @@ TyIndex parse_type(Parser* p, bool allow_incomplete) {
             parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "cannot use incomplete type");
         }
         advance(p);
-        TyIndex arr = ty_allocate(TyArray);
-        TY(arr, TyArray)->to = left;
-        TY(arr, TyArray)->kind = TY_ARRAY;
-        Expr* len_expr = parse_expr(p);
+        AstState save = ast_save();
+        ExprIndex len_expr = parse_expr(p);
 
-        if (!ty_is_integer(len_expr->ty)) {
+        if (!ty_is_integer(EXPR_TY(len_expr))) {
             error_at_expr(p, len_expr, REPORT_ERROR, "array length must be integer");
         }
-        if (len_expr->kind != EXPR_LITERAL) {
+        if (EXPR_KIND(len_expr) != EXPR_LITERAL) {
             error_at_expr(p, len_expr, REPORT_ERROR, "array length must be compile-time known");
         }
-        if (len_expr->literal > (u64)INT32_MAX) {
+        if (EXPR(len_expr).literal > (u64)INT32_MAX) {
             error_at_expr(p, len_expr, REPORT_WARNING, "array length is... excessive");
         }
-        TY(arr, TyArray)->len = len_expr->literal;
+        u64 len = EXPR(len_expr).literal;
+        ast_restore(save); // the length is all that's needed
+        TyIndex arr = ty_get_array(left, len);
         expect(p, TOK_CLOSE_BRACKET);
         advance(p);
         left = arr;
@@ -1032,10 +1531,10 @@ TyIndex parse_type(Parser* p, bool allow_incomplete) {
     return left;
 }
 
-static bool is_lvalue(Expr* e) {
-    switch (e->kind) {
+static bool is_lvalue(ExprIndex e) {
+    switch (EXPR_KIND(e)) {
     case EXPR_ENTITY:
-        return e->entity->kind == ENTKIND_VAR;
+        return EXPR(e).entity->kind == ENTKIND_VAR;
     case EXPR_DEREF:
     case EXPR_DEREF_MEMBER:
     case EXPR_MEMBER:
@@ -1047,9 +1546,9 @@ static bool is_lvalue(Expr* e) {
     }
 }
 
-Expr* parse_atom_terminal(Parser* p) {
+ExprIndex parse_atom_terminal(Parser* p) {
     string span = tok_span(p->current);
-    Expr* atom = nullptr;
+    ExprIndex atom = EXPR_NONE;
     switch (p->current.kind) {
     case TOK_OPEN_PAREN:
         advance(p);
@@ -1058,41 +1557,41 @@ Expr* parse_atom_terminal(Parser* p) {
         advance(p);
         break;
     case TOK_INTEGER:
-        atom = new_expr(p, EXPR_LITERAL, target_uword, literal);
-        atom->literal = eval_integer(p, p->current, p->cursor);
+        atom = new_expr(p, EXPR_LITERAL, target_uword);
+        EXPR(atom).literal = eval_integer(p, p->current, p->cursor);
         advance(p);
         break;
     case TOK_KW_TRUE:
-        atom = new_expr(p, EXPR_LITERAL, target_uword, literal);
-        atom->literal = 1;
+        atom = new_expr(p, EXPR_LITERAL, target_uword);
+        EXPR(atom).literal = 1;
         advance(p);
         break;
     case TOK_KW_FALSE:
-        atom = new_expr(p, EXPR_LITERAL, target_uword, literal);
-        atom->literal = 0;
+        atom = new_expr(p, EXPR_LITERAL, target_uword);
+        EXPR(atom).literal = 0;
         advance(p);
         break;
     case TOK_KW_NULLPTR:
-        atom = new_expr(p, EXPR_LITERAL, TY_VOIDPTR, literal);
-        atom->literal = 0;
+        atom = new_expr(p, EXPR_LITERAL, TY_VOIDPTR);
+        EXPR(atom).literal = 0;
         advance(p);
         break;
     case TOK_KW_ALIGNOF:
-        atom = new_expr(p, EXPR_LITERAL, target_uword, literal);
+        atom = new_expr(p, EXPR_LITERAL, target_uword);
         advance(p);
         TyIndex type = parse_type(p, false); 
-        atom->literal = ty_align(type);
+        EXPR(atom).literal = ty_align(type);
         break;
     case TOK_KW_SIZEOF:
-        atom = new_expr(p, EXPR_LITERAL, target_uword, literal);
+        atom = new_expr(p, EXPR_LITERAL, target_uword);
         advance(p);
         type = parse_type(p, false); 
-        atom->literal = ty_size(type);
+        EXPR(atom).literal = ty_size(type);
         break;
     case TOK_STRING:
-        atom = new_expr(p, EXPR_STR_LITERAL, ty_get_ptr(TY_UBYTE), lit_string);
+        atom = new_expr(p, EXPR_STR_LITERAL, ty_get_ptr(TY_UBYTE));
+        EXPR(atom).lit_string = to_compact(span);
         advance(p);
-        // atom->literal = ty_size(type);
         break;
     case TOK_IDENTIFIER:
         // find an entity
@@ -1108,11 +1607,11 @@ Expr* parse_atom_terminal(Parser* p) {
         }
 
         if (entity->kind == ENTKIND_VARIANT) {
-            atom = new_expr(p, EXPR_LITERAL, entity->ty, literal);
-            atom->literal = entity->variant_value;
+            atom = new_expr(p, EXPR_LITERAL, entity->ty);
+            EXPR(atom).literal = entity->variant_value;
         } else {
-            atom = new_expr(p, EXPR_ENTITY, entity->ty, entity);
-            atom->entity = entity;
+            atom = new_expr(p, EXPR_ENTITY, entity->ty);
+            EXPR(atom).entity = entity;
         }
 
         advance(p);
@@ -1125,43 +1624,43 @@ Expr* parse_atom_terminal(Parser* p) {
     return atom;
 }
 
-Expr* parse_atom(Parser* p) {
-    Expr* atom = parse_atom_terminal(p);
-    Expr* left = nullptr;
+ExprIndex parse_atom(Parser* p) {
+    ExprIndex atom = parse_atom_terminal(p);
+    ExprIndex left = EXPR_NONE;
 
     while (true) {
         switch (p->current.kind) {
         case TOK_OPEN_BRACKET: {
             // UNREACHABLE;
             left = atom;
-            TyKind left_ty_kind = TY_KIND(left->ty);
+            TyKind left_ty_kind = TY_KIND(EXPR_TY(left));
             if_likely (left_ty_kind == TY_PTR) {
-                atom = new_expr(p, EXPR_PTR_INDEX, TY(left->ty, TyPtr)->to, binary);
-                atom->binary.lhs = left;
+                atom = new_expr(p, EXPR_PTR_INDEX, TY(EXPR_TY(left), TyPtr)->to);
+                EXPR(atom).binary.lhs = left;
                 advance(p);
-                Expr* index = parse_expr(p);
-                if_unlikely (!ty_is_integer(index->ty)) {
+                ExprIndex index = parse_expr(p);
+                if_unlikely (!ty_is_integer(EXPR_TY(index))) {
                     parse_error(p, expr_leftmost_token(left), p->cursor, REPORT_ERROR, 
-                        "index type %s is not an integer", ty_name(left->ty));
+                        "index type %s is not an integer", ty_name(EXPR_TY(left)));
                 }
-                atom->binary.rhs = index;
+                EXPR(atom).binary.rhs = index;
                 expect(p, TOK_CLOSE_BRACKET);
                 advance(p);
             } else if_likely (left_ty_kind == TY_ARRAY) {
-                atom = new_expr(p, EXPR_ARRAY_INDEX, TY(left->ty, TyPtr)->to, binary);
-                atom->binary.lhs = left;
+                atom = new_expr(p, EXPR_ARRAY_INDEX, TY(EXPR_TY(left), TyPtr)->to);
+                EXPR(atom).binary.lhs = left;
                 advance(p);
-                Expr* index = parse_expr(p);
-                if_unlikely (!ty_is_integer(index->ty)) {
+                ExprIndex index = parse_expr(p);
+                if_unlikely (!ty_is_integer(EXPR_TY(index))) {
                     parse_error(p, expr_leftmost_token(left), p->cursor, REPORT_ERROR, 
-                        "index type %s is not an integer", ty_name(left->ty));
+                        "index type %s is not an integer", ty_name(EXPR_TY(left)));
                 }
-                atom->binary.rhs = index;
+                EXPR(atom).binary.rhs = index;
                 expect(p, TOK_CLOSE_BRACKET);
                 advance(p);
             } else {
                 parse_error(p, expr_leftmost_token(left), p->cursor, REPORT_ERROR, 
-                    "cannot index type %s", ty_name(left->ty));
+                    "cannot index type %s", ty_name(EXPR_TY(left)));
             }
         } break;
         case TOK_CARET: {
@@ -1169,28 +1668,28 @@ Expr* parse_atom(Parser* p) {
                 goto member_deref;
             }
             left = atom;
-            if_unlikely (TY_KIND(left->ty) != TY_PTR) {
+            if_unlikely (TY_KIND(EXPR_TY(left)) != TY_PTR) {
                 parse_error(p, expr_leftmost_token(left), p->cursor, REPORT_ERROR, 
-                    "cannot dereference type %s", ty_name(left->ty));
+                    "cannot dereference type %s", ty_name(EXPR_TY(left)));
             }
-            TyIndex ptr_target = ty_get_ptr_target(left->ty);
+            TyIndex ptr_target = ty_get_ptr_target(EXPR_TY(left));
             // if_unlikely (!ty_is_scalar(ptr_target)) {
             //     parse_error(p, expr_leftmost_token(left), p->cursor, REPORT_ERROR, 
             //         "cannot use non-scalar type %s", ty_name(ptr_target));
             // }
-            atom = new_expr(p, EXPR_DEREF, ptr_target, unary);
-            atom->unary = left;
+            atom = new_expr(p, EXPR_DEREF, ptr_target);
+            EXPR(atom).unary = left;
             advance(p);
         } break;
         case TOK_CARET_DOT: {
             member_deref:
             left = atom;
 
-            TyIndex left_ty = ty_unwrap_alias(left->ty);
+            TyIndex left_ty = ty_unwrap_alias(EXPR_TY(left));
 
             if_unlikely (TY_KIND(left_ty) != TY_PTR) {
                 parse_error(p, expr_leftmost_token(left), expr_rightmost_token(left), REPORT_ERROR, 
-                    "cannot dereference type %s", ty_name(left->ty));
+                    "cannot dereference type %s", ty_name(EXPR_TY(left)));
             }
             TyIndex record_ty = ty_unwrap_alias(ty_get_ptr_target(left_ty));
             TyKind record_ty_kind = TY_KIND(record_ty);
@@ -1222,16 +1721,16 @@ Expr* parse_atom(Parser* p) {
                     "type %s has no member '"str_fmt"'", ty_name(record_ty), str_arg(member_span));
             }
 
-            atom = new_expr(p, EXPR_DEREF_MEMBER, member_ty, member_access);
-            atom->member_access.aggregate = left;
-            atom->member_access.member_index = member_index;
-            atom->ty = member_ty;
+            atom = new_expr(p, EXPR_DEREF_MEMBER, member_ty);
+            EXPR(atom).member_access.aggregate = left;
+            EXPR(atom).member_access.member_index = member_index;
+            EXPR_TY(atom) = member_ty;
             advance(p);
         } break;
         case TOK_DOT: {
             left = atom;
 
-            TyIndex record_ty = ty_unwrap_alias(left->ty);
+            TyIndex record_ty = ty_unwrap_alias(EXPR_TY(left));
             TyKind record_ty_kind = TY_KIND(record_ty);
 
             if_unlikely (record_ty_kind != TY_STRUCT && record_ty_kind != TY_STRUCT_PACKED && record_ty_kind != TY_UNION) {
@@ -1261,17 +1760,17 @@ Expr* parse_atom(Parser* p) {
                     "type %s has no member '"str_fmt"'", ty_name(record_ty), str_arg(member_span));
             }
 
-            atom = new_expr(p, EXPR_MEMBER, member_ty, member_access);
-            atom->member_access.aggregate = left;
-            atom->member_access.member_index = member_index;
-            atom->ty = member_ty;
+            atom = new_expr(p, EXPR_MEMBER, member_ty);
+            EXPR(atom).member_access.aggregate = left;
+            EXPR(atom).member_access.member_index = member_index;
+            EXPR_TY(atom) = member_ty;
             advance(p);
         } break;
         case TOK_OPEN_PAREN: {
             // function call
             left = atom;
 
-            TyIndex fn_ty = left->ty;
+            TyIndex fn_ty = EXPR_TY(left);
 
             // make sure we're calling an fn/fnptr lol
 
@@ -1289,9 +1788,10 @@ Expr* parse_atom(Parser* p) {
                 TODO("variadic function calls");
             }
 
-            atom = new_expr(p, EXPR_CALL, fn->ret_ty, call);
+            atom = new_expr(p, EXPR_CALL, fn->ret_ty);
 
             u32 args_start = dynbuf_start();
+            vec_append(&dynbuf, left);
 
             // okay, actually check arguments
             advance(p);
@@ -1301,7 +1801,7 @@ Expr* parse_atom(Parser* p) {
                     parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "too many arguments, expected %u", fn->len);
                 }
 
-                Expr* arg = nullptr;
+                ExprIndex arg = EXPR_NONE;
                 Ty_FnParam* param = &fn->params[arg_n];
                 if_unlikely (param->out) {
                     expect(p, TOK_KW_OUT);
@@ -1315,30 +1815,28 @@ Expr* parse_atom(Parser* p) {
                     arg = parse_expr(p);
                 }
 
-                if_unlikely (!ty_compatible(param->ty, arg->ty, arg->kind == EXPR_LITERAL)) {
+                if_unlikely (!ty_compatible(param->ty, EXPR_TY(arg), EXPR_KIND(arg) == EXPR_LITERAL)) {
                     error_at_expr(p, arg, REPORT_ERROR, 
-                        "type %s cannot coerce to %s", ty_name(arg->ty), ty_name(param->ty));
+                        "type %s cannot coerce to %s", ty_name(EXPR_TY(arg)), ty_name(param->ty));
                 }
 
+                vec_append(&dynbuf, arg);
+                arg_n++;
+
                 if_likely (match(p, TOK_COMMA)) {
                     advance(p);
                 } else {
                     break;
                 }
-
-                vec_append(&dynbuf, arg);
-
-                arg_n++;
             }
             expect(p, TOK_CLOSE_PAREN);
             advance(p);
             
-            Expr** args = (Expr**)dynbuf_to_arena(p, args_start);
+            u32 args = dynbuf_to_extra(args_start);
             dynbuf_restore(args_start);
 
-            atom->call.callee = left;
-            atom->call.args = args;
-            atom->call.args_len = arg_n;
+            EXPR(atom).call.args = args;
+            EXPR(atom).call.args_len = arg_n;
 
             // UNREACHABLE;
         } break;
@@ -1350,128 +1848,223 @@ Expr* parse_atom(Parser* p) {
     return atom;
 }
 
-Expr* parse_unary(Parser* p) {
-    // ArenaState save = arena_save(&p->arena);
+// constant folding
+//
+// integer types are mostly suggestions (see notes.txt), so arithmetic
+// happens on whole machine words, or more if the type is bigger than that.
+// literals are kept truncated to that width, sign extended if their type
+// is signed, so they can be compared and divided as-is.
 
-    while_unlikely (match(p, TOK_KW_NOTHING)) {
-        advance(p);
-    }
+static u32 const_bits(TyIndex t) {
+    t = ty_unwrap_alias_or_enum(t);
+    usize size = ty_is_integer(t) ? ty_size(t) : target_ptr_size;
+    return max(size, target_ptr_size) * 8;
+}
 
-    u32 op_position = p->cursor;
+static bool const_signed(TyIndex t) {
+    return ty_is_signed(ty_unwrap_alias_or_enum(t));
+}
 
-    switch (p->current.kind) {
-    case TOK_KW_ALIGNOFVALUE: {
-        advance(p);
+static u64 const_normalize(u64 val, TyIndex t) {
+    u32 bits = const_bits(t);
+    if (bits >= 64) {
+        return val;
+    }
+    u64 mask = ((u64)1 << bits) - 1;
+    val &= mask;
+    if (const_signed(t) && (val >> (bits - 1)) & 1) {
+        val |= ~mask;
+    }
+    return val;
+}
+
+// evaluate 'lhs op rhs' where both sides are literals. binary operators
+// take the type of their left operand, and the right one gets cast to it.
+static u64 const_fold_binary(Parser* p, ExprKind op, TyIndex ty, u64 lhs, u64 rhs, u32 op_token) {
+    bool is_signed = const_signed(ty);
+    u32 bits = const_bits(ty);
+    lhs = const_normalize(lhs, ty);
+    rhs = const_normalize(rhs, ty);
+    i64 slhs = (i64)lhs;
+    i64 srhs = (i64)rhs;
+
+    u64 result;
+    switch (op) {
+    case EXPR_ADD: result = lhs + rhs; break;
+    case EXPR_SUB: result = lhs - rhs; break;
+    case EXPR_MUL: result = lhs * rhs; break;
+    case EXPR_DIV:
+    case EXPR_REM:
+        if_unlikely (rhs == 0) {
+            parse_error(p, op_token, op_token, REPORT_ERROR, "division by zero in constant expression");
+        }
+        if (is_signed && srhs == -1) {
+            // dont trap on INT64_MIN / -1
+            result = op == EXPR_DIV ? -lhs : 0;
+        } else if (is_signed) {
+            result = op == EXPR_DIV ? (u64)(slhs / srhs) : (u64)(slhs % srhs);
+        } else {
+            result = op == EXPR_DIV ? lhs / rhs : lhs % rhs;
+        }
+        break;
+    case EXPR_AND: result = lhs & rhs; break;
+    case EXPR_OR:  result = lhs | rhs; break;
+    case EXPR_XOR: result = lhs ^ rhs; break;
+    case EXPR_LSH:
+        result = rhs >= bits ? 0 : lhs << rhs;
+        break;
+    case EXPR_RSH:
+        if (is_signed) {
+            result = (u64)(slhs >> min(rhs, 63));
+        } else {
+            result = rhs >= bits ? 0 : lhs >> rhs;
+        }
+        break;
+    case EXPR_ROR:
+        // rotate within the word, sign bits and all
+        if (bits < 64) {
+            lhs &= ((u64)1 << bits) - 1;
+        }
+        rhs %= bits;
+        result = rhs == 0 ? lhs : (lhs >> rhs) | (lhs << (bits - rhs));
+        break;
+    case EXPR_EQ:  result = lhs == rhs; break;
+    case EXPR_NEQ: result = lhs != rhs; break;
+    case EXPR_LESS_EQ:    result = is_signed ? slhs <= srhs : lhs <= rhs; break;
+    case EXPR_GREATER_EQ: result = is_signed ? slhs >= srhs : lhs >= rhs; break;
+    case EXPR_LESS:       result = is_signed ? slhs < srhs  : lhs < rhs; break;
+    case EXPR_GREATER:    result = is_signed ? slhs > srhs  : lhs > rhs; break;
+    case EXPR_BOOL_AND: result = lhs != 0 && rhs != 0; break;
+    case EXPR_BOOL_OR:  result = lhs != 0 || rhs != 0; break;
+    default:
+        UNREACHABLE;
+    }
+    return const_normalize(result, ty);
+}
+
+ExprIndex parse_unary(Parser* p) {
+    // AstState save = ast_save();
+
+    while_unlikely (match(p, TOK_KW_NOTHING)) {
+        advance(p);
+    }
+
+    u32 op_position = p->cursor;
+
+    switch (p->current.kind) {
+    case TOK_KW_ALIGNOFVALUE: {
+        advance(p);
 
-        ArenaState save = arena_save(&p->arena);
+        AstState save = ast_save();
 
-        Expr* value = parse_expr(p);
-        TyIndex type = value->ty;
+        ExprIndex value = parse_expr(p);
+        TyIndex type = EXPR_TY(value);
 
-        arena_restore(&p->arena, save);
+        ast_restore(save);
 
-        Expr* alignofvalue = new_expr(p, EXPR_LITERAL, target_uword, literal);
-        alignofvalue->literal = ty_align(type);
+        ExprIndex alignofvalue = new_expr(p, EXPR_LITERAL, target_uword);
+        EXPR(alignofvalue).literal = ty_align(type);
 
         return alignofvalue;
     }
     case TOK_KW_SIZEOFVALUE: {
         advance(p);
 
-        ArenaState save = arena_save(&p->arena);
+        AstState save = ast_save();
 
-        Expr* value = parse_expr(p);
-        TyIndex type = value->ty;
+        ExprIndex value = parse_expr(p);
+        TyIndex type = EXPR_TY(value);
 
-        arena_restore(&p->arena, save);
+        ast_restore(save);
 
-        Expr* sizeofvalue = new_expr(p, EXPR_LITERAL, target_uword, literal);
-        sizeofvalue->literal = ty_size(type);
+        ExprIndex sizeofvalue = new_expr(p, EXPR_LITERAL, target_uword);
+        EXPR(sizeofvalue).literal = ty_size(type);
 
         return sizeofvalue;
     }
     case TOK_AND: {
         advance(p);
-        Expr* inner = parse_unary(p);
+        ExprIndex inner = parse_unary(p);
         if_unlikely (!is_lvalue(inner)) {
             error_at_expr(p, inner, REPORT_ERROR, 
                 "cannot take address of r-value");
         }
-        Expr* addrof = new_expr(p, EXPR_ADDROF, ty_get_ptr(inner->ty), unary);
-        addrof->unary = inner;
-        addrof->token_index = op_position;
+        ExprIndex addrof = new_expr(p, EXPR_ADDROF, ty_get_ptr(EXPR_TY(inner)));
+        EXPR(addrof).unary = inner;
+        EXPR_TOKEN(addrof) = op_position;
         return addrof;
     }
     case TOK_TILDE: {
         advance(p);
-        Expr* inner = parse_unary(p);
-        if_unlikely (!ty_is_integer(inner->ty)) {
+        ExprIndex inner = parse_unary(p);
+        if_unlikely (!ty_is_integer(EXPR_TY(inner))) {
             error_at_expr(p, inner, REPORT_ERROR, 
-                "type %s is not an integer", ty_name(inner->ty));
+                "type %s is not an integer", ty_name(EXPR_TY(inner)));
         }
-        if (inner->kind == EXPR_LITERAL) {
-            inner->literal = ~inner->literal; // reuse this expr
+        if (EXPR_KIND(inner) == EXPR_LITERAL) {
+            EXPR(inner).literal = const_normalize(~EXPR(inner).literal, EXPR_TY(inner)); // reuse this expr
             return inner;
         } else {
-            Expr* not = new_expr(p, EXPR_NOT, inner->ty, unary);
-            not->unary = inner;
-            not->token_index = op_position;
+            ExprIndex not = new_expr(p, EXPR_NOT, EXPR_TY(inner));
+            EXPR(not).unary = inner;
+            EXPR_TOKEN(not) = op_position;
             return not;
         }
     }
     case TOK_MINUS: {
         advance(p);
-        Expr* inner = parse_unary(p);
-        if_unlikely (!ty_is_integer(inner->ty)) {
+        ExprIndex inner = parse_unary(p);
+        if_unlikely (!ty_is_integer(EXPR_TY(inner))) {
             error_at_expr(p, inner, REPORT_ERROR, 
-                "type %s is not an integer", ty_name(inner->ty));
+                "type %s is not an integer", ty_name(EXPR_TY(inner)));
         }
-        if (inner->kind == EXPR_LITERAL) {
-            inner->literal = -inner->literal; // reuse this expr
+        if (EXPR_KIND(inner) == EXPR_LITERAL) {
+            EXPR(inner).literal = const_normalize(-EXPR(inner).literal, EXPR_TY(inner)); // reuse this expr
             return inner;
         } else {
-            Expr* not = new_expr(p, EXPR_NEG, inner->ty, unary);
-            not->unary = inner;
-            not->token_index = op_position;
+            ExprIndex not = new_expr(p, EXPR_NEG, EXPR_TY(inner));
+            EXPR(not).unary = inner;
+            EXPR_TOKEN(not) = op_position;
             return not;
         }
     }
     case TOK_KW_NOT: {
         advance(p);
-        Expr* inner = parse_unary(p);
-        if_unlikely (!ty_is_scalar(inner->ty)) {
+        ExprIndex inner = parse_unary(p);
+        if_unlikely (!ty_is_scalar(EXPR_TY(inner))) {
             error_at_expr(p, inner, REPORT_ERROR, 
-                "type %s is not scalar", ty_name(inner->ty));
+                "type %s is not scalar", ty_name(EXPR_TY(inner)));
         }
-        if (inner->kind == EXPR_LITERAL) {
-            inner->literal = !inner->literal; // reuse this expr
+        if (EXPR_KIND(inner) == EXPR_LITERAL) {
+            EXPR(inner).literal = !EXPR(inner).literal; // reuse this expr
             return inner;
         } else {
-            Expr* not = new_expr(p, EXPR_BOOL_NOT, inner->ty, unary);
-            not->unary = inner;
-            not->token_index = op_position;
+            ExprIndex not = new_expr(p, EXPR_BOOL_NOT, EXPR_TY(inner));
+            EXPR(not).unary = inner;
+            EXPR_TOKEN(not) = op_position;
             return not;
         }
     }
     case TOK_KW_CAST: {
         advance(p);
-        Expr* inner = parse_expr(p);
+        ExprIndex inner = parse_expr(p);
         expect(p, TOK_KW_TO);
         advance(p);
         TyIndex to_ty = parse_type(p, false);
 
-        if_unlikely(!ty_can_cast(to_ty, inner->ty, inner->kind == EXPR_LITERAL)) {
+        if_unlikely(!ty_can_cast(to_ty, EXPR_TY(inner), EXPR_KIND(inner) == EXPR_LITERAL)) {
             error_at_expr(p, inner, REPORT_ERROR, 
-                "type %s cannot cast to %s", ty_name(inner->ty), ty_name(to_ty));
+                "type %s cannot cast to %s", ty_name(EXPR_TY(inner)), ty_name(to_ty));
         }
 
-        if (inner->kind == EXPR_LITERAL) {
-            inner->ty = to_ty;
+        if (EXPR_KIND(inner) == EXPR_LITERAL) {
+            EXPR_TY(inner) = to_ty;
+            EXPR(inner).literal = const_normalize(EXPR(inner).literal, to_ty);
             return inner;
         }
 
-        Expr* cast = new_expr(p, EXPR_CAST, to_ty, unary);
-        cast->unary = inner;
+        ExprIndex cast = new_expr(p, EXPR_CAST, to_ty);
+        EXPR(cast).unary = inner;
         return cast;
     }
     default:
@@ -1525,16 +2118,21 @@ static ExprKind binary_expr_kind(u8 tok_kind) {
         return EXPR_ROR;
     }
 
-    return tok_kind - (TOK_PLUS + EXPR_ADD);
+    // ROR, AND and OR sit between the arithmetic and comparison
+    // kinds, the tokens don't have them there
+    if (TOK_EQ_EQ <= tok_kind && tok_kind <= TOK_GREATER) {
+        return EXPR_EQ + (tok_kind - TOK_EQ_EQ);
+    }
+    return EXPR_ADD + (tok_kind - TOK_PLUS);
 }
 
 static bool is_bool_op(ExprKind op_kind) {
     return op_kind == EXPR_BOOL_AND || op_kind == EXPR_BOOL_OR;
 }
 
-Expr* parse_binary(Parser* p, isize precedence) {
-    ArenaState save = arena_save(&p->arena);
-    Expr* lhs = parse_unary(p);
+ExprIndex parse_binary(Parser* p, isize precedence) {
+    AstState save = ast_save();
+    ExprIndex lhs = parse_unary(p);
     
     while (precedence < bin_precedence(p->current.kind)) {
         isize n_prec = bin_precedence(p->current.kind);
@@ -1542,112 +2140,45 @@ Expr* parse_binary(Parser* p, isize precedence) {
         u32 op_token_index = p->cursor;
         
         advance(p);
-        Expr* rhs = parse_binary(p, n_prec);
+        ExprIndex rhs = parse_binary(p, n_prec);
 
         TyIndex op_ty = target_uword;
         if (!is_bool_op(op_kind)) {
-            if_unlikely (!ty_compatible(lhs->ty, rhs->ty, rhs->kind == EXPR_LITERAL)) {
+            if_unlikely (!ty_compatible(EXPR_TY(lhs), EXPR_TY(rhs), EXPR_KIND(rhs) == EXPR_LITERAL)) {
                 parse_error(p, op_token_index, op_token_index, REPORT_ERROR, 
-                    "types %s and %s are not compatible", ty_name(lhs->ty), ty_name(rhs->ty));
+                    "types %s and %s are not compatible", ty_name(EXPR_TY(lhs)), ty_name(EXPR_TY(rhs)));
             }
             // parse_error(p, op_token_index, op_token_index, REPORT_NOTE, "yuh");
             // printf("is_bool ");
-            op_ty = lhs->ty;
+            op_ty = EXPR_TY(lhs);
         } else {
-            if_unlikely(!ty_is_scalar(lhs->ty)) {
+            if_unlikely(!ty_is_scalar(EXPR_TY(lhs))) {
                 parse_error(p, expr_leftmost_token(lhs), expr_rightmost_token(lhs), REPORT_ERROR, 
-                    "type %s is not scalar", ty_name(lhs->ty));
+                    "type %s is not scalar", ty_name(EXPR_TY(lhs)));
             }
-            if_unlikely(!ty_is_scalar(rhs->ty)) {
+            if_unlikely(!ty_is_scalar(EXPR_TY(rhs))) {
                 parse_error(p, expr_leftmost_token(rhs), expr_rightmost_token(rhs), REPORT_ERROR, 
-                    "type %s is not scalar", ty_name(rhs->ty));
+                    "type %s is not scalar", ty_name(EXPR_TY(rhs)));
             }
         }
 
-        if (lhs->kind == EXPR_LITERAL && rhs->ty != EXPR_LITERAL) {
-            op_ty = rhs->ty;
+        if (EXPR_KIND(lhs) == EXPR_LITERAL && EXPR_KIND(rhs) != EXPR_LITERAL) {
+            op_ty = EXPR_TY(rhs);
         }
         
-        if (lhs->kind == EXPR_LITERAL && rhs->kind == EXPR_LITERAL) {
-            bool signed_op = ty_is_signed(lhs->ty) || ty_is_signed(rhs->ty);
-            u64 lhs_val = lhs->literal;
-            u64 rhs_val = rhs->literal;
+        if (EXPR_KIND(lhs) == EXPR_LITERAL && EXPR_KIND(rhs) == EXPR_LITERAL) {
+            u64 value = const_fold_binary(p, op_kind, op_ty, EXPR(lhs).literal, EXPR(rhs).literal, op_token_index);
             u32 leftmost = expr_leftmost_token(lhs);
 
-            arena_restore(&p->arena, save);
-            Expr* lit = new_expr(p, EXPR_LITERAL, op_ty, literal);
-            lit->token_index = leftmost;
-            
-            switch (op_kind) {
-            case EXPR_ADD: lit->literal = lhs_val + rhs_val; break;
-            case EXPR_SUB: lit->literal = lhs_val - rhs_val; break;
-            case EXPR_MUL: lit->literal = lhs_val * rhs_val; break;
-            case EXPR_DIV: 
-                if (signed_op) {
-                    lit->literal = (isize)lhs_val / (isize)rhs_val;
-                } else {
-                    lit->literal = lhs_val / rhs_val;
-                }
-                break;
-            case EXPR_REM: 
-                if (signed_op) {
-                    lit->literal = (isize)lhs_val % (isize)rhs_val;
-                } else {
-                    lit->literal = lhs_val % rhs_val;
-                }
-                break;
-            case EXPR_AND: lit->literal = lhs_val & rhs_val; break;
-            case EXPR_OR:  lit->literal = lhs_val | rhs_val; break;
-            case EXPR_XOR: lit->literal = lhs_val ^ rhs_val; break;
-            case EXPR_LSH: lit->literal = lhs_val << rhs_val; break;
-            case EXPR_RSH:
-                if (signed_op) {
-                    lit->literal = (isize)lhs_val >> (isize)rhs_val;
-                } else {
-                    lit->literal = lhs_val >> rhs_val;
-                }
-                break;
-            case EXPR_ROR: lit->literal = (lhs_val >> rhs_val) 
-                                        | (lhs_val << (ty_size(target_uword) * 8 - rhs_val)); // 💀
-                break;
-            case EXPR_EQ:  lit->literal = lhs_val == rhs_val; break;
-            case EXPR_NEQ: lit->literal = lhs_val != rhs_val; break;
-            case EXPR_LESS_EQ:
-                if (signed_op) {
-                    lit->literal = (isize)lhs_val <= (isize)rhs_val;
-                } else {
-                    lit->literal = lhs_val <= rhs_val;
-                }
-                break;
-            case EXPR_GREATER_EQ:
-                if (signed_op) {
-                    lit->literal = (isize)lhs_val >= (isize)rhs_val;
-                } else {
-                    lit->literal = lhs_val >= rhs_val;
-                }
-                break;
-            case EXPR_LESS:
-                if (signed_op) {
-                    lit->literal = (isize)lhs_val < (isize)rhs_val;
-                } else {
-                    lit->literal = lhs_val < rhs_val;
-                }
-                break;
-            case EXPR_GREATER:
-                if (signed_op) {
-                    lit->literal = (isize)lhs_val > (isize)rhs_val;
-                } else {
-                    lit->literal = lhs_val > rhs_val;
-                }
-                break;
-            default:
-                UNREACHABLE;
-            }
+            ast_restore(save);
+            ExprIndex lit = new_expr(p, EXPR_LITERAL, op_ty);
+            EXPR_TOKEN(lit) = leftmost;
+            EXPR(lit).literal = value;
             lhs = lit;
         } else {
-            Expr* op = new_expr(p, op_kind, op_ty, binary); 
-            op->binary.lhs = lhs;
-            op->binary.rhs = rhs;
+            ExprIndex op = new_expr(p, op_kind, op_ty); 
+            EXPR(op).binary.lhs = lhs;
+            EXPR(op).binary.rhs = rhs;
             lhs = op;
         }
     }
@@ -1655,19 +2186,19 @@ Expr* parse_binary(Parser* p, isize precedence) {
     return lhs;
 }
 
-Expr* parse_expr(Parser* p) {
+ExprIndex parse_expr(Parser* p) {
     return parse_binary(p, 0);
 }
 
-#define new_stmt(p, kind, field) \
-    new_stmt_(p, kind, offsetof(Stmt, extra) + sizeof(((Stmt*)nullptr)->field))
-
-static Stmt* new_stmt_(Parser* p, u8 kind, usize size) {
-    Stmt* stmt = arena_alloc(&p->arena, size, alignof(Stmt));
-    memset(stmt, 0, size);
-    stmt->retkind = RETKIND_NO;
-    stmt->kind = kind;
-    stmt->token_index = p->cursor;
+static StmtIndex new_stmt(Parser* p, StmtKind kind) {
+    if_unlikely (ast.stmts.len == ast.stmts.cap) {
+        ast_grow_stmts();
+    }
+    StmtIndex stmt = ast.stmts.len++;
+    STMT_KIND(stmt) = kind;
+    STMT_RETKIND(stmt) = RETKIND_NO;
+    STMT_TOKEN(stmt) = p->cursor;
+    STMT(stmt) = (StmtData){0};
     return stmt;
 }
 
@@ -1677,38 +2208,43 @@ static Entity* get_or_create(Parser* p, string ident) {
         entity = new_entity(p, ident, ENTKIND_VAR);
     } else if (entity->storage != STORAGE_EXTERN) {
         parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "symbol already exists");
+    } else if (p->current_function != nullptr) {
+        // locals don't fill in EXTERN globals, they just shadow them.
+        // other threads might be reading the global one anyway.
+        entity = new_entity(p, ident, ENTKIND_VAR);
     }
     return entity;
 }
 
-static bool is_global_data(Expr* expr) {
-    switch (expr->kind) {
+static bool is_global_data(ExprIndex expr) {
+    switch (EXPR_KIND(expr)) {
     case EXPR_ENTITY:
         // should really just be 'true' but do the extra check, whatever
-        return expr->entity->storage != STORAGE_LOCAL && expr->entity->storage != STORAGE_OUT_PARAM;
+        return EXPR(expr).entity->storage != STORAGE_LOCAL && EXPR(expr).entity->storage != STORAGE_OUT_PARAM;
     case EXPR_MEMBER:
-        return is_global_data(expr->member_access.aggregate);
+        return is_global_data(EXPR(expr).member_access.aggregate);
     default:
         return false;
     }
 }
 
-static void ensure_linktime_const(Parser* p, Expr* expr) {
-    switch (expr->kind) {
+static void ensure_linktime_const(Parser* p, ExprIndex expr) {
+    switch (EXPR_KIND(expr)) {
     case EXPR_LITERAL:
+    case EXPR_BLOB_LITERAL:
         return;
     case EXPR_ADDROF:
-        if_unlikely (!is_global_data(expr->unary)) {
+        if_unlikely (!is_global_data(EXPR(expr).unary)) {
             break;
         }
         return;
     case EXPR_COMPOUND_LITERAL:
-        for_n(i, 0, expr->compound_lit.len) {
-            ensure_linktime_const(p, expr->compound_lit.values[i]);
+        for_n(i, 0, EXPR(expr).compound_lit.len) {
+            ensure_linktime_const(p, EXTRA(EXPR(expr).compound_lit.values + i));
         }
         return;
     case EXPR_INDEXED_ITEM:
-        ensure_linktime_const(p, expr->indexed_item.value);
+        ensure_linktime_const(p, EXPR(expr).indexed_item.value);
         return;
     default:
         break;
@@ -1716,16 +2252,211 @@ static void ensure_linktime_const(Parser* p, Expr* expr) {
     error_at_expr(p, expr, REPORT_ERROR, "expression is not link-time constant");
 }
 
-Expr* parse_initializer(Parser* p, TyIndex ty);
+ExprIndex parse_initializer(Parser* p, TyIndex ty);
+
+// [ expr ] = initializer
+static u32 parse_array_index(Parser* p, u32 array_len) {
+    expect(p, TOK_OPEN_BRACKET);
+    advance(p);
+    ExprIndex expr = parse_expr(p);
+    expect(p, TOK_CLOSE_BRACKET);
+    advance(p);
+    expect(p, TOK_EQ);
+    advance(p);
+
+    if_unlikely (EXPR_KIND(expr) != EXPR_LITERAL || !ty_is_integer(EXPR_TY(expr))) {
+        error_at_expr(p, expr, REPORT_ERROR, "index must be a compile-time constant integer");
+    }
+    u32 index = EXPR(expr).literal;
+
+    if_unlikely (index >= array_len) {
+        error_at_expr(p, expr, REPORT_ERROR, "index (%u) must be less than array length (%u)", index, array_len);
+    }
+    return index;
+}
+
+static ExprIndex parse_array_value(Parser* p, TyIndex elem_ty, u32 index, u32 array_len) {
+    ExprIndex value = parse_initializer(p, elem_ty);
+    if_unlikely (!ty_compatible(elem_ty, EXPR_TY(value), EXPR_KIND(value) == EXPR_LITERAL)) {
+        error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to %s",
+            ty_name(EXPR_TY(value)), ty_name(elem_ty));
+    }
+
+    if_unlikely (index >= array_len) {
+        error_at_expr(p, value, REPORT_ERROR, "index (%u) must be less than array length (%u)", index, array_len);
+    }
+    return value;
+}
+
+// tables of literals are common and can be huge, so arrays of numbers and
+// pointers get their elements packed straight into bytes instead of a node
+// each. if something that isn't a literal shows up, or the indices go
+// backwards, we go back and parse it the normal way.
+
+// zeroes shorter than this between two literals stay in the bytes
+#define BLOB_MIN_ZEROES 16
+
+typedef struct {
+    u32 bytes;      // where the data starts in Ast.extra
+    u32 bytes_len;
+    u64 covered;    // how much of the array the runs describe so far
+    usize runs;     // {length, offset} pairs get built in dynbuf from here
+} BlobBuilder;
+
+static void blob_push_zeroes(u64 len) {
+    while (len != 0) {
+        u32 run = min(len, UINT32_MAX);
+        vec_append(&dynbuf, run);
+        vec_append(&dynbuf, BLOB_ZEROES);
+        len -= run;
+    }
+}
+
+static void blob_push(BlobBuilder* b, u64 offset, u64 value, usize size) {
+    // the gaps take care of zeroes
+    if (value == 0) {
+        return;
+    }
+
+    bool in_bytes = dynbuf.len != b->runs && dynbuf.at[dynbuf.len - 1] != BLOB_ZEROES;
+    u64 gap = offset - b->covered;
+    if (in_bytes && gap < BLOB_MIN_ZEROES) {
+        dynbuf.at[dynbuf.len - 2] += gap;
+        b->bytes_len += gap;
+    } else {
+        blob_push_zeroes(gap);
+        vec_append(&dynbuf, 0);
+        vec_append(&dynbuf, b->bytes_len);
+    }
+    dynbuf.at[dynbuf.len - 2] += size;
+
+    u32 words = (b->bytes_len + size + sizeof(u32) - 1) / sizeof(u32);
+    u32 have = ast.extra.len - b->bytes;
+    if (words > have) {
+        u32 more = extra_alloc(words - have);
+        memset(&EXTRA(more), 0, (words - have) * sizeof(u32));
+    }
+
+    // the target is little endian
+    u8* data = (u8*)&EXTRA(b->bytes);
+    for_n(i, 0, size) {
+        data[b->bytes_len + i] = (u8)(value >> (i * 8));
+    }
+    b->bytes_len += size;
+    b->covered = offset + size;
+}
+
+// going back over the initializer can't cross the end of a
+// paste that started before it, the scopes would get mixed up.
+static bool can_pack_initializer(Parser* p, u32 open_brace) {
+    i32 braces = 0;
+    i32 pastes = 0;
+    for (u32 i = open_brace;; i++) {
+        switch (p->tokens[i].kind) {
+        case TOK_OPEN_BRACE:
+            braces++;
+            break;
+        case TOK_CLOSE_BRACE:
+            if (--braces == 0) {
+                return true;
+            }
+            break;
+        case TOK_PREPROC_MACRO_PASTE:
+        case TOK_PREPROC_DEFINE_PASTE:
+            pastes++;
+            break;
+        case TOK_PREPROC_PASTE_END:
+            if (--pastes < 0) {
+                return false;
+            }
+            break;
+        case TOK_EOF:
+            return false;
+        default:
+            break;
+        }
+    }
+}
+
+// returns EXPR_NONE and leaves everything as it was if it can't be packed
+static ExprIndex parse_packed_array_initializer(Parser* p, TyIndex array_ty, u32 init_start_token) {
+    u32 start = p->cursor;
+    ParseScope* scope = p->current_scope;
+    AstState save = ast_save();
+
+    TyIndex elem_ty = TY(array_ty, TyArray)->to;
+    u32 array_len = TY(array_ty, TyArray)->len;
+    usize elem_size = ty_size(ty_unwrap_alias(elem_ty));
+
+    BlobBuilder b = {
+        .bytes = ast.extra.len,
+        .runs = dynbuf_start(),
+    };
+
+    u32 index = 0;
+    while (!match(p, TOK_CLOSE_BRACE)) {
+        // the data has to stay in one piece, so drop the nodes as we go
+        AstState elem_save = ast_save();
+
+        if (match(p, TOK_OPEN_BRACKET)) {
+            u32 next = index;
+            index = parse_array_index(p, array_len);
+            if (index < next) {
+                goto give_up;
+            }
+        }
+
+        ExprIndex value = parse_array_value(p, elem_ty, index, array_len);
+        if (EXPR_KIND(value) != EXPR_LITERAL) {
+            goto give_up;
+        }
+        u64 literal = EXPR(value).literal;
+        ast_restore(elem_save);
+        blob_push(&b, (u64)index * elem_size, literal, elem_size);
 
-Expr* parse_array_initializer(Parser* p, TyIndex array_ty) {
+        index++;
+
+        if_likely (match(p, TOK_COMMA)) {
+            advance(p);
+            continue;
+        } else {
+            break;
+        }
+    }
+    expect(p, TOK_CLOSE_BRACE);
+    advance(p);
+
+    blob_push_zeroes((u64)array_len * elem_size - b.covered);
+
+    u32 runs_len = dynbuf_len(b.runs) / 2;
+    u32 runs = extra_alloc(1 + runs_len * 2);
+    EXTRA(runs) = runs_len;
+    memcpy(&EXTRA(runs + 1), &dynbuf.at[b.runs], runs_len * 2 * sizeof(u32));
+    dynbuf_restore(b.runs);
+
+    ExprIndex packed = new_expr(p, EXPR_BLOB_LITERAL, array_ty);
+    EXPR(packed).blob.bytes = b.bytes;
+    EXPR(packed).blob.runs = runs;
+    EXPR_TOKEN(packed) = init_start_token;
+    return packed;
+
+give_up:
+    dynbuf_restore(b.runs);
+    ast_restore(save);
+    p->current_scope = scope;
+    p->cursor = start;
+    p->current = p->tokens[p->cursor];
+    return EXPR_NONE;
+}
+
+ExprIndex parse_array_initializer(Parser* p, TyIndex array_ty) {
     u32 init_start_token = p->cursor;
 
     expect(p, TOK_OPEN_BRACE);
     advance(p);
     if_unlikely (match(p, TOK_CLOSE_BRACE)) {
-        Expr* empty = new_expr(p, EXPR_EMPTY_COMPOUND_LITERAL, array_ty, nothing);
-        empty->token_index = p->cursor;
+        ExprIndex empty = new_expr(p, EXPR_EMPTY_COMPOUND_LITERAL, array_ty);
+        EXPR_TOKEN(empty) = p->cursor;
         advance(p);
         return empty;
     }
@@ -1733,6 +2464,13 @@ Expr* parse_array_initializer(Parser* p, TyIndex array_ty) {
     TyIndex elem_ty = TY(array_ty, TyArray)->to;
     u32 array_len = TY(array_ty, TyArray)->len;
 
+    if (ty_is_scalar(elem_ty) && can_pack_initializer(p, init_start_token)) {
+        ExprIndex packed = parse_packed_array_initializer(p, array_ty, init_start_token);
+        if (packed != EXPR_NONE) {
+            return packed;
+        }
+    }
+
     u32 exprs_start = dynbuf_start();
     u32 exprs_len = 0;
 
@@ -1741,44 +2479,16 @@ Expr* parse_array_initializer(Parser* p, TyIndex array_ty) {
 
     u32 index = 0;
     while (!match(p, TOK_CLOSE_BRACE)) {
-
         if (match(p, TOK_OPEN_BRACKET)) {
-            advance(p);
-            Expr* expr = parse_expr(p);
-            expect(p, TOK_CLOSE_BRACKET);
-            advance(p);
-            expect(p, TOK_EQ);
-            advance(p);
-
-            if_unlikely (expr->kind != EXPR_LITERAL || !ty_is_integer(expr->ty)) {
-                error_at_expr(p, expr, REPORT_ERROR, "index must be a compile-time constant integer");
-            }
-            index = expr->literal;
+            index = parse_array_index(p, array_len);
+            ExprIndex value = parse_array_value(p, elem_ty, index, array_len);
 
-            if_unlikely (index >= array_len) {
-                error_at_expr(p, expr, REPORT_ERROR, "index (%u) must be less than array length (%u)", index, array_len);
-            }
-
-            Expr* value = parse_initializer(p, elem_ty);
-            if_unlikely (!ty_compatible(elem_ty, value->ty, value->kind == EXPR_LITERAL)) {
-                error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to %s",
-                    ty_name(value->ty), ty_name(elem_ty));
-            }
-
-            Expr* item = new_expr(p, EXPR_INDEXED_ITEM, elem_ty, indexed_item);
-            item->indexed_item.index = index;
-            item->indexed_item.value = value;
+            ExprIndex item = new_expr(p, EXPR_INDEXED_ITEM, elem_ty);
+            EXPR(item).indexed_item.index = index;
+            EXPR(item).indexed_item.value = value;
             vec_append(&dynbuf, item);
         } else {
-            Expr* value = parse_initializer(p, elem_ty);
-            if_unlikely (!ty_compatible(elem_ty, value->ty, value->kind == EXPR_LITERAL)) {
-                error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to %s",
-                    ty_name(value->ty), ty_name(elem_ty));
-            }
-
-            if_unlikely (index >= array_len) {
-                error_at_expr(p, value, REPORT_ERROR, "index (%u) must be less than array length (%u)", index, array_len);
-            }
+            ExprIndex value = parse_array_value(p, elem_ty, index, array_len);
             vec_append(&dynbuf, value);
         }
 
@@ -1796,27 +2506,26 @@ Expr* parse_array_initializer(Parser* p, TyIndex array_ty) {
     advance(p);
 
 
-    Expr** exprs = (Expr**)dynbuf_to_arena(p, exprs_start);
+    u32 exprs = dynbuf_to_extra(exprs_start);
 
-    Expr* array_init = new_expr(p, EXPR_COMPOUND_LITERAL, array_ty, compound_lit);
-    array_init->compound_lit.len = exprs_len;
-    array_init->compound_lit.values = exprs;
-    array_init->token_index = init_start_token;
+    ExprIndex array_init = new_expr(p, EXPR_COMPOUND_LITERAL, array_ty);
+    EXPR(array_init).compound_lit.len = exprs_len;
+    EXPR(array_init).compound_lit.values = exprs;
+    EXPR_TOKEN(array_init) = init_start_token;
 
     dynbuf_restore(exprs_start);
 
     return array_init;
 }
 
-
-Expr* parse_record_initializer(Parser* p, TyIndex record_ty) {
+ExprIndex parse_record_initializer(Parser* p, TyIndex record_ty) {
     u32 init_start_token = p->cursor;
 
     expect(p, TOK_OPEN_BRACE);
     advance(p);
     if_unlikely (match(p, TOK_CLOSE_BRACE)) {
-        Expr* empty = new_expr(p, EXPR_EMPTY_COMPOUND_LITERAL, record_ty, nothing);
-        empty->token_index = p->cursor;
+        ExprIndex empty = new_expr(p, EXPR_EMPTY_COMPOUND_LITERAL, record_ty);
+        EXPR_TOKEN(empty) = p->cursor;
         advance(p);
         return empty;
     }
@@ -1854,15 +2563,15 @@ Expr* parse_record_initializer(Parser* p, TyIndex record_ty) {
         expect(p, TOK_EQ);
         advance(p);
 
-        Expr* value = parse_initializer(p, member_ty);
-        if_unlikely (!ty_compatible(member_ty, value->ty, value->kind == EXPR_LITERAL)) {
+        ExprIndex value = parse_initializer(p, member_ty);
+        if_unlikely (!ty_compatible(member_ty, EXPR_TY(value), EXPR_KIND(value) == EXPR_LITERAL)) {
             error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to %s",
-                ty_name(value->ty), ty_name(member_ty));
+                ty_name(EXPR_TY(value)), ty_name(member_ty));
         }
 
-        Expr* item = new_expr(p, EXPR_INDEXED_ITEM, member_ty, indexed_item);
-        item->indexed_item.index = member_index;
-        item->indexed_item.value = value;
+        ExprIndex item = new_expr(p, EXPR_INDEXED_ITEM, member_ty);
+        EXPR(item).indexed_item.index = member_index;
+        EXPR(item).indexed_item.value = value;
         vec_append(&dynbuf, item);
 
         exprs_len++;
@@ -1878,19 +2587,19 @@ Expr* parse_record_initializer(Parser* p, TyIndex record_ty) {
     advance(p);
 
 
-    Expr** exprs = (Expr**)dynbuf_to_arena(p, exprs_start);
+    u32 exprs = dynbuf_to_extra(exprs_start);
 
-    Expr* array_init = new_expr(p, EXPR_COMPOUND_LITERAL, record_ty, compound_lit);
-    array_init->compound_lit.len = exprs_len;
-    array_init->compound_lit.values = exprs;
-    array_init->token_index = init_start_token;
+    ExprIndex array_init = new_expr(p, EXPR_COMPOUND_LITERAL, record_ty);
+    EXPR(array_init).compound_lit.len = exprs_len;
+    EXPR(array_init).compound_lit.values = exprs;
+    EXPR_TOKEN(array_init) = init_start_token;
 
     dynbuf_restore(exprs_start);
 
     return array_init;
 }
 
-Expr* parse_initializer(Parser* p, TyIndex ty) {
+ExprIndex parse_initializer(Parser* p, TyIndex ty) {
     switch (TY_KIND(ty)) {
     case TY_ARRAY:
         return parse_array_initializer(p, ty);
@@ -1902,14 +2611,24 @@ Expr* parse_initializer(Parser* p, TyIndex ty) {
     }
 }
 
-Stmt* parse_var_decl(Parser* p, StorageKind storage) {
-    Stmt* decl = new_stmt(p, STMT_VAR_DECL, var_decl);
+// point at where an entity was declared. ones that came from a
+// precompiled header weren't declared anywhere in this unit.
+static void note_decl(Parser* p, Entity* entity, const char* msg) {
+    if (entity->decl == STMT_NONE) {
+        return;
+    }
+    u32 at = STMT_TOKEN(entity->decl);
+    parse_error(p, at, at, REPORT_NOTE, msg);
+}
+
+StmtIndex parse_var_decl(Parser* p, StorageKind storage) {
+    StmtIndex decl = new_stmt(p, STMT_VAR_DECL);
     
     string identifier = tok_span(p->current);
     Entity* var = get_or_create(p, identifier);
-    decl->var_decl.var = var;
+    STMT(decl).var_decl.var = var;
     // if (var->storage == STORAGE_EXTERN && storage == STORAGE_PRIVATE) {
-    //         parse_error(p, var->decl->token_index, var->decl->token_index, REPORT_NOTE, "previous EXTERN declaration");
+    //         parse_error(p, STMT_TOKEN(var->decl), STMT_TOKEN(var->decl), REPORT_NOTE, "previous EXTERN declaration");
     //     parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "previously EXTERN variable cannot be PRIVATE");
     // }
 
@@ -1921,7 +2640,7 @@ Stmt* parse_var_decl(Parser* p, StorageKind storage) {
         u32 type_start = p->cursor;
         TyIndex decl_ty = parse_type(p, false);
         if_unlikely (var->storage == STORAGE_EXTERN && !ty_equal(var->ty, decl_ty)) {
-            parse_error(p, var->decl->token_index, var->decl->token_index, REPORT_NOTE, "previous EXTERN declaration");
+            note_decl(p, var, "previous EXTERN declaration");
             parse_error(p, type_start, p->cursor - 1, REPORT_ERROR, "type %s differs from EXTERN type %s",
                 ty_name(decl_ty), ty_name(var->ty));
         }
@@ -1934,15 +2653,15 @@ Stmt* parse_var_decl(Parser* p, StorageKind storage) {
                 parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "EXTERN variable cannot have a value");
             }
             advance(p);
-            Expr* value = parse_initializer(p, var->ty);
-            decl->var_decl.expr = value;
-            if_unlikely (!ty_compatible(decl_ty, value->ty, value->kind == EXPR_LITERAL)) {
+            ExprIndex value = parse_initializer(p, var->ty);
+            STMT(decl).var_decl.expr = value;
+            if_unlikely (!ty_compatible(decl_ty, EXPR_TY(value), EXPR_KIND(value) == EXPR_LITERAL)) {
                 error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to %s",
-                    ty_name(value->ty), ty_name(decl_ty));
+                    ty_name(EXPR_TY(value)), ty_name(decl_ty));
             }
-            // if_unlikely (!ty_is_scalar(value->ty)) {
+            // if_unlikely (!ty_is_scalar(EXPR_TY(value))) {
             //     error_at_expr(p, value, REPORT_ERROR, "cannot use non-scalar type %s",
-            //         ty_name(value->ty));
+            //         ty_name(EXPR_TY(value)));
             // }
             // this is a global declaration
             if (storage != STORAGE_LOCAL) {
@@ -1954,16 +2673,16 @@ Stmt* parse_var_decl(Parser* p, StorageKind storage) {
             parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "EXTERN variable must specify a type");
         }
         advance(p);
-        Expr* value = parse_initializer(p, var->ty);
-        if_unlikely (var->storage == STORAGE_EXTERN && !ty_compatible(var->ty, value->ty, true)) {
+        ExprIndex value = parse_initializer(p, var->ty);
+        if_unlikely (var->storage == STORAGE_EXTERN && !ty_compatible(var->ty, EXPR_TY(value), true)) {
             // parse_error(p, type_start, p->cursor - 1, REPORT_NOTE, "from previous declaration");
             error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to EXTERN type %s",
-                    ty_name(value->ty), ty_name(var->ty));
+                    ty_name(EXPR_TY(value)), ty_name(var->ty));
         }
         
-        // if_unlikely (!ty_is_scalar(value->ty)) {
+        // if_unlikely (!ty_is_scalar(EXPR_TY(value))) {
         //     error_at_expr(p, value, REPORT_ERROR, "cannot use non-scalar type %s",
-        //         ty_name(value->ty));
+        //         ty_name(EXPR_TY(value)));
         // }
         // this is a global declaration
         if (storage != STORAGE_LOCAL) {
@@ -1973,9 +2692,9 @@ Stmt* parse_var_decl(Parser* p, StorageKind storage) {
             ensure_linktime_const(p, value);
         }
 
-        decl->var_decl.expr = value;
+        STMT(decl).var_decl.expr = value;
         if (var->storage != STORAGE_EXTERN) {
-            var->ty = value->ty;
+            var->ty = EXPR_TY(value);
         }
     }
 
@@ -1985,110 +2704,116 @@ Stmt* parse_var_decl(Parser* p, StorageKind storage) {
     return decl;
 }
 
-Stmt* parse_stmt_assign(Parser* p, u8 assign_kind, Expr* left_expr) {
-    Stmt* assign = new_stmt(p, assign_kind, assign);
-    assign->assign.lhs = left_expr;
+StmtIndex parse_stmt_assign(Parser* p, u8 assign_kind, ExprIndex left_expr) {
+    StmtIndex assign = new_stmt(p, assign_kind);
+    STMT(assign).assign.lhs = left_expr;
     if_unlikely (!is_lvalue(left_expr)) {
         error_at_expr(p, left_expr, REPORT_ERROR, "expression is not an l-value");
     }
 
     advance(p);
-    Expr* value = parse_expr(p);
-    if_unlikely (!ty_compatible(left_expr->ty, value->ty, value->kind == EXPR_LITERAL)) {
+    ExprIndex value = parse_expr(p);
+    if_unlikely (!ty_compatible(EXPR_TY(left_expr), EXPR_TY(value), EXPR_KIND(value) == EXPR_LITERAL)) {
         error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to %s",
-            ty_name(value->ty), ty_name(left_expr->ty));
+            ty_name(EXPR_TY(value)), ty_name(EXPR_TY(left_expr)));
     }
-    if_unlikely (!ty_is_scalar(value->ty)) {
+    if_unlikely (!ty_is_scalar(EXPR_TY(value))) {
         error_at_expr(p, value, REPORT_ERROR, "cannot use non-scalar type %s",
-            ty_name(value->ty));
+            ty_name(EXPR_TY(value)));
     }
-    assign->assign.rhs = value;
+    STMT(assign).assign.rhs = value;
     return assign;
 }
 
-Stmt* parse_stmt_expr(Parser* p) {
+StmtIndex parse_stmt_expr(Parser* p) {
     // expression! who fuckin knows
     u32 start = p->cursor;
-    Expr* expr = parse_expr(p);
+    ExprIndex expr = parse_expr(p);
     if (TOK_EQ <= p->current.kind && p->current.kind <= TOK_RSHIFT_EQ) {
         // assignment statement
-        return parse_stmt_assign(p, STMT_ASSIGN + TOK_EQ - p->current.kind, expr);
+        return parse_stmt_assign(p, STMT_ASSIGN + p->current.kind - TOK_EQ, expr);
     } else {
         // expression statement
-        if_unlikely (expr->kind != EXPR_CALL && expr->ty != TY_VOID) {
+        if_unlikely (EXPR_KIND(expr) != EXPR_CALL && EXPR_TY(expr) != TY_VOID) {
             error_at_expr(p, expr, REPORT_WARNING, "unused expression result");
         }
-        Stmt* stmt_expr = new_stmt(p, STMT_EXPR, expr);
-        stmt_expr->expr = expr;
-        stmt_expr->token_index = start;
-        if_likely(expr->kind == EXPR_CALL) {
+        StmtIndex stmt_expr = new_stmt(p, STMT_EXPR);
+        STMT(stmt_expr).expr = expr;
+        STMT_TOKEN(stmt_expr) = start;
+        if_likely(EXPR_KIND(expr) == EXPR_CALL) {
+            TyIndex callee_ty = EXPR_TY(EXTRA(EXPR(expr).call.args));
             TyFn* fn_ty;
-            if (TY_KIND(expr->call.callee->ty) == TY_PTR) {
-                fn_ty = TY(TY(expr->call.callee->ty, TyPtr)->to, TyFn);
+            if (TY_KIND(callee_ty) == TY_PTR) {
+                fn_ty = TY(TY(callee_ty, TyPtr)->to, TyFn);
             } else {
-                fn_ty = TY(expr->call.callee->ty, TyFn);
+                fn_ty = TY(callee_ty, TyFn);
             }
 
             if (fn_ty->is_noreturn) {
-                stmt_expr->retkind = RETKIND_YES;
+                STMT_RETKIND(stmt_expr) = RETKIND_YES;
             }
         }
         return stmt_expr;
     }
 }
 
-static StmtList parse_stmt_block(Parser* p) {
+static StmtList parse_stmt_block(Parser* p, ReturnKind* retkind_out) {
     u32 stmts_start = dynbuf_start();
     u32 stmts_len = 0;
     ReturnKind retkind = RETKIND_NO;
     while (!match(p, TOK_KW_END)) {
-        Stmt* stmt = parse_stmt(p);
-        if (stmt == nullptr) {
+        StmtIndex stmt = parse_stmt(p);
+        if (stmt == STMT_NONE) {
             continue;
         }
-        retkind = max(retkind, stmt->retkind);
+        retkind = max(retkind, STMT_RETKIND(stmt));
         vec_append(&dynbuf, stmt);
         stmts_len++;
     }
-    Stmt** stmts = (Stmt**)dynbuf_to_arena(p, stmts_start);
+    u32 stmts = dynbuf_to_extra(stmts_start);
     dynbuf_restore(stmts_start);
 
+    *retkind_out = retkind;
     return (StmtList){
         .stmts = stmts,
         .len = stmts_len,
-        .retkind = retkind,
     };
 }
 
-static Stmt* parse_do_stmt(Parser* p) {
+static StmtIndex parse_do_stmt(Parser* p) {
     expect(p, TOK_KW_DO);
-    Stmt* block = new_stmt(p, STMT_BLOCK, block);
+    StmtIndex block = new_stmt(p, STMT_BLOCK);
     advance(p);
 
     enter_scope(p);
-    block->block = parse_stmt_block(p);
+    ReturnKind retkind;
+    StmtList body = parse_stmt_block(p, &retkind);
+    STMT(block).block = body;
     advance(p);
 
     exit_scope(p);
     return block;
 }
 
-static Stmt* parse_while(Parser* p) {
-    Stmt* while_ = new_stmt(p, STMT_WHILE, while_);
+static StmtIndex parse_while(Parser* p) {
+    StmtIndex while_ = new_stmt(p, STMT_WHILE);
     advance(p);
-    Expr* cond = parse_expr(p);
+    ExprIndex cond = parse_expr(p);
 
-    if_unlikely (!ty_is_scalar(cond->ty)) {
+    if_unlikely (!ty_is_scalar(EXPR_TY(cond))) {
         error_at_expr(p, cond, REPORT_ERROR, "condition must be scalar");
     }
     expect(p, TOK_KW_DO);
     advance(p);
 
     enter_scope(p);
-    while_->while_.block = parse_stmt_block(p);
-    while_->retkind = while_->while_.block.retkind;
-    // if (cond->kind == EXPR_LITERAL && cond->literal) {
-    //     while_->retkind = RETKIND_YES;
+    ReturnKind retkind;
+    StmtList body = parse_stmt_block(p, &retkind);
+    STMT(while_).while_.cond = cond;
+    STMT(while_).while_.block = body;
+    STMT_RETKIND(while_) = retkind;
+    // if (EXPR_KIND(cond) == EXPR_LITERAL && EXPR(cond).literal) {
+    //     STMT_RETKIND(while_) = RETKIND_YES;
     // }
 
     advance(p);
@@ -2097,7 +2822,7 @@ static Stmt* parse_while(Parser* p) {
     return while_;
 }
 
-static StmtList parse_if_block_(Parser* p) {
+static StmtList parse_if_block_(Parser* p, ReturnKind* retkind_out) {
     u32 stmts_start = dynbuf_start();
     u32 stmts_len = 0;
     ReturnKind retkind = RETKIND_NO;
@@ -2108,52 +2833,55 @@ static StmtList parse_if_block_(Parser* p) {
         case TOK_KW_ELSEIF:
             goto end;
         }
-        Stmt* stmt = parse_stmt(p);
-        if (stmt == nullptr) {
+        StmtIndex stmt = parse_stmt(p);
+        if (stmt == STMT_NONE) {
             continue;
         }
-        retkind = max(retkind, stmt->retkind);
+        retkind = max(retkind, STMT_RETKIND(stmt));
         vec_append(&dynbuf, stmt);
         stmts_len++;
     }
     end:
     ;
-    Stmt** stmts = (Stmt**)dynbuf_to_arena(p, stmts_start);
+    u32 stmts = dynbuf_to_extra(stmts_start);
     dynbuf_restore(stmts_start);
 
+    *retkind_out = retkind;
     return (StmtList){
         .stmts = stmts,
         .len = stmts_len,
-        .retkind = retkind,
     };
 }
 
-Stmt* parse_stmt_if(Parser* p) {
-    Stmt* if_ = new_stmt(p, STMT_IF, if_);
+StmtIndex parse_stmt_if(Parser* p) {
+    StmtIndex if_ = new_stmt(p, STMT_IF);
     advance(p);
 
-    Expr* cond = parse_expr(p);
-    if_unlikely (!ty_is_scalar(cond->ty)) {
+    ExprIndex cond = parse_expr(p);
+    if_unlikely (!ty_is_scalar(EXPR_TY(cond))) {
         error_at_expr(p, cond, REPORT_ERROR, "condition must be scalar");
     }
-    if_->if_.cond = cond;
+    STMT(if_).if_.cond = cond;
     expect(p, TOK_KW_THEN);
     advance(p);
     enter_scope(p);
-    StmtList if_true = parse_if_block_(p);
+    ReturnKind if_true_retkind;
+    StmtList if_true = parse_if_block_(p, &if_true_retkind);
     exit_scope(p);
-    if_->if_.block = if_true;
-    // if_->retkind = if_true.retkind;
-    Stmt* if_false = nullptr;
+    STMT(if_).if_.block = if_true;
+    // STMT_RETKIND(if_) = if_true_retkind;
+    StmtIndex if_false = STMT_NONE;
     switch (p->current.kind) {
     case TOK_KW_END:
         advance(p);
         break;
     case TOK_KW_ELSE:
-        if_false = new_stmt(p, STMT_BLOCK, block);
+        if_false = new_stmt(p, STMT_BLOCK);
         advance(p);
-        if_false->block = parse_stmt_block(p);
-        if_false->retkind = if_false->block.retkind;
+        ReturnKind if_false_retkind;
+        StmtList if_false_body = parse_stmt_block(p, &if_false_retkind);
+        STMT(if_false).block = if_false_body;
+        STMT_RETKIND(if_false) = if_false_retkind;
         advance(p);
         break;
     case TOK_KW_ELSEIF:
@@ -2161,18 +2889,18 @@ Stmt* parse_stmt_if(Parser* p) {
         break;
     }
     
-    if (if_true.retkind == RETKIND_YES && if_false && if_false->retkind == RETKIND_YES) {
-        if_->retkind = RETKIND_YES;
-    } else if (if_true.retkind == RETKIND_MAYBE || (if_false && if_false->retkind == RETKIND_MAYBE)) {
-        if_->retkind = RETKIND_MAYBE;
+    if (if_true_retkind == RETKIND_YES && if_false && STMT_RETKIND(if_false) == RETKIND_YES) {
+        STMT_RETKIND(if_) = RETKIND_YES;
+    } else if (if_true_retkind == RETKIND_MAYBE || (if_false && STMT_RETKIND(if_false) == RETKIND_MAYBE)) {
+        STMT_RETKIND(if_) = RETKIND_MAYBE;
     } else {
-        if_->retkind = RETKIND_NO;
+        STMT_RETKIND(if_) = RETKIND_NO;
     }
-    if_->if_.else_ = if_false;
+    STMT(if_).if_.else_ = if_false;
     return if_;
 }
 
-Stmt* parse_stmt(Parser* p) {
+StmtIndex parse_stmt(Parser* p) {
     switch (p->current.kind) {
     case TOK_KW_LEAVE: {
         TyFn* current_fn = TY(p->current_function->ty, TyFn);
@@ -2183,15 +2911,15 @@ Stmt* parse_stmt(Parser* p) {
         if (current_fn->is_noreturn) {
             parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "cannot LEAVE from NORETURN function");
         }
-        Stmt* leave = new_stmt(p, STMT_LEAVE, nothing);
-        leave->retkind = RETKIND_YES;
+        StmtIndex leave = new_stmt(p, STMT_LEAVE);
+        STMT_RETKIND(leave) = RETKIND_YES;
         advance(p);
         return leave;
     }
     case TOK_KW_RETURN: {
         TyFn* current_fn = TY(p->current_function->ty, TyFn);
         TyIndex ret_ty = current_fn->ret_ty;
-        Stmt* return_ = new_stmt(p, STMT_RETURN, expr);
+        StmtIndex return_ = new_stmt(p, STMT_RETURN);
         if (current_fn->is_noreturn) {
             parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "cannot RETURN from NORETURN function");
         }
@@ -2205,28 +2933,29 @@ Stmt* parse_stmt(Parser* p) {
             advance(p);
         } else {
             advance(p);
-            return_->expr = parse_expr(p);
-            if (!ty_compatible(ret_ty, return_->expr->ty, return_->expr->kind == EXPR_LITERAL)) {
-                error_at_expr(p, return_->expr, REPORT_ERROR, "type %s cannot coerce to %s",
-                    ty_name(return_->expr->ty), ty_name(ret_ty));
+            ExprIndex value = parse_expr(p);
+            STMT(return_).expr = value;
+            if (!ty_compatible(ret_ty, EXPR_TY(value), EXPR_KIND(value) == EXPR_LITERAL)) {
+                error_at_expr(p, value, REPORT_ERROR, "type %s cannot coerce to %s",
+                    ty_name(EXPR_TY(value)), ty_name(ret_ty));
             }
         }
-        return_->retkind = RETKIND_YES;
+        STMT_RETKIND(return_) = RETKIND_YES;
         return return_;
     }
     case TOK_KW_UNREACHABLE:
-        Stmt* unreachable_ = new_stmt(p, STMT_UNREACHABLE, nothing);
-        unreachable_->retkind = RETKIND_YES;
+        StmtIndex unreachable_ = new_stmt(p, STMT_UNREACHABLE);
+        STMT_RETKIND(unreachable_) = RETKIND_YES;
         advance(p);
         return unreachable_;
     case TOK_KW_BREAK:
-        Stmt* continue_ = new_stmt(p, STMT_CONTINUE, nothing);
+        StmtIndex break_ = new_stmt(p, STMT_BREAK);
         advance(p);
-        return continue_;
+        return break_;
     case TOK_KW_CONTINUE:
-        Stmt* break_ = new_stmt(p, STMT_BREAK, nothing);
+        StmtIndex continue_ = new_stmt(p, STMT_CONTINUE);
         advance(p);
-        return break_;
+        return continue_;
     case TOK_IDENTIFIER:
         if (peek(p, 1).kind == TOK_COLON) {
             return parse_var_decl(p, STORAGE_LOCAL);
@@ -2236,7 +2965,7 @@ Stmt* parse_stmt(Parser* p) {
         break;
     case TOK_KW_NOTHING:
         advance(p);
-        return nullptr; // nothing
+        return STMT_NONE; // nothing
     case TOK_KW_IF:
         return parse_stmt_if(p);
     case TOK_KW_WHILE:
@@ -2264,7 +2993,7 @@ Stmt* parse_stmt(Parser* p) {
     default:
         return parse_stmt_expr(p);
     }
-    return nullptr;
+    return STMT_NONE;
 }
 
 Entity* get_incomplete_type_entity(Parser* p, string identifier) {
@@ -2401,18 +3130,160 @@ TyIndex parse_fn_prototype(Parser* p) {
     fn->variadic = is_variadic;
     fn->is_noreturn = is_noreturn;
     fn->ret_ty = ret_ty;
+    fn->name = (CompactString){};
     memcpy(fn->params, params, sizeof(Ty_FnParam) * params_len);
 
     arena_restore(&p->arena, a_save);
-    return proto;
+    return ty_intern(proto);
 }
 
-Stmt* parse_fn_decl(Parser* p, u8 storage) {
+// function bodies get skipped over on the first pass through a unit and
+// parsed once every global declaration is in, see parse_deferred_bodies
+
+typedef struct {
+    Entity* fn;
+    StmtIndex decl;
+    u32 ident_pos;
+    u32 start; // first token of the body
+    u32 end;   // the END that closes it
+} DeferredBody;
+
+Vec_typedef(DeferredBody);
+static thread_local Vec(DeferredBody) deferred_bodies;
+
+// find the END that closes the function body starting at the current
+// token, without parsing anything. returns 0 if the body has to be
+// parsed in place instead, like when a macro paste straddles the END
+// or there's something in there the parser is going to complain about.
+static u32 skip_fn_body(Parser* p) {
+    u32 depth = 1;
+    u32 whiles = 0; // WHILEs still waiting on their DO
+    u32 pastes = 0;
+    for (u32 i = p->cursor;; i++) {
+        switch (p->tokens[i].kind) {
+        case TOK_EOF:
+            return 0;
+        case TOK_PREPROC_DEFINE_PASTE:
+        case TOK_PREPROC_MACRO_PASTE:
+            pastes++;
+            break;
+        case TOK_PREPROC_PASTE_END:
+            if (pastes == 0) {
+                return 0;
+            }
+            pastes--;
+            break;
+        case TOK_KW_IF:
+            depth++;
+            break;
+        case TOK_KW_WHILE:
+            depth++;
+            whiles++;
+            break;
+        case TOK_KW_DO:
+            if (whiles != 0) {
+                whiles--;
+            } else {
+                depth++;
+            }
+            break;
+        case TOK_KW_END:
+            depth--;
+            if (depth == 0) {
+                return pastes == 0 ? i : 0;
+            }
+            break;
+        case TOK_KW_FN:
+        case TOK_KW_STRUCT:
+        case TOK_KW_UNION:
+        case TOK_KW_ENUM:
+            return 0;
+        }
+    }
+}
+
+// parse a function's statements, starting at the first token after its
+// prototype. leaves the parser sitting on the END.
+static StmtList parse_fn_body(Parser* p, Entity* fn, u32 ident_pos) {
+    string identifier = from_compact(fn->name);
+    TyIndex decl_ty = fn->ty;
+
+    p->current_function = fn;
+
+    enter_scope(p);
+
+    // define parameters
+    TyFn* fn_type = TY(decl_ty, TyFn);
+    for_n(i, 0, fn_type->len - 1) {
+        Ty_FnParam* param = &fn_type->params[i];
+        Entity* param_entity = new_entity(p, from_compact(param->name), ENTKIND_VAR);
+        param_entity->ty = param->ty;
+        param_entity->storage = param->out ? STORAGE_OUT_PARAM : STORAGE_LOCAL;
+    }
+    if (fn_type->variadic) {
+        Ty_FnParam* param = &fn_type->params[fn_type->len - 1];
+        Entity* argv_entity = new_entity(p, from_compact(param->varargs.argv), ENTKIND_VAR);
+        argv_entity->ty = ty_get_ptr(TY_VOIDPTR);
+        argv_entity->storage = STORAGE_LOCAL;
+        Entity* argc_entity = new_entity(p, from_compact(param->varargs.argc), ENTKIND_VAR);
+        argc_entity->storage = STORAGE_LOCAL;
+        argc_entity->ty = target_uword;
+    } else if (fn_type->len != 0) {
+        Ty_FnParam* param = &fn_type->params[fn_type->len - 1];
+        Entity* param_entity = new_entity(p, from_compact(param->name), ENTKIND_VAR);
+        param_entity->ty = param->ty;
+        param_entity->storage = param->out ? STORAGE_OUT_PARAM : STORAGE_LOCAL;
+    }
+
+    u32 stmts_start = dynbuf_start();
+    u32 stmts_len = 0;
+    bool has_returned = false;
+    bool has_warned = false;
+    while (!match(p, TOK_KW_END)) {
+        StmtIndex stmt = parse_stmt(p);
+        if (stmt == STMT_NONE) {
+            continue;
+        }
+        if (has_returned && !has_warned && STMT_KIND(stmt) != STMT_UNREACHABLE) {
+            // parse_error(p, ident_pos, ident_pos, REPORT_NOTE, "in function '"str_fmt"'", str_arg(identifier));
+            parse_error(p, STMT_TOKEN(stmt), STMT_TOKEN(stmt), REPORT_WARNING, "dead code after control flow diverges");
+            has_warned = true;
+        }
+
+        if (STMT_RETKIND(stmt) == RETKIND_YES) {
+            has_returned = true;
+        }
+        vec_append(&dynbuf, stmt);
+        stmts_len++;
+    }
+    u32 stmts = dynbuf_to_extra(stmts_start);
+    dynbuf_restore(stmts_start);
+
+    if (!has_returned && fn_type->is_noreturn) {
+        parse_error(p, ident_pos, ident_pos, REPORT_NOTE, "in function '"str_fmt"'", str_arg(identifier));
+        parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "control might reach end of NORETURN function");
+    }
+
+    if (!has_returned && fn_type->ret_ty != TY_VOID) {
+        parse_error(p, ident_pos, ident_pos, REPORT_NOTE, "in function '"str_fmt"'", str_arg(identifier));
+        parse_error(p, p->cursor, p->cursor, REPORT_WARNING, "function may not return with defined value");
+    }
+
+    exit_scope(p);
+
+    p->current_function = nullptr;
+
+    return (StmtList){stmts, stmts_len};
+}
+
+
+
+StmtIndex parse_fn_decl(Parser* p, u8 storage) {
     // advance(p);
     advance(p);
 
     TyIndex fnptr_ty = TY__INVALID;
-    u32 fnptr_decl_loc = 0;
+    Entity* fnptr_entity = nullptr;
     if (match(p, TOK_OPEN_PAREN)) {
         advance(p);
         expect(p, TOK_IDENTIFIER);
@@ -2426,7 +3297,7 @@ Stmt* parse_fn_decl(Parser* p, u8 storage) {
         if (TY_KIND(fnptr_ty) != TY_FN) {
             parse_error(p, ty_loc, ty_loc, REPORT_ERROR, "provided type %s is not an FNPTR", ty_name(fnptr));
         }
-        fnptr_decl_loc = ty_entity->decl->token_index;
+        fnptr_entity = ty_entity;
         expect(p, TOK_CLOSE_PAREN);
         advance(p);
     }
@@ -2436,7 +3307,7 @@ Stmt* parse_fn_decl(Parser* p, u8 storage) {
     string identifier = tok_span(p->current);
     Entity* fn = get_or_create(p, identifier);
     // if (fn->storage == STORAGE_EXTERN && storage == STORAGE_PRIVATE) {
-    //     parse_error(p, fn->decl->token_index, fn->decl->token_index, REPORT_NOTE, "previous EXTERN declaration");
+    //     parse_error(p, STMT_TOKEN(fn->decl), STMT_TOKEN(fn->decl), REPORT_NOTE, "previous EXTERN declaration");
     //     parse_error(p, ident_pos, ident_pos, REPORT_ERROR, "previously EXTERN function cannot be PRIVATE");
     // }
     advance(p);
@@ -2445,11 +3316,11 @@ Stmt* parse_fn_decl(Parser* p, u8 storage) {
         fn->ty = decl_ty;
     }
     if (fn->storage == STORAGE_EXTERN && !ty_equal(fn->ty, decl_ty)) {
-        parse_error(p, fn->decl->token_index, fn->decl->token_index, REPORT_NOTE, "previous EXTERN declaration");
+        note_decl(p, fn, "previous EXTERN declaration");
         parse_error(p, ident_pos, ident_pos, REPORT_ERROR, "type differs from previous EXTERN type");
     }
     if (fnptr_ty != TY__INVALID && !ty_equal(fnptr_ty, decl_ty)) {
-        parse_error(p, fnptr_decl_loc, fnptr_decl_loc, REPORT_NOTE, "from FNPTR declaration");
+        note_decl(p, fnptr_entity, "from FNPTR declaration");
         parse_error(p, ident_pos, ident_pos, REPORT_ERROR, "type differs from provided FNPTR type");
     }
     if (fnptr_ty != TY__INVALID) {
@@ -2458,84 +3329,37 @@ Stmt* parse_fn_decl(Parser* p, u8 storage) {
 
     fn->ty = decl_ty;
     if (storage != STORAGE_EXTERN) {
-        Stmt* fn_decl = new_stmt(p, STMT_FN_DECL, fn_decl);
-        fn_decl->fn_decl.fn = fn;
+        StmtIndex fn_decl = new_stmt(p, STMT_FN_DECL);
+        STMT(fn_decl).fn_decl.fn = fn;
         fn->decl = fn_decl;
 
-        p->current_function = fn;
-
-        enter_scope(p);
-
-        // define parameters
-        TyFn* fn_type = TY(decl_ty, TyFn);
-        for_n(i, 0, fn_type->len - 1) {
-            Ty_FnParam* param = &fn_type->params[i];
-            Entity* param_entity = new_entity(p, from_compact(param->name), ENTKIND_VAR);
-            param_entity->ty = param->ty;
-            param_entity->storage = param->out ? STORAGE_OUT_PARAM : STORAGE_LOCAL;
-        }
-        if (fn_type->variadic) {
-            Ty_FnParam* param = &fn_type->params[fn_type->len - 1];
-            Entity* argv_entity = new_entity(p, from_compact(param->varargs.argv), ENTKIND_VAR);
-            argv_entity->ty = ty_get_ptr(TY_VOIDPTR);
-            argv_entity->storage = STORAGE_LOCAL;
-            Entity* argc_entity = new_entity(p, from_compact(param->varargs.argc), ENTKIND_VAR);
-            argc_entity->storage = STORAGE_LOCAL;
-            argc_entity->ty = target_uword;
-        } else if (fn_type->len != 0) {
-            Ty_FnParam* param = &fn_type->params[fn_type->len - 1];
-            Entity* param_entity = new_entity(p, from_compact(param->name), ENTKIND_VAR);
-            param_entity->ty = param->ty;
-            param_entity->storage = param->out ? STORAGE_OUT_PARAM : STORAGE_LOCAL;
-        }
-
-        u32 stmts_start = dynbuf_start();
-        u32 stmts_len = 0;
-        bool has_returned = false;
-        bool has_warned = false;
-        while (!match(p, TOK_KW_END)) {
-            Stmt* stmt = parse_stmt(p);
-            if (stmt == nullptr) {
-                continue;
-            }
-            if (has_returned && !has_warned && stmt->kind != STMT_UNREACHABLE) {
-                // parse_error(p, ident_pos, ident_pos, REPORT_NOTE, "in function '"str_fmt"'", str_arg(identifier));
-                parse_error(p, stmt->token_index, stmt->token_index, REPORT_WARNING, "dead code after control flow diverges");
-                has_warned = true;
-            }
-
-            if (stmt->retkind == RETKIND_YES) {
-                has_returned = true;
-            }
-            vec_append(&dynbuf, stmt);
-            stmts_len++;
-        }
-        Stmt** stmts = (Stmt**)dynbuf_to_arena(p, stmts_start);
-        dynbuf_restore(stmts_start);
+        DeferredBody deferred = {
+            .fn = fn,
+            .decl = fn_decl,
+            .ident_pos = ident_pos,
+            .start = p->cursor,
+            .end = 0,
+        };
 
-        if (!has_returned && fn_type->is_noreturn) {
-            parse_error(p, ident_pos, ident_pos, REPORT_NOTE, "in function '"str_fmt"'", str_arg(identifier));
-            parse_error(p, p->cursor, p->cursor, REPORT_ERROR, "control might reach end of NORETURN function");
+        // bodies inside a macro's scope can't be picked up later
+        if (p->current_scope == p->global_scope) {
+            deferred.end = skip_fn_body(p);
         }
-
-        if (!has_returned && fn_type->ret_ty != TY_VOID) {
-            parse_error(p, ident_pos, ident_pos, REPORT_NOTE, "in function '"str_fmt"'", str_arg(identifier));
-            parse_error(p, p->cursor, p->cursor, REPORT_WARNING, "function may not return with defined value");
+        if (deferred.end != 0) {
+            vec_append(&deferred_bodies, deferred);
+            p->cursor = deferred.end;
+            p->current = p->tokens[p->cursor];
+        } else {
+            StmtList body = parse_fn_body(p, fn, ident_pos);
+            STMT(fn_decl).fn_decl.body = body;
         }
         advance(p);
-
-        exit_scope(p);
-
-        p->current_function = nullptr;
-
-        fn_decl->fn_decl.body.stmts = stmts;
-        fn_decl->fn_decl.body.len = stmts_len;
     } else {
-        fn->decl = new_stmt(p, STMT_DECL_LOCATION, nothing);
-        fn->decl->token_index = ident_pos;
+        fn->decl = new_stmt(p, STMT_DECL_LOCATION);
+        STMT_TOKEN(fn->decl) = ident_pos;
     }
     fn->storage = storage;
-    return nullptr;
+    return STMT_NONE;
 }
 
 static bool nuh_uh_recursive_alias(TyIndex t, TyIndex err_on) {
@@ -2657,7 +3481,7 @@ TyIndex parse_enum_decl(Parser* p) {
     TY(enum_ty, TyEnum)->backing_ty = backing_ty;
     // UNREACHABLE;
 
-    ArenaState save = arena_save(&p->arena);
+    AstState save = ast_save();
 
     u64 running_value = 0;
     while (!match(p, TOK_KW_END)) {
@@ -2670,11 +3494,11 @@ TyIndex parse_enum_decl(Parser* p) {
         advance(p);
         if (match(p, TOK_EQ)) {
             advance(p);
-            Expr* value = parse_expr(p);
-            if (value->kind != EXPR_LITERAL) {
+            ExprIndex value = parse_expr(p);
+            if (EXPR_KIND(value) != EXPR_LITERAL) {
                 error_at_expr(p, value, REPORT_ERROR, "expected a constant integer expression");
             }
-            running_value = value->literal;
+            running_value = EXPR(value).literal;
         }
 
         Entity* entity = new_entity(p, span, ENTKIND_VARIANT);
@@ -2693,7 +3517,7 @@ TyIndex parse_enum_decl(Parser* p) {
     expect(p, TOK_KW_END);
     advance(p);
 
-    arena_restore(&p->arena, save);
+    ast_restore(save);
 
     return enum_ty;
 }
@@ -2706,7 +3530,7 @@ void parse_global_decl(Parser* p) {
         return;
     case TOK_KW_TYPE: {
         advance(p);
-        Stmt* typedecl_loc = new_stmt(p, STMT_DECL_LOCATION, nothing);
+        StmtIndex typedecl_loc = new_stmt(p, STMT_DECL_LOCATION);
         u32 identifier_pos = p->cursor;
         expect(p, TOK_IDENTIFIER);
         string identifier = tok_span(p->current);
@@ -2726,7 +3550,7 @@ void parse_global_decl(Parser* p) {
     } break;
     case TOK_KW_FNPTR: {
         advance(p);
-        Stmt* typedecl_loc = new_stmt(p, STMT_DECL_LOCATION, nothing);
+        StmtIndex typedecl_loc = new_stmt(p, STMT_DECL_LOCATION);
         expect(p, TOK_IDENTIFIER);
         string identifier = tok_span(p->current);
         Entity* entity = get_incomplete_type_entity(p, identifier);
@@ -2740,7 +3564,7 @@ void parse_global_decl(Parser* p) {
         break;
     }
     case TOK_KW_ENUM: {
-        Stmt* typedecl_loc = new_stmt(p, STMT_DECL_LOCATION, nothing);
+        StmtIndex typedecl_loc = new_stmt(p, STMT_DECL_LOCATION);
         advance(p);
         expect(p, TOK_IDENTIFIER);
         string identifier = tok_span(p->current);
@@ -2756,7 +3580,7 @@ void parse_global_decl(Parser* p) {
     }
     case TOK_KW_STRUCT: {
         // hello there
-        Stmt* typedecl_loc = new_stmt(p, STMT_DECL_LOCATION, nothing);
+        StmtIndex typedecl_loc = new_stmt(p, STMT_DECL_LOCATION);
         advance(p);
         TyKind kind = TY_STRUCT;
         if (match(p, TOK_KW_PACKED)) {
@@ -2777,7 +3601,7 @@ void parse_global_decl(Parser* p) {
         break;
     }
     case TOK_KW_UNION: {
-        Stmt* typedecl_loc = new_stmt(p, STMT_DECL_LOCATION, nothing);
+        StmtIndex typedecl_loc = new_stmt(p, STMT_DECL_LOCATION);
         advance(p);
 
         expect(p, TOK_IDENTIFIER);
@@ -2818,25 +3642,992 @@ void parse_global_decl(Parser* p) {
     }
 }
 
-CompilationUnit parse_unit(Parser* p) {
+static StmtList parse_deferred_body(Parser* p, DeferredBody* body) {
+    p->cursor = body->start;
+    p->current = p->tokens[p->cursor];
+    StmtList list = parse_fn_body(p, body->fn, body->ident_pos);
+    if_unlikely (p->cursor != body->end) {
+        CRASH("function body ended somewhere other than where it was skipped to");
+    }
+    return list;
+}
+
+typedef struct {
+    Parser p;
+    DeferredBody* bodies;
+    u32 len;
+    StmtList* lists; // bodies in this worker's ast, until they're adopted
+    Ast ast;
+    ParseScope* root; // under the global scope, enter_scope hangs the rest off it
+} BodyWorker;
+
+static int body_worker(void* arg) {
+    BodyWorker* w = arg;
+    Parser* p = &w->p;
+
+    global_scope = p->global_scope;
+    dynbuf = vec_new(u32, 256);
+    ast_init();
+
+    for_n(i, 0, w->len) {
+        w->lists[i] = parse_deferred_body(p, &w->bodies[i]);
+    }
+
+    vec_destroy(&dynbuf);
+    w->ast = ast;
+    return 0;
+}
+
+// parse every body skipped over by parse_fn_decl. with more than one job,
+// they get split into runs of about the same number of tokens, and each
+// run gets parsed on its own thread with its own arenas and scopes.
+// the global scope is frozen by now, so the workers can all read it.
+// afterwards their nodes get moved into this thread's ast, in order.
+static void parse_deferred_bodies(Parser* p) {
+    u32 jobs = p->flags.jobs;
+    if (jobs > deferred_bodies.len) {
+        jobs = deferred_bodies.len;
+    }
+
+    if (jobs <= 1) {
+        for_n(i, 0, deferred_bodies.len) {
+            DeferredBody* body = &deferred_bodies.at[i];
+            StmtList list = parse_deferred_body(p, body);
+            STMT(body->decl).fn_decl.body = list;
+        }
+        return;
+    }
+
+    // token_error builds this lazily, do it now so the workers don't race on it
+    if (p->pastes == nullptr) {
+        build_paste_index(p);
+    }
+
+    usize total = 0;
+    for_n(i, 0, deferred_bodies.len) {
+        total += deferred_bodies.at[i].end - deferred_bodies.at[i].start + 1;
+    }
+
+    BodyWorker* workers = malloc(sizeof(BodyWorker) * jobs);
+    thrd_t* threads = malloc(sizeof(thrd_t) * jobs);
+    StmtList* lists = malloc(sizeof(StmtList) * deferred_bodies.len);
+
+    ty_threaded = true;
+
+    u32 next = 0;
+    usize seen = 0;
+    for_n(j, 0, jobs) {
+        BodyWorker* w = &workers[j];
+        w->bodies = &deferred_bodies.at[next];
+        w->lists = &lists[next];
+        w->len = 0;
+
+        // leave at least one body for each worker after this one
+        usize target = total * (j + 1) / jobs;
+        while (next < deferred_bodies.len - (jobs - j - 1)
+            && (w->len == 0 || seen < target || j == jobs - 1)
+        ) {
+            DeferredBody* body = &deferred_bodies.at[next];
+            seen += body->end - body->start + 1;
+            w->len++;
+            next++;
+        }
+
+        w->p = *p;
+        arena_init(&w->p.arena);
+        arena_init(&w->p.entities);
+        w->root = malloc(sizeof(ParseScope));
+        w->root->super = p->global_scope;
+        w->root->sub = nullptr;
+        strmap_init(&w->root->map, 16);
+        w->p.current_scope = w->root;
+
+        if (thrd_create(&threads[j], body_worker, w) != thrd_success) {
+            CRASH("could not start a parser thread");
+        }
+    }
+
+    for_n(j, 0, jobs) {
+        thrd_join(threads[j], nullptr);
+    }
+    ty_threaded = false;
+
+    for_n(j, 0, jobs) {
+        BodyWorker* w = &workers[j];
+        AstOffsets off = ast_adopt(&w->ast);
+        for_n(i, 0, w->len) {
+            StmtList list = w->lists[i];
+            ast_rebase_list(&list, off);
+            STMT(w->bodies[i].decl).fn_decl.body = list;
+        }
+
+        free(w->ast.exprs.kind);
+        free(w->ast.exprs.ty);
+        free(w->ast.exprs.token_index);
+        free(w->ast.exprs.data);
+        free(w->ast.stmts.kind);
+        free(w->ast.stmts.retkind);
+        free(w->ast.stmts.token_index);
+        free(w->ast.stmts.data);
+        free(w->ast.extra.at);
+
+        // nothing points into the scopes anymore, the entities are in the arenas
+        for (ParseScope* scope = w->root; scope != nullptr;) {
+            ParseScope* sub = scope->sub;
+            strmap_destroy(&scope->map);
+            free(scope);
+            scope = sub;
+        }
+    }
+
+    free(workers);
+    free(threads);
+    free(lists);
+}
+
+// precompiled headers
+//
+// a header's global scope, everything in tybuf and the entities
+// it declared get saved to an image that later compiles map in
+// instead of parsing the header again. TyIndex is already
+// position independent, strings become offsets into a table at
+// the end of the image and entity pointers become indices. it also
+// lists every file that went into it, so a change to any of them
+// makes it stale, not just a change to the header itself.
+
+#define PCH_MAGIC 0x48505943 // "CYPH"
+#define PCH_FORMAT 2
+
+typedef struct {
+    u32 magic;
+    u16 version; // COYOTE_VERSION
+    u16 format;
+    u64 key;     // see pch_key
+
+    u32 types_len;
+    u32 interned_len;
+    u32 entities_len;
+    u32 deps_len;
+    u32 strings_len;
+
+    // byte offsets from the start of the image
+    u32 types;
+    u32 ptrs;
+    u32 interned;
+    u32 entities;
+    u32 deps;
+    u32 strings;
+} PchHeader;
+
+typedef struct {
+    CompactString name;
+    u64 variant_value;
+    TyIndex ty;
+    EntityKind kind;
+    StorageKind storage;
+} PchEntity;
+
+Vec_typedef(PchEntity);
+
+typedef struct {
+    u32 path; // plain offset into the string table
+    u32 path_len;
+    u64 hash; // see pch_hash
+} PchDep;
+
+Vec_typedef(PchDep);
+
+// how many slots the type at 't' takes up
+static u32 ty_slots(TyIndex t) {
+    switch (TY_KIND(t)) {
+    case TY__INVALID: // padding
+    case TY_PTR:
+    case TY_ENUM:
+        return 1;
+    case TY_ARRAY:
+        return sizeof(TyArray) / sizeof(TyBufSlot);
+    case TY_ALIAS:
+    case TY_ALIAS_INCOMPLETE:
+        return sizeof(TyAlias) / sizeof(TyBufSlot);
+    case TY_STRUCT:
+    case TY_STRUCT_PACKED:
+    case TY_UNION:
+        return (sizeof(TyRecord) + sizeof(Ty_RecordMember) * TY(t, TyRecord)->len) / sizeof(TyBufSlot);
+    case TY_FN:
+        return (sizeof(TyFn) + sizeof(Ty_FnParam) * TY(t, TyFn)->len) / sizeof(TyBufSlot);
+    default:
+        CRASH("bad type kind %u at %u", TY_KIND(t), t);
+    }
+}
+
+typedef struct {
+    bool saving;
+    Vec(char)* strings; // saving
+    StrMap* entity_index; // saving, name -> index + 1
+    char* strings_base; // loading
+    Entity* entities;   // loading
+} PchReloc;
+
+static void pch_append(Vec(char)* image, const void* data, usize len) {
+    while (image->len + len > image->cap) {
+        vec_reserve(image, image->cap);
+    }
+    memcpy(&image->at[image->len], data, len);
+    image->len += len;
+}
+
+// saved strings are offset + 1, so a null one stays null
+static void pch_reloc_string(PchReloc* r, CompactString* str) {
+    string s = from_compact(*str);
+    if (s.raw == nullptr) {
+        return;
+    }
+    if (r->saving) {
+        usize offset = r->strings->len;
+        pch_append(r->strings, s.raw, s.len);
+        s.raw = (char*)(offset + 1);
+    } else {
+        s.raw = r->strings_base + (uintptr_t)s.raw - 1;
+    }
+    *str = to_compact(s);
+}
+
+static void pch_reloc_entity(PchReloc* r, Entity** entity) {
+    if (*entity == nullptr) {
+        return;
+    }
+    if (r->saving) {
+        void* index = strmap_get(r->entity_index, from_compact((*entity)->name));
+        *entity = index == STRMAP_NOT_FOUND ? nullptr : index;
+    } else {
+        *entity = &r->entities[(uintptr_t)*entity - 1];
+    }
+}
+
+// fix up everything in tybuf that points somewhere
+static void pch_reloc_types(PchReloc* r) {
+    for (u32 t = TYBUF_BUILTIN_END; t < tybuf.len; t += ty_slots(t)) {
+        switch (TY_KIND(t)) {
+        case TY_ALIAS:
+        case TY_ALIAS_INCOMPLETE:
+            pch_reloc_entity(r, &TY(t, TyAlias)->entity);
+            break;
+        case TY_STRUCT:
+        case TY_STRUCT_PACKED:
+        case TY_UNION:
+            for_n(i, 0, TY(t, TyRecord)->len) {
+                pch_reloc_string(r, &TY(t, TyRecord)->members[i].name);
+            }
+            break;
+        case TY_FN:
+            ;
+            TyFn* fn = TY(t, TyFn);
+            pch_reloc_string(r, &fn->name);
+            for_n(i, 0, fn->len) {
+                if (ty_fn_is_variadic_param(fn, i)) {
+                    pch_reloc_string(r, &fn->params[i].varargs.argv);
+                    pch_reloc_string(r, &fn->params[i].varargs.argc);
+                } else {
+                    pch_reloc_string(r, &fn->params[i].name);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+u64 pch_hash(string src) {
+    u64 h = 0xcbf29ce484222325;
+    for_n(i, 0, src.len) {
+        h = (h ^ (u8)src.raw[i]) * 0x100000001b3;
+    }
+    return h;
+}
+
+// anything that changes what a header parses to goes in here
+u64 pch_key(string header_src, FlagSet flags) {
+    u64 h = pch_hash(header_src);
+    u64 extra[] = {flags.xrsdk, flags.error_on_warn, target_ptr_size};
+    for_n(i, 0, sizeof(extra) / sizeof(extra[0])) {
+        h = (h ^ extra[i]) * 0x100000001b3;
+    }
+    return h;
+}
+
+bool pch_valid(string image, u64 key, bool (*dep_current)(string path, u64 hash)) {
+    if (image.len < sizeof(PchHeader)) {
+        return false;
+    }
+    PchHeader* h = (PchHeader*)image.raw;
+    if (h->magic != PCH_MAGIC || h->version != COYOTE_VERSION
+        || h->format != PCH_FORMAT || h->key != key
+    ) {
+        return false;
+    }
+    bool fits = h->types_len <= TYBUF_CAP
+        && (usize)h->types + h->types_len * sizeof(TyBufSlot) <= image.len
+        && (usize)h->ptrs + h->types_len * sizeof(TyIndex) <= image.len
+        && (usize)h->interned + h->interned_len * sizeof(TyIndex) <= image.len
+        && (usize)h->entities + h->entities_len * sizeof(PchEntity) <= image.len
+        && (usize)h->deps + h->deps_len * sizeof(PchDep) <= image.len
+        && (usize)h->strings + h->strings_len <= image.len;
+    if (!fits) {
+        return false;
+    }
+
+    PchDep* deps = (PchDep*)(image.raw + h->deps);
+    for_n(i, 0, h->deps_len) {
+        if ((usize)deps[i].path + deps[i].path_len > h->strings_len) {
+            return false;
+        }
+        string path = {
+            .raw = image.raw + h->strings + deps[i].path,
+            .len = deps[i].path_len,
+        };
+        if (!dep_current(path, deps[i].hash)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// call right after parse_unit on the header
+string pch_build(Parser* p, u64 key) {
+    StrMap* map = &p->global_scope->map;
+
+    StrMap entity_index;
+    strmap_init(&entity_index, map->cap);
+    Vec(PchEntity) entities = vec_new(PchEntity, 64);
+    Vec(char) strings = vec_new(char, 1024);
+    PchReloc r = {
+        .saving = true,
+        .strings = &strings,
+        .entity_index = &entity_index,
+    };
+
+    for_n(i, 0, map->cap) {
+        Entity* ent = map->vals[i];
+        if (ent == nullptr) {
+            continue;
+        }
+        // there's nowhere to keep the bodies and initializers
+        if ((ent->kind == ENTKIND_FN || ent->kind == ENTKIND_VAR) && ent->storage != STORAGE_EXTERN) {
+            parse_error(p, ent->declared_at, ent->declared_at, REPORT_ERROR,
+                "precompiled headers can only declare things, not define them");
+        }
+
+        PchEntity saved = {
+            .name = ent->name,
+            .ty = ent->ty,
+            .kind = ent->kind,
+            .storage = ent->storage,
+        };
+        if (ent->kind == ENTKIND_VARIANT) {
+            saved.variant_value = ent->variant_value;
+        }
+        pch_reloc_string(&r, &saved.name);
+        vec_append(&entities, saved);
+        strmap_put(&entity_index, from_compact(ent->name), (void*)(uintptr_t)entities.len);
+    }
+
+    // relocate a copy, the unit's types have to stay usable
+    TyBufSlot* types = malloc(sizeof(TyBufSlot) * tybuf.len);
+    memcpy(types, tybuf.at, sizeof(TyBufSlot) * tybuf.len);
+    TyBufSlot* live = tybuf.at;
+    tybuf.at = types;
+    pch_reloc_types(&r);
+    tybuf.at = live;
+
+    // the header and everything it pulled in
+    Vec(PchDep) deps = vec_new(PchDep, 4);
+    for_n(i, 0, p->sources.len) {
+        SrcFile* f = p->sources.at[i];
+        PchDep dep = {
+            .path = strings.len,
+            .path_len = f->path.len,
+            .hash = pch_hash(f->src),
+        };
+        vec_append(&deps, dep);
+        pch_append(&strings, f->path.raw, f->path.len);
+    }
+
+    PchHeader h = {
+        .magic = PCH_MAGIC,
+        .version = COYOTE_VERSION,
+        .format = PCH_FORMAT,
+        .key = key,
+        .types_len = tybuf.len,
+        .entities_len = entities.len,
+        .deps_len = deps.len,
+        .strings_len = strings.len,
+    };
+    for_n(i, 0, tyintern.cap) {
+        h.interned_len += tyintern.at[i] != 0;
+    }
+
+    Vec(char) image = vec_new(char, 4096);
+    image.len = sizeof(PchHeader);
+
+    h.types = image.len;
+    pch_append(&image, types, sizeof(TyBufSlot) * tybuf.len);
+    h.ptrs = image.len;
+    pch_append(&image, tybuf.ptrs, sizeof(TyIndex) * tybuf.len);
+    h.interned = image.len;
+    for_n(i, 0, tyintern.cap) {
+        if (tyintern.at[i] != 0) {
+            pch_append(&image, &tyintern.at[i], sizeof(TyIndex));
+        }
+    }
+    while (image.len % alignof(PchEntity) != 0) {
+        vec_append(&image, 0);
+    }
+    h.entities = image.len;
+    pch_append(&image, entities.at, sizeof(PchEntity) * entities.len);
+    while (image.len % alignof(PchDep) != 0) {
+        vec_append(&image, 0);
+    }
+    h.deps = image.len;
+    pch_append(&image, deps.at, sizeof(PchDep) * deps.len);
+    h.strings = image.len;
+    pch_append(&image, strings.at, strings.len);
+    memcpy(image.at, &h, sizeof(h));
+
+    free(types);
+    strmap_destroy(&entity_index);
+    vec_destroy(&entities);
+    vec_destroy(&deps);
+    vec_destroy(&strings);
+    return (string){.raw = image.at, .len = image.len};
+}
+
+// the image has to stay mapped, names point into it. the types go
+// straight into tybuf, the entities come back for pch_declare
+static Entity* pch_import(string image) {
+    PchHeader* h = (PchHeader*)image.raw;
+
+    memcpy(tybuf.at, image.raw + h->types, sizeof(TyBufSlot) * h->types_len);
+    memcpy(tybuf.ptrs, image.raw + h->ptrs, sizeof(TyIndex) * h->types_len);
+    tybuf.len = h->types_len;
+    tybuf.last = 0;
+
+    PchEntity* saved = (PchEntity*)(image.raw + h->entities);
+    char* strings = image.raw + h->strings;
+    Entity* entities = malloc(sizeof(Entity) * h->entities_len);
+    PchReloc r = {
+        .strings_base = strings,
+        .entities = entities,
+    };
+    for_n(i, 0, h->entities_len) {
+        Entity* ent = &entities[i];
+        *ent = (Entity){
+            .name = saved[i].name,
+            .kind = saved[i].kind,
+            .storage = saved[i].storage,
+            .ty = saved[i].ty,
+        };
+        if (ent->kind == ENTKIND_VARIANT) {
+            ent->variant_value = saved[i].variant_value;
+        } else {
+            ent->decl = STMT_NONE;
+        }
+        pch_reloc_string(&r, &ent->name);
+    }
+
+    pch_reloc_types(&r);
+
+    TyIndex* interned = (TyIndex*)(image.raw + h->interned);
+    for_n(i, 0, h->interned_len) {
+        ty__intern(interned[i]);
+    }
+    return entities;
+}
+
+// they're all visible from the very first token
+static void pch_declare(Parser* p, string image, Entity* entities) {
+    PchHeader* h = (PchHeader*)image.raw;
+    for_n(i, 0, h->entities_len) {
+        strmap_put(&p->global_scope->map, from_compact(entities[i].name), &entities[i]);
+    }
+}
+
+// an image pch_prepare already imported. the server's forks start out
+// with tybuf holding exactly that, so the first unit one of them parses
+// can use it as is. any unit after that has to import it again.
+static struct {
+    string image;
+    Entity* entities;
+    bool current; // nothing's touched tybuf since
+} prepared;
+
+void pch_prepare(string image) {
+    if (prepared.current && prepared.image.raw == image.raw) {
+        return;
+    }
+    free(prepared.entities);
+    prepared.image = image;
+    prepared.entities = nullptr;
+    prepared.current = false;
+    if (image.raw == nullptr) {
+        return;
+    }
     ty_init();
+    prepared.entities = pch_import(image);
+    prepared.current = true;
+}
 
+CompilationUnit parse_unit(Parser* p) {
     global_scope = p->global_scope;
+    if (p->pch.raw != nullptr && prepared.current && p->pch.raw == prepared.image.raw) {
+        pch_declare(p, p->pch, prepared.entities);
+    } else {
+        ty_init();
+        if (p->pch.raw != nullptr) {
+            pch_declare(p, p->pch, pch_import(p->pch));
+        }
+    }
+    prepared.current = false;
 
-    dynbuf = vecptr_new(void, 256);
+    dynbuf = vec_new(u32, 256);
+    deferred_bodies = vec_new(DeferredBody, 64);
+    ast_init();
 
     while (p->current.kind != TOK_EOF) {
         parse_global_decl(p);
     }
 
+    u32 eof = p->cursor;
+    parse_deferred_bodies(p);
+    p->cursor = eof;
+    p->current = p->tokens[eof];
+
     CompilationUnit cu = {};
     cu.tokens = p->tokens;
     cu.tokens_len = p->tokens_len;
     cu.sources = p->sources;
     cu.top_scope = p->global_scope;
     cu.arena = p->arena;
+    cu.ast = ast;
 
     vec_destroy(&dynbuf);
+    vec_destroy(&deferred_bodies);
 
     return cu;
 }
+
+// --dump prints every global in name order and the function bodies under
+// them, so tests can look at what got parsed without caring where it
+// ended up in the ast, or which thread parsed it.
+
+static const char* dump_storage[] = {
+    [STORAGE_LOCAL]     = "",
+    [STORAGE_OUT_PARAM] = "OUT ",
+    [STORAGE_PUBLIC]    = "PUBLIC ",
+    [STORAGE_PRIVATE]   = "PRIVATE ",
+    [STORAGE_EXPORT]    = "EXPORT ",
+    [STORAGE_EXTERN]    = "EXTERN ",
+};
+
+static const char* dump_expr_op[] = {
+    [EXPR_ADD] = "+",
+    [EXPR_SUB] = "-",
+    [EXPR_MUL] = "*",
+    [EXPR_DIV] = "/",
+    [EXPR_REM] = "%",
+    [EXPR_AND] = "&",
+    [EXPR_OR]  = "|",
+    [EXPR_XOR] = "$",
+    [EXPR_LSH] = "<<",
+    [EXPR_RSH] = ">>",
+    [EXPR_ROR] = "ROR",
+
+    [EXPR_BOOL_OR]  = "OR",
+    [EXPR_BOOL_AND] = "AND",
+
+    [EXPR_EQ]         = "==",
+    [EXPR_NEQ]        = "!=",
+    [EXPR_LESS_EQ]    = "<=",
+    [EXPR_GREATER_EQ] = ">=",
+    [EXPR_LESS]       = "<",
+    [EXPR_GREATER]    = ">",
+
+    [EXPR_ADDROF]       = "&",
+    [EXPR_NEG]          = "-",
+    [EXPR_NOT]          = "~",
+    [EXPR_BOOL_NOT]     = "NOT",
+    [EXPR_SIZEOFVALUE]  = "SIZEOFVALUE",
+    [EXPR_OUT_ARG]      = "OUT",
+    [EXPR_CONTAINEROF]  = "CONTAINEROF",
+    [EXPR_CAST]         = "CAST",
+
+    [EXPR_PTR_INDEX]    = "[]",
+    [EXPR_ARRAY_INDEX]  = "[]",
+    [EXPR_DEREF]        = "^",
+    [EXPR_DEREF_MEMBER] = "^.",
+    [EXPR_MEMBER]       = ".",
+    [EXPR_CALL]         = "CALL",
+};
+
+static const char* dump_assign_op[] = {
+    [STMT_ASSIGN]     = "=",
+    [STMT_ASSIGN_ADD] = "+=",
+    [STMT_ASSIGN_SUB] = "-=",
+    [STMT_ASSIGN_MUL] = "*=",
+    [STMT_ASSIGN_DIV] = "/=",
+    [STMT_ASSIGN_MOD] = "%=",
+    [STMT_ASSIGN_AND] = "&=",
+    [STMT_ASSIGN_OR]  = "|=",
+    [STMT_ASSIGN_XOR] = "$=",
+    [STMT_ASSIGN_LSH] = "<<=",
+    [STMT_ASSIGN_RSH] = ">>=",
+};
+
+static void dump_name(Vec(char)* out, CompactString name) {
+    string s = from_compact(name);
+    vec_char_append_many(out, s.raw, s.len);
+}
+
+static void dump_hex_byte(Vec(char)* out, u8 byte) {
+    const char* digits = "0123456789abcdef";
+    vec_append(out, digits[byte >> 4]);
+    vec_append(out, digits[byte & 0xF]);
+}
+
+static void dump_literal(Vec(char)* out, u64 value, TyIndex ty) {
+    if (ty_is_signed(ty_unwrap_alias_or_enum(ty)) && (i64)value < 0) {
+        vec_append(out, '-');
+        value = -value;
+    }
+    vec_char_print_num(out, value);
+    vec_append(out, ':');
+    _ty_name(out, ty);
+}
+
+static void dump_expr(Vec(char)* out, ExprIndex e);
+
+static void dump_blob(Vec(char)* out, ExprIndex e) {
+    u8* bytes = (u8*)&EXTRA(EXPR(e).blob.bytes);
+    u32 runs = EXPR(e).blob.runs;
+    vec_char_append_str(out, "BLOB{");
+    for_n(i, 0, EXTRA(runs)) {
+        u32 len = EXTRA(runs + 1 + i * 2);
+        u32 offset = EXTRA(runs + 2 + i * 2);
+        if (i != 0) {
+            vec_char_append_str(out, ", ");
+        }
+        if (offset == BLOB_ZEROES) {
+            vec_char_append_str(out, "zeroes ");
+            vec_char_print_num(out, len);
+            continue;
+        }
+        for_n(j, 0, len) {
+            if (j != 0) {
+                vec_append(out, ' ');
+            }
+            dump_hex_byte(out, bytes[offset + j]);
+        }
+    }
+    vec_append(out, '}');
+}
+
+static void dump_expr(Vec(char)* out, ExprIndex e) {
+    ExprData* data = &EXPR(e);
+    switch (EXPR_KIND(e)) {
+    case EXPR_LITERAL:
+        dump_literal(out, data->literal, EXPR_TY(e));
+        return;
+    case EXPR_STR_LITERAL:
+        vec_append(out, '"');
+        dump_name(out, data->lit_string);
+        vec_append(out, '"');
+        return;
+    case EXPR_ENTITY:
+        dump_name(out, data->entity->name);
+        return;
+    case EXPR_EMPTY_COMPOUND_LITERAL:
+        vec_char_append_str(out, "{}");
+        return;
+    case EXPR_COMPOUND_LITERAL:
+        vec_append(out, '{');
+        for_n(i, 0, data->compound_lit.len) {
+            if (i != 0) {
+                vec_char_append_str(out, ", ");
+            }
+            dump_expr(out, EXTRA(data->compound_lit.values + i));
+        }
+        vec_append(out, '}');
+        return;
+    case EXPR_BLOB_LITERAL:
+        dump_blob(out, e);
+        return;
+    case EXPR_INDEXED_ITEM:
+        vec_append(out, '[');
+        vec_char_print_num(out, data->indexed_item.index);
+        vec_char_append_str(out, "] = ");
+        dump_expr(out, data->indexed_item.value);
+        return;
+    default:
+        break;
+    }
+
+    vec_append(out, '(');
+    vec_char_append_str(out, dump_expr_op[EXPR_KIND(e)]);
+    switch (EXPR_KIND(e)) {
+    case EXPR_ADD ... EXPR_GREATER:
+    case EXPR_PTR_INDEX:
+    case EXPR_ARRAY_INDEX:
+        vec_append(out, ' ');
+        dump_expr(out, data->binary.lhs);
+        vec_append(out, ' ');
+        dump_expr(out, data->binary.rhs);
+        break;
+    case EXPR_CAST:
+    case EXPR_CONTAINEROF:
+        vec_append(out, ' ');
+        _ty_name(out, EXPR_TY(e));
+        // fallthrough
+    case EXPR_ADDROF:
+    case EXPR_NEG:
+    case EXPR_NOT:
+    case EXPR_BOOL_NOT:
+    case EXPR_SIZEOFVALUE:
+    case EXPR_OUT_ARG:
+    case EXPR_DEREF:
+        vec_append(out, ' ');
+        dump_expr(out, data->unary);
+        break;
+    case EXPR_DEREF_MEMBER:
+    case EXPR_MEMBER: {
+        ExprIndex aggregate = data->member_access.aggregate;
+        TyIndex record_ty = ty_unwrap_alias(EXPR_TY(aggregate));
+        if (EXPR_KIND(e) == EXPR_DEREF_MEMBER) {
+            record_ty = ty_unwrap_alias(ty_get_ptr_target(record_ty));
+        }
+        vec_append(out, ' ');
+        dump_expr(out, aggregate);
+        vec_append(out, ' ');
+        dump_name(out, TY(record_ty, TyRecord)->members[data->member_access.member_index].name);
+    } break;
+    case EXPR_CALL:
+        for_n(i, 0, data->call.args_len + 1) {
+            vec_append(out, ' ');
+            dump_expr(out, EXTRA(data->call.args + i));
+        }
+        break;
+    default:
+        UNREACHABLE;
+    }
+    vec_append(out, ')');
+}
+
+static void dump_indent(Vec(char)* out, usize depth) {
+    for_n(_, 0, depth) {
+        vec_char_append_str(out, "    ");
+    }
+}
+
+static void dump_stmt(Vec(char)* out, StmtIndex s, usize depth);
+
+static void dump_stmt_list(Vec(char)* out, StmtList list, usize depth) {
+    for_n(i, 0, list.len) {
+        dump_stmt(out, EXTRA(list.stmts + i), depth);
+    }
+}
+
+static void dump_stmt(Vec(char)* out, StmtIndex s, usize depth) {
+    StmtData* data = &STMT(s);
+    dump_indent(out, depth);
+    switch (STMT_KIND(s)) {
+    case STMT_EXPR:
+        dump_expr(out, data->expr);
+        break;
+    case STMT_VAR_DECL:
+        vec_char_append_str(out, "VAR ");
+        dump_name(out, data->var_decl.var->name);
+        vec_char_append_str(out, ": ");
+        _ty_name(out, data->var_decl.var->ty);
+        if (data->var_decl.expr != EXPR_NONE) {
+            vec_char_append_str(out, " = ");
+            dump_expr(out, data->var_decl.expr);
+        }
+        break;
+    case STMT_ASSIGN ... STMT_ASSIGN_RSH:
+        vec_append(out, '(');
+        vec_char_append_str(out, dump_assign_op[STMT_KIND(s)]);
+        vec_append(out, ' ');
+        dump_expr(out, data->assign.lhs);
+        vec_append(out, ' ');
+        dump_expr(out, data->assign.rhs);
+        vec_append(out, ')');
+        break;
+    case STMT_BARRIER:     vec_char_append_str(out, "BARRIER"); break;
+    case STMT_BREAK:       vec_char_append_str(out, "BREAK"); break;
+    case STMT_CONTINUE:    vec_char_append_str(out, "CONTINUE"); break;
+    case STMT_LEAVE:       vec_char_append_str(out, "LEAVE"); break;
+    case STMT_UNREACHABLE: vec_char_append_str(out, "UNREACHABLE"); break;
+    case STMT_RETURN:
+        vec_char_append_str(out, "RETURN");
+        if (data->expr != EXPR_NONE) {
+            vec_append(out, ' ');
+            dump_expr(out, data->expr);
+        }
+        break;
+    case STMT_IF:
+        vec_char_append_str(out, "IF ");
+        dump_expr(out, data->if_.cond);
+        vec_append(out, '\n');
+        dump_stmt_list(out, data->if_.block, depth + 1);
+        if (data->if_.else_ != STMT_NONE) {
+            dump_indent(out, depth);
+            vec_char_append_str(out, "ELSE\n");
+            dump_stmt(out, data->if_.else_, depth + 1);
+        }
+        return;
+    case STMT_BLOCK:
+        vec_char_append_str(out, "BLOCK\n");
+        dump_stmt_list(out, data->block, depth + 1);
+        return;
+    case STMT_WHILE:
+        vec_char_append_str(out, "WHILE ");
+        dump_expr(out, data->while_.cond);
+        vec_append(out, '\n');
+        dump_stmt_list(out, data->while_.block, depth + 1);
+        return;
+    case STMT_LABEL:
+        vec_char_append_str(out, "@");
+        dump_name(out, data->label->name);
+        break;
+    case STMT_GOTO:
+        vec_char_append_str(out, "GOTO ");
+        dump_name(out, data->goto_->name);
+        break;
+    default:
+        vec_char_append_str(out, "???");
+        break;
+    }
+    vec_append(out, '\n');
+}
+
+// what a TYPE declares, not just its name
+static void dump_type_def(Vec(char)* out, TyIndex t) {
+    if (TY_KIND(t) == TY_ALIAS) {
+        t = TY(t, TyAlias)->aliasing;
+    }
+    switch (TY_KIND(t)) {
+    case TY_STRUCT:
+    case TY_STRUCT_PACKED:
+    case TY_UNION: {
+        TyRecord* record = TY(t, TyRecord);
+        vec_char_append_str(out, TY_KIND(t) == TY_UNION ? "UNION" : TY_KIND(t) == TY_STRUCT ? "STRUCT" : "STRUCT PACKED");
+        vec_char_append_str(out, " size ");
+        vec_char_print_num(out, record->size);
+        vec_char_append_str(out, " align ");
+        vec_char_print_num(out, record->align);
+        vec_char_append_str(out, " {");
+        for_n(i, 0, record->len) {
+            vec_char_append_str(out, i == 0 ? "" : ", ");
+            dump_name(out, record->members[i].name);
+            vec_char_append_str(out, ": ");
+            _ty_name(out, record->members[i].type);
+            vec_char_append_str(out, " @");
+            vec_char_print_num(out, record->members[i].offset);
+        }
+        vec_append(out, '}');
+    } break;
+    case TY_ENUM:
+        vec_char_append_str(out, "ENUM ");
+        _ty_name(out, TY(t, TyEnum)->backing_ty);
+        break;
+    default:
+        _ty_name(out, t);
+        break;
+    }
+}
+
+static int dump_entity_cmp(const void* a, const void* b) {
+    string a_name = from_compact((*(Entity**)a)->name);
+    string b_name = from_compact((*(Entity**)b)->name);
+    int cmp = strncmp(a_name.raw, b_name.raw, min(a_name.len, b_name.len));
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (a_name.len > b_name.len) - (a_name.len < b_name.len);
+}
+
+void dump_unit(CompilationUnit* cu) {
+    ast = cu->ast;
+    StrMap* globals = &cu->top_scope->map;
+
+    VecPtr(Entity) entities = vecptr_new(Entity, globals->size + 1);
+    for_n(i, 0, globals->cap) {
+        Entity* ent = globals->vals[i];
+        if (ent != nullptr) {
+            vec_append(&entities, ent);
+        }
+    }
+    qsort(entities.at, entities.len, sizeof(entities.at[0]), dump_entity_cmp);
+
+    Vec(char) out = vec_new(char, 4096);
+    for_vec(Entity** entry, &entities) {
+        Entity* ent = *entry;
+        // functions are declared as variables of their FN type
+        EntityKind kind = ent->kind;
+        if (kind == ENTKIND_VAR && TY_KIND(ent->ty) == TY_FN) {
+            kind = ENTKIND_FN;
+        }
+        switch (kind) {
+        case ENTKIND_VAR:
+            vec_char_append_str(&out, dump_storage[ent->storage]);
+            vec_char_append_str(&out, "VAR ");
+            break;
+        case ENTKIND_FN:
+            vec_char_append_str(&out, dump_storage[ent->storage]);
+            vec_char_append_str(&out, "FN ");
+            break;
+        case ENTKIND_TYPE:    vec_char_append_str(&out, "TYPE "); break;
+        case ENTKIND_VARIANT: vec_char_append_str(&out, "VARIANT "); break;
+        default:              vec_char_append_str(&out, "??? "); break;
+        }
+        dump_name(&out, ent->name);
+
+        switch (kind) {
+        case ENTKIND_VAR:
+            vec_char_append_str(&out, ": ");
+            _ty_name(&out, ent->ty);
+            if (ent->decl != STMT_NONE && STMT_KIND(ent->decl) == STMT_VAR_DECL
+                && STMT(ent->decl).var_decl.expr != EXPR_NONE
+            ) {
+                vec_char_append_str(&out, " = ");
+                dump_expr(&out, STMT(ent->decl).var_decl.expr);
+            }
+            vec_append(&out, '\n');
+            break;
+        case ENTKIND_FN:
+            vec_char_append_str(&out, ": ");
+            _ty_name(&out, ent->ty);
+            vec_append(&out, '\n');
+            if (ent->decl != STMT_NONE && STMT_KIND(ent->decl) == STMT_FN_DECL) {
+                dump_stmt_list(&out, STMT(ent->decl).fn_decl.body, 1);
+            }
+            break;
+        case ENTKIND_TYPE:
+            vec_char_append_str(&out, " = ");
+            dump_type_def(&out, ent->ty);
+            vec_append(&out, '\n');
+            break;
+        case ENTKIND_VARIANT:
+            vec_char_append_str(&out, " = ");
+            dump_literal(&out, ent->variant_value, ent->ty);
+            vec_append(&out, '\n');
+            break;
+        default:
+            vec_append(&out, '\n');
+            break;
+        }
+    }
+
+    fwrite(out.at, 1, out.len, stdout);
+    vec_destroy(&out);
+    vec_destroy(&entities);
+}
@@ -107,8 +107,13 @@ void ty_init();
 
 void token_error(Parser* ctx, ReportKind kind, u32 start_index, u32 end_index, const char* msg);
 
-typedef struct Expr Expr;
-typedef struct Stmt Stmt;
+// AST nodes are indices into the ast buffers below. 0 is never a
+// valid node, so it doubles as "nothing here"
+typedef u32 ExprIndex;
+typedef u32 StmtIndex;
+
+#define EXPR_NONE 0
+#define STMT_NONE 0
 
 typedef enum : u8 {
     STORAGE_LOCAL,
@@ -133,9 +138,10 @@ typedef struct Entity {
     EntityKind kind;
     StorageKind storage;
     TyIndex ty;
+    u32 declared_at; // token index where it first showed up
 
     union {
-        Stmt* decl;
+        StmtIndex decl;
         u64 variant_value;
     };
 } Entity;
@@ -184,57 +190,47 @@ typedef enum : u8 {
     RETKIND_YES,    // will return
 } ReturnKind;
 
+// a run of statements in Ast.extra
 typedef struct StmtList {
+    u32 stmts;
     u32 len;
-    ReturnKind retkind;
-    Stmt** stmts;
 } StmtList;
 
-typedef struct Stmt {
-    StmtKind kind;
-    ReturnKind retkind;
-    u32 token_index;
-    
-    union { // allocated in the arena as-needed
-        usize extra[0];
-
-        usize nothing[0];
-        
-        Expr* expr;
-
-        struct {
-            Entity* var;
-            Expr* expr;
-        } var_decl;
-
-        struct {
-            Entity* fn;
-            StmtList body;
-        } fn_decl;
-
-        struct {
-            Expr* lhs;
-            Expr* rhs;
-        } assign;
-
-        struct {
-            Expr* cond;
-            StmtList block;
-            Stmt* else_;
-        } if_;
+typedef union StmtData {
+    ExprIndex expr;
+
+    struct {
+        Entity* var;
+        ExprIndex expr;
+    } var_decl;
+
+    struct {
+        Entity* fn;
+        StmtList body;
+    } fn_decl;
+
+    struct {
+        ExprIndex lhs;
+        ExprIndex rhs;
+    } assign;
 
+    struct {
+        ExprIndex cond;
+        StmtIndex else_;
         StmtList block;
+    } if_;
 
-        struct {
-            Expr* cond;
-            StmtList block;
-        } while_;
+    StmtList block;
 
-        Entity* label;
+    struct {
+        ExprIndex cond;
+        StmtList block;
+    } while_;
 
-        Entity* goto_;
-    };
-} Stmt;
+    Entity* label;
+
+    Entity* goto_;
+} StmtData;
 
 typedef enum : u8 {
     EXPR_ADD,
@@ -274,6 +270,7 @@ typedef enum : u8 {
     EXPR_LITERAL,
     EXPR_COMPOUND_LITERAL,
     EXPR_EMPTY_COMPOUND_LITERAL,
+    EXPR_BLOB_LITERAL,  // array initializer made of only literals
 
     EXPR_INDEXED_ITEM,
 
@@ -285,53 +282,84 @@ typedef enum : u8 {
     EXPR_CALL,          // foo(bar, baz)
 } ExprKind;
 
-typedef struct Expr {
-    ExprKind kind;
-    TyIndex ty;
-    u32 token_index;
-    
-    union { // allocated in the arena as-needed
-        usize extra[0];
+typedef union ExprData {
+    u64 literal;
+    CompactString lit_string;
 
-        usize nothing[0];
+    struct {
+        ExprIndex value;
+        u32 index;
+    } indexed_item;
 
-        u64 literal;
-        CompactString lit_string;
+    // 'values' indexes Ast.extra
+    struct {
+        u32 values;
+        u32 len;
+    } compound_lit;
+
+    // Ast.extra[bytes] is the data packed four bytes to a word.
+    // Ast.extra[runs] is the number of runs, then a {length, offset} pair
+    // for each. an offset of BLOB_ZEROES is a run of zeroes instead,
+    // so these line up with FE_MIRN_BYTES and FE_MIRN_ZEROES.
+    struct {
+        u32 bytes;
+        u32 runs;
+    } blob;
 
-        struct {
-            Expr* value;
-            u32 index;
-        } indexed_item;
+    Entity* entity;
+
+    ExprIndex unary;
 
-        struct {
-            Expr** values;
-            u32 len;
-        } compound_lit;
+    struct {
+        ExprIndex lhs;
+        ExprIndex rhs;
+    } binary;
 
-        Entity* entity;
+    // Ast.extra[args] is the callee, the arguments follow it
+    struct {
+        u32 args;
+        u32 args_len;
+    } call;
 
-        Expr* unary;
+    struct {
+        ExprIndex aggregate;
+        u32 member_index;
+    } member_access;
+} ExprData;
 
-        struct {
-            Expr* lhs;
-            Expr* rhs;
-        } binary;
+#define BLOB_ZEROES UINT32_MAX
 
-        struct {
-            Expr* callee;
-            Expr** args;
-            u32 args_len;
-        } call;
+// every node is split across parallel arrays so walking the
+// kinds or types of a whole unit doesn't drag the rest along.
+// anything that doesn't fit in a node's data goes in 'extra'.
+typedef struct Ast {
+    struct {
+        ExprKind* kind;
+        TyIndex* ty;
+        u32* token_index;
+        ExprData* data;
+        u32 len;
+        u32 cap;
+    } exprs;
 
-        struct {
-            Expr* aggregate;
-            u32 member_index;
-        } member_access;
-    };
-} Expr;
+    struct {
+        StmtKind* kind;
+        ReturnKind* retkind;
+        u32* token_index;
+        StmtData* data;
+        u32 len;
+        u32 cap;
+    } stmts;
 
-Stmt* parse_stmt(Parser* p);
-Expr* parse_expr(Parser* p);
+    struct {
+        u32* at;
+        u32 len;
+        u32 cap;
+    } extra;
+} Ast;
+
+StmtIndex parse_stmt(Parser* p);
+ExprIndex parse_expr(Parser* p);
 TyIndex parse_type(Parser* p, bool allow_incomplete);
 
 VecPtr_typedef(Entity);
@@ -344,8 +372,23 @@ typedef struct CompilationUnit {
     u32 tokens_len;
 
     VecPtr(SrcFile) sources;
+
+    Ast ast;
 } CompilationUnit;
 
 CompilationUnit parse_unit(Parser* p);
+// print the unit's globals and function bodies, for --dump
+void dump_unit(CompilationUnit* cu);
+
+u64 pch_hash(string src);
+u64 pch_key(string header_src, FlagSet flags);
+// dep_current gets every file the image was built from, with the
+// pch_hash its contents had then
+bool pch_valid(string image, u64 key, bool (*dep_current)(string path, u64 hash));
+string pch_build(Parser* p, u64 key);
+// import an image into this process ahead of time, so a fork of it can
+// parse a unit on top of it without importing it again. the image has to
+// stay mapped until this is called with another one, or an empty one.
+void pch_prepare(string image);
 
 #endif // PARSE_H
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "common/fs.h"
@@ -7,27 +8,57 @@
 #include "lex.h"
 #include "common/ansi.h"
 
-static u32 line_number(string src, string snippet) {
-    u32 line = 1;
-    char* current = src.raw;
-    while (current != snippet.raw) {
-        if (*current == '\n') line++;
-        current++;
+static void build_line_index(SrcFile* f) {
+    char* src = f->src.raw;
+    char* end = f->src.raw + f->src.len;
+
+    // count first so the table can be allocated exactly.
+    // memchr is vectorized in every libc we care about
+    u32 lines = 1;
+    for (char* nl = memchr(src, '\n', end - src); nl != nullptr; nl = memchr(nl, '\n', end - nl)) {
+        lines++;
+        nl++;
     }
 
-    return line;
+    f->line_starts = malloc(sizeof(f->line_starts[0]) * lines);
+    f->lines_len = lines;
+    f->line_starts[0] = 0;
+
+    u32 line = 1;
+    for (char* nl = memchr(src, '\n', end - src); nl != nullptr; nl = memchr(nl, '\n', end - nl)) {
+        nl++;
+        f->line_starts[line++] = nl - src;
+    }
 }
 
-static u32 col_number(string src, string snippet) {
-    u32 col = 1;
-    char* current = src.raw;
-    while (current != snippet.raw) {
-        if (*current == '\n') col = 0;
-        col++;
-        current++;
+// index of the line containing 'at'
+static u32 line_index(SrcFile* f, char* at) {
+    if (f->line_starts == nullptr) {
+        build_line_index(f);
+    }
+
+    u32 offset = at - f->src.raw;
+    u32 low = 0;
+    u32 high = f->lines_len;
+    // find the last line that starts at or before 'offset'
+    while (high - low > 1) {
+        u32 mid = low + (high - low) / 2;
+        if (f->line_starts[mid] <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
     }
+    return low;
+}
+
+static u32 line_number(SrcFile* f, string snippet) {
+    return line_index(f, snippet.raw) + 1;
+}
 
-    return col;
+static u32 col_number(SrcFile* f, string snippet) {
+    u32 line = line_index(f, snippet.raw);
+    return (u32)(snippet.raw - f->src.raw) - f->line_starts[line] + 1;
 }
 
 static void print_snippet(string line, string snippet, const char* color, usize pad, string msg) {
@@ -141,7 +172,7 @@ void report_line(ReportLine* report) {
 
     const char* color = White;
 
-    report->path = try_localize_path(report->path);
+    string path = try_localize_path(report->file->path);
 
     switch (report->kind) {
     case REPORT_ERROR: fprintf(stderr, Bold Red"error"Reset); color = Red; break;
@@ -149,10 +180,10 @@ void report_line(ReportLine* report) {
     case REPORT_NOTE: fprintf(stderr, Bold Cyan"note"Reset); color = Cyan; break;
     }
 
-    u32 line_num = line_number(report->src, report->snippet);
-    u32 col_num  = col_number(report->src, report->snippet);
+    u32 line_num = line_number(report->file, report->snippet);
+    u32 col_num  = col_number(report->file, report->snippet);
 
-    // fprintf(stderr, " -> "str_fmt":%u:%u ", str_arg(report->path), line_num, col_num);
+    // fprintf(stderr, " -> "str_fmt":%u:%u ", str_arg(path), line_num, col_num);
     fprintf(stderr, ": "Bold str_fmt Reset, str_arg(report->msg));
     fprintf(stderr, "\n");
     
@@ -161,13 +192,13 @@ void report_line(ReportLine* report) {
     for_n(i, 0, line_digits) {
         fprintf(stderr, " ");
     }
-    fprintf(stderr, Blue"--> "Reset str_fmt":%u:%u\n", str_arg(report->path), line_num, col_num);
+    fprintf(stderr, Blue"--> "Reset str_fmt":%u:%u\n", str_arg(path), line_num, col_num);
     for_n(i, 0, line_digits) {
         fprintf(stderr, " ");
     }
     fprintf(stderr, Blue" |\n"Reset);
 
-    string line = snippet_line(report->src, report->snippet);
+    string line = snippet_line(report->file->src, report->snippet);
 
     fprintf(stderr, Blue "%u ", line_num);
 
@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+
+#ifdef OS_LINUX
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SERVER_MAGIC 0x56525943
+#define SERVER_MAX_REQUEST (1 << 20)
+
+// sent along with the client's stdout and stderr
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 argc;
+    u32 len; // the working directory then each argument, all nul terminated
+} RequestHeader;
+
+// the reply is just the exit code. this one means the server
+// can't handle the request and the client should compile it itself
+#define SERVER_DECLINED -1
+
+const char* server_socket_path() {
+    const char* env = getenv("COYOTE_SOCKET");
+    if (env != nullptr && env[0] != '\0') {
+        return env;
+    }
+
+    static char path[sizeof(((struct sockaddr_un*)nullptr)->sun_path)];
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    if (dir != nullptr && dir[0] != '\0') {
+        snprintf(path, sizeof(path), "%s/coyote.sock", dir);
+    } else {
+        snprintf(path, sizeof(path), "/tmp/coyote-%u.sock", (u32)getuid());
+    }
+    return path;
+}
+
+static bool make_addr(const char* path, struct sockaddr_un* addr) {
+    *addr = (struct sockaddr_un){.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+// the client hands over its stdout and stderr and the server runs
+// whatever it's asked to as itself, so both ends have to be the same user
+static bool peer_is_us(int sock) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1 || len != sizeof(cred)) {
+        return false;
+    }
+    return cred.uid == getuid();
+}
+
+// a server that isn't ours counts as no server at all
+static int connect_to(const char* path) {
+    struct sockaddr_un addr;
+    if (!make_addr(path, &addr)) {
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 || !peer_is_us(sock)) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static bool write_all(int fd, const void* buf, usize len) {
+    const char* at = buf;
+    while (len != 0) {
+        isize n = write(fd, at, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        at += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* buf, usize len) {
+    char* at = buf;
+    while (len != 0) {
+        isize n = read(fd, at, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        at += n;
+        len -= n;
+    }
+    return true;
+}
+
+typedef union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int) * 2)];
+} FdControl;
+
+static bool send_header(int sock, RequestHeader* h, int fds[2]) {
+    struct iovec iov = {.iov_base = h, .iov_len = sizeof(*h)};
+    FdControl control = {};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 2);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 2);
+    return sendmsg(sock, &msg, 0) == sizeof(*h);
+}
+
+// fds are -1 if they didn't come through
+static bool recv_header(int sock, RequestHeader* h, int fds[2]) {
+    struct iovec iov = {.iov_base = h, .iov_len = sizeof(*h)};
+    FdControl control = {};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    fds[0] = fds[1] = -1;
+    isize n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+
+    struct cmsghdr* cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+    if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+        && cmsg->cmsg_len == CMSG_LEN(sizeof(int) * 2)
+    ) {
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 2);
+    }
+    return n == sizeof(*h) && fds[0] != -1;
+}
+
+typedef struct {
+    int out;
+    int err;
+    char* payload;
+    int argc;
+    char** argv;
+} Request;
+
+static bool read_request(int conn, Request* req) {
+    req->out = req->err = -1;
+    if (!peer_is_us(conn)) {
+        return false;
+    }
+
+    RequestHeader h;
+    int fds[2];
+    bool ok = recv_header(conn, &h, fds);
+    req->out = fds[0];
+    req->err = fds[1];
+    if (!ok) {
+        return false;
+    }
+    if (h.magic != SERVER_MAGIC || h.version != COYOTE_VERSION
+        || h.len == 0 || h.len > SERVER_MAX_REQUEST || h.argc > h.len
+    ) {
+        i32 declined = SERVER_DECLINED;
+        write_all(conn, &declined, sizeof(declined));
+        return false;
+    }
+
+    req->payload = malloc(h.len + 1);
+    if (!read_all(conn, req->payload, h.len)) {
+        return false;
+    }
+    req->payload[h.len] = '\0';
+
+    // argv[0] is ours, the client starts from the file
+    req->argc = h.argc + 1;
+    req->argv = malloc(sizeof(char*) * (req->argc + 1));
+    req->argv[0] = "coyote";
+    char* at = req->payload + strlen(req->payload) + 1;
+    char* end = req->payload + h.len;
+    for_n(i, 1, req->argc) {
+        if (at >= end) {
+            return false;
+        }
+        req->argv[i] = at;
+        at += strlen(at) + 1;
+    }
+    req->argv[req->argc] = nullptr;
+    return true;
+}
+
+// the server hands each request to a waiter, which runs the compile in a
+// worker and sends back how it went. the worker can exit() from anywhere
+// and the server never has to wait on anything.
+static void serve(int listener, int conn, ServerHooks hooks) {
+    Request req = {};
+    i32 code = 1;
+
+    if (!read_request(conn, &req)) {
+        // nothing to reply to
+    } else if (!fs_set_current_dir(req.payload)) {
+        dprintf(req.err, "cannot enter directory %s\n", req.payload);
+        write_all(conn, &code, sizeof(code));
+    } else {
+        hooks.prepare(req.argc, req.argv);
+        fflush(stdout);
+
+        pid_t waiter = fork();
+        if (waiter == 0) {
+            close(listener);
+            signal(SIGCHLD, SIG_DFL);
+
+            pid_t worker = fork();
+            if (worker == 0) {
+                close(conn);
+                dup2(req.out, STDOUT_FILENO);
+                dup2(req.err, STDERR_FILENO);
+                exit(hooks.compile(req.argc, req.argv));
+            }
+
+            int status;
+            if (worker != -1 && waitpid(worker, &status, 0) == worker) {
+                code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+            write_all(conn, &code, sizeof(code));
+            _exit(0);
+        }
+        if (waiter == -1) {
+            write_all(conn, &code, sizeof(code));
+        }
+    }
+
+    if (req.out != -1) {
+        close(req.out);
+    }
+    if (req.err != -1) {
+        close(req.err);
+    }
+    free(req.payload);
+    free(req.argv);
+}
+
+int server_run(const char* socket_path, ServerHooks hooks) {
+    struct sockaddr_un addr;
+    if (!make_addr(socket_path, &addr)) {
+        printf("socket path too long: %s\n", socket_path);
+        return 1;
+    }
+
+    // if nobody answers, it's left over from a server that went away
+    int existing = connect_to(socket_path);
+    if (existing != -1) {
+        close(existing);
+        printf("a server is already running on %s\n", socket_path);
+        return 1;
+    }
+    unlink(socket_path);
+
+    // nobody else gets to connect in the first place
+    mode_t old_mask = umask(0077);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool bound = listener != -1 && bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    umask(old_mask);
+    if (!bound || listen(listener, 64) == -1) {
+        printf("cannot listen on %s\n", socket_path);
+        return 1;
+    }
+
+    // waiters get reaped on their own, and clients that
+    // hang up early shouldn't take the server down with them
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("listening on %s\n", socket_path);
+    fflush(stdout);
+
+    while (true) {
+        int conn = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn == -1) {
+            continue;
+        }
+        serve(listener, conn, hooks);
+        close(conn);
+    }
+}
+
+int client_run(const char* socket_path, int argc, char** argv) {
+    int sock = connect_to(socket_path);
+    if (sock == -1) {
+        return -1;
+    }
+
+    char* cwd = fs_get_current_dir();
+    usize len = strlen(cwd) + 1;
+    for_n(i, 0, argc) {
+        len += strlen(argv[i]) + 1;
+    }
+    char* payload = malloc(len);
+    char* at = stpcpy(payload, cwd) + 1;
+    for_n(i, 0, argc) {
+        at = stpcpy(at, argv[i]) + 1;
+    }
+    free(cwd);
+
+    RequestHeader h = {
+        .magic = SERVER_MAGIC,
+        .version = COYOTE_VERSION,
+        .argc = argc,
+        .len = len,
+    };
+    int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    fflush(stdout);
+    bool sent = send_header(sock, &h, fds) && write_all(sock, payload, len);
+    free(payload);
+
+    i32 code = SERVER_DECLINED;
+    if (sent && !read_all(sock, &code, sizeof(code))) {
+        printf("lost the connection to the compile server\n");
+        code = 1;
+    }
+    close(sock);
+    return code;
+}
+
+#else
+
+const char* server_socket_path() {
+    return nullptr;
+}
+
+int server_run(const char* socket_path, ServerHooks hooks) {
+    printf("the compile server isn't supported on this system\n");
+    return 1;
+}
+
+int client_run(const char* socket_path, int argc, char** argv) {
+    return -1;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "coyote.h"
+
+// compile server. the server sits on a unix socket and runs every
+// compile it's handed in a fork of itself, so whatever it's already
+// set up (parsed headers and such) doesn't have to be redone.
+
+typedef struct {
+    // runs in the server itself before the fork, with the client's
+    // working directory. anything it caches is there for every later request.
+    void (*prepare)(int argc, char** argv);
+    // runs in the fork with the client's stdout and stderr, returns the exit code.
+    int (*compile)(int argc, char** argv);
+} ServerHooks;
+
+// $COYOTE_SOCKET, or somewhere per-user in the temp directory
+const char* server_socket_path();
+
+// doesn't return unless the socket can't be set up
+int server_run(const char* socket_path, ServerHooks hooks);
+
+// hand a compile to the server. argv[0] is the file like normal.
+// returns the exit code, or -1 if there's no server to talk to.
+int client_run(const char* socket_path, int argc, char** argv);
+
+#endif // SERVER_H
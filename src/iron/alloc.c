@@ -1,6 +1,16 @@
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef __STDC_NO_THREADS__
+    #include <threads.h>
+#endif
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+#endif
 
 #include "common/util.h"
 #include "iron/iron.h"
@@ -16,7 +26,7 @@ static u8 extra_size_table[FE__INST_END] = {
     [FE_SYM_ADDR] = sizeof(FeInstSymAddr),
     [FE_STACK_ADDR] = sizeof(FeInstStack),
     [FE_IADD ... FE_FREM] = 0,
-    [FE_MOV ... FE_F2I] = 0,
+    [FE_MOV ... FE_F2U] = 0,
     [FE_LOAD ... FE_MEM_BARRIER] = sizeof(FeInstMemop),
     [FE_UNREACHABLE] = 0,
     [FE_BRANCH] = sizeof(FeInstBranch),
@@ -24,6 +34,7 @@ static u8 extra_size_table[FE__INST_END] = {
     [FE_RETURN] = 0,
     [FE_PHI ... FE_MEM_PHI] = sizeof(FeInstPhi),
     [FE_CALL] = sizeof(FeInstCall),
+    [FE_TAILCALL] = sizeof(FeInstCall),
     [FE__MACH_REG] = 0,
     [FE__MACH_RETURN] = 0,
     [FE__MACH_STACK_SPILL] = sizeof(FeInstStack),
@@ -51,114 +62,326 @@ usize fe_inst_extra_size(FeInstKind kind) {
     return (usize) size;
 }
 
-#define IPOOL_CHUNK_DATA_SIZE 4096
+// the instruction space is reserved once for the whole process and
+// pools take chunks out of it, so every instruction and list is a
+// FeInstRef away from fe__inst_space. chunks get committed as
+// they're handed out and recycled when a pool is destroyed or reset.
+#if FE_HOST_BITS == 64
+    #define INST_SPACE_SIZE ((usize)1 << 35) // all of FeInstRef
+#else
+    #define INST_SPACE_SIZE ((usize)1 << 29)
+#endif
+#define INST_SPACE_MIN_SIZE ((usize)1 << 26)
+
+#define IPOOL_CHUNK_SIZE 4096 // slots, including the chunk header
 struct Fe__InstPoolChunk {
     Fe__InstPoolChunk* next;
     usize used;
-    usize data[IPOOL_CHUNK_DATA_SIZE];
-    // set to non-zero so slot reclaimer doesn't
-    // walk off the end of the chunk data on accident
-    usize backstop;
+    usize len; // slots in 'data'
+    usize data[];
 };
 struct Fe__InstPoolFreeSpace {
     Fe__InstPoolFreeSpace* next;
 };
 
-static Fe__InstPoolChunk* ipool_new_chunk() {
-    Fe__InstPoolChunk* chunk = fe_malloc(sizeof(Fe__InstPoolChunk));
+#define CHUNK_HEADER_SLOTS (sizeof(Fe__InstPoolChunk) / sizeof(usize))
+
+usize* fe__inst_space = nullptr;
+
+static struct {
+    _Atomic(u32) state; // 0 = not reserved, 1 = reserving, 2 = ready
+    usize size;         // in chunks
+    _Atomic(usize) top; // chunks handed out so far
+
+    atomic_flag lock;   // for 'recycled'
+    Fe__InstPoolChunk* recycled;
+} space;
+
+// chunks recycled on this thread get handed back out before the shared
+// list is touched. past CHUNK_CACHE_MAX they go to the shared list.
+// whatever's left when the thread exits goes there too, see chunk_cache_key.
+#define CHUNK_CACHE_MAX 256
+typedef struct ChunkCache {
+    Fe__InstPoolChunk* top;
+    usize len;
+    bool registered; // with chunk_cache_key
+} ChunkCache;
+static thread_local ChunkCache chunk_cache;
+
+static void chunk_cache_flush(void* data) {
+    ChunkCache* cache = data;
+    if (cache->top == nullptr) {
+        return;
+    }
+    Fe__InstPoolChunk* last = cache->top;
+    while (last->next != nullptr) {
+        last = last->next;
+    }
+    while (atomic_flag_test_and_set_explicit(&space.lock, memory_order_acquire)) {}
+    last->next = space.recycled;
+    space.recycled = cache->top;
+    atomic_flag_clear_explicit(&space.lock, memory_order_release);
+    cache->top = nullptr;
+    cache->len = 0;
+}
+
+#ifndef __STDC_NO_THREADS__
+    // only here for its destructor, which flushes the exiting thread's cache
+    static tss_t chunk_cache_key;
+#endif
+
+void fe_ipool_thread_flush() {
+    chunk_cache_flush(&chunk_cache);
+}
+
+static void* space_reserve(usize size) {
+#ifdef _WIN32
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void* p = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+#endif
+}
+
+static bool space_commit(void* p, usize size) {
+#ifdef _WIN32
+    return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    return mprotect(p, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+static void space_init() {
+    if_likely (atomic_load_explicit(&space.state, memory_order_acquire) == 2) {
+        return;
+    }
+    u32 expected = 0;
+    if (!atomic_compare_exchange_strong(&space.state, &expected, 1)) {
+        // someone else is reserving it
+        while (atomic_load_explicit(&space.state, memory_order_acquire) != 2) {}
+        return;
+    }
+
+    // take what we can get if the address space is tight
+    usize size = INST_SPACE_SIZE;
+    void* base = space_reserve(size);
+    while (base == nullptr && size > INST_SPACE_MIN_SIZE) {
+        size /= 2;
+        base = space_reserve(size);
+    }
+    if (base == nullptr) {
+        FE_CRASH("unable to reserve instruction space");
+    }
+    fe__inst_space = base;
+    space.size = size / (IPOOL_CHUNK_SIZE * sizeof(usize));
+    atomic_flag_clear(&space.lock);
+#ifndef __STDC_NO_THREADS__
+    if (tss_create(&chunk_cache_key, chunk_cache_flush) != thrd_success) {
+        FE_CRASH("unable to create thread exit hook");
+    }
+#endif
+    atomic_store_explicit(&space.state, 2, memory_order_release);
+}
+
+static Fe__InstPoolChunk* ipool_new_chunk(usize min_slots) {
+    usize len = IPOOL_CHUNK_SIZE - CHUNK_HEADER_SLOTS;
+    usize num_chunks = 1;
+    if_unlikely (min_slots > len) {
+        num_chunks = (min_slots + CHUNK_HEADER_SLOTS + IPOOL_CHUNK_SIZE - 1) / IPOOL_CHUNK_SIZE;
+        len = num_chunks * IPOOL_CHUNK_SIZE - CHUNK_HEADER_SLOTS;
+    }
+
+    Fe__InstPoolChunk* chunk = nullptr;
+    if (num_chunks == 1 && chunk_cache.top != nullptr) {
+        chunk = chunk_cache.top;
+        chunk_cache.top = chunk->next;
+        chunk_cache.len -= 1;
+    } else if (num_chunks == 1) {
+        while (atomic_flag_test_and_set_explicit(&space.lock, memory_order_acquire)) {}
+        chunk = space.recycled;
+        if (chunk != nullptr) {
+            space.recycled = chunk->next;
+        }
+        atomic_flag_clear_explicit(&space.lock, memory_order_release);
+    }
+
+    if (chunk == nullptr) {
+        usize index = atomic_fetch_add(&space.top, num_chunks);
+        if_unlikely (index + num_chunks > space.size) {
+            FE_CRASH("out of instruction space");
+        }
+        chunk = (Fe__InstPoolChunk*)&fe__inst_space[index * IPOOL_CHUNK_SIZE];
+        if (!space_commit(chunk, num_chunks * IPOOL_CHUNK_SIZE * sizeof(usize))) {
+            FE_CRASH("unable to commit instruction space");
+        }
+    }
+
     chunk->next = nullptr;
     chunk->used = 0;
-    chunk->backstop = 0xFF;
+    chunk->len = len;
     return chunk;
 }
 
 void fe_ipool_init(FeInstPool* pool) {
+    space_init();
     memset(pool, 0, sizeof(*pool));
-    pool->top = ipool_new_chunk();
-}
-
-static FeInst* init_inst(FeInst* inst) {
-    memset(inst, 0, sizeof(*inst));
-    inst->kind = 0xAAAA;
-    inst->vr_def = FE_VREG_NONE;
-    return inst;
+    pool->top = ipool_new_chunk(0);
 }
 
 static void* ipool_alloc_raw(FeInstPool* pool, usize slots) {
     // try to allocate on the front block
-    if (pool->top->used + slots <= IPOOL_CHUNK_DATA_SIZE) {
+    if (pool->top->used + slots <= pool->top->len) {
         // allocate on this block!
-        FeInst* inst = (FeInst*)&pool->top->data[pool->top->used];
+        void* mem = &pool->top->data[pool->top->used];
         pool->top->used += slots;
-        return init_inst(inst);
-    } 
+        return mem;
+    }
     // we need to make a new block and allocate on this.
-    Fe__InstPoolChunk* new_chunk = ipool_new_chunk();
+    Fe__InstPoolChunk* new_chunk;
+    if (pool->spare != nullptr && slots <= pool->spare->len) {
+        new_chunk = pool->spare;
+        pool->spare = new_chunk->next;
+    } else {
+        new_chunk = ipool_new_chunk(slots);
+    }
     new_chunk->next = pool->top;
     pool->top = new_chunk;
     new_chunk->used = slots;
-    return &new_chunk->data;;
+    return &new_chunk->data;
 }
 
-FeInst* fe_ipool_alloc(FeInstPool* pool, usize extra_size) {
-    if (extra_size > FE__INST_EXTRA_MAX_SIZE)  {
-        FE_CRASH("extra size > max size");
+static void ipool_add_spare(FeInstPool* pool, Fe__InstPoolChunk* chunk) {
+    chunk->next = pool->spare;
+    chunk->used = 0;
+    chunk->len = IPOOL_CHUNK_SIZE - CHUNK_HEADER_SLOTS;
+    pool->spare = chunk;
+}
+
+void fe_ipool_reserve(FeInstPool* pool, usize size) {
+    usize slots = (size + sizeof(usize) - 1) / sizeof(usize);
+    usize have = pool->top->len - pool->top->used;
+    for (Fe__InstPoolChunk* chunk = pool->spare; chunk != nullptr && have < slots; chunk = chunk->next) {
+        have += chunk->len;
+    }
+    if (have >= slots) {
+        return;
+    }
+    usize chunk_len = IPOOL_CHUNK_SIZE - CHUNK_HEADER_SLOTS;
+    usize num_chunks = (slots - have + chunk_len - 1) / chunk_len;
+
+    // recycled ones are already committed
+    while (num_chunks != 0 && chunk_cache.top != nullptr) {
+        Fe__InstPoolChunk* chunk = chunk_cache.top;
+        chunk_cache.top = chunk->next;
+        chunk_cache.len -= 1;
+        ipool_add_spare(pool, chunk);
+        num_chunks -= 1;
+    }
+    if (num_chunks != 0) {
+        while (atomic_flag_test_and_set_explicit(&space.lock, memory_order_acquire)) {}
+        while (num_chunks != 0 && space.recycled != nullptr) {
+            Fe__InstPoolChunk* chunk = space.recycled;
+            space.recycled = chunk->next;
+            ipool_add_spare(pool, chunk);
+            num_chunks -= 1;
+        }
+        atomic_flag_clear_explicit(&space.lock, memory_order_release);
+    }
+    if (num_chunks == 0) {
+        return;
     }
-    if (extra_size < sizeof(usize)) {
-        extra_size = sizeof(usize);
+
+    usize index = atomic_fetch_add(&space.top, num_chunks);
+    if_unlikely (index + num_chunks > space.size) {
+        FE_CRASH("out of instruction space");
+    }
+    usize* base = &fe__inst_space[index * IPOOL_CHUNK_SIZE];
+    if (!space_commit(base, num_chunks * IPOOL_CHUNK_SIZE * sizeof(usize))) {
+        FE_CRASH("unable to commit instruction space");
+    }
+#if !defined(_WIN32) && defined(MADV_POPULATE_WRITE)
+    // fault it all in now rather than a page at a time.
+    // older kernels say no and it happens the slow way
+    madvise(base, num_chunks * IPOOL_CHUNK_SIZE * sizeof(usize), MADV_POPULATE_WRITE);
+#endif
+    // backwards, so they get used in address order
+    for (usize i = num_chunks; i-- != 0;) {
+        ipool_add_spare(pool, (Fe__InstPoolChunk*)&base[i * IPOOL_CHUNK_SIZE]);
     }
+}
+
+// every node ends with room for two uses
+#define INLINE_USES_SLOTS (2 * sizeof(FeInstUse) / sizeof(usize))
 
-    usize extra_slots = extra_size / sizeof(usize);
-    usize node_slots = extra_slots + sizeof(FeInst) / 8;
+static inline usize tail_slots(usize tail_size) {
+    usize slots = (tail_size + sizeof(usize) - 1) / sizeof(usize);
+    return slots == 0 ? 1 : slots;
+}
 
-    // check if there's any reusable slots.
+FeInst* fe_ipool_alloc(FeInstPool* pool, usize tail_size) {
+    if (tail_size > FE__INST_EXTRA_MAX_SIZE + FE__INST_INLINE_INPUTS_MAX_SIZE)  {
+        FE_CRASH("extra size > max size");
+    }
+
+    usize size_class = tail_slots(tail_size);
+    usize node_slots = sizeof(FeInst) / sizeof(usize) + size_class + INLINE_USES_SLOTS;
+
+    FeInst* inst = nullptr;
+
+    // check if there's any reusable slots, smallest fit first.
     // THE VOICESSSSSS
-    for_n(i, extra_slots, FE__INST_EXTRA_MAX_SIZE / sizeof(usize) + 1) {
-        if (pool->inst_free_spaces[i] != nullptr) {
-            // pop from slot list
-            FeInst* inst = (FeInst*)pool->inst_free_spaces[i];
-            pool->inst_free_spaces[i] = pool->inst_free_spaces[i]->next;
-            return init_inst(inst);
+    u64 available = pool->inst_free_mask >> size_class;
+    if (available != 0) {
+        usize i = size_class + __builtin_ctzll(available);
+        // pop from slot list
+        inst = (FeInst*)pool->inst_free_spaces[i];
+        pool->inst_free_spaces[i] = pool->inst_free_spaces[i]->next;
+        if (pool->inst_free_spaces[i] == nullptr) {
+            pool->inst_free_mask &= ~((u64)1 << i);
         }
     }
 
-    FeInst* inst = (FeInst*) ipool_alloc_raw(pool, node_slots);
-    return init_inst(inst);
+    if (inst == nullptr) {
+        inst = ipool_alloc_raw(pool, node_slots);
+    }
+    pool->allocated += node_slots * sizeof(usize);
+    memset(inst, 0, node_slots * sizeof(usize));
+    inst->kind = 0xAAAA;
+    inst->vr_def = FE_VREG_NONE;
+    inst->uses = fe_inst_ref(&inst->extra[size_class]);
+    inst->caps = FE__USE_CAP_INLINE << 4;
+    return inst;
 }
 
-void fe_ipool_free(FeInstPool* pool, FeInst* inst) {
-    // set inst extra memory to zero
-    usize* extra = fe_extra(inst);
+// the part of the tail we know about for sure. extra data that outgrew
+// the kind's table entry or inline inputs that got moved out of the
+// instruction are just lost until the pool goes away.
+static usize inst_size_class(FeInst* inst) {
     usize extra_size = fe_inst_extra_size(inst->kind);
-    memset(extra, 0, extra_size);
+    usize size_class = tail_slots(extra_size);
+    if (fe_inst_in_inline(inst)) {
+        size_class += fe_inst_in_cap(inst) * sizeof(FeInstRef) / sizeof(usize);
+    }
+    return size_class;
+}
 
+void fe_ipool_free(FeInstPool* pool, FeInst* inst) {
     // reclaim slots
-    usize size_class = extra_size / sizeof(pool->top->data[0]);
-    // while (size_class < FE__IPOOL_INST_FREE_SPACES_LEN - 1 && extra[size_class] == 0) {
-    //     size_class += 1;
-    // }
+    usize size_class = inst_size_class(inst);
 
     // add to free list
     Fe__InstPoolFreeSpace* free_space = (Fe__InstPoolFreeSpace*)inst;
     free_space->next = pool->inst_free_spaces[size_class];
     pool->inst_free_spaces[size_class] = free_space;
+    pool->inst_free_mask |= (u64)1 << size_class;
 }
 
 // "free" the memory without actually giving it back to the allocator
 // return the amount of usable space available
 usize fe_ipool_free_manual(FeInstPool* pool, FeInst* inst) {
-    // set inst extra memory to zero
-    usize* extra = fe_extra(inst);
-    usize extra_size = fe_inst_extra_size(inst->kind);
-    memset(extra, 0, extra_size);
-
-    // reclaim slots
-    usize size_class = extra_size / sizeof(pool->top->data[0]);
-    while (size_class < FE__IPOOL_INST_FREE_SPACES_LEN - 1 && extra[size_class] == 0) {
-        size_class += 1;
-    }
-
-    return size_class * sizeof(pool->top->data[0]) + sizeof(FeInst);
+    usize size_class = inst_size_class(inst);
+    memset(fe_extra(inst), 0, (size_class + INLINE_USES_SLOTS) * sizeof(usize));
+    return (size_class + INLINE_USES_SLOTS) * sizeof(usize) + sizeof(FeInst);
 }
 
 static inline usize usize_next_pow_2(usize x) {
@@ -177,7 +400,7 @@ static inline usize usize_log2(usize x) {
 
 #define lengthof(arr) (sizeof(arr) / sizeof(arr[0]))
 
-// if not 3, must be a power of two
+// list_cap is in slots, and must be a power of two
 void* fe_ipool_list_alloc(FeInstPool* pool, usize list_cap) {
     // list_len = usize_next_pow_2(list_len);
 
@@ -186,6 +409,7 @@ void* fe_ipool_list_alloc(FeInstPool* pool, usize list_cap) {
     }
 
     usize index = usize_log2(list_cap);
+    pool->allocated += list_cap * sizeof(usize);
 
     if (index < lengthof(pool->lists_pow_2) && pool->lists_pow_2[index]) {
         Fe__InstPoolFreeSpace* space = pool->lists_pow_2[index];
@@ -217,25 +441,77 @@ void fe_ipool_list_free(FeInstPool* pool, void* list, usize list_cap) {
     constexpr usize top_index = lengthof(pool->lists_pow_2) - 1;
     constexpr usize chunk_len = (1ull << top_index);
 
+    usize* slots = list;
     while (list_cap != 0) {
         // insert into free list
-        Fe__InstPoolFreeSpace* space = (Fe__InstPoolFreeSpace*) list;
+        Fe__InstPoolFreeSpace* space = (Fe__InstPoolFreeSpace*) slots;
         space->next = pool->lists_pow_2[top_index];
         pool->lists_pow_2[top_index] = space;
 
-        // pointer arithmetic works out here i think???????
-        list += chunk_len;
+        slots += chunk_len;
         list_cap -= chunk_len;
     }
 }
 
-void fe_ipool_destroy(FeInstPool* pool) {
+static void ipool_recycle_chunks(FeInstPool* pool) {
     Fe__InstPoolChunk* top = pool->top;
+    // reserved ones that never got used go back the same way
+    if (pool->spare != nullptr) {
+        Fe__InstPoolChunk* last = pool->spare;
+        while (last->next != nullptr) {
+            last = last->next;
+        }
+        last->next = top;
+        top = pool->spare;
+    }
+    Fe__InstPoolChunk* shared = nullptr;
+    Fe__InstPoolChunk* shared_last = nullptr;
     while (top != nullptr) {
         Fe__InstPoolChunk* this = top;
         top = top->next;
-        fe_free(this);
-    } 
+
+        // big chunks go back as regular-sized ones
+        usize num_chunks = (this->len + CHUNK_HEADER_SLOTS) / IPOOL_CHUNK_SIZE;
+        for_n (i, 0, num_chunks) {
+            Fe__InstPoolChunk* chunk = (Fe__InstPoolChunk*)((usize*)this + i * IPOOL_CHUNK_SIZE);
+            if (chunk_cache.len < CHUNK_CACHE_MAX) {
+#ifndef __STDC_NO_THREADS__
+                if_unlikely (!chunk_cache.registered) {
+                    tss_set(chunk_cache_key, &chunk_cache);
+                    chunk_cache.registered = true;
+                }
+#endif
+                chunk->next = chunk_cache.top;
+                chunk_cache.top = chunk;
+                chunk_cache.len += 1;
+            } else {
+                chunk->next = shared;
+                shared = chunk;
+                if (shared_last == nullptr) {
+                    shared_last = chunk;
+                }
+            }
+        }
+    }
+
+    if (shared != nullptr) {
+        while (atomic_flag_test_and_set_explicit(&space.lock, memory_order_acquire)) {}
+        shared_last->next = space.recycled;
+        space.recycled = shared;
+        atomic_flag_clear_explicit(&space.lock, memory_order_release);
+    }
+}
+
+void fe_ipool_reset(FeInstPool* pool) {
+    usize allocated = pool->allocated;
+    ipool_recycle_chunks(pool);
+    memset(pool, 0, sizeof(*pool));
+    pool->top = ipool_new_chunk(0);
+    pool->allocated = allocated;
+}
+
+void fe_ipool_destroy(FeInstPool* pool) {
+    ipool_recycle_chunks(pool);
     *pool = (FeInstPool){0};
 }
 
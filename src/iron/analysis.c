@@ -0,0 +1,316 @@
+#include "iron/iron.h"
+
+// analyses that get cached on the function and its blocks.
+// f->analyses says which ones are still good, passes that break
+// one say so when they're registered, see FePassManager.
+
+// reverse postorder of the blocks reachable from the entry, then
+// everything unreachable in list order. returns how many are reachable.
+usize fe__block_rpo(FeFunc* f, FeBlock** order, usize block_count) {
+    bool* visited = fe_malloc(f->max_block_id * sizeof(visited[0]));
+    memset(visited, 0, f->max_block_id * sizeof(visited[0]));
+    FeBlock** stack = fe_malloc(block_count * sizeof(stack[0]));
+    u16* next_succ = fe_malloc(block_count * sizeof(next_succ[0]));
+
+    // postorder from the back of 'order'
+    usize post_index = block_count;
+    usize stack_len = 0;
+    stack[stack_len] = f->entry_block;
+    next_succ[stack_len] = 0;
+    stack_len += 1;
+    visited[f->entry_block->id] = true;
+    while (stack_len != 0) {
+        FeBlock* block = stack[stack_len - 1];
+        u16* succ_index = &next_succ[stack_len - 1];
+        if (*succ_index == block->succ_len) {
+            order[--post_index] = block;
+            stack_len -= 1;
+            continue;
+        }
+        // backwards, so the first successor ends up first
+        FeBlock* succ = block->succ[block->succ_len - 1 - (*succ_index)++];
+        if (!visited[succ->id]) {
+            visited[succ->id] = true;
+            stack[stack_len] = succ;
+            next_succ[stack_len] = 0;
+            stack_len += 1;
+        }
+    }
+
+    // slide the reachable blocks down and put the rest
+    // after them, in the order they were in before
+    usize reachable = block_count - post_index;
+    memmove(order, &order[post_index], reachable * sizeof(order[0]));
+    usize index = reachable;
+    for_blocks(block, f) {
+        if (!visited[block->id]) {
+            order[index++] = block;
+        }
+    }
+
+    fe_free(visited);
+    fe_free(stack);
+    fe_free(next_succ);
+    return reachable;
+}
+
+static usize count_blocks(FeFunc* f) {
+    usize count = 0;
+    for_blocks(block, f) {
+        count += 1;
+    }
+    return count;
+}
+
+static bool add_live_in(FeBlockLiveness* lv, FeVReg vr) {
+    // check to see if its already in the live-in_set.
+    for_n(i, 0, lv->in_len) {
+        if (lv->in[i] == vr) {
+            return false;
+        }
+    }
+    // vr is not in live-in. add it.
+    if (lv->in_len == lv->in_cap) {
+        lv->in_cap += lv->in_cap >> 1;
+        lv->in = fe_realloc(lv->in, sizeof(lv->in[0]) * lv->in_cap);
+    }
+    lv->in[lv->in_len++] = vr;
+    return true;
+}
+
+static bool add_live_out(FeBlockLiveness* lv, FeVReg vr) {
+    // check to see if its already in the live-out set.
+    for_n(i, 0, lv->out_len) {
+        if (lv->out[i] == vr) {
+            return false;
+        }
+    }
+    // vr is not in live-out. add it.
+    if (lv->out_len == lv->out_cap) {
+        lv->out_cap += lv->out_cap >> 1;
+        lv->out = fe_realloc(lv->out, sizeof(lv->out[0]) * lv->out_cap);
+    }
+    lv->out[lv->out_len++] = vr;
+    return true;
+}
+
+void fe__liveness_free(FeBlockLiveness* lv) {
+    fe_free(lv->in);
+    fe_free(lv->out);
+    fe_free(lv);
+}
+
+// needs vregs, so this only makes sense after isel
+static void compute_liveness(FeFunc* f) {
+    // give every basic block a liveness chunk.
+    for_blocks(block, f) {
+        if (block->live) {
+            fe__liveness_free(block->live);
+        }
+        FeBlockLiveness* lv = fe_malloc(sizeof(FeBlockLiveness));
+        memset(lv, 0, sizeof(FeBlockLiveness));
+        lv->block = block;
+        block->live = lv;
+
+        // initialize live-in/live-out vectors
+        lv->in_cap = 16;
+        lv->out_cap = 16;
+        lv->in = fe_malloc(sizeof(lv->in[0]) * lv->in_cap);
+        lv->out = fe_malloc(sizeof(lv->out[0]) * lv->out_cap);
+    }
+
+    // initialize simple live-ins
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            if (inst->vr_def == FE_VREG_NONE) continue;
+
+            FeInstRef* inputs = fe_inst_inputs(inst);
+            for_n(i, 0, inst->in_len) {
+                FeInst* input = fe_inst_at(inputs[i]);
+                FeVirtualReg* vr = fe_vreg(f->vregs, input->vr_def);
+                if (input->kind == FE__MACH_UPSILON || vr->def_block != block) {
+                    add_live_in(block->live, input->vr_def);
+                }
+            }
+        }
+    }
+
+    // iterate over the blocks, refining liveness until everything is settled
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        // block.live_out = block.live_out U successor0.live_in U successor1.live_in ...
+        for_blocks(block, f) {
+            for_n(succ_i, 0, block->succ_len) {
+                FeBlock* succ = block->succ[succ_i];
+                for_n(i, 0, succ->live->in_len) {
+                    FeVReg succ_live_in = succ->live->in[i];
+                    // add it to block.out
+                    changed |= add_live_out(block->live, succ_live_in);
+                    // if not defined in this block, add it block.in
+                    FeVirtualReg* succ_live_in_vr = fe_vreg(f->vregs, succ_live_in);
+                    if (!succ_live_in_vr->is_phi_out && succ_live_in_vr->def_block != block) {
+                        changed |= add_live_in(block->live, succ_live_in);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// cooper, harvey & kennedy, "a simple, fast dominance algorithm".
+// iterate over the blocks in reverse postorder, meeting the
+// dominators of every processed predecessor, until nothing moves.
+static void compute_dominators(FeFunc* f) {
+    usize block_count = count_blocks(f);
+    FeBlock** order = fe_malloc(block_count * sizeof(order[0]));
+    usize reachable = fe__block_rpo(f, order, block_count);
+
+    u32* rpo_index = fe_malloc(f->max_block_id * sizeof(rpo_index[0]));
+    for_n (i, 0, block_count) {
+        rpo_index[order[i]->id] = i;
+        order[i]->idom = nullptr;
+    }
+
+    // the entry is its own dominator while this runs,
+    // so a null idom means "not reached yet"
+    FeBlock* entry = f->entry_block;
+    entry->idom = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for_n (i, 1, reachable) {
+            FeBlock* block = order[i];
+            FeBlock* new_idom = nullptr;
+            for_n (p, 0, block->pred_len) {
+                FeBlock* pred = block->pred[p];
+                if (pred->idom == nullptr) {
+                    continue;
+                }
+                if (new_idom == nullptr) {
+                    new_idom = pred;
+                    continue;
+                }
+                // walk both up the tree until they meet
+                FeBlock* a = pred;
+                FeBlock* b = new_idom;
+                while (a != b) {
+                    while (rpo_index[a->id] > rpo_index[b->id]) a = a->idom;
+                    while (rpo_index[b->id] > rpo_index[a->id]) b = b->idom;
+                }
+                new_idom = a;
+            }
+            if (block->idom != new_idom) {
+                block->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+    entry->idom = nullptr;
+
+    // idoms always come first in reverse postorder
+    for_n (i, 0, block_count) {
+        FeBlock* block = order[i];
+        block->dom_depth = block->idom == nullptr ? 0 : block->idom->dom_depth + 1;
+    }
+
+    fe_free(rpo_index);
+    fe_free(order);
+}
+
+bool fe_block_dominates(FeBlock* a, FeBlock* b) {
+    while (b != nullptr && b->dom_depth > a->dom_depth) {
+        b = b->idom;
+    }
+    return a == b;
+}
+
+// natural loops. an edge into a block that dominates its source is a
+// back edge, and the loop is everything that reaches the back edge
+// without going through the header. headers come up in reverse
+// postorder, outer before inner, so the innermost header wins.
+static void compute_loops(FeFunc* f) {
+    usize block_count = count_blocks(f);
+    FeBlock** order = fe_malloc(block_count * sizeof(order[0]));
+    usize reachable = fe__block_rpo(f, order, block_count);
+    FeBlock** stack = fe_malloc(block_count * sizeof(stack[0]));
+
+    // in_loop[id] == header index + 1 once a block is in that header's loop
+    u32* in_loop = fe_malloc(f->max_block_id * sizeof(in_loop[0]));
+    memset(in_loop, 0, f->max_block_id * sizeof(in_loop[0]));
+
+    for_blocks(block, f) {
+        block->loop_header = nullptr;
+        block->loop_depth = 0;
+    }
+
+    for_n (i, 0, reachable) {
+        FeBlock* header = order[i];
+        u32 mark = i + 1;
+        bool is_header = false;
+        usize stack_len = 0;
+        in_loop[header->id] = mark;
+        for_n (p, 0, header->pred_len) {
+            FeBlock* pred = header->pred[p];
+            if (!fe_block_dominates(header, pred)) {
+                continue;
+            }
+            is_header = true;
+            if (in_loop[pred->id] != mark) {
+                in_loop[pred->id] = mark;
+                stack[stack_len++] = pred;
+            }
+        }
+        if (!is_header) {
+            continue;
+        }
+
+        header->loop_header = header;
+        header->loop_depth += 1;
+        while (stack_len != 0) {
+            FeBlock* block = stack[--stack_len];
+            block->loop_header = header;
+            block->loop_depth += 1;
+            for_n (p, 0, block->pred_len) {
+                FeBlock* pred = block->pred[p];
+                // unreachable blocks can jump in, but they aren't part of anything
+                bool pred_reachable = pred->idom != nullptr || pred == f->entry_block;
+                if (pred_reachable && in_loop[pred->id] != mark) {
+                    in_loop[pred->id] = mark;
+                    stack[stack_len++] = pred;
+                }
+            }
+        }
+    }
+
+    fe_free(in_loop);
+    fe_free(stack);
+    fe_free(order);
+}
+
+void fe_analysis_require(FeFunc* f, FeAnalysisSet set) {
+    // loops are found with the dominator tree
+    if (set & FE_ANALYSIS_LOOPS) {
+        set |= FE_ANALYSIS_DOMINATORS;
+    }
+
+    FeAnalysisSet missing = set & ~f->analyses;
+    if (missing & FE_ANALYSIS_LIVENESS) {
+        compute_liveness(f);
+    }
+    if (missing & FE_ANALYSIS_DOMINATORS) {
+        compute_dominators(f);
+    }
+    if (missing & FE_ANALYSIS_LOOPS) {
+        compute_loops(f);
+    }
+    f->analyses |= set;
+}
+
+void fe_analysis_invalidate(FeFunc* f, FeAnalysisSet set) {
+    // loops are only good as long as the dominators they came from
+    if (set & FE_ANALYSIS_DOMINATORS) {
+        set |= FE_ANALYSIS_LOOPS;
+    }
+    f->analyses &= ~set;
+}
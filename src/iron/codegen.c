@@ -61,7 +61,7 @@ static void insert_upsilon(FeFunc* f) {
     }
 }
 
-void fe_codegen(FeFunc* f) {
+void fe_codegen_isel(FeFunc* f) {
 
     insert_upsilon(f);
 
@@ -125,11 +125,11 @@ void fe_codegen(FeFunc* f) {
         fe_inst_destroy(f, from);
     }
 
-    fe_opt_tdce(f);
-
-    fe_opt_compact_ids(f);
-
     fe_free(value_map);
+}
+
+void fe_codegen_vregs(FeFunc* f) {
+    const FeTarget* target = f->mod->target;
 
     // create virtual registers for instructions that dont have them yet
     for_blocks(block, f) {
@@ -150,8 +150,12 @@ void fe_codegen(FeFunc* f) {
 
         }
     }
+}
 
-    fe_regalloc_basic(f);
-
-    fe_opt_post_regalloc(f);
+void fe_codegen(FeFunc* f) {
+    FePassManager pm;
+    fe_pm_init(&pm);
+    fe_pm_add_codegen(&pm);
+    fe_pm_run(&pm, f);
+    fe_pm_destroy(&pm);
 }
@@ -0,0 +1,145 @@
+#include "iron/iron.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// throughput of fe_opt_local on big synthetic functions.
+//     iron-bench [inst count] [function count]
+
+static u64 rng = 88172645463325252ull;
+
+static u32 random_below(u32 n) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (u32)(rng % n);
+}
+
+static f64 now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (f64)t.tv_sec + (f64)t.tv_nsec * 1e-9;
+}
+
+static FeInstKind binops[] = {
+    FE_IADD, FE_ISUB, FE_IMUL, FE_AND, FE_OR, FE_XOR, FE_SHL, FE_USR, FE_UDIV, FE_UREM,
+};
+
+// straight-line arithmetic over the params and small constants, split
+// into blocks now and then. plenty of it folds, simplifies, or dies.
+static FeFunc* make_func(FeModule* mod, FeSection* text, FeFuncSig* sig, FeInstPool* ipool, FeVRegBuffer* vregs, usize index, usize inst_count) {
+    char name[32];
+    snprintf(name, sizeof(name), "bench_%zu", index);
+    FeSymbol* sym = fe_symbol_new(mod, strdup(name), 0, text, FE_BIND_GLOBAL);
+    FeFunc* f = fe_func_new(mod, sym, sig, ipool, vregs);
+
+    FeInst** values = malloc(sizeof(values[0]) * (inst_count + 2));
+    usize values_len = 0;
+    values[values_len++] = fe_func_param(f, 0);
+    values[values_len++] = fe_func_param(f, 1);
+
+    FeBlock* block = f->entry_block;
+    for_n (i, 0, inst_count) {
+        FeInst* inst;
+        if (random_below(4) == 0) {
+            inst = fe_inst_const(f, FE_TY_I32, 1 << random_below(6));
+        } else {
+            usize window = values_len < 64 ? values_len : 64;
+            FeInst* lhs = values[values_len - 1 - random_below(window)];
+            FeInst* rhs = values[values_len - 1 - random_below(window)];
+            inst = fe_inst_binop(f, FE_TY_I32, binops[random_below(sizeof(binops) / sizeof(binops[0]))], lhs, rhs);
+        }
+        fe_append_end(block, inst);
+        values[values_len++] = inst;
+
+        if (random_below(256) == 0) {
+            FeBlock* next = fe_block_new(f);
+            FeInst* jump = fe_inst_jump(f);
+            fe_append_end(block, jump);
+            fe_jump_set_target(f, jump, next);
+            block = next;
+        }
+    }
+
+    FeInst* ret = fe_inst_return(f);
+    fe_append_end(block, ret);
+    fe_return_set_arg(f, ret, 0, values[values_len - 1]);
+
+    free(values);
+    return f;
+}
+
+static usize count_insts(FeFunc* f) {
+    usize count = 0;
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    usize inst_count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    usize func_count = argc > 2 ? strtoull(argv[2], nullptr, 10) : 10;
+
+    FeModule* mod = fe_module_new(FE_ARCH_XR17032, FE_SYSTEM_FREESTANDING);
+    FeSection* text = fe_section_new(mod, "text", 0, FE_SECTION_EXECUTABLE);
+    FeFuncSig* sig = fe_funcsig_new(FE_CCONV_JACKAL, 2, 1);
+    fe_funcsig_param(sig, 0)->ty = FE_TY_I32;
+    fe_funcsig_param(sig, 1)->ty = FE_TY_I32;
+    fe_funcsig_return(sig, 0)->ty = FE_TY_I32;
+
+    FeVRegBuffer vregs;
+    fe_vrbuf_init(&vregs, 2048);
+
+    f64 local_time = 0;
+    usize insts_before = 0;
+    usize insts_after = 0;
+    for_n (i, 0, func_count) {
+        FeInstPool ipool;
+        fe_ipool_init(&ipool);
+        FeFunc* f = make_func(mod, text, sig, &ipool, &vregs, i, inst_count);
+        insts_before += count_insts(f);
+
+        f64 start = now();
+        fe_opt_local(f);
+        local_time += now() - start;
+
+        insts_after += count_insts(f);
+        fe_func_destroy_fast(f);
+        fe_ipool_destroy(&ipool);
+    }
+
+    printf("fe_opt_local: %zu functions, %zu -> %zu insts\n", func_count, insts_before, insts_after);
+    printf("  %.3f s, %.2f M insts/s\n", local_time, (f64)insts_before / local_time / 1e6);
+
+    // the worklist by itself, every inst pushed once then
+    // pushed again as they come off, like a pass would
+    FeInstPool ipool;
+    fe_ipool_init(&ipool);
+    FeFunc* f = make_func(mod, text, sig, &ipool, &vregs, func_count, inst_count);
+    const char* order_names[] = {"by id", "lifo", "fifo"};
+    for_n (order, FE_ISET_BY_ID, FE_ISET_FIFO + 1) {
+        f64 start = now();
+        usize pops = 0;
+        for_n (round, 0, 10) {
+            FeInstSet wlist;
+            fe_iset_init(&wlist, f, order);
+            for_blocks(block, f) {
+                for_inst(inst, block) {
+                    fe_iset_push(&wlist, inst);
+                }
+            }
+            for (FeInst* inst = fe_iset_pop(&wlist); inst != nullptr; inst = fe_iset_pop(&wlist)) {
+                pops += 1;
+                if (inst->in_len != 0 && (inst->id & 7) == 0) {
+                    fe_iset_push(&wlist, fe_inst_input(inst, 0));
+                }
+            }
+            fe_iset_destroy(&wlist);
+        }
+        f64 time = now() - start;
+        printf("FeInstSet %-6s %.2f M pops/s\n", order_names[order], (f64)pops / time / 1e6);
+    }
+}
@@ -0,0 +1,265 @@
+#include "iron/iron.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// reads iron IR, runs passes over it, writes it back out.
+//     fe-opt [-p pass,pass,...] [-e sym,sym,...] [--inline] [--gc] [-u units]
+//            [-b] [--stats] [-o out] in...
+// the input can be printed IR or a module from fe_module_write,
+// -b writes the latter instead of printing.
+// 'codegen' in the pass list stands for the whole codegen pipeline.
+// more than one input gets linked into one module first. -e makes
+// everything but the listed symbols local, --inline runs the inliner
+// over the whole thing, --gc drops whatever nothing can reach anymore,
+// and -u splits it back up into out.0, out.1, ...
+
+static f64 now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (f64)t.tv_sec + (f64)t.tv_nsec * 1e-9;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: fe-opt [-p pass,pass,...] [-e sym,sym,...] [--inline] [--gc] [-u units]\n");
+    fprintf(stderr, "              [-b] [--stats] [-o out] in...\n");
+    exit(1);
+}
+
+// stays mapped until exit, binary modules point into it
+static const u8* map_file(const char* path, usize* len) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "cannot open '%s'\n", path);
+        exit(1);
+    }
+    // pipes and such can't be mapped, just read them in
+    if (!S_ISREG(st.st_mode)) {
+        usize cap = 4096;
+        u8* data = malloc(cap);
+        *len = 0;
+        ssize_t n;
+        while ((n = read(fd, data + *len, cap - *len)) > 0) {
+            *len += n;
+            if (*len == cap) {
+                cap *= 2;
+                data = realloc(data, cap);
+            }
+        }
+        close(fd);
+        return data;
+    }
+    *len = st.st_size;
+    if (*len == 0) {
+        close(fd);
+        return (const u8*)"";
+    }
+    void* data = mmap(nullptr, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "cannot read '%s'\n", path);
+        exit(1);
+    }
+    return data;
+}
+
+static void add_passes(FePassManager* pm, char* list) {
+    for (char* name = strtok(list, ","); name != nullptr; name = strtok(nullptr, ",")) {
+        if (strcmp(name, "codegen") == 0) {
+            fe_pm_add_codegen(pm);
+            continue;
+        }
+        const FePass* pass = fe_pass_by_name(name);
+        if (pass == nullptr) {
+            fprintf(stderr, "unknown pass '%s'\n", name);
+            exit(1);
+        }
+        fe_pm_add(pm, pass);
+    }
+}
+
+static FeModule* load_module(const char* path, usize* len, FeInstPool* ipool, FeVRegBuffer* vregs) {
+    const u8* src = map_file(path, len);
+    if (*len >= 4 && memcmp(src, "FeIR", 4) == 0) {
+        FeModule* mod = fe_module_read(src, *len, ipool, vregs);
+        if (mod == nullptr) {
+            fprintf(stderr, "%s: not a module this version of iron can read\n", path);
+            exit(1);
+        }
+        return mod;
+    }
+    FeModule* mod = fe_module_new(FE_ARCH_XR17032, FE_SYSTEM_FREESTANDING);
+    FeIrParseError err;
+    if (!fe_parse_ir(mod, (const char*)src, *len, ipool, vregs, &err)) {
+        fprintf(stderr, "%s:%u:%u: %s\n", path, err.line, err.col, err.message);
+        exit(1);
+    }
+    return mod;
+}
+
+static void write_module(FeModule* mod, FeDataBuffer* db, bool binary) {
+    if (binary) {
+        fe_module_write(db, mod);
+    } else {
+        for_funcs(f, mod) {
+            fe_emit_ir_func(db, f, false);
+        }
+    }
+}
+
+static void write_file(const char* path, FeDataBuffer* db) {
+    FILE* out = stdout;
+    if (path != nullptr) {
+        out = fopen(path, "wb");
+        if (out == nullptr) {
+            fprintf(stderr, "cannot open '%s'\n", path);
+            exit(1);
+        }
+    }
+    fwrite(db->at, 1, db->len, out);
+    if (out != stdout) {
+        fclose(out);
+    }
+}
+
+int main(int argc, char** argv) {
+    const char** in_paths = malloc(sizeof(in_paths[0]) * argc);
+    usize in_len = 0;
+    const char* out_path = nullptr;
+    bool stats = false;
+    bool binary = false;
+    bool inline_funcs = false;
+    bool gc = false;
+    usize units_len = 0;
+
+    const char** exports = nullptr;
+    usize exports_len = 0;
+    bool internalize = false;
+
+    FePassManager pm;
+    fe_pm_init(&pm);
+
+    for_n (i, 1, argc) {
+        if (strcmp(argv[i], "-p") == 0) {
+            if (++i == argc) usage();
+            add_passes(&pm, argv[i]);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (++i == argc) usage();
+            out_path = argv[i];
+        } else if (strcmp(argv[i], "-e") == 0) {
+            if (++i == argc) usage();
+            internalize = true;
+            for (char* name = strtok(argv[i], ","); name != nullptr; name = strtok(nullptr, ",")) {
+                exports = realloc(exports, sizeof(exports[0]) * (exports_len + 1));
+                exports[exports_len++] = name;
+            }
+        } else if (strcmp(argv[i], "-u") == 0) {
+            if (++i == argc) usage();
+            units_len = strtoul(argv[i], nullptr, 10);
+            if (units_len == 0) usage();
+        } else if (strcmp(argv[i], "-b") == 0) {
+            binary = true;
+        } else if (strcmp(argv[i], "--inline") == 0) {
+            inline_funcs = true;
+        } else if (strcmp(argv[i], "--gc") == 0) {
+            gc = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            in_paths[in_len++] = argv[i];
+        }
+    }
+    if (in_len == 0 || (units_len != 0 && out_path == nullptr)) {
+        usage();
+    }
+
+    FeInstPool ipool;
+    fe_ipool_init(&ipool);
+    FeVRegBuffer vregs;
+    fe_vrbuf_init(&vregs, 2048);
+
+    f64 read_start = now();
+    usize src_len = 0;
+    FeModule* mod = nullptr;
+    for_n (i, 0, in_len) {
+        usize len;
+        FeModule* next = load_module(in_paths[i], &len, &ipool, &vregs);
+        src_len += len;
+        if (mod == nullptr) {
+            mod = next;
+            continue;
+        }
+        FeSymbol* clash = fe_module_link(mod, next);
+        if (clash != nullptr) {
+            fprintf(stderr, "%s: '%.*s' is already defined\n", in_paths[i], clash->name.len, fe_compstr_data(clash->name));
+            return 1;
+        }
+    }
+    f64 read_time = now() - read_start;
+
+    if (internalize) {
+        fe_module_internalize(mod, exports, exports_len);
+    }
+    if (inline_funcs) {
+        fe_opt_inline(mod, FE_INLINE_THRESHOLD_DEFAULT);
+    }
+    usize removed = 0;
+    if (gc) {
+        removed = fe_opt_dead_symbols(mod);
+    }
+
+    // externs don't have anything to run passes on
+    for_funcs(f, mod) {
+        if (f->sym->bind != FE_BIND_EXTERN) {
+            fe_pm_run(&pm, f);
+        }
+    }
+
+    FeDataBuffer db;
+    fe_db_init(&db, 4096);
+    f64 write_time = 0;
+    usize written = 0;
+    if (units_len == 0) {
+        f64 write_start = now();
+        write_module(mod, &db, binary);
+        write_time = now() - write_start;
+        written = db.len;
+        write_file(out_path, &db);
+    } else {
+        FeModule** units = malloc(sizeof(units[0]) * units_len);
+        units_len = fe_module_partition(mod, units, units_len);
+        for_n (u, 0, units_len) {
+            db.len = 0;
+            f64 write_start = now();
+            write_module(units[u], &db, binary);
+            write_time += now() - write_start;
+            written += db.len;
+
+            char* path = malloc(strlen(out_path) + 24);
+            sprintf(path, "%s.%zu", out_path, u);
+            write_file(path, &db);
+            free(path);
+        }
+    }
+
+    if (stats) {
+        fprintf(stderr, "read %zu bytes in %.3f ms, %.2f MB/s\n",
+            src_len, read_time * 1e3, (f64)src_len / read_time / 1e6);
+        if (gc) {
+            fprintf(stderr, "removed %zu dead symbols\n", removed);
+        }
+        fprintf(stderr, "wrote %zu bytes in %.3f ms, %.2f MB/s\n",
+            written, write_time * 1e3, (f64)written / write_time / 1e6);
+        FeDataBuffer json;
+        fe_db_init(&json, 4096);
+        fe_pm_dump_json(&pm, &json);
+        fwrite(json.at, 1, json.len, stderr);
+    }
+}
@@ -6,7 +6,7 @@
 static const char* inst_name(FeInst* inst) {
     FeInst* bookend = inst;
     while (bookend->kind != FE__BOOKEND) {
-        bookend = bookend->next;
+        bookend = fe_inst_next(bookend);
     }
     const FeTarget* t = fe_extra(bookend, FeInst_Bookend)->block->func->mod->target;
     return fe_inst_name(t, inst->kind);
@@ -247,12 +247,12 @@ FeBlock* fe_block_new(FeFunc* f) {
     // init predecessor list
     block->pred_len = 0;
     block->pred_cap = 2;
-    block->pred = fe_ipool_list_alloc(f->ipool, block->pred_cap);
+    block->pred = block->pred_inline;
 
     // init successor list
     block->succ_len = 0;
     block->succ_cap = 2;
-    block->succ = fe_ipool_list_alloc(f->ipool, block->succ_cap);
+    block->succ = block->succ_inline;
 
     block->func = f;
     
@@ -260,8 +260,8 @@ FeBlock* fe_block_new(FeFunc* f) {
     FeInst* bookend = fe_ipool_alloc(f->ipool, sizeof(FeInst_Bookend));
     bookend->kind = FE__BOOKEND;
     bookend->ty = FE_TY_VOID;
-    bookend->next = bookend;
-    bookend->prev = bookend;
+    bookend->next = fe_inst_ref(bookend);
+    bookend->prev = fe_inst_ref(bookend);
     fe_extra(bookend, FeInst_Bookend)->block = block;
     block->bookend = bookend;
 
@@ -298,8 +298,15 @@ void fe_block_destroy(FeBlock *block) {
     }
     fe_inst_destroy(f, block->bookend);
     
-    fe_ipool_list_free(f->ipool, block->pred, block->pred_cap);
-    fe_ipool_list_free(f->ipool, block->succ, block->succ_cap);
+    if (block->pred != block->pred_inline) {
+        fe_ipool_list_free(f->ipool, block->pred, block->pred_cap);
+    }
+    if (block->succ != block->succ_inline) {
+        fe_ipool_list_free(f->ipool, block->succ, block->succ_cap);
+    }
+    if (block->live) {
+        fe__liveness_free(block->live);
+    }
     
     fe_free(block);
 }
@@ -308,14 +315,14 @@ FeInstChain fe_chain_from_block(FeBlock* block) {
     FeInstChain chain;
     
     // extract it from the block's inst list
-    chain.begin = block->bookend->next;
-    chain.end = block->bookend->prev;
-    chain.begin->prev = nullptr;
-    chain.end->next = nullptr;
+    chain.begin = fe_inst_next(block->bookend);
+    chain.end = fe_inst_prev(block->bookend);
+    chain.begin->prev = 0;
+    chain.end->next = 0;
     
     // remove it from the block
-    block->bookend->next = block->bookend;
-    block->bookend->prev = block->bookend;
+    block->bookend->next = fe_inst_ref(block->bookend);
+    block->bookend->prev = fe_inst_ref(block->bookend);
     return chain;
 }
 
@@ -325,9 +332,11 @@ void fe_cfg_add_edge(FeFunc* f, FeBlock* pred, FeBlock* succ) {
     // append succ to pred's succ list
     if_unlikely (pred->succ_cap == pred->succ_len) {
         pred->succ_cap *= 2;
-        FeBlock** new_list = fe_ipool_list_alloc(pool, pred->succ_len);
+        FeBlock** new_list = fe_ipool_list_alloc(pool, pred->succ_cap);
         memcpy(new_list, pred->succ, sizeof(pred->succ[0]) * pred->succ_len);
-        fe_ipool_list_free(pool, pred->succ, pred->succ_len);
+        if (pred->succ != pred->succ_inline) {
+            fe_ipool_list_free(pool, pred->succ, pred->succ_len);
+        }
         pred->succ = new_list;
     }
     pred->succ[pred->succ_len] = succ;
@@ -336,9 +345,11 @@ void fe_cfg_add_edge(FeFunc* f, FeBlock* pred, FeBlock* succ) {
     // append pred to succ's pred list
     if_unlikely (succ->pred_cap == succ->pred_len) {
         succ->pred_cap *= 2;
-        FeBlock** new_list = fe_ipool_list_alloc(pool, succ->pred_len);
+        FeBlock** new_list = fe_ipool_list_alloc(pool, succ->pred_cap);
         memcpy(new_list, succ->pred, sizeof(succ->pred[0]) * succ->pred_len);
-        fe_ipool_list_free(pool, pred->pred, succ->pred_len);
+        if (succ->pred != succ->pred_inline) {
+            fe_ipool_list_free(pool, succ->pred, succ->pred_len);
+        }
         succ->pred = new_list;
     }
     succ->pred[succ->pred_len] = pred;
@@ -481,11 +492,33 @@ FeFunc* fe_func_new(FeModule* mod, FeSymbol* sym, FeFuncSig* sig, FeInstPool* ip
     return f;
 }
 
+static void func_remove_from_module(FeFunc* f) {
+    if (f->list_next == nullptr) { // at back of list
+        f->mod->funcs.last = f->list_prev;
+    } else {
+        f->list_next->list_prev = f->list_prev;
+    }
+    if (f->list_prev == nullptr) { // at front of list
+        f->mod->funcs.first = f->list_next;
+    } else {
+        f->list_prev->list_next = f->list_next;
+    }
+}
+
 void fe_func_destroy(FeFunc *f) {
     if (f->params) {
         fe_free(f->params);    
     }
 
+    // cut every edge first, an instruction can't go while it still has users
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            for_n (i, 0, inst->in_len) {
+                fe_set_input_null(inst, i);
+            }
+        }
+    }
+
     // free the block list
     while (f->entry_block) {
         fe_block_destroy(f->entry_block);
@@ -496,19 +529,41 @@ void fe_func_destroy(FeFunc *f) {
         fe_free(fe_stack_remove(f, f->stack_top));
     }
 
-    // remove from linked list
-    if (f->list_next == nullptr) { // at back of list
-        f->mod->funcs.last = f->list_prev;
-    } else {
-        f->list_next->list_prev = f->list_prev;
+    if (f->owns_ipool) {
+        fe_ipool_destroy(f->ipool);
+        fe_free(f->ipool);
     }
-    if (f->list_prev == nullptr) { // at front of list
-        f->mod->funcs.first = f->list_next;
+
+    func_remove_from_module(f);
+    fe_free(f);
+}
+
+void fe_func_destroy_fast(FeFunc* f) {
+    if (f->params) {
+        fe_free(f->params);
+    }
+
+    // the instructions and lists all go with the pool,
+    // the blocks are the only thing left to free
+    for (FeBlock* block = f->entry_block, *next; block != nullptr; block = next) {
+        next = block->list_next;
+        if (block->live) {
+            fe__liveness_free(block->live);
+        }
+        fe_free(block);
+    }
+    if (f->owns_ipool) {
+        fe_ipool_destroy(f->ipool);
+        fe_free(f->ipool);
     } else {
-        f->list_prev->list_next = f->list_next;
+        fe_ipool_reset(f->ipool);
     }
-    // f->list_next = NULL;
-    // f->list_prev = NULL;
+
+    while (f->stack_top) {
+        fe_free(fe_stack_remove(f, f->stack_top));
+    }
+
+    func_remove_from_module(f);
     fe_free(f);
 }
 
@@ -532,6 +587,7 @@ FeBlock** fe_list_terminator_successors(const FeTarget* t, FeInst* term, usize*
         *len_out = 2;
         return &fe_extra(term, FeInstBranch)->if_true;
     case FE_RETURN:
+    case FE_TAILCALL:
     default:
         *len_out = 0;
         return nullptr;
@@ -540,41 +596,43 @@ FeBlock** fe_list_terminator_successors(const FeTarget* t, FeInst* term, usize*
 
 // remove inst from its basic block
 FeInst* fe_inst_remove_from_block(FeInst* inst) {
-    if (inst->next) {
-        inst->next->prev = inst->prev;
+    FeInst* next = fe_inst_next(inst);
+    FeInst* prev = fe_inst_prev(inst);
+    if (next) {
+        next->prev = inst->prev;
     }
-    if (inst->prev) {
-        inst->prev->next = inst->next;
+    if (prev) {
+        prev->next = inst->next;
     }
-    inst->next = nullptr;
-    inst->prev = nullptr;
+    inst->next = 0;
+    inst->prev = 0;
     return inst;
 }
 
 // insert 'i' before 'point' in a basic block
 FeInst* fe_insert_before(FeInst* point, FeInst* i) {
-    FeInst* p_prev = point->prev;
-    p_prev->next = i;
-    point->prev = i;
-    i->next = point;
-    i->prev = p_prev;
+    FeInst* p_prev = fe_inst_prev(point);
+    p_prev->next = fe_inst_ref(i);
+    point->prev = fe_inst_ref(i);
+    i->next = fe_inst_ref(point);
+    i->prev = fe_inst_ref(p_prev);
     return i;
 }
 
 // insert 'i' after 'point' in a basic block
 FeInst* fe_insert_after(FeInst* point, FeInst* i) {
-    FeInst* p_next = point->next;
-    p_next->prev = i;
-    point->next = i;
-    i->prev = point;
-    i->next = p_next;
+    FeInst* p_next = fe_inst_next(point);
+    p_next->prev = fe_inst_ref(i);
+    point->next = fe_inst_ref(i);
+    i->prev = fe_inst_ref(point);
+    i->next = fe_inst_ref(p_next);
     return i;
 }
 
 // replace 'from' with 'to' in a basic block
 void fe_inst_replace_pos(FeInst* from, FeInst* to) {
-    from->next->prev = to;
-    from->prev->next = to;
+    fe_inst_next(from)->prev = fe_inst_ref(to);
+    fe_inst_prev(from)->next = fe_inst_ref(to);
     to->next = from->next;
     to->prev = from->prev;
 }
@@ -587,15 +645,15 @@ FeInstChain fe_chain_new(FeInst* initial) {
 }
 
 FeInstChain fe_chain_append_end(FeInstChain chain, FeInst* i) {
-    chain.end->next = i;
-    i->prev = chain.end;
+    chain.end->next = fe_inst_ref(i);
+    i->prev = fe_inst_ref(chain.end);
     chain.end = i;
     return chain;
 }
 
 FeInstChain fe_chain_append_begin(FeInstChain chain, FeInst* i) {
-    chain.begin->prev = i;
-    i->next = chain.begin;
+    chain.begin->prev = fe_inst_ref(i);
+    i->next = fe_inst_ref(chain.begin);
     chain.begin = i;
     return chain;
 }
@@ -608,39 +666,39 @@ FeInstChain fe_chain_concat(FeInstChain front, FeInstChain back) {
         return front;
     }
 
-    front.end->next = back.begin;
-    back.begin->prev = front.end;
+    front.end->next = fe_inst_ref(back.begin);
+    back.begin->prev = fe_inst_ref(front.end);
     front.end = back.end;
 
     return front;
 }
 void fe_insert_chain_before(FeInst* point, FeInstChain chain) {
-    FeInst* p_prev = point->prev;
-    p_prev->next = chain.begin;
-    point->prev = chain.end;
-    chain.end->next = point;
-    chain.begin->prev = p_prev;
+    FeInst* p_prev = fe_inst_prev(point);
+    p_prev->next = fe_inst_ref(chain.begin);
+    point->prev = fe_inst_ref(chain.end);
+    chain.end->next = fe_inst_ref(point);
+    chain.begin->prev = fe_inst_ref(p_prev);
 }
 
 void fe_insert_chain_after(FeInst* point, FeInstChain chain) {
-    FeInst* p_next = point->next;
-    p_next->prev = chain.end;
-    point->next = chain.begin;
-    chain.begin->prev = point;
-    chain.end->next = p_next;
+    FeInst* p_next = fe_inst_next(point);
+    p_next->prev = fe_inst_ref(chain.end);
+    point->next = fe_inst_ref(chain.begin);
+    chain.begin->prev = fe_inst_ref(point);
+    chain.end->next = fe_inst_ref(p_next);
 }
 
 void fe_chain_replace_pos(FeInst* from, FeInstChain to) {
-    from->next->prev = to.end;
-    from->prev->next = to.begin;
+    fe_inst_next(from)->prev = fe_inst_ref(to.end);
+    fe_inst_prev(from)->next = fe_inst_ref(to.begin);
     to.end->next = from->next;
     to.begin->prev = from->prev;
-    from->next = nullptr;
-    from->prev = nullptr;
+    from->next = 0;
+    from->prev = 0;
 }
 
 void fe_chain_destroy(FeFunc* f, FeInstChain chain) {
-    for (FeInst* inst = chain.begin, *next = inst->next; inst == nullptr; inst = next, next = next->next) {
+    for (FeInst* inst = chain.begin, *next = fe_inst_next(inst); inst == nullptr; inst = next, next = fe_inst_next(next)) {
         fe_inst_destroy(f, inst);
     }
 }
@@ -649,73 +707,74 @@ void fe_chain_destroy(FeFunc* f, FeInstChain chain) {
 // instruction builders
 // -------------------------------------
 
+// unordered remove of input 'n' of 'inst' from the uses of 'old_input'
+static void remove_use(FeInst* old_input, FeInst* inst, u16 n) {
+    FeInstRef inst_ref = fe_inst_ref(inst);
+    FeInstUse* uses = fe_inst_uses(old_input);
+    usize use_index = USIZE_MAX;
+    for_n (i, 0, old_input->use_len) {
+        if (uses[i].idx == n && uses[i].inst == inst_ref) {
+            use_index = i;
+            break;
+        }
+    }
+    FE_ASSERT(use_index != USIZE_MAX);
+
+    old_input->use_len -= 1;
+    uses[use_index] = uses[old_input->use_len];
+}
+
 void fe_set_input(FeFunc* f, FeInst* inst, u16 n, FeInst* input) {
     FE_ASSERT(n < inst->in_len);
     FE_ASSERT(input != nullptr); // maybe fix it to handle this case?
     
-    FeInst* old_input = inst->inputs[n];
+    FeInst* old_input = fe_inst_input(inst, n);
 
     if (old_input != nullptr) {
-        // unordered remove inst from old_input->uses
-        usize use_index = USIZE_MAX;
-        for_n (i, 0, old_input->use_len) {
-            FeInstUse old_input_use = old_input->uses[i];
-            if (old_input_use.idx == n && FE_USE_PTR(old_input_use) == inst) {
-                use_index = i;
-                break;
-            }
-        }
-        FE_ASSERT(use_index != USIZE_MAX);
-
-        old_input->use_len -= 1;
-        old_input->uses[use_index] = old_input->uses[old_input->use_len];
+        remove_use(old_input, inst, n);
     }
 
     // add inst to input's uses
-    inst->inputs[n] = input;
-    if_unlikely (input->use_cap == input->use_len) {
+    fe_inst_inputs(inst)[n] = fe_inst_ref(input);
+    usize use_cap = fe_inst_use_cap(input);
+    if_unlikely (use_cap == input->use_len) {
         FeInstPool* pool = f->ipool;
+        if_unlikely (use_cap == FE__USE_CAP_MAX) {
+            FE_CRASH("too many uses of inst %s", inst_name(input));
+        }
         
-        input->use_cap *= 2;
         // copy uses to new larger list
-        FeInstUse* new_uses = fe_ipool_list_alloc(pool, input->use_cap);
-        memcpy(new_uses, input->uses, sizeof(new_uses[0]) * input->use_len);
+        FeInstUse* new_uses = fe_ipool_list_alloc(pool, use_cap * 2);
+        memcpy(new_uses, fe_inst_uses(input), sizeof(new_uses[0]) * input->use_len);
        
         // set the top list to zero
-        memset(&new_uses[input->use_len], 0, sizeof(new_uses[0]) * input->use_len);
+        memset(&new_uses[input->use_len], 0, sizeof(new_uses[0]) * use_cap);
         
-        // free old list
-        fe_ipool_list_free(pool, input->uses, input->use_len);
+        // free old list, inline uses just stay behind
+        if (!fe_inst_uses_inline(input)) {
+            fe_ipool_list_free(pool, fe_inst_uses(input), use_cap);
+        }
 
-        input->uses = new_uses;
+        input->uses = fe_inst_ref(new_uses);
+        input->caps = (input->caps & 0x0F) | (usize_log2(use_cap * 2) - 1) << 4;
     }
 
-    input->uses[input->use_len].idx = n;
-    input->uses[input->use_len].ptr = (i64)inst;
+    fe_inst_uses(input)[input->use_len] = (FeInstUse){
+        .inst = fe_inst_ref(inst),
+        .idx = n,
+    };
     input->use_len += 1;
 }
 
 void fe_set_input_null(FeInst* inst, u16 n) {
     FE_ASSERT(n < inst->in_len);
-    FeInst* old_input = inst->inputs[n];
+    FeInst* old_input = fe_inst_input(inst, n);
 
     if (old_input != nullptr) {
-        // unordered remove inst from old_input->uses
-        usize use_index = USIZE_MAX;
-        for_n (i, 0, old_input->use_len) {
-            FeInstUse old_input_use = old_input->uses[i];
-            if (old_input_use.idx == n && FE_USE_PTR(old_input_use) == inst) {
-                use_index = i;
-                break;
-            }
-        }
-        FE_ASSERT(use_index != USIZE_MAX);
-
-        old_input->use_len -= 1;
-        old_input->uses[use_index] = old_input->uses[old_input->use_len];
+        remove_use(old_input, inst, n);
 
         // set current input to null
-        inst->inputs[n] = nullptr;
+        fe_inst_inputs(inst)[n] = 0;
     }
 }
 
@@ -723,12 +782,12 @@ void fe_set_input_null(FeInst* inst, u16 n) {
 usize fe_replace_uses(FeFunc* f, FeInst* old_val, FeInst* new_val) {
     // kinda unsafe, directly manipulating inputs and use lists is not great
     for_n (i, 0, old_val->use_len) {
-        FeInstUse old_val_use = old_val->uses[i];
+        FeInstUse old_val_use = fe_inst_uses(old_val)[i];
         FeInst* old_val_use_inst = FE_USE_PTR(old_val_use);
         u16 old_val_use_input = old_val_use.idx; // which input of 'old_val_use_inst' is 'old_val'
 
         // unlink so fe_set_input doesnt try to touch our precious use list
-        old_val_use_inst->inputs[old_val_use_input] = nullptr;
+        fe_inst_inputs(old_val_use_inst)[old_val_use_input] = 0;
 
         fe_set_input(f, old_val_use_inst, old_val_use_input, new_val);
     }
@@ -742,47 +801,68 @@ usize fe_replace_uses(FeFunc* f, FeInst* old_val, FeInst* new_val) {
 // #include <stdio.h>
 
 FeInst* fe_inst_new(FeFunc* f, usize input_len, usize extra_size) {
+    // small fixed-arity instructions keep their inputs inline,
+    // everything else gets a list
+    usize extra_slots = (extra_size + sizeof(usize) - 1) / sizeof(usize);
+    if (extra_slots == 0) {
+        extra_slots = 1;
+    }
+    usize inline_cap = 0;
+    if (input_len != 0 && input_len <= 3) {
+        inline_cap = input_len <= 2 ? 2 : 4;
+        extra_size = extra_slots * sizeof(usize) + inline_cap * sizeof(FeInstRef);
+    }
+
     FeInst* inst = fe_ipool_alloc(f->ipool, extra_size);
     inst->in_len = input_len;
     inst->id = f->max_id++;
 
-    if (input_len != 0) {
-        inst->in_cap = usize_next_pow_2(input_len);
-        inst->inputs = fe_ipool_list_alloc(f->ipool, inst->in_cap);
-        memset(inst->inputs, 0, sizeof(inst->inputs[0]) * inst->in_cap);
-    } else {
-        inst->in_cap = 0;
-        inst->inputs = nullptr;
+    if (inline_cap != 0) {
+        inst->inputs = fe_inst_ref(&inst->extra[extra_slots]);
+        inst->caps |= inline_cap == 2 ? FE__IN_CAP_INLINE_2 : FE__IN_CAP_INLINE_4;
+    } else if (input_len != 0) {
+        if_unlikely (input_len > FE__IN_CAP_MAX) {
+            FE_CRASH("too many inputs (%zu)", input_len);
+        }
+        usize in_cap = usize_next_pow_2(input_len);
+        FeInstRef* inputs = fe_ipool_list_alloc(f->ipool, in_cap / 2);
+        memset(inputs, 0, sizeof(inputs[0]) * in_cap);
+        inst->inputs = fe_inst_ref(inputs);
+        inst->caps |= usize_log2(in_cap) - 1;
     }
 
-    inst->use_len = 0;
-    inst->use_cap = 2;
-    inst->uses = fe_ipool_list_alloc(f->ipool, inst->use_cap);
-    memset(inst->uses, 0, sizeof(inst->uses[0]) * inst->use_cap);
-
     return inst;
 }
 
 void fe_inst_add_input(FeFunc* f, FeInst* inst, FeInst* input) {
 
     // expand dong
-    if_unlikely (inst->in_len == inst->in_cap) {
+    usize old_cap = fe_inst_in_cap(inst);
+    if_unlikely (inst->in_len == old_cap) {
         FeInstPool* pool = f->ipool;
 
-        inst->in_cap *= 2;
+        usize new_cap = old_cap == 0 ? 2 : old_cap * 2;
+        if_unlikely (new_cap > FE__IN_CAP_MAX) {
+            FE_CRASH("too many inputs on inst %s", inst_name(inst));
+        }
         // copy inputs to new larger list
-        FeInst** new_inputs = fe_ipool_list_alloc(pool, inst->in_cap);
-        memcpy(new_inputs, inst->inputs, sizeof(new_inputs[0]) * inst->in_len);
+        FeInstRef* new_inputs = fe_ipool_list_alloc(pool, new_cap / 2);
+        memcpy(new_inputs, fe_inst_inputs(inst), sizeof(new_inputs[0]) * inst->in_len);
 
         // set the top list to zero
-        memset(&new_inputs[input->in_len], 0, sizeof(new_inputs[0]) * input->in_len);
+        memset(&new_inputs[inst->in_len], 0, sizeof(new_inputs[0]) * (new_cap - inst->in_len));
 
-        fe_ipool_list_free(pool, input->inputs, input->in_len);
-        inst->inputs = new_inputs;
+        // inline inputs just stay behind
+        if (old_cap != 0 && !fe_inst_in_inline(inst)) {
+            fe_ipool_list_free(pool, fe_inst_inputs(inst), old_cap / 2);
+        }
+        inst->inputs = fe_inst_ref(new_inputs);
+        inst->caps = (inst->caps & 0xF0) | (usize_log2(new_cap) - 1);
     }
 
-    inst->inputs[inst->in_len] = input;
+    fe_inst_inputs(inst)[inst->in_len] = 0;
     inst->in_len++;
+    fe_set_input(f, inst, inst->in_len - 1, input);
 }
 
 void fe_inst_destroy(FeFunc* f, FeInst* inst) {
@@ -799,10 +879,12 @@ void fe_inst_destroy(FeFunc* f, FeInst* inst) {
     fe_inst_remove_from_block(inst);
 
     // free inputs and uses lists
-    if (inst->inputs != nullptr) {
-        fe_ipool_list_free(f->ipool, inst->inputs, inst->in_cap);
+    if (inst->inputs != 0 && !fe_inst_in_inline(inst)) {
+        fe_ipool_list_free(f->ipool, fe_inst_inputs(inst), fe_inst_in_cap(inst) / 2);
+    }
+    if (!fe_inst_uses_inline(inst)) {
+        fe_ipool_list_free(f->ipool, fe_inst_uses(inst), fe_inst_use_cap(inst));
     }
-    fe_ipool_list_free(f->ipool, inst->uses, inst->use_cap);
 
     // free instruction itself
     fe_ipool_free(f->ipool, inst);
@@ -931,22 +1013,24 @@ FeInst* fe_inst_store(FeFunc* f, FeInst* ptr, FeInst* val, u16 align, u8 offset)
 }
 
 FeInst* fe_inst_call(FeFunc* f, FeInst* callee, FeFuncSig* sig) {
-    FeInst* i = fe_inst_new(f, 2 + sig->param_len, sizeof(FeInstMemop));
-    i->kind = FE_STORE;
-    if (sig->param_len == 0) {
+    FeInst* i = fe_inst_new(f, 2 + sig->param_len, sizeof(FeInstCall));
+    i->kind = FE_CALL;
+    if (sig->return_len == 0) {
         i->ty = FE_TY_VOID;
     } else {
         i->ty = FE_TY_TUPLE;
     }
 
     fe_set_input_null(i, 0); // no last_effect yet
-    fe_set_input(f, i, 0, callee);
+    fe_set_input(f, i, 1, callee);
 
     for_n (n, 0, sig->param_len) {
         // fill in parameters
         fe_set_input_null(i, n + 2);
     }
 
+    fe_extra(i, FeInstCall)->sig = sig;
+
     return i;
 }
 
@@ -979,7 +1063,9 @@ FeInst* fe_inst_phi(FeFunc* f, FeTy ty, u16 expected_len) {
     i->ty = ty;
     i->in_len = 0;
 
-    fe_extra(i, FeInstPhi)->blocks = fe_ipool_list_alloc(f->ipool, i->in_cap);
+    if (expected_len != 0) {
+        fe_extra(i, FeInstPhi)->blocks = fe_ipool_list_alloc(f->ipool, fe_inst_in_cap(i));
+    }
 
     return i;
 }
@@ -990,7 +1076,9 @@ FeInst* fe_inst_mem_phi(FeFunc* f, u16 expected_len) {
     i->ty = FE_TY_VOID;
     i->in_len = 0;
 
-    fe_extra(i, FeInstPhi)->blocks = fe_ipool_list_alloc(f->ipool, i->in_cap);
+    if (expected_len != 0) {
+        fe_extra(i, FeInstPhi)->blocks = fe_ipool_list_alloc(f->ipool, fe_inst_in_cap(i));
+    }
 
     return i;
 }
@@ -999,18 +1087,22 @@ void fe_phi_add_src(FeFunc* f, FeInst* phi, FeInst* src_value, FeBlock* src_bloc
 
     FeInstPhi* phi_data = fe_extra(phi);
 
-    if_unlikely (phi->in_len == phi->in_cap) {
+    // keep in step with the inputs, see fe_inst_add_input
+    usize in_cap = fe_inst_in_cap(phi);
+    if_unlikely (phi->in_len == in_cap) {
         FeInstPool* pool = f->ipool;
 
-        usize new_cap = phi->in_cap * 2;
+        usize new_cap = in_cap == 0 ? 2 : in_cap * 2;
         // copy blocks to new larger list
         FeBlock** new_blocks = fe_ipool_list_alloc(pool, new_cap);
         memcpy(new_blocks, phi_data->blocks, sizeof(new_blocks[0]) * phi->in_len);
 
         // set the top list to zero
-        memset(&new_blocks[phi->in_len], 0, sizeof(new_blocks[0]) * phi->in_len);
+        memset(&new_blocks[phi->in_len], 0, sizeof(new_blocks[0]) * (new_cap - phi->in_len));
 
-        fe_ipool_list_free(pool, phi_data->blocks, phi->in_len);
+        if (in_cap != 0) {
+            fe_ipool_list_free(pool, phi_data->blocks, in_cap);
+        }
         phi_data->blocks = new_blocks;
     }
     
@@ -1019,12 +1111,37 @@ void fe_phi_add_src(FeFunc* f, FeInst* phi, FeInst* src_value, FeBlock* src_bloc
     fe_inst_add_input(f, phi, src_value);
 }
 
+// unordered remove of the n-th source
 void fe_phi_remove_src(FeFunc* f, FeInst* phi, u16 n) {
     FeInstPhi* phi_data = fe_extra(phi);
+    u16 last = phi->in_len - 1;
+
+    fe_set_input_null(phi, n);
+    if (n != last) {
+        FeInst* moved = fe_inst_input(phi, last);
+        fe_set_input_null(phi, last);
+        if (moved != nullptr) {
+            fe_set_input(f, phi, n, moved);
+        }
+        phi_data->blocks[n] = phi_data->blocks[last];
+    }
     
     phi->in_len -= 1;
-    phi_data->blocks[n] = phi_data->blocks[phi->in_len]; 
-    phi->inputs[n] = phi->inputs[phi->in_len];
+}
+
+// remove every source coming from 'src_block' in the phis of 'block'
+void fe_phi_remove_srcs_from(FeFunc* f, FeBlock* block, FeBlock* src_block) {
+    for_inst(inst, block) {
+        if (inst->kind != FE_PHI && inst->kind != FE_MEM_PHI) {
+            continue;
+        }
+        FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+        for (isize i = (isize)inst->in_len - 1; i >= 0; --i) {
+            if (srcs[i] == src_block) {
+                fe_phi_remove_src(f, inst, i);
+            }
+        }
+    }
 }
 
 FeInst* fe_inst_branch(FeFunc* f, FeInst* cond) {
@@ -1039,7 +1156,7 @@ FeInst* fe_inst_branch(FeFunc* f, FeInst* cond) {
 }
 
 void fe_branch_set_true(FeFunc* f, FeInst* branch, FeBlock* block) {
-    FeInst* bookend = branch->next;
+    FeInst* bookend = fe_inst_next(branch);
     FE_ASSERT(bookend && "branch is not in a block");
     FE_ASSERT(bookend->kind == FE__BOOKEND && "branch is not at the end of a block");
 
@@ -1056,7 +1173,7 @@ void fe_branch_set_true(FeFunc* f, FeInst* branch, FeBlock* block) {
 }
 
 void fe_branch_set_false(FeFunc* f, FeInst* branch, FeBlock* block) {
-    FeInst* bookend = branch->next;
+    FeInst* bookend = fe_inst_next(branch);
     FE_ASSERT(bookend && "branch is not in a block");
     FE_ASSERT(bookend->kind == FE__BOOKEND && "branch is not at the end of a block");
 
@@ -1073,15 +1190,15 @@ void fe_branch_set_false(FeFunc* f, FeInst* branch, FeBlock* block) {
 }
 
 FeInst* fe_inst_jump(FeFunc* f) {
-    FeInst* i = fe_inst_new(f, 0, sizeof(FeInstBranch));
-    i->kind = FE_BRANCH;
+    FeInst* i = fe_inst_new(f, 0, sizeof(FeInstJump));
+    i->kind = FE_JUMP;
     i->ty = FE_TY_VOID;
 
     return i;
 }
 
 void fe_jump_set_target(FeFunc* f, FeInst* jump, FeBlock* block) {
-    FeInst* bookend = jump->next;
+    FeInst* bookend = fe_inst_next(jump);
     FE_ASSERT(bookend && "jump is not in a block");
     FE_ASSERT(bookend->kind == FE__BOOKEND && "jump is not at the end of a block");
 
@@ -1106,7 +1223,7 @@ FeTy fe_proj_ty(FeInst* tuple, usize index) {
         if (index < icall->sig->return_len) {
             return fe_funcsig_return(icall->sig, index)->ty;
         }
-        FE_CRASH("index %zu out of bounds for [0, %u)", icall->sig->return_len);
+        FE_CRASH("index %zu out of bounds for [0, %u)", index, icall->sig->return_len);
     default:
         FE_CRASH("unknown inst kind (%s) %u", inst_name(tuple), tuple->kind);
     }
@@ -1128,6 +1245,8 @@ static FeTrait inst_traits[FE__INST_END] = {
     [FE_IADD] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS | COMMU | ASSOC | FAST_ASSOC,
     [FE_ISUB] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS,
     [FE_IMUL] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS | COMMU | ASSOC | FAST_ASSOC,
+    [FE_IMULH] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS | COMMU,
+    [FE_UMULH] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS | COMMU,
     [FE_IDIV] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS,
     [FE_UDIV] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS,
     [FE_IREM] = BINOP | INT_IN | VEC_IN | SAME_IN_OUT | SAME_INS,
@@ -1166,6 +1285,7 @@ static FeTrait inst_traits[FE__INST_END] = {
     [FE_MEM_BARRIER] = VOL | MEM_USE | MEM_DEF,
     [FE_LOAD] = MEM_USE,
     [FE_CALL] = MEM_USE | MEM_DEF,
+    [FE_TAILCALL] = TERM | VOL | MEM_USE | MEM_DEF,
 
     [FE_UNREACHABLE] = TERM | VOL,
     [FE_BRANCH] = TERM | VOL,
@@ -1191,90 +1311,110 @@ void fe__load_trait_table(usize start_index, const FeTrait* table, usize len) {
 
 #define USIZE_BITS (sizeof(usize) * 8)
 
-void fe_iset_init(FeInstSet* iset) {
+void fe_iset_init(FeInstSet* iset, FeFunc* f, FeInstSetOrder order) {
     *iset = (FeInstSet){};
-    iset->id_start = UINT32_MAX;
+    iset->order = order;
+
+    // room for every inst the function has right now
+    iset->words = f->max_id / USIZE_BITS + 1;
+    iset->exists = fe_malloc(sizeof(iset->exists[0]) * iset->words);
+    memset(iset->exists, 0, sizeof(iset->exists[0]) * iset->words);
+
+    iset->cap = iset->words * USIZE_BITS;
+    if (order == FE_ISET_BY_ID) {
+        iset->insts = fe_malloc(sizeof(iset->insts[0]) * iset->cap);
+    } else {
+        iset->queue = fe_malloc(sizeof(iset->queue[0]) * iset->cap);
+    }
+}
+
+static void iset_grow_words(FeInstSet* iset, u32 id_word) {
+    u32 new_words = iset->words * 2;
+    if (new_words <= id_word) {
+        new_words = id_word + 1;
+    }
+    iset->exists = fe_realloc(iset->exists, sizeof(iset->exists[0]) * new_words);
+    memset(&iset->exists[iset->words], 0, sizeof(iset->exists[0]) * (new_words - iset->words));
+    iset->words = new_words;
+
+    if (iset->order == FE_ISET_BY_ID) {
+        iset->cap = new_words * USIZE_BITS;
+        iset->insts = fe_realloc(iset->insts, sizeof(iset->insts[0]) * iset->cap);
+    }
+}
+
+// the stack/queue only outgrows its space when removed insts are pushed again
+static void iset_grow_queue(FeInstSet* iset) {
+    u32 new_cap = iset->cap * 2;
+    FeInstSetEntry* new_queue = fe_malloc(sizeof(new_queue[0]) * new_cap);
+    for_n (i, 0, iset->len) {
+        new_queue[i] = iset->queue[(iset->head + i) % iset->cap];
+    }
+    fe_free(iset->queue);
+    iset->queue = new_queue;
+    iset->cap = new_cap;
+    iset->head = 0;
 }
 
 bool fe_iset_contains(FeInstSet* iset, FeInst* inst) {
     u32 id = inst->id;
-    u32 id_block = id / USIZE_BITS;
+    u32 id_word = id / USIZE_BITS;
     usize id_bit = (usize)(1) << (id % USIZE_BITS);
 
-    if_likely (iset->id_start <= id_block && id_block < iset->id_end) {
-        usize exists_block = iset->exists[id_block - iset->id_start];
-        return (exists_block & id_bit) != 0;
+    if_likely (id_word < iset->words) {
+        return (iset->exists[id_word] & id_bit) != 0;
     }
     return false;
 }
 
-
+// null is ignored, so inputs can be pushed without checking them
 void fe_iset_push(FeInstSet* iset, FeInst* inst) {
+    if (inst == nullptr) {
+        return;
+    }
+
     u32 id = inst->id;
-    u32 id_block = id / USIZE_BITS;
+    u32 id_word = id / USIZE_BITS;
     usize id_bit = (usize)(1) << (id % USIZE_BITS);
 
-    // construct the initial state for the set centered around this inst
-    if_unlikely (iset->id_start == UINT32_MAX) {
-        iset->id_start = id_block;
-        iset->id_end   = id_block + 1;
-        iset->exists = fe_malloc(sizeof(usize));
-        // memset(iset->exists, 0, sizeof(usize));
-        iset->insts = fe_malloc(sizeof(iset->insts[0]) * USIZE_BITS);
-
-        iset->exists[0] = id_bit; 
-        iset->insts[id - iset->id_start * USIZE_BITS] = inst;
-
-        return;
+    // insts made after the set was
+    if_unlikely (id_word >= iset->words) {
+        iset_grow_words(iset, id_word);
     }
 
-    // printf("push %u %p\n", id, inst);
-
-    if_likely (iset->id_start <= id_block && id_block < iset->id_end) {
-        usize exists_block = iset->exists[id_block - iset->id_start];
-        // printf("> %064lb\n", exists_block);
-        if (!(exists_block & id_bit)) {
-            exists_block |= id_bit;
-            iset->exists[id_block - iset->id_start] = exists_block;
-            iset->insts[id - iset->id_start * USIZE_BITS] = inst;
-        }
-        // printf("> %064lb\n\n", exists_block);
+    if (iset->exists[id_word] & id_bit) {
         return;
     }
+    iset->exists[id_word] |= id_bit;
 
-    if (iset->id_end <= id_block) {
-        // expand upwards
-        usize new_end = id_block + 1;
-        usize new_size = new_end - iset->id_start;
-        // we can realloc
-        iset->insts = fe_realloc(iset->insts, sizeof(FeInst*) * new_size * USIZE_BITS);
-        iset->exists = fe_realloc(iset->insts, sizeof(FeInst*) * new_size);
-        // have to memset the newly allocated '.exists' space
-        for_n (i, iset->id_end, new_end) {
-            iset->exists[i] = 0;
+    switch (iset->order) {
+    case FE_ISET_BY_ID:
+        iset->insts[id] = inst;
+        if (id_word < iset->cursor) {
+            iset->cursor = id_word;
         }
-        // do this more efficiently later idk
-        iset->id_end = new_end;
-        // fe_iset_push(iset, inst);
-        iset->exists[id_block] = id_bit;
-        iset->insts[id - iset->id_start * USIZE_BITS] = inst;
-    } else {
-        // expand downwards
-        FE_CRASH("fuck! implement downwards set expansion");
+        break;
+    case FE_ISET_LIFO:
+    case FE_ISET_FIFO:
+        if_unlikely (iset->len == iset->cap) {
+            iset_grow_queue(iset);
+        }
+        u32 tail = (iset->head + iset->len) % iset->cap;
+        iset->queue[tail].inst = inst;
+        iset->queue[tail].id = id;
+        iset->len += 1;
+        break;
     }
-
 }
 
 void fe_iset_remove(FeInstSet* iset, FeInst* inst) {
     u32 id = inst->id;
-    u32 exists_block_index = id / USIZE_BITS;
+    u32 id_word = id / USIZE_BITS;
     usize id_bit = (usize)(1) << (id % USIZE_BITS);
 
-    if_likely (iset->id_start <= exists_block_index && exists_block_index < iset->id_end) {
-        usize exists_block = iset->exists[exists_block_index - iset->id_start];
-        if (exists_block & id_bit) {
-            iset->exists[exists_block_index - iset->id_start] = exists_block ^ id_bit;
-        }
+    // a removed inst stays in the stack/queue, pop skips over it
+    if_likely (id_word < iset->words) {
+        iset->exists[id_word] &= ~id_bit;
     }
 }
 
@@ -1287,31 +1427,41 @@ static inline usize count_trailing_zeros(usize n) {
 }
 
 FeInst* fe_iset_pop(FeInstSet* iset) {
+    if (iset->order == FE_ISET_BY_ID) {
+        // nothing is set below the cursor, so start there
+        while (iset->cursor < iset->words) {
+            usize exists_word = iset->exists[iset->cursor];
+            if (exists_word == 0) {
+                iset->cursor += 1;
+                continue;
+            }
 
-    u32 blocks_len = iset->id_end - iset->id_start;
-    for_n (exists_block_index, 0, blocks_len) {
-
-        usize exists_block = iset->exists[exists_block_index];
-        if (exists_block == 0) {
-            // we can skip this block
-            continue;
+            // pop the lowest instruction in the set
+            usize set_bit = count_trailing_zeros(exists_word);
+            iset->exists[iset->cursor] = exists_word ^ ((usize)(1) << set_bit);
+            return iset->insts[set_bit + iset->cursor * USIZE_BITS];
         }
-
-        // pop the next instruction in the set
-        usize set_bit = count_trailing_zeros(exists_block);
-        // return the instruction at that position
-        FeInst* inst = iset->insts[set_bit + exists_block_index * USIZE_BITS];
-
-        // printf("pop %u %p\n", inst->id, inst);
-
-        // remove it from its 'exists' block
-        // printf("> %064lb\n", iset->exists[exists_block_index]);
-        iset->exists[exists_block_index] ^= (usize)(1) << set_bit;
-        // printf("> %064lb\n\n", iset->exists[exists_block_index]);
-
-        return inst;
+        return nullptr;
     }
 
+    while (iset->len != 0) {
+        u32 at = iset->head;
+        if (iset->order == FE_ISET_LIFO) {
+            at = (iset->head + iset->len - 1) % iset->cap;
+        } else {
+            iset->head = (iset->head + 1) % iset->cap;
+        }
+        iset->len -= 1;
+
+        // only look at the inst once we know it's still in the set
+        u32 id = iset->queue[at].id;
+        u32 id_word = id / USIZE_BITS;
+        usize id_bit = (usize)(1) << (id % USIZE_BITS);
+        if (iset->exists[id_word] & id_bit) {
+            iset->exists[id_word] ^= id_bit;
+            return iset->queue[at].inst;
+        }
+    }
     return nullptr;
 }
 
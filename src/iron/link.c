@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/util.h"
+#include "iron/iron.h"
+
+// module linking, for whole-program optimization
+//
+// fe_module_link pours one module into another. an extern in one
+// resolves to the definition in the other, weak loses to anything
+// else, and local symbols that happen to share a name get renamed
+// so they don't trip over each other. fe_module_internalize then
+// makes everything the outside world doesn't ask for local, so the
+// inliner is free to treat it like a static function. once that's
+// done, fe_module_partition splits the result back up into modules
+// that can go through codegen on their own.
+
+static bool defines(FeSymbol* sym) {
+    return sym->bind != FE_BIND_EXTERN && sym->bind != FE_BIND_SHARED_IMPORT;
+}
+
+static void append_func(FeModule* mod, FeFunc* f) {
+    f->mod = mod;
+    f->list_next = nullptr;
+    f->list_prev = mod->funcs.last;
+    if (mod->funcs.first == nullptr) {
+        mod->funcs.first = f;
+    } else {
+        mod->funcs.last->list_next = f;
+    }
+    mod->funcs.last = f;
+}
+
+static void append_section(FeModule* mod, FeSection* section) {
+    section->next = nullptr;
+    section->prev = mod->sections.last;
+    if (mod->sections.first == nullptr) {
+        mod->sections.first = section;
+    } else {
+        mod->sections.last->next = section;
+    }
+    mod->sections.last = section;
+}
+
+// sorted by pointer, looked up with bsearch
+typedef struct {
+    void* from;
+    void* to;
+} PtrPair;
+
+static int pair_cmp(const void* a, const void* b) {
+    usize pa = (usize)((const PtrPair*)a)->from;
+    usize pb = (usize)((const PtrPair*)b)->from;
+    return (pa > pb) - (pa < pb);
+}
+
+static void* pair_get(PtrPair* pairs, usize len, void* from) {
+    PtrPair key = {.from = from};
+    PtrPair* pair = bsearch(&key, pairs, len, sizeof(key), pair_cmp);
+    return pair != nullptr ? pair->to : from;
+}
+
+static bool name_taken(FeModule* a, FeModule* b, const char* data, u16 len) {
+    return fe_symtab_get(&a->symtab, data, len) != nullptr
+        || fe_symtab_get(&b->symtab, data, len) != nullptr;
+}
+
+// symbols don't own their names, so this one lives as long as the process
+static FeCompactStr unique_name(FeModule* dst, FeModule* src, FeCompactStr name) {
+    usize cap = name.len + 12;
+    char* data = fe_malloc(cap);
+    u16 len;
+    for (u32 n = 1;; n++) {
+        len = snprintf(data, cap, "%.*s.%u", (int)name.len, fe_compstr_data(name), n);
+        if (!name_taken(dst, src, data, len)) {
+            break;
+        }
+    }
+    return fe_compstr(data, len);
+}
+
+static void rename_symbol(FeModule* mod, FeSymbol* sym, FeCompactStr name) {
+    fe_symtab_remove(&mod->symtab, fe_compstr_data(sym->name), sym->name.len);
+    sym->name = name;
+    fe_symtab_put(&mod->symtab, sym);
+}
+
+static void remap_sym_addrs(FeFunc* f, PtrPair* pairs, usize len) {
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            if (inst->kind == FE_SYM_ADDR) {
+                FeInstSymAddr* sym_addr = fe_extra(inst, FeInstSymAddr);
+                sym_addr->sym = pair_get(pairs, len, sym_addr->sym);
+            }
+        }
+    }
+}
+
+FeSymbol* fe_module_link(FeModule* dst, FeModule* src) {
+    if (dst->target->arch != src->target->arch || dst->target->system != src->target->system) {
+        FE_CRASH("cannot link modules for different targets");
+    }
+
+    // look for clashes first, so a failed link leaves both modules alone
+    for_n (i, 0, src->symtab.cap) {
+        FeSymbol* s = src->symtab.entries[i].sym;
+        if ((usize)s <= 1 || s->bind == FE_BIND_LOCAL) {
+            continue;
+        }
+        FeSymbol* d = fe_symtab_get(&dst->symtab, fe_compstr_data(s->name), s->name.len);
+        if (d == nullptr || d->bind == FE_BIND_LOCAL) {
+            continue;
+        }
+        if (defines(s) && defines(d) && s->bind != FE_BIND_WEAK && d->bind != FE_BIND_WEAK) {
+            return s;
+        }
+    }
+
+    // sections with the same name are the same section
+    usize sections_len = 0;
+    for (FeSection* s = src->sections.first; s != nullptr; s = s->next) {
+        sections_len += 1;
+    }
+    PtrPair* sections = fe_malloc(sizeof(sections[0]) * (sections_len + 1));
+    usize merged_len = 0;
+    for (FeSection* s = src->sections.first, *next; s != nullptr; s = next) {
+        next = s->next;
+        FeSection* match = nullptr;
+        for (FeSection* d = dst->sections.first; d != nullptr; d = d->next) {
+            if (d->name.len == s->name.len && memcmp(fe_compstr_data(d->name), fe_compstr_data(s->name), s->name.len) == 0) {
+                match = d;
+                break;
+            }
+        }
+        if (match == nullptr) {
+            append_section(dst, s);
+        } else {
+            sections[merged_len++] = (PtrPair){s, match};
+        }
+    }
+    qsort(sections, merged_len, sizeof(sections[0]), pair_cmp);
+
+    // src symbols that got folded into a dst symbol
+    usize syms_cap = 64;
+    usize syms_len = 0;
+    PtrPair* syms = fe_malloc(sizeof(syms[0]) * syms_cap);
+
+    for_n (i, 0, src->symtab.cap) {
+        FeSymbol* s = src->symtab.entries[i].sym;
+        if ((usize)s <= 1) {
+            continue;
+        }
+        s->section = pair_get(sections, merged_len, s->section);
+
+        FeSymbol* d = fe_symtab_get(&dst->symtab, fe_compstr_data(s->name), s->name.len);
+        if (d != nullptr && s->bind == FE_BIND_LOCAL) {
+            s->name = unique_name(dst, src, s->name);
+            d = nullptr;
+        } else if (d != nullptr && d->bind == FE_BIND_LOCAL) {
+            rename_symbol(dst, d, unique_name(dst, src, d->name));
+            d = nullptr;
+        }
+        if (d == nullptr) {
+            fe_symtab_put(&dst->symtab, s);
+            continue;
+        }
+
+        // both are visible, figure out which one stays.
+        // d is the one that's kept either way, it just takes on s's
+        // definition if s wins, so nothing in dst has to be rewritten.
+        bool s_wins = defines(s) && (!defines(d) || (d->bind == FE_BIND_WEAK && s->bind != FE_BIND_WEAK));
+        FeSymbol* loser = s_wins ? d : s;
+        if (loser->kind == FE_SYMKIND_FUNC && loser->func != nullptr) {
+            fe_func_destroy(loser->func);
+        }
+        if (s_wins) {
+            d->kind = s->kind;
+            d->bind = s->bind;
+            d->section = s->section;
+            d->func = s->func;
+            if (s->kind == FE_SYMKIND_FUNC && s->func != nullptr) {
+                s->func->sym = d;
+            }
+        }
+
+        if (syms_len == syms_cap) {
+            syms_cap += syms_cap >> 1;
+            syms = fe_realloc(syms, sizeof(syms[0]) * syms_cap);
+        }
+        syms[syms_len++] = (PtrPair){s, d};
+    }
+    qsort(syms, syms_len, sizeof(syms[0]), pair_cmp);
+
+    for (FeFunc* f = src->funcs.first, *next; f != nullptr; f = next) {
+        next = f->list_next;
+        remap_sym_addrs(f, syms, syms_len);
+        append_func(dst, f);
+    }
+
+    for_n (i, 0, syms_len) {
+        fe_symbol_destroy(syms[i].from);
+    }
+    for_n (i, 0, merged_len) {
+        fe_free(sections[i].from);
+    }
+    fe_free(syms);
+    fe_free(sections);
+
+    fe_symtab_destroy(&src->symtab);
+    fe_free((void*)src->target);
+    fe_free(src);
+    return nullptr;
+}
+
+void fe_module_internalize(FeModule* mod, const char* const* exports, usize exports_len) {
+    PtrPair* keep = fe_malloc(sizeof(keep[0]) * (exports_len + 1));
+    usize keep_len = 0;
+    for_n (i, 0, exports_len) {
+        FeSymbol* sym = fe_symtab_get(&mod->symtab, exports[i], strlen(exports[i]));
+        if (sym != nullptr) {
+            keep[keep_len++] = (PtrPair){sym, sym};
+        }
+    }
+    qsort(keep, keep_len, sizeof(keep[0]), pair_cmp);
+
+    for_n (i, 0, mod->symtab.cap) {
+        FeSymbol* sym = mod->symtab.entries[i].sym;
+        if ((usize)sym <= 1) {
+            continue;
+        }
+        if (sym->bind != FE_BIND_GLOBAL && sym->bind != FE_BIND_WEAK) {
+            continue;
+        }
+        PtrPair key = {.from = sym};
+        if (bsearch(&key, keep, keep_len, sizeof(key), pair_cmp) == nullptr) {
+            sym->bind = FE_BIND_LOCAL;
+        }
+    }
+
+    fe_free(keep);
+}
+
+// -------------------------------------
+// partitioning
+// -------------------------------------
+
+typedef struct {
+    FeFunc* f;
+    u32 size;
+    u32 order; // position in the module, breaks ties
+} PartFunc;
+
+static int part_func_cmp(const void* a, const void* b) {
+    const PartFunc* fa = a;
+    const PartFunc* fb = b;
+    if (fa->size != fb->size) {
+        return fa->size < fb->size ? 1 : -1;
+    }
+    return (fa->order > fb->order) - (fa->order < fb->order);
+}
+
+typedef struct {
+    FeSymbol* sym;
+    u32 owner; // which unit defines it
+} PartSym;
+
+static int part_sym_cmp(const void* a, const void* b) {
+    usize pa = (usize)((const PartSym*)a)->sym;
+    usize pb = (usize)((const PartSym*)b)->sym;
+    return (pa > pb) - (pa < pb);
+}
+
+static usize part_sym_index(PartSym* syms, usize len, FeSymbol* sym) {
+    PartSym key = {.sym = sym};
+    PartSym* found = bsearch(&key, syms, len, sizeof(key), part_sym_cmp);
+    if (found == nullptr) {
+        FE_CRASH("symbol '%.*s' is not in this module", sym->name.len, fe_compstr_data(sym->name));
+    }
+    return found - syms;
+}
+
+// unit u's copy of a section from the old module
+static FeSection* unit_section(FeModule* mod, FeSection** sections, usize sections_len, usize u, FeSection* section) {
+    if (section == nullptr) {
+        return nullptr;
+    }
+    usize index = 0;
+    for (FeSection* s = mod->sections.first; s != section; s = s->next) {
+        index += 1;
+    }
+    return sections[u * sections_len + index];
+}
+
+usize fe_module_partition(FeModule* mod, FeModule** units, usize max_units) {
+    usize syms_len = 0;
+    for_n (i, 0, mod->symtab.cap) {
+        if ((usize)mod->symtab.entries[i].sym > 1) {
+            syms_len += 1;
+        }
+    }
+    PartSym* syms = fe_malloc(sizeof(syms[0]) * (syms_len + 1));
+    syms_len = 0;
+    for_n (i, 0, mod->symtab.cap) {
+        FeSymbol* sym = mod->symtab.entries[i].sym;
+        if ((usize)sym > 1) {
+            syms[syms_len++] = (PartSym){sym, 0};
+        }
+    }
+    qsort(syms, syms_len, sizeof(syms[0]), part_sym_cmp);
+
+    // biggest first, each to whichever unit is smallest so far.
+    // declarations and data stay with unit 0.
+    usize funcs_len = 0;
+    for_funcs(f, mod) {
+        funcs_len += 1;
+    }
+    PartFunc* funcs = fe_malloc(sizeof(funcs[0]) * (funcs_len + 1));
+    usize defined_len = 0;
+    for_funcs(f, mod) {
+        if (!defines(f->sym)) {
+            continue;
+        }
+        u32 size = 0;
+        for_blocks(block, f) {
+            for_inst(inst, block) {
+                size += 1;
+            }
+        }
+        funcs[defined_len] = (PartFunc){f, size, defined_len};
+        defined_len += 1;
+    }
+    qsort(funcs, defined_len, sizeof(funcs[0]), part_func_cmp);
+
+    usize units_len = max_units;
+    if (units_len > defined_len) {
+        units_len = defined_len;
+    }
+    if (units_len == 0) {
+        units_len = 1;
+    }
+    u64* unit_size = fe_malloc(sizeof(unit_size[0]) * units_len);
+    memset(unit_size, 0, sizeof(unit_size[0]) * units_len);
+    for_n (i, 0, defined_len) {
+        usize smallest = 0;
+        for_n (u, 1, units_len) {
+            if (unit_size[u] < unit_size[smallest]) {
+                smallest = u;
+            }
+        }
+        unit_size[smallest] += funcs[i].size;
+        syms[part_sym_index(syms, syms_len, funcs[i].f->sym)].owner = smallest;
+    }
+
+    // anything local that gets used from another unit has to be
+    // visible to the linker now
+    for_funcs(f, mod) {
+        u32 owner = syms[part_sym_index(syms, syms_len, f->sym)].owner;
+        for_blocks(block, f) {
+            for_inst(inst, block) {
+                if (inst->kind != FE_SYM_ADDR) {
+                    continue;
+                }
+                FeSymbol* target = fe_extra(inst, FeInstSymAddr)->sym;
+                if (target->bind == FE_BIND_LOCAL && syms[part_sym_index(syms, syms_len, target)].owner != owner) {
+                    target->bind = FE_BIND_GLOBAL;
+                }
+            }
+        }
+    }
+
+    usize sections_len = 0;
+    for (FeSection* s = mod->sections.first; s != nullptr; s = s->next) {
+        sections_len += 1;
+    }
+    FeSection** sections = fe_malloc(sizeof(sections[0]) * (units_len * sections_len + 1));
+    // unit u's copy of syms[i] is unit_syms[u * syms_len + i]
+    FeSymbol** unit_syms = fe_malloc(sizeof(unit_syms[0]) * (units_len * syms_len + 1));
+    memset(unit_syms, 0, sizeof(unit_syms[0]) * units_len * syms_len);
+
+    for_n (u, 0, units_len) {
+        units[u] = fe_module_new(mod->target->arch, mod->target->system);
+        usize index = 0;
+        for (FeSection* s = mod->sections.first; s != nullptr; s = s->next) {
+            sections[u * sections_len + index++] = fe_section_new(units[u], fe_compstr_data(s->name), s->name.len, s->flags);
+        }
+    }
+
+    for_n (i, 0, syms_len) {
+        FeSymbol* sym = syms[i].sym;
+        usize u = syms[i].owner;
+        FeSymbol* copy = fe_symbol_new(units[u], fe_compstr_data(sym->name), sym->name.len, unit_section(mod, sections, sections_len, u, sym->section), sym->bind);
+        if (sym->kind == FE_SYMKIND_DATA) {
+            copy->kind = FE_SYMKIND_DATA;
+        }
+        unit_syms[u * syms_len + i] = copy;
+    }
+
+    for (FeFunc* f = mod->funcs.first, *next; f != nullptr; f = next) {
+        next = f->list_next;
+        usize index = part_sym_index(syms, syms_len, f->sym);
+        usize u = syms[index].owner;
+
+        for_blocks(block, f) {
+            for_inst(inst, block) {
+                if (inst->kind != FE_SYM_ADDR) {
+                    continue;
+                }
+                FeInstSymAddr* sym_addr = fe_extra(inst, FeInstSymAddr);
+                usize target = part_sym_index(syms, syms_len, sym_addr->sym);
+                FeSymbol** copy = &unit_syms[u * syms_len + target];
+                // defined somewhere else, this unit just needs to know the name
+                if (*copy == nullptr) {
+                    FeSymbol* sym = syms[target].sym;
+                    *copy = fe_symbol_new(units[u], fe_compstr_data(sym->name), sym->name.len, unit_section(mod, sections, sections_len, u, sym->section), FE_BIND_EXTERN);
+                }
+                sym_addr->sym = *copy;
+            }
+        }
+
+        f->sym = unit_syms[u * syms_len + index];
+        f->sym->kind = FE_SYMKIND_FUNC;
+        f->sym->func = f;
+        append_func(units[u], f);
+    }
+
+    mod->funcs.first = nullptr;
+    mod->funcs.last = nullptr;
+    for_n (i, 0, syms_len) {
+        fe_symbol_destroy(syms[i].sym);
+    }
+    fe_symtab_destroy(&mod->symtab);
+    fe_symtab_init(&mod->symtab);
+
+    fe_free(unit_syms);
+    fe_free(sections);
+    fe_free(unit_size);
+    fe_free(funcs);
+    fe_free(syms);
+    return units_len;
+}
@@ -0,0 +1,373 @@
+#include "common/util.h"
+#include "iron/iron.h"
+
+// control flow graph simplification
+//
+// frontends lower structured control flow into lots of small blocks,
+// most of which just forward to somewhere else. this cleans that up:
+//   - branches whose targets are identical become jumps
+//   - jumps to a block that only branches on something the jumping
+//     block already knows get sent straight to the right successor
+//   - blocks that contain only a jump are bypassed
+//   - a block with a single successor that has a single predecessor
+//     gets merged with it
+// and anything that becomes unreachable along the way is deleted.
+
+static bool is_phi(FeInst* inst) {
+    return inst->kind == FE_PHI || inst->kind == FE_MEM_PHI;
+}
+
+static bool has_phis(FeBlock* block) {
+    return is_phi(fe_inst_next(block->bookend));
+}
+
+static bool is_pred(FeBlock* block, FeBlock* pred) {
+    for_n (i, 0, block->pred_len) {
+        if (block->pred[i] == pred) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the value 'phi' takes when control comes from 'pred'
+static FeInst* phi_src_from(FeInst* phi, FeBlock* pred) {
+    FeBlock** srcs = fe_extra(phi, FeInstPhi)->blocks;
+    for_n (i, 0, phi->in_len) {
+        if (srcs[i] == pred) {
+            return fe_inst_input(phi, i);
+        }
+    }
+    return nullptr;
+}
+
+// number of cfg edges from 'pred' to 'succ' through a jump or branch,
+// or -1 if the terminator is something we can't rewrite
+static isize edges_to(FeBlock* pred, FeBlock* succ) {
+    FeInst* term = fe_inst_prev(pred->bookend);
+    switch (term->kind) {
+    case FE_JUMP:
+        return fe_extra(term, FeInstJump)->to == succ;
+    case FE_BRANCH:
+        ;
+        FeInstBranch* branch = fe_extra(term);
+        return (branch->if_true == succ) + (branch->if_false == succ);
+    default:
+        return -1;
+    }
+}
+
+// point the edge 'pred' -> 'from' at 'to' instead
+static void retarget(FeFunc* f, FeBlock* pred, FeBlock* from, FeBlock* to) {
+    FeInst* term = fe_inst_prev(pred->bookend);
+    if (term->kind == FE_JUMP) {
+        fe_extra(term, FeInstJump)->to = to;
+    } else {
+        FeInstBranch* branch = fe_extra(term);
+        if (branch->if_true == from) {
+            branch->if_true = to;
+        } else {
+            branch->if_false = to;
+        }
+    }
+    fe_cfg_remove_edge(pred, from);
+    fe_cfg_add_edge(f, pred, to);
+}
+
+// 'pred' is about to start jumping to 'succ' directly instead of through
+// 'via', so give succ's phis whatever they got from 'via'.
+// fails if that would need two different values for the same predecessor.
+static bool can_bypass(FeBlock* pred, FeBlock* via, FeBlock* succ) {
+    if (!has_phis(succ)) {
+        return true;
+    }
+    bool already_pred = is_pred(succ, pred);
+    for_inst(inst, succ) {
+        if (!is_phi(inst)) {
+            break;
+        }
+        FeInst* val = phi_src_from(inst, via);
+        if (val == nullptr) {
+            return false;
+        }
+        if (already_pred && phi_src_from(inst, pred) != val) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bypass(FeFunc* f, FeBlock* pred, FeBlock* via, FeBlock* succ) {
+    for_inst(inst, succ) {
+        if (!is_phi(inst)) {
+            break;
+        }
+        fe_phi_add_src(f, inst, phi_src_from(inst, via), pred);
+    }
+    retarget(f, pred, via, succ);
+}
+
+static bool fold_same_target_branch(FeFunc* f, FeBlock* block) {
+    FeInst* term = fe_inst_prev(block->bookend);
+    if (term->kind != FE_BRANCH) {
+        return false;
+    }
+    FeInstBranch* branch = fe_extra(term);
+    FeBlock* target = branch->if_true;
+    if (target != branch->if_false) {
+        return false;
+    }
+
+    // every phi has to agree on what it gets from both edges
+    for_inst(inst, target) {
+        if (!is_phi(inst)) {
+            break;
+        }
+        FeInst* val = phi_src_from(inst, block);
+        FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+        for_n (i, 0, inst->in_len) {
+            if (srcs[i] == block && fe_inst_input(inst, i) != val) {
+                return false;
+            }
+        }
+    }
+
+    FeInst* jump = fe_inst_jump(f);
+    fe_extra(jump, FeInstJump)->to = target;
+    fe_insert_before(term, jump);
+    fe_inst_destroy(f, term);
+
+    // drop the second edge and any duplicate phi sources that came with it
+    fe_cfg_remove_edge(block, target);
+    for_inst(inst, target) {
+        if (!is_phi(inst)) {
+            break;
+        }
+        FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+        usize count = 0;
+        for_n (i, 0, inst->in_len) {
+            count += srcs[i] == block;
+        }
+        if (count < 2) {
+            continue;
+        }
+        for_n (i, 0, inst->in_len) {
+            if (srcs[i] == block) {
+                fe_phi_remove_src(f, inst, i);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// if 'block' only branches on something a predecessor already
+// determines, send that predecessor straight to the right side.
+static bool thread_jumps(FeFunc* f, FeBlock* block) {
+    FeInst* term = fe_inst_prev(block->bookend);
+    if (term->kind != FE_BRANCH) {
+        return false;
+    }
+    FeInstBranch* branch = fe_extra(term);
+    FeInst* cond = fe_inst_input(term, 0);
+
+    // the block can't define anything that its successors might use,
+    // except for a phi that feeds the branch and nothing else.
+    bool cond_is_local_phi = cond->kind == FE_PHI && fe_inst_next(cond) == term
+        && fe_inst_prev(cond) == block->bookend && cond->use_len == 1;
+    if (!cond_is_local_phi && fe_inst_prev(term) != block->bookend) {
+        return false;
+    }
+
+    bool changed = false;
+    for (usize i = 0; i < block->pred_len;) {
+        FeBlock* pred = block->pred[i];
+        FeBlock* target = nullptr;
+
+        if (pred != block && edges_to(pred, block) == 1) {
+            FeInst* pred_term = fe_inst_prev(pred->bookend);
+            if (cond_is_local_phi) {
+                FeInst* val = phi_src_from(cond, pred);
+                if (val != nullptr && val->kind == FE_CONST) {
+                    bool taken = fe_extra(val, FeInstConst)->val != 0;
+                    target = taken ? branch->if_true : branch->if_false;
+                }
+            } else if (pred_term->kind == FE_BRANCH && fe_inst_input(pred_term, 0) == cond) {
+                // we got here from one side of a branch on the same condition
+                FeInstBranch* pred_branch = fe_extra(pred_term);
+                target = pred_branch->if_true == block ? branch->if_true : branch->if_false;
+            }
+        }
+
+        if (target == nullptr || target == block || !can_bypass(pred, block, target)) {
+            i += 1;
+            continue;
+        }
+
+        bypass(f, pred, block, target);
+        if (cond_is_local_phi) {
+            fe_phi_remove_srcs_from(f, block, pred);
+        }
+        changed = true;
+        // retarget did an unordered remove from block->pred, dont advance
+    }
+    return changed;
+}
+
+// send everything that jumps to a jump-only block to its target instead
+static bool remove_forwarding_block(FeFunc* f, FeBlock* block) {
+    if (block == f->entry_block) {
+        return false;
+    }
+    FeInst* term = fe_inst_prev(block->bookend);
+    if (term->kind != FE_JUMP || fe_inst_prev(term) != block->bookend) {
+        return false;
+    }
+    FeBlock* target = fe_extra(term, FeInstJump)->to;
+    if (target == block) {
+        return false;
+    }
+
+    bool changed = false;
+    for (usize i = 0; i < block->pred_len;) {
+        FeBlock* pred = block->pred[i];
+        if (edges_to(pred, block) != 1 || !can_bypass(pred, block, target)) {
+            i += 1;
+            continue;
+        }
+        bypass(f, pred, block, target);
+        changed = true;
+    }
+    return changed;
+}
+
+// pull a successor with no other predecessors into this block
+static bool merge_with_succ(FeFunc* f, FeBlock* block) {
+    FeInst* term = fe_inst_prev(block->bookend);
+    if (term->kind != FE_JUMP) {
+        return false;
+    }
+    FeBlock* succ = fe_extra(term, FeInstJump)->to;
+    if (succ == block || succ == f->entry_block || succ->pred_len != 1) {
+        return false;
+    }
+
+    // phis with only one source are just that source
+    for_inst(inst, succ) {
+        if (!is_phi(inst)) {
+            break;
+        }
+        if (inst->in_len != 1 || fe_inst_input(inst, 0) == nullptr) {
+            return false;
+        }
+    }
+    for_inst(inst, succ) {
+        if (!is_phi(inst)) {
+            break;
+        }
+        fe_replace_uses(f, inst, fe_inst_input(inst, 0));
+        fe_inst_destroy(f, inst);
+    }
+
+    fe_inst_destroy(f, term);
+    fe_cfg_remove_edge(block, succ);
+    if (fe_inst_next(succ->bookend) != succ->bookend) {
+        fe_insert_chain_before(block->bookend, fe_chain_from_block(succ));
+    }
+
+    // succ's outgoing edges are ours now
+    while (succ->succ_len != 0) {
+        FeBlock* next = succ->succ[0];
+        fe_cfg_add_edge(f, block, next);
+        fe_cfg_remove_edge(succ, next);
+        for_inst(inst, next) {
+            if (!is_phi(inst)) {
+                break;
+            }
+            FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+            for_n (i, 0, inst->in_len) {
+                if (srcs[i] == succ) {
+                    srcs[i] = block;
+                }
+            }
+        }
+    }
+    // succ is empty and unreachable, it gets cleaned up with the rest
+    return true;
+}
+
+static bool remove_unreachable(FeFunc* f) {
+    bool* reached = fe_malloc(sizeof(reached[0]) * f->max_block_id);
+    FeBlock** stack = fe_malloc(sizeof(stack[0]) * f->max_block_id);
+    memset(reached, 0, sizeof(reached[0]) * f->max_block_id);
+
+    usize stack_len = 0;
+    reached[f->entry_block->id] = true;
+    stack[stack_len++] = f->entry_block;
+    while (stack_len != 0) {
+        FeBlock* block = stack[--stack_len];
+        for_n (i, 0, block->succ_len) {
+            FeBlock* succ = block->succ[i];
+            if (!reached[succ->id]) {
+                reached[succ->id] = true;
+                stack[stack_len++] = succ;
+            }
+        }
+    }
+
+    // reuse the stack for the dead list
+    usize dead_len = 0;
+    FeBlock** dead = stack;
+    for_blocks(block, f) {
+        if (!reached[block->id]) {
+            dead[dead_len++] = block;
+        }
+    }
+
+    // cut every dead block loose first, they can reference each other
+    for_n (i, 0, dead_len) {
+        FeBlock* block = dead[i];
+        for_inst(inst, block) {
+            for_n (j, 0, inst->in_len) {
+                fe_set_input_null(inst, j);
+            }
+        }
+        while (block->succ_len != 0) {
+            FeBlock* succ = block->succ[0];
+            fe_phi_remove_srcs_from(f, succ, block);
+            fe_cfg_remove_edge(block, succ);
+        }
+    }
+    for_n (i, 0, dead_len) {
+        fe_block_destroy(dead[i]);
+    }
+
+    fe_free(reached);
+    fe_free(stack);
+    return dead_len != 0;
+}
+
+void fe_opt_cfg_simplify(FeFunc* f) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for_blocks(block, f) {
+            // already bypassed or merged away, removed below
+            if (block != f->entry_block && block->pred_len == 0) {
+                continue;
+            }
+            if (fe_inst_next(block->bookend) == block->bookend) {
+                continue;
+            }
+
+            if (fold_same_target_branch(f, block)
+                || thread_jumps(f, block)
+                || remove_forwarding_block(f, block)
+                || merge_with_succ(f, block)
+            ) {
+                changed = true;
+            }
+        }
+        changed |= remove_unreachable(f);
+    }
+}
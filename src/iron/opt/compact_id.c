@@ -6,8 +6,10 @@
 void fe_opt_compact_ids(FeFunc* f) {
     FeInst** insts = fe_malloc(f->max_id * sizeof(insts[0]));
     FeBlock** blocks = fe_malloc(f->max_block_id * sizeof(blocks[0]));
+    // ids that nothing has anymore stay null
+    memset(insts, 0, f->max_id * sizeof(insts[0]));
+    memset(blocks, 0, f->max_block_id * sizeof(blocks[0]));
 
-    
     for_blocks(block, f) {
         blocks[block->id] = block;
         for_inst(inst, block) {
@@ -0,0 +1,171 @@
+#include <stdlib.h>
+
+#include "common/util.h"
+#include "iron/iron.h"
+
+// module-level dead symbol elimination
+//
+// anything that isn't local can be reached from outside the module, so
+// those are the roots. from there, every sym-addr in a live function
+// (calls go through one too) makes its symbol live. whatever's left
+// over is either a local nobody can get to or an extern nobody uses,
+// and goes away along with its function. data symbols don't carry
+// contents or relocations yet, so they only ever get marked, never
+// walked.
+
+typedef struct {
+    FeSymbol* sym;
+    bool live;
+} SymInfo;
+
+static int info_cmp(const void* a, const void* b) {
+    usize pa = (usize)((const SymInfo*)a)->sym;
+    usize pb = (usize)((const SymInfo*)b)->sym;
+    return (pa > pb) - (pa < pb);
+}
+
+static SymInfo* get_info(SymInfo* infos, usize len, FeSymbol* sym) {
+    SymInfo key = {.sym = sym};
+    return bsearch(&key, infos, len, sizeof(key), info_cmp);
+}
+
+static bool is_root(FeSymbol* sym) {
+    return sym->bind != FE_BIND_LOCAL
+        && sym->bind != FE_BIND_EXTERN
+        && sym->bind != FE_BIND_SHARED_IMPORT;
+}
+
+usize fe_opt_dead_symbols(FeModule* mod) {
+    usize infos_len = 0;
+    for_n (i, 0, mod->symtab.cap) {
+        if ((usize)mod->symtab.entries[i].sym > 1) {
+            infos_len += 1;
+        }
+    }
+    if (infos_len == 0) {
+        return 0;
+    }
+    SymInfo* infos = fe_malloc(sizeof(infos[0]) * infos_len);
+    usize index = 0;
+    for_n (i, 0, mod->symtab.cap) {
+        FeSymbol* sym = mod->symtab.entries[i].sym;
+        if ((usize)sym > 1) {
+            infos[index++] = (SymInfo){sym, false};
+        }
+    }
+    qsort(infos, infos_len, sizeof(infos[0]), info_cmp);
+
+    // every function goes on here at most once, when it's first marked
+    FeFunc** stack = fe_malloc(sizeof(stack[0]) * infos_len);
+    usize stack_len = 0;
+    for_n (i, 0, infos_len) {
+        if (!is_root(infos[i].sym)) {
+            continue;
+        }
+        infos[i].live = true;
+        if (infos[i].sym->kind == FE_SYMKIND_FUNC && infos[i].sym->func != nullptr) {
+            stack[stack_len++] = infos[i].sym->func;
+        }
+    }
+
+    while (stack_len != 0) {
+        FeFunc* f = stack[--stack_len];
+        for_blocks(block, f) {
+            for_inst(inst, block) {
+                if (inst->kind >= FE__BASE_INST_END) {
+                    FE_CRASH("dead symbol elimination has to run before codegen");
+                }
+                if (inst->kind != FE_SYM_ADDR) {
+                    continue;
+                }
+                // the inliner leaves these behind. they don't count, and
+                // can't stay, since what they point at might be deleted
+                if (inst->use_len == 0) {
+                    fe_inst_destroy(f, inst);
+                    continue;
+                }
+                FeSymbol* sym = fe_extra(inst, FeInstSymAddr)->sym;
+                SymInfo* info = get_info(infos, infos_len, sym);
+                if (info == nullptr || info->live) {
+                    continue;
+                }
+                info->live = true;
+                if (sym->kind == FE_SYMKIND_FUNC && sym->func != nullptr) {
+                    stack[stack_len++] = sym->func;
+                }
+            }
+        }
+    }
+
+    // functions first, their sym-addrs point at symbols that are about to go
+    usize removed = 0;
+    for_n (i, 0, infos_len) {
+        FeSymbol* sym = infos[i].sym;
+        if (!infos[i].live && sym->kind == FE_SYMKIND_FUNC && sym->func != nullptr) {
+            fe_func_destroy(sym->func);
+        }
+    }
+    // sections that just lost a symbol, the only ones that might be freed
+    FeSection** emptied = fe_malloc(sizeof(emptied[0]) * infos_len);
+    usize emptied_len = 0;
+    for_n (i, 0, infos_len) {
+        FeSymbol* sym = infos[i].sym;
+        if (infos[i].live) {
+            continue;
+        }
+        // there are only ever a few sections, a linear search is fine
+        bool seen = sym->section == nullptr;
+        for_n (j, 0, emptied_len) {
+            seen |= emptied[j] == sym->section;
+        }
+        if (!seen) {
+            emptied[emptied_len++] = sym->section;
+        }
+        fe_symtab_remove(&mod->symtab, fe_compstr_data(sym->name), sym->name.len);
+        fe_symbol_destroy(sym);
+        infos[i].sym = nullptr;
+        removed += 1;
+    }
+
+    // sections this left with nothing in them. ones that were empty
+    // to begin with are the caller's business.
+    for (FeSection* section = mod->sections.first, *next; section != nullptr; section = next) {
+        next = section->next;
+        bool emptied_here = false;
+        for_n (i, 0, emptied_len) {
+            if (emptied[i] == section) {
+                emptied_here = true;
+                break;
+            }
+        }
+        if (!emptied_here) {
+            continue;
+        }
+        bool used = false;
+        for_n (i, 0, infos_len) {
+            if (infos[i].sym != nullptr && infos[i].sym->section == section) {
+                used = true;
+                break;
+            }
+        }
+        if (used) {
+            continue;
+        }
+        if (section->prev == nullptr) {
+            mod->sections.first = section->next;
+        } else {
+            section->prev->next = section->next;
+        }
+        if (section->next == nullptr) {
+            mod->sections.last = section->prev;
+        } else {
+            section->next->prev = section->prev;
+        }
+        fe_free(section);
+    }
+
+    fe_free(emptied);
+    fe_free(stack);
+    fe_free(infos);
+    return removed;
+}
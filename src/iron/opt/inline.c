@@ -0,0 +1,473 @@
+#include <stdlib.h>
+
+#include "common/util.h"
+#include "iron/iron.h"
+
+// module-level function inliner
+//
+// the call graph is walked bottom-up, so by the time a caller is looked
+// at, its callees have already had their own calls inlined and their
+// sizes are final. a call is inlined if the callee's instruction count
+// minus what the call itself costs (the jump-and-link, argument and
+// result moves) is under the threshold, or if the callee is local and
+// this is the only place it's ever called from.
+//
+// recursive calls (anything that reaches back into a function that is
+// still being visited) are left alone.
+
+typedef struct {
+    FeFunc* f;
+    u32 size;           // instruction count, stands in for code size
+    u32 callers;        // direct call sites across the module
+    bool address_taken; // referenced by something other than a direct call
+    bool cloneable;     // nothing in the body we don't know how to clone
+    u8 state;           // 0 = unvisited, 1 = on the dfs stack, 2 = done
+} FuncInfo;
+
+typedef struct {
+    FeModule* mod;
+    usize threshold;
+
+    FuncInfo* infos; // sorted by func pointer
+    usize infos_len;
+} Inliner;
+
+static int info_cmp(const void* a, const void* b) {
+    FeFunc* fa = ((const FuncInfo*)a)->f;
+    FeFunc* fb = ((const FuncInfo*)b)->f;
+    return (fa > fb) - (fa < fb);
+}
+
+static FuncInfo* get_info(Inliner* in, FeFunc* f) {
+    FuncInfo key = {.f = f};
+    return bsearch(&key, in->infos, in->infos_len, sizeof(key), info_cmp);
+}
+
+// the function a call jumps to, if it's known and we're allowed to look inside
+static FeFunc* direct_callee(FeInst* call) {
+    FeInst* callee = fe_inst_input(call, 1);
+    if (callee == nullptr || callee->kind != FE_SYM_ADDR) {
+        return nullptr;
+    }
+    FeSymbol* sym = fe_extra(callee, FeInstSymAddr)->sym;
+    if (sym->kind != FE_SYMKIND_FUNC || sym->func == nullptr) {
+        return nullptr;
+    }
+    // anything else can be swapped out from under us at link time
+    if (sym->bind != FE_BIND_LOCAL && sym->bind != FE_BIND_GLOBAL) {
+        return nullptr;
+    }
+    return sym->func;
+}
+
+// root and parameter projections, these get replaced by the call's inputs
+static bool is_incoming(FeInst* inst) {
+    return inst->kind == FE__ROOT
+        || (inst->kind == FE_PROJ && fe_inst_input(inst, 0) != nullptr && fe_inst_input(inst, 0)->kind == FE__ROOT);
+}
+
+static void analyze(Inliner* in, FuncInfo* info) {
+    FeFunc* f = info->f;
+
+    info->cloneable = true;
+    for_n (i, 0, f->sig->param_len) {
+        FeTy ty = f->sig->params[i].ty;
+        if (ty == FE_TY_RECORD || ty == FE_TY_ARRAY) {
+            info->cloneable = false;
+        }
+    }
+
+    bool has_return = false;
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            if (is_incoming(inst)) {
+                continue;
+            }
+            info->size += 1;
+
+            if (inst->kind >= FE__BASE_INST_END || inst->kind == FE_INLINE_ASM || inst->kind == FE_TAILCALL) {
+                info->cloneable = false;
+            }
+            if (inst->kind == FE_RETURN) {
+                has_return = true;
+                for_n (i, 1, inst->in_len) {
+                    if (fe_inst_input(inst, i) == nullptr) {
+                        info->cloneable = false;
+                    }
+                }
+            }
+
+            if (inst->kind != FE_SYM_ADDR) {
+                continue;
+            }
+            FeSymbol* sym = fe_extra(inst, FeInstSymAddr)->sym;
+            if (sym->kind != FE_SYMKIND_FUNC || sym->func == nullptr) {
+                continue;
+            }
+            FuncInfo* target = get_info(in, sym->func);
+            if (target == nullptr) {
+                continue;
+            }
+            for_n (i, 0, inst->use_len) {
+                FeInst* use = FE_USE_PTR(fe_inst_uses(inst)[i]);
+                if ((use->kind == FE_CALL || use->kind == FE_TAILCALL) && fe_inst_uses(inst)[i].idx == 1) {
+                    target->callers += 1;
+                } else {
+                    target->address_taken = true;
+                }
+            }
+        }
+    }
+    if (!has_return) {
+        info->cloneable = false;
+    }
+}
+
+static bool should_inline(Inliner* in, FuncInfo* caller, FuncInfo* callee, FeInst* call) {
+    if (caller == callee || callee->state != 2 || !callee->cloneable) {
+        return false;
+    }
+
+    // the call's signature has to line up with what the callee expects
+    FeFuncSig* sig = fe_extra(call, FeInstCall)->sig;
+    FeFuncSig* callee_sig = callee->f->sig;
+    if (sig->param_len != callee_sig->param_len || sig->return_len != callee_sig->return_len) {
+        return false;
+    }
+
+    // the out-of-line copy is dead afterwards, so this never grows the code
+    if (callee->f->sym->bind == FE_BIND_LOCAL && callee->callers == 1 && !callee->address_taken) {
+        return true;
+    }
+
+    usize call_cost = 2 + sig->param_len + sig->return_len;
+    return callee->size <= in->threshold + call_cost;
+}
+
+static FeInst* mapped(FeInst** inst_map, FeInst* inst) {
+    return inst != nullptr ? inst_map[inst->id] : nullptr;
+}
+
+static FeBlock* inst_block(FeInst* inst) {
+    while (inst->kind != FE__BOOKEND) {
+        inst = fe_inst_next(inst);
+    }
+    return fe_extra(inst, FeInst_Bookend)->block;
+}
+
+// move 'from's outgoing edges onto 'to', fixing up phis on the other end
+static void move_succs(FeFunc* f, FeBlock* from, FeBlock* to) {
+    while (from->succ_len != 0) {
+        FeBlock* succ = from->succ[0];
+        fe_cfg_add_edge(f, to, succ);
+        fe_cfg_remove_edge(from, succ);
+        for_inst(inst, succ) {
+            if (inst->kind != FE_PHI && inst->kind != FE_MEM_PHI) {
+                break;
+            }
+            FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+            for_n (i, 0, inst->in_len) {
+                if (srcs[i] == from) {
+                    srcs[i] = to;
+                }
+            }
+        }
+    }
+}
+
+static void inline_call(Inliner* in, FuncInfo* caller, FeInst* call, FuncInfo* callee_info) {
+    FeFunc* f = caller->f;
+    FeFunc* callee = callee_info->f;
+    FeBlock* block = inst_block(call);
+
+    // split the block right after the call
+    FeBlock* after = fe_block_new(f);
+    FeInstChain rest = {
+        .begin = fe_inst_next(call),
+        .end = fe_inst_prev(block->bookend),
+    };
+    call->next = fe_inst_ref(block->bookend);
+    block->bookend->prev = fe_inst_ref(call);
+    rest.begin->prev = 0;
+    rest.end->next = 0;
+    fe_insert_chain_before(after->bookend, rest);
+    move_succs(f, block, after);
+
+    FeInst** inst_map = fe_malloc(sizeof(inst_map[0]) * callee->max_id);
+    FeBlock** block_map = fe_malloc(sizeof(block_map[0]) * callee->max_block_id);
+    memset(inst_map, 0, sizeof(inst_map[0]) * callee->max_id);
+
+    // stack items don't have ids, map them by position
+    usize stack_len = 0;
+    for (FeStackItem* item = callee->stack_bottom; item != nullptr; item = item->next) {
+        stack_len += 1;
+    }
+    FeStackItem** stack_from = fe_malloc(sizeof(stack_from[0]) * (stack_len + 1));
+    FeStackItem** stack_to = fe_malloc(sizeof(stack_to[0]) * (stack_len + 1));
+    stack_len = 0;
+    for (FeStackItem* item = callee->stack_bottom; item != nullptr; item = item->next) {
+        FeStackItem* clone = fe_stack_item_new(item->ty, item->complex_ty);
+        clone->flags = item->flags;
+        fe_stack_append_top(f, clone);
+        stack_from[stack_len] = item;
+        stack_to[stack_len] = clone;
+        stack_len += 1;
+    }
+
+    for_blocks(cb, callee) {
+        block_map[cb->id] = fe_block_new(f);
+    }
+
+    // the callee's incoming values are the call's inputs
+    for_inst(inst, callee->entry_block) {
+        if (inst->kind == FE__ROOT) {
+            inst_map[inst->id] = fe_inst_input(call, 0);
+        }
+    }
+    for_n (i, 0, callee->sig->param_len) {
+        inst_map[callee->params[i]->id] = fe_inst_input(call, 2 + i);
+    }
+
+    // clone instructions, inputs are filled in once everything exists
+    usize returns_len = 0;
+    FeInst** returns = fe_malloc(sizeof(returns[0]) * callee->max_id);
+    FeBlock** return_blocks = fe_malloc(sizeof(return_blocks[0]) * callee->max_id);
+
+    for_blocks(cb, callee) {
+        FeBlock* nb = block_map[cb->id];
+        for_inst(inst, cb) {
+            if (is_incoming(inst)) {
+                continue;
+            }
+
+            FeInst* clone;
+            switch (inst->kind) {
+            case FE_PHI:
+                clone = fe_inst_phi(f, inst->ty, inst->in_len ? inst->in_len : 1);
+                break;
+            case FE_MEM_PHI:
+                clone = fe_inst_mem_phi(f, inst->in_len ? inst->in_len : 1);
+                break;
+            case FE_RETURN:
+                clone = fe_inst_jump(f);
+                fe_extra(clone, FeInstJump)->to = after;
+                returns[returns_len] = inst;
+                return_blocks[returns_len] = nb;
+                returns_len += 1;
+                break;
+            default:
+                ;
+                usize extra_size = fe_inst_extra_size(inst->kind);
+                clone = fe_inst_new(f, inst->in_len, extra_size);
+                clone->kind = inst->kind;
+                clone->ty = inst->ty;
+                memcpy(fe_extra(clone), fe_extra(inst), extra_size);
+
+                switch (inst->kind) {
+                case FE_BRANCH:
+                    ;
+                    FeInstBranch* branch = fe_extra(clone);
+                    branch->if_true = block_map[branch->if_true->id];
+                    branch->if_false = block_map[branch->if_false->id];
+                    break;
+                case FE_JUMP:
+                    ;
+                    FeInstJump* jump = fe_extra(clone);
+                    jump->to = block_map[jump->to->id];
+                    break;
+                case FE_STACK_ADDR:
+                    ;
+                    FeInstStack* stack = fe_extra(clone);
+                    for_n (i, 0, stack_len) {
+                        if (stack_from[i] == stack->item) {
+                            stack->item = stack_to[i];
+                            break;
+                        }
+                    }
+                    break;
+                case FE_CALL:
+                    ;
+                    // the callee's calls are now ours too
+                    FeFunc* target = direct_callee(inst);
+                    FuncInfo* target_info = target ? get_info(in, target) : nullptr;
+                    if (target_info) {
+                        target_info->callers += 1;
+                    }
+                    break;
+                }
+                break;
+            }
+            inst_map[inst->id] = clone;
+            fe_append_end(nb, clone);
+        }
+    }
+
+    for_blocks(cb, callee) {
+        for_inst(inst, cb) {
+            if (is_incoming(inst) || inst->kind == FE_RETURN) {
+                continue;
+            }
+            FeInst* clone = inst_map[inst->id];
+            if (inst->kind == FE_PHI || inst->kind == FE_MEM_PHI) {
+                FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+                for_n (i, 0, inst->in_len) {
+                    fe_phi_add_src(f, clone, inst_map[fe_inst_input(inst, i)->id], block_map[srcs[i]->id]);
+                }
+                continue;
+            }
+            for_n (i, 0, inst->in_len) {
+                FeInst* input = fe_inst_input(inst, i);
+                if (mapped(inst_map, input) != nullptr) {
+                    fe_set_input(f, clone, i, inst_map[input->id]);
+                }
+            }
+        }
+        for_n (i, 0, cb->succ_len) {
+            fe_cfg_add_edge(f, block_map[cb->id], block_map[cb->succ[i]->id]);
+        }
+    }
+    for_n (i, 0, returns_len) {
+        fe_cfg_add_edge(f, return_blocks[i], after);
+    }
+
+    // merge the returned values, one per return value (plus memory)
+    usize results_len = callee->sig->return_len + 1;
+    FeInst** results = fe_malloc(sizeof(results[0]) * results_len);
+    for_n (r, 0, results_len) {
+        // memory is input 0 of the return, return values come after
+        usize input = r == callee->sig->return_len ? 0 : r + 1;
+
+        FeInst* first = mapped(inst_map, fe_inst_input(returns[0], input));
+        bool all_same = true;
+        bool any_null = first == nullptr;
+        for_n (i, 1, returns_len) {
+            FeInst* val = mapped(inst_map, fe_inst_input(returns[i], input));
+            all_same &= val == first;
+            any_null |= val == nullptr;
+        }
+
+        if (all_same || any_null) {
+            // a missing memory effect means there's nothing to order against
+            results[r] = all_same ? first : nullptr;
+            continue;
+        }
+
+        FeInst* phi = input == 0
+            ? fe_inst_mem_phi(f, returns_len)
+            : fe_inst_phi(f, first->ty, returns_len);
+        fe_append_begin(after, phi);
+        for_n (i, 0, returns_len) {
+            fe_phi_add_src(f, phi, mapped(inst_map, fe_inst_input(returns[i], input)), return_blocks[i]);
+        }
+        results[r] = phi;
+    }
+
+    // rewire everything that used the call
+    while (call->use_len != 0) {
+        FeInstUse use = fe_inst_uses(call)[call->use_len - 1];
+        FeInst* user = FE_USE_PTR(use);
+        if (user->kind == FE_PROJ) {
+            FeInst* val = results[fe_extra(user, FeInstProj)->index];
+            fe_replace_uses(f, user, val);
+            fe_inst_destroy(f, user);
+            continue;
+        }
+        FeInst* mem = results[callee->sig->return_len];
+        if (mem != nullptr) {
+            fe_set_input(f, user, use.idx, mem);
+        } else {
+            fe_set_input_null(user, use.idx);
+        }
+    }
+
+    // and finally, jump into the inlined body instead of calling it
+    FeInst* jump = fe_inst_jump(f);
+    fe_insert_after(call, jump);
+    fe_jump_set_target(f, jump, block_map[callee->entry_block->id]);
+    fe_inst_destroy(f, call);
+
+    caller->size += callee_info->size;
+    callee_info->callers -= 1;
+
+    fe_free(inst_map);
+    fe_free(block_map);
+    fe_free(stack_from);
+    fe_free(stack_to);
+    fe_free(returns);
+    fe_free(return_blocks);
+    fe_free(results);
+}
+
+static void visit(Inliner* in, FuncInfo* info) {
+    info->state = 1;
+
+    // find the call sites first, inlining adds blocks and calls of its own
+    usize calls_len = 0;
+    usize calls_cap = 16;
+    FeInst** calls = fe_malloc(sizeof(calls[0]) * calls_cap);
+
+    for_blocks(block, info->f) {
+        for_inst(inst, block) {
+            if (inst->kind != FE_CALL) {
+                continue;
+            }
+            FeFunc* callee = direct_callee(inst);
+            FuncInfo* callee_info = callee ? get_info(in, callee) : nullptr;
+            if (callee_info == nullptr) {
+                continue;
+            }
+            if (callee_info->state == 0) {
+                visit(in, callee_info);
+            }
+            if (calls_len == calls_cap) {
+                calls_cap *= 2;
+                calls = fe_realloc(calls, sizeof(calls[0]) * calls_cap);
+            }
+            calls[calls_len++] = inst;
+        }
+    }
+
+    for_n (i, 0, calls_len) {
+        FuncInfo* callee_info = get_info(in, direct_callee(calls[i]));
+        if (should_inline(in, info, callee_info, calls[i])) {
+            inline_call(in, info, calls[i], callee_info);
+        }
+    }
+
+    fe_free(calls);
+    info->state = 2;
+}
+
+void fe_opt_inline(FeModule* mod, usize threshold) {
+    Inliner in = {0};
+    in.mod = mod;
+    in.threshold = threshold;
+
+    for (FeFunc* f = mod->funcs.first; f != nullptr; f = f->list_next) {
+        in.infos_len += 1;
+    }
+    if (in.infos_len == 0) {
+        return;
+    }
+    in.infos = fe_malloc(sizeof(in.infos[0]) * in.infos_len);
+    memset(in.infos, 0, sizeof(in.infos[0]) * in.infos_len);
+    usize index = 0;
+    for (FeFunc* f = mod->funcs.first; f != nullptr; f = f->list_next) {
+        in.infos[index++].f = f;
+    }
+    qsort(in.infos, in.infos_len, sizeof(in.infos[0]), info_cmp);
+
+    for_n (i, 0, in.infos_len) {
+        analyze(&in, &in.infos[i]);
+    }
+
+    // bottom-up, in module order
+    for (FeFunc* f = mod->funcs.first; f != nullptr; f = f->list_next) {
+        FuncInfo* info = get_info(&in, f);
+        if (info->state == 0) {
+            visit(&in, info);
+        }
+    }
+
+    fe_free(in.infos);
+}
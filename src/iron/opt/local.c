@@ -5,7 +5,7 @@
 
 static void push_uses(FeInstSet* wlist, FeInst* inst) {
     for_n(i, 0, inst->use_len) {
-        fe_iset_push(wlist, FE_USE_PTR(inst->uses[i]));
+        fe_iset_push(wlist, FE_USE_PTR(fe_inst_uses(inst)[i]));
     }
 }
 
@@ -25,17 +25,17 @@ static FeInst* try_load_elim(FeFunc* f, FeInstSet* wlist, FeInst* load) {
         %3 = ... %val
     */
 
-    FeInst* dependent_store = load->inputs[0];
+    FeInst* dependent_store = fe_inst_input(load, 0);
     // dependent operation is not a store
     if (dependent_store->kind != FE_STORE) {
         return nullptr;
     }
     // pointers dont match
-    if (dependent_store->inputs[1] != load->inputs[1]) {
+    if (fe_inst_input(dependent_store, 1) != fe_inst_input(load, 1)) {
         return nullptr;
     }
 
-    FeInst* new_val = dependent_store->inputs[2];
+    FeInst* new_val = fe_inst_input(dependent_store, 2);
 
     fe_replace_uses(f, load, new_val);
     fe_inst_destroy(f, load);
@@ -43,7 +43,7 @@ static FeInst* try_load_elim(FeFunc* f, FeInstSet* wlist, FeInst* load) {
     // add the store and its uses to the worklist
     fe_iset_push(wlist, dependent_store);
     for_n(i, 0, dependent_store->use_len) {
-        fe_iset_push(wlist, FE_USE_PTR(dependent_store->uses[i]));
+        fe_iset_push(wlist, FE_USE_PTR(fe_inst_uses(dependent_store)[i]));
     }
 
     return new_val;
@@ -62,13 +62,13 @@ static FeInst* try_store_elim(FeFunc* f, FeInstSet* wlist, FeInst* store) {
     */
 
 
-    FeInst* dependent_store = store->inputs[0];
+    FeInst* dependent_store = fe_inst_input(store, 0);
     // dependent operation is not a store
     if (dependent_store->kind != FE_STORE) {
         return nullptr;
     }
     // pointers dont match
-    if (dependent_store->inputs[1] != store->inputs[1]) {
+    if (fe_inst_input(dependent_store, 1) != fe_inst_input(store, 1)) {
         return nullptr;
     }
 
@@ -78,13 +78,13 @@ static FeInst* try_store_elim(FeFunc* f, FeInstSet* wlist, FeInst* store) {
     }
 
     // use the dependent store's memory link
-    fe_set_input(f, store, 0, dependent_store->inputs[0]);
+    fe_set_input(f, store, 0, fe_inst_input(dependent_store, 0));
     fe_inst_destroy(f, dependent_store);
 
     // add the store and its uses to the worklist
     fe_iset_push(wlist, store);
     for_n(i, 0, store->use_len) {
-        fe_iset_push(wlist, FE_USE_PTR(store->uses[i]));
+        fe_iset_push(wlist, FE_USE_PTR(fe_inst_uses(store)[i]));
     }
 
     return store;
@@ -93,9 +93,10 @@ static FeInst* try_store_elim(FeFunc* f, FeInstSet* wlist, FeInst* store) {
 static bool try_tdce(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
     if (inst->use_len == 0 && !fe_inst_has_trait(inst->kind, FE_TRAIT_VOLATILE)) {
         for_n(i, 0, inst->in_len) {
-            fe_iset_push(wlist, inst->inputs[i]);
+            fe_iset_push(wlist, fe_inst_input(inst, i));
         }
         fe_inst_destroy(f, inst);
+        return true;
     }
     return false;
 }
@@ -103,9 +104,17 @@ static bool try_tdce(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
 /*
     strength reduction:
         x - const -> x + (-const)
-        x imul 2     -> x << 1 // extend to powers of two
-        x udiv 2     -> x >> 1 // extend to powers of two
-        x umod 2     -> x & 1  // extend to powers of two
+        x imul 2^k   -> x << k
+        x udiv 2^k   -> x >> k
+        x urem 2^k   -> x & (2^k - 1)
+        x idiv 2^k   -> (x + ((x >>s (k-1)) >> (w-k))) >>s k
+        x udiv const -> umulh(x, magic) >> shift (+ fixup)
+        x idiv const -> imulh(x, magic) >>s shift (+ fixup)
+        x urem/irem const -> x - (x div const) * const
+
+    the magic numbers are from granlund & montgomery,
+    "division by invariant integers using multiplication",
+    computed the way hacker's delight (ch. 10) does it.
 */ 
 
 
@@ -117,13 +126,250 @@ static inline usize u64_log2(usize x) {
     return (sizeof(x) * 8 - 1) - __builtin_clzll(x);
 }
 
+static usize int_ty_bits(FeTy ty) {
+    switch (ty) {
+    case FE_TY_BOOL: return 1;
+    case FE_TY_I8:  return 8;
+    case FE_TY_I16: return 16;
+    case FE_TY_I32: return 32;
+    case FE_TY_I64: return 64;
+    default:        return 0;
+    }
+}
+
+static inline u64 bits_mask(usize bits) {
+    return bits == 64 ? UINT64_MAX : (1ull << bits) - 1;
+}
+
+static inline i64 sign_extend(u64 val, usize bits) {
+    usize shift = 64 - bits;
+    return (i64)(val << shift) >> shift;
+}
+
+typedef struct {
+    u64 mul;
+    u8 shift;
+    bool add; // magic number needs bits+1 bits, use the add fixup
+} MagicUnsigned;
+
+// hacker's delight magicu2, generalized to any width <= 64.
+// d must be in [2, 2^bits)
+static MagicUnsigned magic_unsigned(u64 d, usize bits) {
+    const u64 mask = bits_mask(bits);
+    const u64 sign = 1ull << (bits - 1);
+    MagicUnsigned mag = {0};
+
+    usize p = bits - 1;
+    u64 q = (sign - 1) / d;       // (2^p - 1) / d
+    u64 r = (sign - 1) - q * d;   // (2^p - 1) % d
+    u64 p_big = 0;                // 2^(p - bits)
+    u64 delta;
+    do {
+        p += 1;
+        p_big = (p == bits) ? 1 : p_big * 2;
+        if (r + 1 >= d - r) {
+            if (q >= sign - 1) mag.add = true;
+            q = (2 * q + 1) & mask;
+            r = (2 * r + 1 - d) & mask;
+        } else {
+            if (q >= sign) mag.add = true;
+            q = (2 * q) & mask;
+            r = (2 * r + 1) & mask;
+        }
+        delta = d - 1 - r;
+    } while (p < 2 * bits && p_big < delta);
+
+    mag.mul = (q + 1) & mask;
+    mag.shift = p - bits;
+    return mag;
+}
+
+typedef struct {
+    u64 mul;
+    u8 shift;
+} MagicSigned;
+
+// hacker's delight magic, generalized to any width <= 64.
+// |d| must be >= 2 and not a power of two
+static MagicSigned magic_signed(i64 d, usize bits) {
+    const u64 mask = bits_mask(bits);
+    const u64 sign = 1ull << (bits - 1);
+
+    u64 ad = (d < 0 ? -(u64)d : (u64)d) & mask;
+    u64 t = sign + (d < 0);
+    u64 anc = t - 1 - t % ad; // |nc|
+
+    usize p = bits - 1;
+    u64 q1 = sign / anc;      // 2^p / |nc|
+    u64 r1 = sign - q1 * anc; // 2^p % |nc|
+    u64 q2 = sign / ad;       // 2^p / |d|
+    u64 r2 = sign - q2 * ad;  // 2^p % |d|
+    u64 delta;
+    do {
+        p += 1;
+        q1 = (2 * q1) & mask;
+        r1 = (2 * r1) & mask;
+        if (r1 >= anc) {
+            q1 += 1;
+            r1 -= anc;
+        }
+        q2 = (2 * q2) & mask;
+        r2 = (2 * r2) & mask;
+        if (r2 >= ad) {
+            q2 += 1;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    MagicSigned mag;
+    mag.mul = (q2 + 1) & mask;
+    if (d < 0) {
+        mag.mul = -mag.mul & mask;
+    }
+    mag.shift = p - bits;
+    return mag;
+}
+
+static FeInst* insert_const(FeFunc* f, FeInst* point, FeTy ty, u64 val) {
+    FeInst* c = fe_inst_const(f, ty, val & bits_mask(int_ty_bits(ty)));
+    fe_insert_before(point, c);
+    return c;
+}
+
+static FeInst* insert_binop(FeFunc* f, FeInstSet* wlist, FeInst* point, FeInstKind kind, FeInst* lhs, FeInst* rhs) {
+    FeInst* binop = fe_inst_binop(f, point->ty, kind, lhs, rhs);
+    fe_insert_before(point, binop);
+    fe_iset_push(wlist, binop);
+    return binop;
+}
+
+static FeInst* insert_binop_const(FeFunc* f, FeInstSet* wlist, FeInst* point, FeInstKind kind, FeInst* lhs, u64 rhs) {
+    return insert_binop(f, wlist, point, kind, lhs, insert_const(f, point, point->ty, rhs));
+}
+
+// emit n / d before 'point', d in [2, 2^bits)
+static FeInst* emit_udiv_const(FeFunc* f, FeInstSet* wlist, FeInst* point, FeInst* n, u64 d, usize bits) {
+    if (is_pow_2(d)) {
+        return insert_binop_const(f, wlist, point, FE_USR, n, u64_log2(d));
+    }
+
+    MagicUnsigned mag = magic_unsigned(d, bits);
+    FeInst* hi = insert_binop_const(f, wlist, point, FE_UMULH, n, mag.mul);
+    if (!mag.add) {
+        return insert_binop_const(f, wlist, point, FE_USR, hi, mag.shift);
+    }
+
+    // q = (((n - hi) >> 1) + hi) >> (shift - 1)
+    FeInst* q = insert_binop(f, wlist, point, FE_ISUB, n, hi);
+    q = insert_binop_const(f, wlist, point, FE_USR, q, 1);
+    q = insert_binop(f, wlist, point, FE_IADD, q, hi);
+    return insert_binop_const(f, wlist, point, FE_USR, q, mag.shift - 1);
+}
+
+// emit n / d before 'point', d sign-extended from bits and |d| >= 2
+static FeInst* emit_idiv_const(FeFunc* f, FeInstSet* wlist, FeInst* point, FeInst* n, i64 d, usize bits) {
+    u64 ad = (d < 0 ? -(u64)d : (u64)d) & bits_mask(bits);
+
+    FeInst* q;
+    if (is_pow_2(ad)) {
+        // bias negative dividends by 2^k - 1 so the shift rounds towards zero
+        usize k = u64_log2(ad);
+        FeInst* bias = insert_binop_const(f, wlist, point, FE_ISR, n, k - 1);
+        bias = insert_binop_const(f, wlist, point, FE_USR, bias, bits - k);
+        q = insert_binop(f, wlist, point, FE_IADD, n, bias);
+        q = insert_binop_const(f, wlist, point, FE_ISR, q, k);
+        if (d < 0) {
+            q = insert_binop(f, wlist, point, FE_ISUB, insert_const(f, point, point->ty, 0), q);
+        }
+        return q;
+    }
+
+    MagicSigned mag = magic_signed(d, bits);
+    bool mul_negative = sign_extend(mag.mul, bits) < 0;
+
+    q = insert_binop_const(f, wlist, point, FE_IMULH, n, mag.mul);
+    if (d > 0 && mul_negative) {
+        q = insert_binop(f, wlist, point, FE_IADD, q, n);
+    } else if (d < 0 && !mul_negative) {
+        q = insert_binop(f, wlist, point, FE_ISUB, q, n);
+    }
+    if (mag.shift != 0) {
+        q = insert_binop_const(f, wlist, point, FE_ISR, q, mag.shift);
+    }
+    // add one if the quotient is negative
+    FeInst* sign_bit = insert_binop_const(f, wlist, point, FE_USR, q, bits - 1);
+    return insert_binop(f, wlist, point, FE_IADD, q, sign_bit);
+}
+
+// emit n - q * d before 'point'
+static FeInst* emit_rem_from_quotient(FeFunc* f, FeInstSet* wlist, FeInst* point, FeInst* n, FeInst* q, u64 d) {
+    FeInst* prod = insert_binop_const(f, wlist, point, FE_IMUL, q, d);
+    return insert_binop(f, wlist, point, FE_ISUB, n, prod);
+}
+
+// lower multiplication/division/remainder by a constant.
+// returns the new value or nullptr if nothing was done.
+static FeInst* strength_by_const(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
+    FeInst* lhs = fe_inst_input(inst, 0);
+    FeInst* rhs = fe_inst_input(inst, 1);
+
+    // leave it to consteval
+    if (rhs->kind != FE_CONST || lhs->kind == FE_CONST) {
+        return nullptr;
+    }
+
+    usize bits = int_ty_bits(inst->ty);
+    if (bits == 0) {
+        return nullptr;
+    }
+
+    u64 d = fe_extra(rhs, FeInstConst)->val & bits_mask(bits);
+    i64 sd = sign_extend(d, bits);
+
+    switch (inst->kind) {
+    case FE_IMUL:
+        if (d > 1 && is_pow_2(d)) {
+            return insert_binop_const(f, wlist, inst, FE_SHL, lhs, u64_log2(d));
+        }
+        return nullptr;
+    case FE_UDIV:
+        if (d < 2) {
+            return nullptr;
+        }
+        return emit_udiv_const(f, wlist, inst, lhs, d, bits);
+    case FE_UREM:
+        if (d < 2) {
+            return nullptr;
+        }
+        if (is_pow_2(d)) {
+            return insert_binop_const(f, wlist, inst, FE_AND, lhs, d - 1);
+        }
+        return emit_rem_from_quotient(f, wlist, inst, lhs, 
+            emit_udiv_const(f, wlist, inst, lhs, d, bits), d);
+    case FE_IDIV:
+        if (sd == 0 || sd == 1 || sd == -1) {
+            return nullptr;
+        }
+        return emit_idiv_const(f, wlist, inst, lhs, sd, bits);
+    case FE_IREM:
+        if (sd == 0 || sd == 1 || sd == -1) {
+            return nullptr;
+        }
+        return emit_rem_from_quotient(f, wlist, inst, lhs, 
+            emit_idiv_const(f, wlist, inst, lhs, sd, bits), d);
+    default:
+        return nullptr;
+    }
+}
+
 static bool try_strength_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
     if (!fe_inst_has_trait(inst->kind, FE_TRAIT_BINOP)) {
         return false;
     }
 
-    FeInst* lhs = inst->inputs[0];
-    FeInst* rhs = inst->inputs[1];
+    FeInst* lhs = fe_inst_input(inst, 0);
+    FeInst* rhs = fe_inst_input(inst, 1);
 
     bool modified = false;
 
@@ -142,6 +388,21 @@ static bool try_strength_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
             inst->kind = FE_IADD;
             modified = true;
         }
+        break;
+    case FE_IMUL:
+    case FE_UDIV:
+    case FE_UREM:
+    case FE_IDIV:
+    case FE_IREM:
+        ;
+        FeInst* replace = strength_by_const(f, wlist, inst);
+        if (replace) {
+            fe_replace_uses(f, inst, replace);
+            fe_iset_push(wlist, rhs);
+            push_uses(wlist, replace);
+            modified = true;
+        }
+        break;
     }
 
     if (modified) {
@@ -185,8 +446,8 @@ static bool try_identity_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
         return false;
     }
 
-    FeInst* lhs = inst->inputs[0];
-    FeInst* rhs = inst->inputs[1];
+    FeInst* lhs = fe_inst_input(inst, 0);
+    FeInst* rhs = fe_inst_input(inst, 1);
 
     FeInst* replace = nullptr;
 
@@ -201,7 +462,7 @@ static bool try_identity_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
         if (is_const(rhs, 0)) {
             replace = rhs;
         } else if (is_const(lhs, 1)) {
-            replace = lhs;
+            replace = rhs;
         }
         break;
     case FE_SHL:
@@ -210,7 +471,7 @@ static bool try_identity_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
         if (is_const(rhs, 0)) {
             replace = lhs;
         } else if (is_const(lhs, 0)) {
-            replace = rhs;
+            replace = lhs;
         }
         break;
     case FE_XOR:
@@ -252,18 +513,21 @@ static bool try_reassoc(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
         return false;
     }
 
-    FeInst* first = inst->inputs[0];
+    FeInst* first = fe_inst_input(inst, 0);
 
-    // two operations must be the same kind
-    if (inst->kind != first->kind) {
+    // two operations must be the same kind, and
+    // 'first' gets rewritten so nothing else can be using it
+    if (inst->kind != first->kind || first->use_len != 1) {
         return false;
     }
 
-    FeInst* x = first->inputs[0];
-    FeInst* y = first->inputs[1];
-    FeInst* z = inst->inputs[1];
+    FeInst* x = fe_inst_input(first, 0);
+    FeInst* y = fe_inst_input(first, 1);
+    FeInst* z = fe_inst_input(inst, 1);
 
-    if (y->kind != FE_CONST || z->kind != FE_CONST) {
+    // if x is a constant too, 'first' folds on its own.
+    // rotating it would just go around in circles
+    if (x->kind == FE_CONST || y->kind != FE_CONST || z->kind != FE_CONST) {
         return false;
     }
 
@@ -280,6 +544,38 @@ static bool try_reassoc(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
     return true;
 }
 
+// upper 64 bits of the 128-bit product
+static u64 u64_mulh(u64 a, u64 b) {
+    u64 a_lo = (u32)a, a_hi = a >> 32;
+    u64 b_lo = (u32)b, b_hi = b >> 32;
+
+    u64 lo_lo = a_lo * b_lo;
+    u64 hi_lo = a_hi * b_lo;
+    u64 lo_hi = a_lo * b_hi;
+    u64 hi_hi = a_hi * b_hi;
+
+    u64 cross = (lo_lo >> 32) + (u32)hi_lo + lo_hi;
+    return hi_hi + (hi_lo >> 32) + (cross >> 32);
+}
+
+static u64 eval_mulh(u64 lhs, u64 rhs, FeTy ty, bool is_signed) {
+    usize bits = int_ty_bits(ty);
+    if (bits == 64) {
+        u64 hi = u64_mulh(lhs, rhs);
+        if (is_signed) {
+            if ((i64)lhs < 0) hi -= rhs;
+            if ((i64)rhs < 0) hi -= lhs;
+        }
+        return hi;
+    }
+    // the full product fits in 64 bits
+    if (is_signed) {
+        return (u64)(sign_extend(lhs, bits) * sign_extend(rhs, bits)) >> bits;
+    }
+    u64 mask = bits_mask(bits);
+    return ((lhs & mask) * (rhs & mask)) >> bits;
+}
+
 /*
     constant evaluation:
         1 + 2   -> 3
@@ -290,13 +586,80 @@ static bool try_reassoc(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
         ...
 */
 
+// evaluate a binop over constants of integer type 'ty' (the operand type).
+// returns false if the result is undefined or the op can't be evaluated.
+bool fe__const_eval_binop(FeInstKind kind, FeTy ty, u64 lhs, u64 rhs, u64* result) {
+    usize bits = int_ty_bits(ty);
+    if (bits == 0) {
+        return false;
+    }
+
+    u64 mask = bits_mask(bits);
+    lhs &= mask;
+    rhs &= mask;
+    i64 slhs = sign_extend(lhs, bits);
+    i64 srhs = sign_extend(rhs, bits);
+
+    switch (kind) {
+    case FE_IDIV:
+    case FE_IREM:
+        // division by zero and INT_MIN / -1 trap on the host
+        if (rhs == 0 || (srhs == -1 && lhs == (1ull << (bits - 1)))) {
+            return false;
+        }
+        break;
+    case FE_UDIV:
+    case FE_UREM:
+        if (rhs == 0) {
+            return false;
+        }
+        break;
+    case FE_SHL:
+    case FE_USR:
+    case FE_ISR:
+        if (rhs >= bits) {
+            return false;
+        }
+        break;
+    }
+
+    u64 r;
+    switch (kind) {
+    case FE_IADD:  r = lhs + rhs; break;
+    case FE_ISUB:  r = lhs - rhs; break;
+    case FE_IMUL:  r = lhs * rhs; break;
+    case FE_IMULH: r = eval_mulh(lhs, rhs, ty, true); break;
+    case FE_UMULH: r = eval_mulh(lhs, rhs, ty, false); break;
+    case FE_IDIV:  r = slhs / srhs; break;
+    case FE_IREM:  r = slhs % srhs; break;
+    case FE_UDIV:  r = lhs / rhs; break;
+    case FE_UREM:  r = lhs % rhs; break;
+    case FE_AND:   r = lhs & rhs; break;
+    case FE_OR:    r = lhs | rhs; break;
+    case FE_XOR:   r = lhs ^ rhs; break;
+    case FE_SHL:   r = lhs << rhs; break;
+    case FE_USR:   r = lhs >> rhs; break;
+    case FE_ISR:   r = slhs >> rhs; break;
+    case FE_ILT:   *result = slhs <  srhs; return true;
+    case FE_ILE:   *result = slhs <= srhs; return true;
+    case FE_ULT:   *result = lhs <  rhs; return true;
+    case FE_ULE:   *result = lhs <= rhs; return true;
+    case FE_IEQ:   *result = lhs == rhs; return true;
+    default:
+        return false;
+    }
+
+    *result = r & mask;
+    return true;
+}
+
 static bool try_consteval_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
     if (!fe_inst_has_trait(inst->kind, FE_TRAIT_BINOP)) {
         return false;
     }
     
-    FeInst* lhs_inst = inst->inputs[0];
-    FeInst* rhs_inst = inst->inputs[1];
+    FeInst* lhs_inst = fe_inst_input(inst, 0);
+    FeInst* rhs_inst = fe_inst_input(inst, 1);
 
     if (lhs_inst->kind != FE_CONST || rhs_inst->kind != FE_CONST) {
         return false;
@@ -306,37 +669,7 @@ static bool try_consteval_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
     u64 rhs = fe_extra(rhs_inst, FeInstConst)->val;
     u64 result = 0;
 
-    bool can_eval = true;
-    
-    if (inst->kind == FE_IDIV && rhs == 0) {
-        can_eval = false;
-    }
-
-    if (can_eval) switch (inst->kind) {
-    case FE_IADD: result = lhs + rhs; break;
-    case FE_ISUB: result = lhs - rhs; break;
-    case FE_IMUL: result = lhs * rhs; break;
-    case FE_IDIV: result = (i64)lhs / (i64)rhs; break;
-    case FE_IREM: result = (i64)lhs % (i64)rhs; break;
-    case FE_UDIV: result = lhs / rhs; break;
-    case FE_UREM: result = lhs % rhs; break;
-    case FE_AND:  result = lhs & rhs; break;
-    case FE_OR:   result = lhs | rhs; break;
-    case FE_XOR:  result = lhs ^ rhs; break;
-    case FE_SHL:  result = lhs << rhs; break;
-    case FE_USR:  result = lhs >> rhs; break;
-    case FE_ISR:  result = (i64)lhs >> (i64)rhs; break;
-    case FE_ILT:  result = (bool)((i64)lhs >  (i64)rhs); break;
-    case FE_ILE:  result = (bool)((i64)lhs >= (i64)rhs); break;
-    case FE_ULT:  result = (bool)(lhs >  rhs); break;
-    case FE_ULE:  result = (bool)(lhs >= rhs); break;
-    case FE_IEQ:  result = (bool)(lhs == rhs); break;
-    default:
-        can_eval = false;
-        break;
-    }
-
-    if (!can_eval) {
+    if (!fe__const_eval_binop(inst->kind, lhs_inst->ty, lhs, rhs, &result)) {
         return false;
     }
 
@@ -349,7 +682,7 @@ static bool try_consteval_binop(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
     fe_iset_push(wlist, inst);
 
     for_n(i, 0, c->use_len) {
-        fe_iset_push(wlist, FE_USE_PTR(c->uses[i]));
+        fe_iset_push(wlist, FE_USE_PTR(fe_inst_uses(c)[i]));
     }
 
     return true;
@@ -364,8 +697,8 @@ static bool try_commute(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
         return false;
     }
 
-    FeInst* lhs_inst = inst->inputs[0];
-    FeInst* rhs_inst = inst->inputs[1];
+    FeInst* lhs_inst = fe_inst_input(inst, 0);
+    FeInst* rhs_inst = fe_inst_input(inst, 1);
 
     if (!(lhs_inst->kind == FE_CONST && rhs_inst->kind != FE_CONST)) {
         return false;
@@ -381,7 +714,7 @@ static bool try_commute(FeFunc* f, FeInstSet* wlist, FeInst* inst) {
 
 void fe_opt_tdce(FeFunc* f) {
     FeInstSet wlist;
-    fe_iset_init(&wlist);
+    fe_iset_init(&wlist, f, FE_ISET_BY_ID);
 
     for_blocks(block, f) {
         for_inst(inst, block) {
@@ -403,7 +736,7 @@ void fe_opt_tdce(FeFunc* f) {
 
 void fe_opt_local(FeFunc* f) {
     FeInstSet wlist;
-    fe_iset_init(&wlist);
+    fe_iset_init(&wlist, f, FE_ISET_BY_ID);
 
     for_blocks(block, f) {
         for_inst(inst, block) {
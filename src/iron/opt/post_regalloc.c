@@ -12,8 +12,8 @@ static bool try_mov_elim(FeFunc* f, FeInstSet* wlist, FeInst* mov) {
         return false;
     }
 
-    if (f->vregs->at[mov->vr_def].real == f->vregs->at[mov->inputs[0]->vr_def].real) {
-        fe_replace_uses(f, mov, mov->inputs[0]);
+    if (f->vregs->at[mov->vr_def].real == f->vregs->at[fe_inst_input(mov, 0)->vr_def].real) {
+        fe_replace_uses(f, mov, fe_inst_input(mov, 0));
         fe_inst_destroy(f, mov);
         return true;
     }
@@ -24,7 +24,7 @@ static bool try_mov_elim(FeFunc* f, FeInstSet* wlist, FeInst* mov) {
 
 void fe_opt_post_regalloc(FeFunc* f) {
     FeInstSet wlist;
-    fe_iset_init(&wlist);
+    fe_iset_init(&wlist, f, FE_ISET_BY_ID);
 
     for_blocks(block, f) {
         for_inst(inst, block) {
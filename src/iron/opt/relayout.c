@@ -0,0 +1,157 @@
+#include "common/util.h"
+#include "iron/iron.h"
+
+// copy a function into a fresh pool, laid out in reverse postorder.
+// everything after this walks blocks and instructions in the order
+// they sit in memory, and ids come out compacted like fe_opt_compact_ids.
+// the old copy goes back to the pool it came from, other functions
+// might still be allocating out of that one.
+
+static FeBlock** copy_block_list(FeInstPool* pool, FeBlock** list, u16 len, u16 cap) {
+    FeBlock** new_list = fe_ipool_list_alloc(pool, cap);
+    memcpy(new_list, list, len * sizeof(list[0]));
+    return new_list;
+}
+
+// nothing points at the old instructions anymore, so they
+// can go without unhooking them from each other first
+static void free_old_insts(FeInstPool* pool, FeInst* bookend) {
+    for (FeInst* inst = fe_inst_next(bookend), *next; inst != bookend; inst = next) {
+        next = fe_inst_next(inst);
+        if (inst->kind == FE_PHI || inst->kind == FE_MEM_PHI) {
+            usize in_cap = fe_inst_in_cap(inst);
+            if (in_cap != 0) {
+                fe_ipool_list_free(pool, fe_extra(inst, FeInstPhi)->blocks, in_cap);
+            }
+        }
+        if (inst->inputs != 0 && !fe_inst_in_inline(inst)) {
+            fe_ipool_list_free(pool, fe_inst_inputs(inst), fe_inst_in_cap(inst) / 2);
+        }
+        if (!fe_inst_uses_inline(inst)) {
+            fe_ipool_list_free(pool, fe_inst_uses(inst), fe_inst_use_cap(inst));
+        }
+        fe_ipool_free(pool, inst);
+    }
+    fe_ipool_free(pool, bookend);
+}
+
+void fe_func_relayout(FeFunc* f, FeInstPool* pool) {
+    usize block_count = 0;
+    for_blocks(block, f) {
+        block_count += 1;
+    }
+    FeBlock** order = fe_malloc(block_count * sizeof(order[0]));
+    fe__block_rpo(f, order, block_count);
+
+    // old id -> new instruction
+    FeInst** map = fe_malloc(f->max_id * sizeof(map[0]));
+    memset(map, 0, f->max_id * sizeof(map[0]));
+    FeInst** old_bookends = fe_malloc(block_count * sizeof(old_bookends[0]));
+
+    FeInstPool* old_pool = f->ipool;
+    f->ipool = pool;
+    u32 old_max_id = f->max_id;
+    f->max_id = 0;
+
+    // relink the block list and copy every instruction, inputs come later
+    // once everything has somewhere to point to
+    f->entry_block = order[0];
+    f->last_block = order[block_count - 1];
+    for_n (i, 0, block_count) {
+        FeBlock* block = order[i];
+        block->id = i;
+        block->list_prev = i == 0 ? nullptr : order[i - 1];
+        block->list_next = i + 1 == block_count ? nullptr : order[i + 1];
+
+        if (block->pred != block->pred_inline) {
+            FeBlock** old = block->pred;
+            block->pred = copy_block_list(pool, old, block->pred_len, block->pred_cap);
+            fe_ipool_list_free(old_pool, old, block->pred_cap);
+        }
+        if (block->succ != block->succ_inline) {
+            FeBlock** old = block->succ;
+            block->succ = copy_block_list(pool, old, block->succ_len, block->succ_cap);
+            fe_ipool_list_free(old_pool, old, block->succ_cap);
+        }
+
+        FeInst* bookend = fe_ipool_alloc(pool, sizeof(FeInst_Bookend));
+        bookend->kind = FE__BOOKEND;
+        bookend->ty = FE_TY_VOID;
+        bookend->next = fe_inst_ref(bookend);
+        bookend->prev = fe_inst_ref(bookend);
+        fe_extra(bookend, FeInst_Bookend)->block = block;
+        old_bookends[i] = block->bookend;
+        block->bookend = bookend;
+
+        for (FeInst* inst = fe_inst_next(old_bookends[i]); inst->kind != FE__BOOKEND; inst = fe_inst_next(inst)) {
+            usize extra_size = fe_inst_extra_size(inst->kind);
+            FeInst* new_inst = fe_inst_new(f, inst->in_len, extra_size);
+            new_inst->kind = inst->kind;
+            new_inst->ty = inst->ty;
+            new_inst->vr_def = inst->vr_def;
+            memcpy(fe_extra(new_inst), fe_extra(inst), extra_size);
+
+            // phi blocks stay in step with the inputs, see fe_phi_add_src
+            if (inst->kind == FE_PHI || inst->kind == FE_MEM_PHI) {
+                FeInstPhi* phi = fe_extra(new_inst);
+                usize in_cap = fe_inst_in_cap(new_inst);
+                phi->blocks = in_cap == 0 ? nullptr : copy_block_list(pool, phi->blocks, inst->in_len, in_cap);
+            }
+
+            FE_ASSERT(inst->id < old_max_id && map[inst->id] == nullptr);
+            map[inst->id] = new_inst;
+            fe_insert_before(bookend, new_inst);
+        }
+    }
+    f->max_block_id = block_count;
+
+    // walk the old and new blocks side by side to hook up the inputs
+    FeVRegBuffer* vregs = f->vregs;
+    for_n (i, 0, block_count) {
+        FeInst* new_inst = fe_inst_next(order[i]->bookend);
+        for (FeInst* inst = fe_inst_next(old_bookends[i]); inst->kind != FE__BOOKEND; inst = fe_inst_next(inst)) {
+            for_n (n, 0, inst->in_len) {
+                FeInst* input = fe_inst_input(inst, n);
+                if (input == nullptr) {
+                    continue;
+                }
+                if_unlikely (input->id >= old_max_id || map[input->id] == nullptr) {
+                    FE_CRASH("input of inst %u isn't in any block", inst->id);
+                }
+                fe_set_input(f, new_inst, n, map[input->id]);
+            }
+            if (inst->vr_def != FE_VREG_NONE && vregs->at[inst->vr_def].def == inst) {
+                vregs->at[inst->vr_def].def = new_inst;
+            }
+            // params are the root's projections, see place_params
+            FeInst* root = inst->kind == FE_PROJ ? fe_inst_input(inst, 0) : nullptr;
+            if (root != nullptr && root->kind == FE__ROOT) {
+                usize index = fe_extra(inst, FeInstProj)->index;
+                if (f->params[index] == inst) {
+                    f->params[index] = new_inst;
+                }
+            }
+            new_inst = fe_inst_next(new_inst);
+        }
+    }
+    for_n (i, 0, block_count) {
+        free_old_insts(old_pool, old_bookends[i]);
+    }
+
+    fe_free(map);
+    fe_free(old_bookends);
+    fe_free(order);
+}
+
+void fe_opt_relayout(FeFunc* f) {
+    FeInstPool* pool = fe_malloc(sizeof(*pool));
+    fe_ipool_init(pool);
+    FeInstPool* old_pool = f->ipool;
+    bool owned = f->owns_ipool;
+    fe_func_relayout(f, pool);
+    if (owned) {
+        fe_ipool_destroy(old_pool);
+        fe_free(old_pool);
+    }
+    f->owns_ipool = true;
+}
@@ -0,0 +1,393 @@
+#include "common/util.h"
+#include "iron/iron.h"
+
+// sparse conditional constant propagation
+// (wegman & zadeck, "constant propagation with conditional branches")
+//
+// values start out as TOP (undefined) and only ever move down the
+// lattice to a single CONST and then to BOTTOM (overdefined). blocks are
+// only considered once an executable edge reaches them, so constants
+// flow through phis whose other inputs come from dead paths.
+
+typedef enum : u8 {
+    LAT_TOP,
+    LAT_CONST,
+    LAT_BOTTOM,
+} LatticeKind;
+
+typedef struct {
+    LatticeKind kind;
+    u64 val;
+} LatticeVal;
+
+typedef struct {
+    FeFunc* f;
+
+    LatticeVal* values;   // [inst->id]
+    FeBlock** inst_block; // [inst->id]
+    bool* block_exec;     // [block->id]
+
+    FeInst** ssa_list;
+    u32 ssa_len;
+    bool* ssa_in_list;    // [inst->id]
+
+    FeBlock** cfg_list;
+    u32 cfg_len;
+    bool* cfg_in_list;    // [block->id]
+} Sccp;
+
+static LatticeVal meet(LatticeVal a, LatticeVal b) {
+    if (a.kind == LAT_TOP) return b;
+    if (b.kind == LAT_TOP) return a;
+    if (a.kind == LAT_CONST && b.kind == LAT_CONST && a.val == b.val) {
+        return a;
+    }
+    return (LatticeVal){.kind = LAT_BOTTOM};
+}
+
+static void push_inst(Sccp* s, FeInst* inst) {
+    if (s->ssa_in_list[inst->id]) {
+        return;
+    }
+    s->ssa_in_list[inst->id] = true;
+    s->ssa_list[s->ssa_len++] = inst;
+}
+
+static void push_block(Sccp* s, FeBlock* block) {
+    if (s->cfg_in_list[block->id]) {
+        return;
+    }
+    s->cfg_in_list[block->id] = true;
+    s->cfg_list[s->cfg_len++] = block;
+}
+
+static u64 ty_mask(FeTy ty) {
+    switch (ty) {
+    case FE_TY_BOOL: return 1;
+    case FE_TY_I8:   return UINT8_MAX;
+    case FE_TY_I16:  return UINT16_MAX;
+    case FE_TY_I32:  return UINT32_MAX;
+    default:         return UINT64_MAX;
+    }
+}
+
+static bool is_int_ty(FeTy ty) {
+    return FE_TY_BOOL <= ty && ty <= FE_TY_I64;
+}
+
+// can control flow along pred -> succ, given what we know right now?
+static bool edge_feasible(Sccp* s, FeBlock* pred, FeBlock* succ) {
+    if (!s->block_exec[pred->id]) {
+        return false;
+    }
+
+    FeInst* term = fe_inst_prev(pred->bookend);
+    switch (term->kind) {
+    case FE_JUMP:
+        return fe_extra(term, FeInstJump)->to == succ;
+    case FE_BRANCH:
+        ;
+        FeInstBranch* branch = fe_extra(term);
+        LatticeVal cond = s->values[fe_inst_input(term, 0)->id];
+        switch (cond.kind) {
+        case LAT_TOP:
+            return false;
+        case LAT_CONST:
+            return (cond.val ? branch->if_true : branch->if_false) == succ;
+        default:
+            return branch->if_true == succ || branch->if_false == succ;
+        }
+    default:
+        if (!fe_inst_has_trait(term->kind, FE_TRAIT_TERMINATOR)) {
+            return false;
+        }
+        // target-specific terminator, assume every target is reachable
+        usize len = 0;
+        FeBlock** targets = fe_list_terminator_successors(s->f->mod->target, term, &len);
+        for_n (i, 0, len) {
+            if (targets[i] == succ) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+static LatticeVal eval_inst(Sccp* s, FeInst* inst) {
+    const LatticeVal bottom = {.kind = LAT_BOTTOM};
+
+    switch (inst->kind) {
+    case FE_CONST:
+        if (!is_int_ty(inst->ty)) {
+            return bottom;
+        }
+        return (LatticeVal){
+            .kind = LAT_CONST,
+            .val = fe_extra(inst, FeInstConst)->val & ty_mask(inst->ty),
+        };
+    case FE_PHI:
+        ;
+        FeBlock* block = s->inst_block[inst->id];
+        FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+        LatticeVal phi_val = {.kind = LAT_TOP};
+        for_n (i, 0, inst->in_len) {
+            if (!edge_feasible(s, srcs[i], block)) {
+                continue;
+            }
+            phi_val = meet(phi_val, s->values[fe_inst_input(inst, i)->id]);
+            if (phi_val.kind == LAT_BOTTOM) {
+                break;
+            }
+        }
+        return phi_val;
+    case FE_MOV:
+    case FE_TRUNC:
+    case FE_ZERO_EXT:
+    case FE_SIGN_EXT:
+        ;
+        FeInst* src = fe_inst_input(inst, 0);
+        LatticeVal src_val = s->values[src->id];
+        if (src_val.kind != LAT_CONST) {
+            return src_val;
+        }
+        if (!is_int_ty(src->ty) || !is_int_ty(inst->ty)) {
+            return bottom;
+        }
+        u64 val = src_val.val;
+        if (inst->kind == FE_SIGN_EXT) {
+            u64 src_mask = ty_mask(src->ty);
+            if (val & (src_mask ^ (src_mask >> 1))) {
+                val |= ~src_mask;
+            }
+        }
+        return (LatticeVal){.kind = LAT_CONST, .val = val & ty_mask(inst->ty)};
+    }
+
+    if (fe_inst_has_trait(inst->kind, FE_TRAIT_BINOP)) {
+        LatticeVal lhs = s->values[fe_inst_input(inst, 0)->id];
+        LatticeVal rhs = s->values[fe_inst_input(inst, 1)->id];
+        if (lhs.kind == LAT_TOP || rhs.kind == LAT_TOP) {
+            return (LatticeVal){.kind = LAT_TOP};
+        }
+        u64 result;
+        if (lhs.kind == LAT_CONST && rhs.kind == LAT_CONST
+            && fe__const_eval_binop(inst->kind, fe_inst_input(inst, 0)->ty, lhs.val, rhs.val, &result)
+        ) {
+            return (LatticeVal){.kind = LAT_CONST, .val = result};
+        }
+    }
+
+    return bottom;
+}
+
+static void mark_edge(Sccp* s, FeBlock* succ) {
+    if (!s->block_exec[succ->id]) {
+        s->block_exec[succ->id] = true;
+        push_block(s, succ);
+        return;
+    }
+    // a new edge into an already executable block only changes its phis
+    for_inst(inst, succ) {
+        if (inst->kind == FE_PHI) {
+            push_inst(s, inst);
+        }
+    }
+}
+
+static void visit_inst(Sccp* s, FeInst* inst) {
+    FeBlock* block = s->inst_block[inst->id];
+
+    if (fe_inst_has_trait(inst->kind, FE_TRAIT_TERMINATOR)) {
+        for_n (i, 0, block->succ_len) {
+            if (edge_feasible(s, block, block->succ[i])) {
+                mark_edge(s, block->succ[i]);
+            }
+        }
+        return;
+    }
+
+    if (inst->ty == FE_TY_VOID) {
+        return;
+    }
+
+    LatticeVal old_val = s->values[inst->id];
+    if (old_val.kind == LAT_BOTTOM) {
+        return;
+    }
+    LatticeVal new_val = meet(old_val, eval_inst(s, inst));
+    if (new_val.kind == old_val.kind && new_val.val == old_val.val) {
+        return;
+    }
+    s->values[inst->id] = new_val;
+
+    for_n (i, 0, inst->use_len) {
+        push_inst(s, FE_USE_PTR(fe_inst_uses(inst)[i]));
+    }
+}
+
+// replace a branch on a known condition with a jump to the taken side
+static void fold_branch(Sccp* s, FeBlock* block, FeInst* branch) {
+    FeFunc* f = s->f;
+    LatticeVal cond = s->values[fe_inst_input(branch, 0)->id];
+    FeInstBranch* branch_data = fe_extra(branch);
+
+    FeBlock* taken = cond.val ? branch_data->if_true : branch_data->if_false;
+    FeBlock* untaken = cond.val ? branch_data->if_false : branch_data->if_true;
+
+    // the edge to 'taken' already exists, dont go through fe_jump_set_target
+    FeInst* jump = fe_inst_jump(f);
+    fe_extra(jump, FeInstJump)->to = taken;
+    fe_insert_before(branch, jump);
+    fe_inst_destroy(f, branch);
+
+    if (untaken != taken) {
+        fe_phi_remove_srcs_from(f, untaken, block);
+    }
+    fe_cfg_remove_edge(block, untaken);
+}
+
+// control can't get past a branch on a value that is never defined
+static void make_unreachable(Sccp* s, FeBlock* block, FeInst* term) {
+    FeFunc* f = s->f;
+
+    FeInst* unreachable = fe_inst_new(f, 0, 0);
+    unreachable->kind = FE_UNREACHABLE;
+    unreachable->ty = FE_TY_VOID;
+    fe_insert_before(term, unreachable);
+    fe_inst_destroy(f, term);
+
+    while (block->succ_len != 0) {
+        FeBlock* succ = block->succ[0];
+        fe_phi_remove_srcs_from(f, succ, block);
+        fe_cfg_remove_edge(block, succ);
+    }
+}
+
+// the block is unreachable, but it's used as a phi source or branch target.
+// cut it loose from the rest of the cfg.
+static void detach_dead_block(FeFunc* f, FeBlock* block) {
+    for_inst(inst, block) {
+        for_n (i, 0, inst->in_len) {
+            fe_set_input_null(inst, i);
+        }
+    }
+    while (block->succ_len != 0) {
+        FeBlock* succ = block->succ[0];
+        fe_phi_remove_srcs_from(f, succ, block);
+        fe_cfg_remove_edge(block, succ);
+    }
+}
+
+void fe_opt_sccp(FeFunc* f) {
+    Sccp s = {0};
+    s.f = f;
+    // anything created while rewriting gets an id past this
+    const u32 max_id = f->max_id;
+    s.values      = fe_malloc(sizeof(s.values[0]) * f->max_id);
+    s.inst_block  = fe_malloc(sizeof(s.inst_block[0]) * f->max_id);
+    s.ssa_list    = fe_malloc(sizeof(s.ssa_list[0]) * f->max_id);
+    s.ssa_in_list = fe_malloc(sizeof(s.ssa_in_list[0]) * f->max_id);
+    s.block_exec  = fe_malloc(sizeof(s.block_exec[0]) * f->max_block_id);
+    s.cfg_list    = fe_malloc(sizeof(s.cfg_list[0]) * f->max_block_id);
+    s.cfg_in_list = fe_malloc(sizeof(s.cfg_in_list[0]) * f->max_block_id);
+    memset(s.values, 0, sizeof(s.values[0]) * f->max_id);
+    memset(s.ssa_in_list, 0, sizeof(s.ssa_in_list[0]) * f->max_id);
+    memset(s.block_exec, 0, sizeof(s.block_exec[0]) * f->max_block_id);
+    memset(s.cfg_in_list, 0, sizeof(s.cfg_in_list[0]) * f->max_block_id);
+
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            s.inst_block[inst->id] = block;
+        }
+    }
+
+    // solve
+    s.block_exec[f->entry_block->id] = true;
+    push_block(&s, f->entry_block);
+    while (s.cfg_len != 0 || s.ssa_len != 0) {
+        while (s.cfg_len != 0) {
+            FeBlock* block = s.cfg_list[--s.cfg_len];
+            s.cfg_in_list[block->id] = false;
+            for_inst(inst, block) {
+                visit_inst(&s, inst);
+            }
+        }
+        while (s.ssa_len != 0) {
+            FeInst* inst = s.ssa_list[--s.ssa_len];
+            s.ssa_in_list[inst->id] = false;
+            if (s.block_exec[s.inst_block[inst->id]->id]) {
+                visit_inst(&s, inst);
+            }
+        }
+    }
+
+    // fold branches on known conditions
+    for_blocks(block, f) {
+        if (!s.block_exec[block->id]) {
+            continue;
+        }
+        FeInst* term = fe_inst_prev(block->bookend);
+        if (term->kind != FE_BRANCH) {
+            continue;
+        }
+        switch (s.values[fe_inst_input(term, 0)->id].kind) {
+        case LAT_CONST:
+            fold_branch(&s, block, term);
+            break;
+        case LAT_TOP:
+            make_unreachable(&s, block, term);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // delete unreachable blocks
+    usize dead_len = 0;
+    FeBlock** dead = s.cfg_list; // reuse, it's empty now
+    for_blocks(block, f) {
+        if (!s.block_exec[block->id]) {
+            dead[dead_len++] = block;
+        }
+    }
+    for_n (i, 0, dead_len) {
+        detach_dead_block(f, dead[i]);
+    }
+    for_n (i, 0, dead_len) {
+        fe_block_destroy(dead[i]);
+    }
+
+    // replace constant values with actual constants
+    for_blocks(block, f) {
+        FeInst* first_non_phi = fe_inst_next(block->bookend);
+        while (first_non_phi->kind == FE_PHI || first_non_phi->kind == FE_MEM_PHI) {
+            first_non_phi = fe_inst_next(first_non_phi);
+        }
+
+        for_inst(inst, block) {
+            if (inst->kind == FE_CONST || inst->id >= max_id) {
+                continue;
+            }
+            LatticeVal val = s.values[inst->id];
+            if (val.kind != LAT_CONST || inst->use_len == 0) {
+                continue;
+            }
+
+            FeInst* c = fe_inst_const(f, inst->ty, val.val);
+            fe_insert_before(inst->kind == FE_PHI ? first_non_phi : inst, c);
+            fe_replace_uses(f, inst, c);
+
+            if (!fe_inst_has_trait(inst->kind, FE_TRAIT_VOLATILE)) {
+                fe_inst_destroy(f, inst);
+            }
+        }
+    }
+
+    fe_free(s.values);
+    fe_free(s.inst_block);
+    fe_free(s.ssa_list);
+    fe_free(s.ssa_in_list);
+    fe_free(s.block_exec);
+    fe_free(s.cfg_list);
+    fe_free(s.cfg_in_list);
+}
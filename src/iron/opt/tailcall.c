@@ -0,0 +1,252 @@
+#include "common/util.h"
+#include "iron/iron.h"
+
+// tail call optimization
+//
+// a call is in tail position when the block's return hands back exactly
+// the call's results, in order, and nothing else happens in between.
+// calls to the function itself become a jump back to the top of the body
+// (with the arguments flowing through phis), everything else becomes an
+// FE_TAILCALL terminator that the backend lowers to a plain jump after
+// tearing down the frame, as long as the target says it can.
+
+// how many arguments don't fit in registers, the caller's incoming
+// argument area has to be big enough for the callee's
+static usize stack_args(FeFuncSig* sig) {
+    return sig->param_len > 4 ? sig->param_len - 4 : 0;
+}
+
+static bool sig_compatible(FeFunc* f, FeFuncSig* callee) {
+    FeFuncSig* caller = f->sig;
+    if (caller->cconv != callee->cconv || caller->return_len != callee->return_len) {
+        return false;
+    }
+    for_n (i, 0, caller->return_len) {
+        if (fe_funcsig_return(caller, i)->ty != fe_funcsig_return(callee, i)->ty) {
+            return false;
+        }
+    }
+    return stack_args(callee) <= stack_args(caller);
+}
+
+// if the return at the end of 'block' just returns a call's results, get the call
+static FeInst* tail_call_of(FeFunc* f, FeBlock* block) {
+    FeInst* ret = fe_inst_prev(block->bookend);
+    if (ret->kind != FE_RETURN) {
+        return nullptr;
+    }
+
+    // skip over the result projections
+    FeInst* call = fe_inst_prev(ret);
+    while (call->kind == FE_PROJ) {
+        call = fe_inst_prev(call);
+    }
+    if (call->kind != FE_CALL) {
+        return nullptr;
+    }
+    for (FeInst* proj = fe_inst_next(call); proj != ret; proj = fe_inst_next(proj)) {
+        if (fe_inst_input(proj, 0) != call) {
+            return nullptr;
+        }
+    }
+
+    FeFuncSig* sig = fe_extra(call, FeInstCall)->sig;
+    if (!sig_compatible(f, sig) || ret->in_len != sig->return_len + 1) {
+        return nullptr;
+    }
+    if (fe_inst_input(ret, 0) != nullptr && fe_inst_input(ret, 0) != call) {
+        return nullptr;
+    }
+    for_n (i, 0, sig->return_len) {
+        FeInst* val = fe_inst_input(ret, i + 1);
+        if (val == nullptr || val->kind != FE_PROJ || fe_inst_input(val, 0) != call
+            || fe_extra(val, FeInstProj)->index != (usize)i
+        ) {
+            return nullptr;
+        }
+    }
+
+    // the results can't go anywhere else
+    for_n (i, 0, call->use_len) {
+        FeInst* use = FE_USE_PTR(fe_inst_uses(call)[i]);
+        if (use != ret && (use->kind != FE_PROJ || use->use_len != 1 || FE_USE_PTR(fe_inst_uses(use)[0]) != ret)) {
+            return nullptr;
+        }
+    }
+
+    return call;
+}
+
+static bool is_self_call(FeFunc* f, FeInst* call) {
+    FeInst* callee = fe_inst_input(call, 1);
+    return callee != nullptr
+        && callee->kind == FE_SYM_ADDR
+        && fe_extra(callee, FeInstSymAddr)->sym == f->sym
+        // a weak definition might not be the one that gets called
+        && f->sym->bind != FE_BIND_WEAK;
+}
+
+// remove the return and the projections that fed it, then the call
+static void destroy_tail(FeFunc* f, FeBlock* block, FeInst* call) {
+    FeInst* ret = fe_inst_prev(block->bookend);
+    fe_inst_destroy(f, ret);
+    while (fe_inst_next(call) != block->bookend) {
+        fe_inst_destroy(f, fe_inst_next(call));
+    }
+    fe_inst_destroy(f, call);
+}
+
+// split the entry block after the parameters and give each parameter a
+// phi at the top of the new loop header. memory gets one too, everything
+// in the body that hung off the root's memory goes through it instead.
+static FeBlock* make_loop_header(FeFunc* f, FeInst** phis, FeInst** mem_phi) {
+    FeBlock* entry = f->entry_block;
+    FeBlock* header = fe_block_new(f);
+
+    FeInst* first_body = fe_inst_next(entry->bookend);
+    while (first_body->kind == FE__ROOT
+        || (first_body->kind == FE_PROJ && fe_inst_input(first_body, 0)->kind == FE__ROOT)
+    ) {
+        first_body = fe_inst_next(first_body);
+    }
+
+    // move the body, and the edges out of it, into the header
+    FeInstChain body = {
+        .begin = first_body,
+        .end = fe_inst_prev(entry->bookend),
+    };
+    fe_inst_prev(first_body)->next = fe_inst_ref(entry->bookend);
+    entry->bookend->prev = first_body->prev;
+    body.begin->prev = 0;
+    body.end->next = 0;
+    fe_insert_chain_before(header->bookend, body);
+
+    while (entry->succ_len != 0) {
+        FeBlock* succ = entry->succ[0];
+        fe_cfg_add_edge(f, header, succ);
+        fe_cfg_remove_edge(entry, succ);
+        for_inst(inst, succ) {
+            if (inst->kind != FE_PHI && inst->kind != FE_MEM_PHI) {
+                break;
+            }
+            FeBlock** srcs = fe_extra(inst, FeInstPhi)->blocks;
+            for_n (i, 0, inst->in_len) {
+                if (srcs[i] == entry) {
+                    srcs[i] = header;
+                }
+            }
+        }
+    }
+
+    FeInst* jump = fe_inst_jump(f);
+    fe_append_end(entry, jump);
+    fe_jump_set_target(f, jump, header);
+
+    for_n (i, 0, f->sig->param_len) {
+        FeInst* param = fe_func_param(f, i);
+        FeInst* phi = fe_inst_phi(f, param->ty, 2);
+        if (i == 0) {
+            fe_append_begin(header, phi);
+        } else {
+            fe_insert_after(phis[i - 1], phi);
+        }
+
+        fe_replace_uses(f, param, phi);
+        fe_phi_add_src(f, phi, param, entry);
+        phis[i] = phi;
+    }
+
+    // the params are the only users of the root that stay outside the loop
+    FeInst* root = fe_inst_next(entry->bookend);
+    usize mem_users_len = 0;
+    FeInstUse* mem_users = fe_malloc(sizeof(mem_users[0]) * (root->use_len + 1));
+    for_n (i, 0, root->use_len) {
+        FeInstUse use = fe_inst_uses(root)[i];
+        if (FE_USE_PTR(use)->kind != FE_PROJ) {
+            mem_users[mem_users_len++] = use;
+        }
+    }
+    *mem_phi = fe_inst_mem_phi(f, 2);
+    fe_append_begin(header, *mem_phi);
+    for_n (i, 0, mem_users_len) {
+        fe_set_input(f, FE_USE_PTR(mem_users[i]), mem_users[i].idx, *mem_phi);
+    }
+    fe_phi_add_src(f, *mem_phi, root, entry);
+    fe_free(mem_users);
+
+    return header;
+}
+
+void fe_opt_tailcall(FeFunc* f) {
+    // the frame goes away before the callee runs, so nothing
+    // on it can be handed off to the callee
+    if (f->stack_top != nullptr) {
+        return;
+    }
+
+    bool params_scalar = true;
+    for_n (i, 0, f->sig->param_len) {
+        FeTy ty = f->sig->params[i].ty;
+        params_scalar &= ty != FE_TY_RECORD && ty != FE_TY_ARRAY;
+    }
+
+    FeBlock* header = nullptr;
+    FeInst* mem_phi = nullptr;
+    FeInst** phis = fe_malloc(sizeof(phis[0]) * (f->sig->param_len + 1));
+
+    for_blocks(block, f) {
+        FeInst* call = tail_call_of(f, block);
+        if (call == nullptr) {
+            continue;
+        }
+
+        if (is_self_call(f, call) && params_scalar) {
+            // the memory going around the loop is whatever the call saw
+            bool args_set = fe_inst_input(call, 0) != nullptr;
+            for_n (i, 2, call->in_len) {
+                args_set &= fe_inst_input(call, i) != nullptr;
+            }
+            if (!args_set) {
+                continue;
+            }
+
+            FeBlock* call_block = block;
+            if (header == nullptr) {
+                header = make_loop_header(f, phis, &mem_phi);
+                // the call might have just moved out of the entry block
+                if (block == f->entry_block) {
+                    call_block = header;
+                }
+            }
+            for_n (i, 0, f->sig->param_len) {
+                fe_phi_add_src(f, phis[i], fe_inst_input(call, i + 2), call_block);
+            }
+            fe_phi_add_src(f, mem_phi, fe_inst_input(call, 0), call_block);
+            destroy_tail(f, call_block, call);
+
+            FeInst* jump = fe_inst_jump(f);
+            fe_append_end(call_block, jump);
+            fe_jump_set_target(f, jump, header);
+            continue;
+        }
+
+        const FeTarget* target = f->mod->target;
+        if (target->can_tail_call == nullptr || !target->can_tail_call(fe_extra(call, FeInstCall)->sig)) {
+            continue;
+        }
+
+        FeInst* tail = fe_inst_new(f, call->in_len, sizeof(FeInstCall));
+        tail->kind = FE_TAILCALL;
+        tail->ty = FE_TY_VOID;
+        fe_extra(tail, FeInstCall)->sig = fe_extra(call, FeInstCall)->sig;
+        for_n (i, 0, call->in_len) {
+            if (fe_inst_input(call, i) != nullptr) {
+                fe_set_input(f, tail, i, fe_inst_input(call, i));
+            }
+        }
+        destroy_tail(f, block, call);
+        fe_append_end(block, tail);
+    }
+
+    fe_free(phis);
+}
@@ -0,0 +1,985 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "iron/iron.h"
+
+// reads what fe_emit_ir_func writes (with fancy off) back into a module.
+// one pass over the text, instructions get made as their line is read.
+// inputs are all hooked up at the end of each function since a value
+// can be printed after something that uses it, same with block labels.
+//
+// ids and block labels come through as written, so printing the parsed
+// function gives the same text back.
+
+typedef struct {
+    FeInst* inst;
+    u32 id;
+    u16 index;
+    u32 line;
+} InputFixup;
+
+typedef struct {
+    const char* src;
+    usize len;
+    usize pos;
+    u32 line;
+    usize line_start;
+
+    FeModule* mod;
+    FeInstPool* ipool;
+    FeVRegBuffer* vregs;
+    FeSection* text;
+
+    FeIrParseError* err;
+    jmp_buf bail;
+
+    // per function
+    FeFunc* f;
+    FeInst* root;
+    u32 root_id;
+
+    FeInst** insts; // printed id -> inst
+    u32 insts_cap;
+
+    FeBlock** blocks; // printed label -> block
+    bool* blocks_defined;
+    u32 blocks_cap;
+
+    FeStackItem** stack; // s1 is stack[0]
+    u32 stack_len;
+    u32 stack_cap;
+
+    InputFixup* fixups;
+    u32 fixups_len;
+    u32 fixups_cap;
+} Parser;
+
+[[noreturn]] static void error(Parser* p, const char* fmt, ...) {
+    p->err->line = p->line;
+    p->err->col = p->pos - p->line_start + 1;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(p->err->message, sizeof(p->err->message), fmt, args);
+    va_end(args);
+    longjmp(p->bail, 1);
+}
+
+static inline char peek(Parser* p) {
+    return p->pos < p->len ? p->src[p->pos] : '\0';
+}
+
+static inline bool is_digit(char c) {
+    return '0' <= c && c <= '9';
+}
+
+static inline bool is_word_char(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || is_digit(c) || c == '_' || c == '-' || c == '.';
+}
+
+// spaces and tabs, not newlines
+static void skip_space(Parser* p) {
+    while (peek(p) == ' ' || peek(p) == '\t' || peek(p) == '\r') {
+        p->pos += 1;
+    }
+}
+
+static void skip_lines(Parser* p) {
+    while (true) {
+        char c = peek(p);
+        if (c == '\n') {
+            p->pos += 1;
+            p->line += 1;
+            p->line_start = p->pos;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            p->pos += 1;
+        } else {
+            return;
+        }
+    }
+}
+
+static void end_line(Parser* p) {
+    skip_space(p);
+    if (p->pos == p->len) {
+        return;
+    }
+    if (peek(p) != '\n') {
+        error(p, "expected end of line");
+    }
+    skip_lines(p);
+}
+
+static bool accept(Parser* p, char c) {
+    skip_space(p);
+    if (peek(p) == c) {
+        p->pos += 1;
+        return true;
+    }
+    return false;
+}
+
+static void expect(Parser* p, char c) {
+    if (!accept(p, c)) {
+        error(p, "expected '%c'", c);
+    }
+}
+
+static u64 parse_u64(Parser* p) {
+    skip_space(p);
+    if (!is_digit(peek(p))) {
+        error(p, "expected a number");
+    }
+    u64 value = 0;
+    while (is_digit(peek(p))) {
+        u64 digit = peek(p) - '0';
+        if (value > (UINT64_MAX - digit) / 10) {
+            error(p, "number too big");
+        }
+        value = value * 10 + digit;
+        p->pos += 1;
+    }
+    return value;
+}
+
+static u32 parse_u32(Parser* p) {
+    u64 value = parse_u64(p);
+    if (value > UINT32_MAX - 1) {
+        error(p, "number too big");
+    }
+    return value;
+}
+
+typedef struct {
+    const char* data;
+    usize len;
+} Word;
+
+static Word parse_word(Parser* p) {
+    skip_space(p);
+    Word word = {.data = &p->src[p->pos]};
+    while (is_word_char(peek(p))) {
+        p->pos += 1;
+    }
+    word.len = &p->src[p->pos] - word.data;
+    return word;
+}
+
+static bool word_is(Word word, const char* s) {
+    return strlen(s) == word.len && memcmp(word.data, s, word.len) == 0;
+}
+
+static bool accept_word(Parser* p, const char* s) {
+    usize save = p->pos;
+    if (word_is(parse_word(p), s)) {
+        return true;
+    }
+    p->pos = save;
+    return false;
+}
+
+// FE_CCONV_ANY isn't written out, so that's what no name means
+static FeCallConv parse_cconv(Parser* p) {
+    for (FeCallConv cconv = FE_CCONV_ANY + 1; fe_cconv_name(cconv) != nullptr; cconv++) {
+        if (accept_word(p, fe_cconv_name(cconv))) {
+            return cconv;
+        }
+    }
+    return FE_CCONV_ANY;
+}
+
+static FeTy ty_from_word(Word word) {
+    for_n (ty, FE_TY_BOOL, FE__TY_END) {
+        const char* name = fe_ty_name(ty);
+        if (name != nullptr && word_is(word, name)) {
+            return ty;
+        }
+    }
+    return FE_TY_VOID;
+}
+
+static FeTy parse_scalar_ty(Parser* p) {
+    Word word = parse_word(p);
+    FeTy ty = ty_from_word(word);
+    if (ty == FE_TY_VOID || ty == FE_TY_TUPLE || ty == FE_TY_RECORD || ty == FE_TY_ARRAY) {
+        error(p, "expected a type, got '%.*s'", (int)word.len, word.data);
+    }
+    return ty;
+}
+
+// records and arrays only show up on stack items
+static FeTy parse_ty(Parser* p, FeComplexTy** cty) {
+    *cty = nullptr;
+    skip_space(p);
+    if (accept(p, '{')) {
+        // count the fields first, they're all on this line
+        usize save = p->pos;
+        u32 fields_len = 0;
+        u32 depth = 0;
+        for (char c = peek(p); c != '\n' && c != '\0'; c = peek(p)) {
+            if (c == '{' || c == '[') depth += 1;
+            if ((c == '}' || c == ']') && depth-- == 0) break;
+            if (c == ':' && depth == 0) fields_len += 1;
+            p->pos += 1;
+        }
+        p->pos = save;
+
+        FeComplexTy* record = fe_ty_record_new(fields_len);
+        for_n (i, 0, fields_len) {
+            if (i != 0) {
+                expect(p, ',');
+            }
+            FeRecordField* field = &record->record.fields[i];
+            u32 offset = parse_u32(p);
+            if (offset > UINT16_MAX) {
+                error(p, "field offset too big");
+            }
+            field->offset = offset;
+            expect(p, ':');
+            field->ty = parse_ty(p, &field->complex_ty);
+        }
+        expect(p, '}');
+        *cty = record;
+        return FE_TY_RECORD;
+    }
+    if (accept(p, '[')) {
+        u32 len = parse_u32(p);
+        expect(p, '*');
+        FeComplexTy* elem_cty;
+        FeTy elem_ty = parse_ty(p, &elem_cty);
+        expect(p, ']');
+        *cty = fe_ty_array_new(len, elem_ty, elem_cty);
+        return FE_TY_ARRAY;
+    }
+    return parse_scalar_ty(p);
+}
+
+// comma separated, stops at anything that isn't a type
+static u16 parse_ty_list(Parser* p, FeTy* tys, u16 max) {
+    u16 len = 0;
+    usize save = p->pos;
+    FeTy first = ty_from_word(parse_word(p));
+    p->pos = save;
+    if (first == FE_TY_VOID) {
+        return 0;
+    }
+    do {
+        if (len == max) {
+            error(p, "too many types");
+        }
+        tys[len++] = parse_scalar_ty(p);
+    } while (accept(p, ','));
+    return len;
+}
+
+static char* parse_string(Parser* p, u16* len_out) {
+    expect(p, '"');
+    usize start = p->pos;
+    while (peek(p) != '"') {
+        if (peek(p) == '\n' || peek(p) == '\0') {
+            error(p, "unterminated string");
+        }
+        p->pos += 1;
+    }
+    usize len = p->pos - start;
+    p->pos += 1;
+    if (len == 0 || len > UINT16_MAX) {
+        error(p, "bad symbol name");
+    }
+    // symbols keep the pointer, so it has to outlive the source
+    char* data = fe_malloc(len + 1);
+    memcpy(data, &p->src[start], len);
+    data[len] = '\0';
+    *len_out = len;
+    return data;
+}
+
+// a symbol can be used before its function shows up
+static FeSymbol* get_symbol(Parser* p, char* name, u16 len, FeSymbolBinding bind) {
+    FeSymbol* sym = fe_symtab_get(&p->mod->symtab, name, len);
+    if (sym == nullptr) {
+        if (p->text == nullptr) {
+            p->text = fe_section_new(p->mod, "text", 0, FE_SECTION_EXECUTABLE);
+        }
+        return fe_symbol_new(p->mod, name, len, p->text, bind);
+    }
+    fe_free(name);
+    return sym;
+}
+
+// -------------------------------------
+// per-function tables
+// -------------------------------------
+
+#define GROW(ptr, cap, need) do { \
+    u32 old_cap_ = (cap); \
+    if ((need) >= old_cap_) { \
+        u32 new_cap_ = old_cap_ == 0 ? 64 : old_cap_; \
+        while (new_cap_ <= (need)) new_cap_ *= 2; \
+        (ptr) = fe_realloc((ptr), new_cap_ * sizeof((ptr)[0])); \
+        memset(&(ptr)[old_cap_], 0, (new_cap_ - old_cap_) * sizeof((ptr)[0])); \
+        (cap) = new_cap_; \
+    } \
+} while (0)
+
+static void name_inst(Parser* p, FeInst* inst, u32 id) {
+    u32 insts_cap = p->insts_cap;
+    GROW(p->insts, insts_cap, id);
+    p->insts_cap = insts_cap;
+    if (p->insts[id] != nullptr) {
+        error(p, "%%%u is already defined", id);
+    }
+    p->insts[id] = inst;
+    inst->id = id;
+}
+
+static void grow_blocks(Parser* p, u32 label) {
+    u32 blocks_cap = p->blocks_cap;
+    GROW(p->blocks, blocks_cap, label);
+    u32 defined_cap = p->blocks_cap;
+    GROW(p->blocks_defined, defined_cap, label);
+    p->blocks_cap = blocks_cap;
+}
+
+static FeBlock* get_block(Parser* p, u32 label) {
+    grow_blocks(p, label);
+    if (p->blocks[label] == nullptr) {
+        p->blocks[label] = fe_block_new(p->f);
+    }
+    return p->blocks[label];
+}
+
+// '%N' or '%N/vreg', null is UINT32_MAX
+static u32 parse_ref(Parser* p) {
+    skip_space(p);
+    if (accept_word(p, "null")) {
+        return UINT32_MAX;
+    }
+    expect(p, '%');
+    u32 id = parse_u32(p);
+    if (peek(p) == '/') {
+        p->pos += 1;
+        parse_word(p);
+    }
+    return id;
+}
+
+static void add_fixup(Parser* p, FeInst* inst, u16 index, u32 id) {
+    if (id == UINT32_MAX) {
+        return;
+    }
+    if (p->fixups_len == p->fixups_cap) {
+        p->fixups_cap = p->fixups_cap == 0 ? 256 : p->fixups_cap * 2;
+        p->fixups = fe_realloc(p->fixups, p->fixups_cap * sizeof(p->fixups[0]));
+    }
+    p->fixups[p->fixups_len++] = (InputFixup){
+        .inst = inst,
+        .id = id,
+        .index = index,
+        .line = p->line,
+    };
+}
+
+static u32 parse_label(Parser* p) {
+    u32 label = parse_u32(p);
+    if (peek(p) != ':') {
+        error(p, "expected ':' after block label");
+    }
+    p->pos += 1;
+    return label;
+}
+
+// -------------------------------------
+// instructions
+// -------------------------------------
+
+static FeInstKind kind_from_word(Parser* p, Word word) {
+    for_n (kind, FE__ROOT, FE__BASE_INST_END) {
+        const char* name = fe_inst_name(p->mod->target, kind);
+        if (name != nullptr && word_is(word, name)) {
+            return kind;
+        }
+    }
+    error(p, "unknown instruction '%.*s'", (int)word.len, word.data);
+}
+
+#define MAX_OPERANDS 256
+
+static FeInst* new_inst(Parser* p, FeInstKind kind, FeTy ty, usize in_len) {
+    FeInst* inst = fe_inst_new(p->f, in_len, fe_inst_extra_size(kind));
+    inst->kind = kind;
+    inst->ty = ty;
+    // named later, if it has a name at all
+    inst->id = UINT32_MAX;
+    return inst;
+}
+
+static void parse_memop_tail(Parser* p, FeInst* inst) {
+    FeInstMemop* memop = fe_extra(inst);
+    if (!accept_word(p, "align")) {
+        error(p, "expected 'align'");
+    }
+    expect(p, '(');
+    memop->align = parse_u32(p);
+    expect(p, ')');
+    if (accept_word(p, "offset")) {
+        expect(p, '(');
+        u32 offset = parse_u32(p);
+        if (offset > UINT8_MAX) {
+            error(p, "offset too big");
+        }
+        memop->offset = offset;
+        expect(p, ')');
+    }
+}
+
+static void parse_const(Parser* p, FeInst* inst) {
+    FeInstConst* c = fe_extra(inst);
+    skip_space(p);
+    switch (inst->ty) {
+    case FE_TY_BOOL:
+        if (accept_word(p, "true")) {
+            c->val = 1;
+        } else if (accept_word(p, "false")) {
+            c->val = 0;
+        } else {
+            error(p, "expected 'true' or 'false'");
+        }
+        break;
+    case FE_TY_I8 ... FE_TY_I64:
+        c->val = parse_u64(p);
+        // the printer would cut it down, so something else got printed
+        usize bits = 8 << (inst->ty - FE_TY_I8);
+        if (bits < 64 && c->val >> bits != 0) {
+            error(p, "%llu doesn't fit in %s", (unsigned long long)c->val, fe_ty_name(inst->ty));
+        }
+        break;
+    case FE_TY_F32:
+    case FE_TY_F64:
+        ;
+        // strtod wants a terminator, the number won't be this long anyway
+        char buf[64];
+        usize len = 0;
+        while (len < sizeof(buf) - 1 && peek(p) != '\n' && peek(p) != ' ' && peek(p) != '\0') {
+            buf[len++] = peek(p);
+            p->pos += 1;
+        }
+        buf[len] = '\0';
+        char* end;
+        f64 value = strtod(buf, &end);
+        if (len == 0 || *end != '\0') {
+            error(p, "bad float constant");
+        }
+        if (inst->ty == FE_TY_F64) {
+            c->val_f64 = value;
+        } else {
+            c->val_f32 = value;
+        }
+        break;
+    default:
+        error(p, "can't read a constant of type %s", fe_ty_name(inst->ty));
+    }
+}
+
+static void parse_inst(Parser* p, FeBlock* block) {
+    FeFunc* f = p->f;
+
+    // '%N: ty, ty =' if it's named
+    u32 id = UINT32_MAX;
+    FeTy tys[MAX_OPERANDS];
+    u16 tys_len = 0;
+    if (peek(p) == '%') {
+        id = parse_ref(p);
+        if (accept(p, ':')) {
+            tys_len = parse_ty_list(p, tys, MAX_OPERANDS);
+        }
+        expect(p, '=');
+    }
+    FeTy ty = tys_len == 0 ? FE_TY_VOID : tys[0];
+
+    Word name = parse_word(p);
+    FeInstKind kind = kind_from_word(p, name);
+    if (kind != FE_CALL && tys_len > 1) {
+        error(p, "only calls have more than one type");
+    }
+
+    u32 refs[MAX_OPERANDS];
+    u16 refs_len = 0;
+    FeInst* inst = nullptr;
+    switch (kind) {
+    case FE__ROOT:
+        if (block != f->entry_block || p->root_id != UINT32_MAX) {
+            error(p, "root has to be the first thing in the entry block");
+        }
+        inst = p->root;
+        if (id != UINT32_MAX) {
+            p->root_id = id;
+            name_inst(p, inst, id);
+        }
+        end_line(p);
+        return;
+    case FE_PROJ:
+        ;
+        u32 tuple = parse_ref(p);
+        expect(p, ',');
+        u32 index = parse_u32(p);
+        // params already exist, they came with fe_func_new
+        if (tuple == p->root_id && p->root_id != UINT32_MAX) {
+            if (index >= f->sig->param_len) {
+                error(p, "function only has %u params", f->sig->param_len);
+            }
+            inst = f->params[index];
+            if (id != UINT32_MAX) {
+                name_inst(p, inst, id);
+            }
+            end_line(p);
+            return;
+        }
+        inst = new_inst(p, kind, ty, 1);
+        fe_extra(inst, FeInstProj)->index = index;
+        add_fixup(p, inst, 0, tuple);
+        break;
+    case FE_CONST:
+        inst = new_inst(p, kind, ty, 0);
+        parse_const(p, inst);
+        break;
+    case FE_SYM_ADDR:
+        ;
+        u16 sym_len;
+        char* sym_name = parse_string(p, &sym_len);
+        inst = new_inst(p, kind, ty, 0);
+        fe_extra(inst, FeInstSymAddr)->sym = get_symbol(p, sym_name, sym_len, FE_BIND_EXTERN);
+        break;
+    case FE_STACK_ADDR:
+        ;
+        Word item = parse_word(p);
+        u32 item_index = 0;
+        for_n (i, 1, item.len) {
+            if (!is_digit(item.data[i])) {
+                item_index = 0;
+                break;
+            }
+            item_index = item_index * 10 + item.data[i] - '0';
+        }
+        if (item.len < 2 || item.data[0] != 's' || item_index == 0 || item_index > p->stack_len) {
+            error(p, "unknown stack item '%.*s'", (int)item.len, item.data);
+        }
+        inst = new_inst(p, kind, ty, 0);
+        fe_extra(inst, FeInstStack)->item = p->stack[item_index - 1];
+        break;
+    case FE_IADD ... FE_FREM:
+        inst = new_inst(p, kind, ty, 2);
+        add_fixup(p, inst, 0, parse_ref(p));
+        expect(p, ',');
+        add_fixup(p, inst, 1, parse_ref(p));
+        break;
+    case FE_MOV:
+    case FE_TRUNC ... FE_F2U:
+        inst = new_inst(p, kind, ty, 1);
+        add_fixup(p, inst, 0, parse_ref(p));
+        break;
+    case FE_LOAD:
+        expect(p, '[');
+        refs[0] = parse_ref(p);
+        expect(p, ']');
+        refs[1] = parse_ref(p);
+        inst = new_inst(p, kind, ty, 2);
+        add_fixup(p, inst, 0, refs[0]);
+        add_fixup(p, inst, 1, refs[1]);
+        parse_memop_tail(p, inst);
+        break;
+    case FE_STORE:
+        expect(p, '[');
+        refs[0] = parse_ref(p);
+        expect(p, ']');
+        refs[1] = parse_ref(p);
+        expect(p, ',');
+        refs[2] = parse_ref(p);
+        inst = new_inst(p, kind, ty, 3);
+        for_n (i, 0, 3) {
+            add_fixup(p, inst, i, refs[i]);
+        }
+        parse_memop_tail(p, inst);
+        break;
+    case FE_MEM_BARRIER:
+        expect(p, '[');
+        refs[0] = parse_ref(p);
+        expect(p, ']');
+        inst = new_inst(p, kind, ty, 1);
+        add_fixup(p, inst, 0, refs[0]);
+        break;
+    case FE_UNREACHABLE:
+        inst = new_inst(p, kind, ty, 0);
+        break;
+    case FE_RETURN:
+    case FE_CALL:
+    case FE_TAILCALL:
+        ;
+        FeCallConv cconv = kind == FE_RETURN ? FE_CCONV_ANY : parse_cconv(p);
+        expect(p, '[');
+        refs[refs_len++] = parse_ref(p);
+        expect(p, ']');
+        skip_space(p);
+        if (peek(p) == '%' || peek(p) == 'n') {
+            do {
+                if (refs_len == MAX_OPERANDS) {
+                    error(p, "too many inputs");
+                }
+                refs[refs_len++] = parse_ref(p);
+            } while (accept(p, ','));
+        }
+
+        if (kind == FE_RETURN) {
+            if (refs_len - 1 != f->sig->return_len) {
+                error(p, "function returns %u values, not %u", f->sig->return_len, refs_len - 1);
+            }
+        } else {
+            if (refs_len < 2) {
+                error(p, "call without a callee");
+            }
+            // param types get filled in once the args are known
+            FeFuncSig* sig;
+            if (kind == FE_CALL) {
+                sig = fe_funcsig_new(cconv, refs_len - 2, tys_len);
+                for_n (i, 0, tys_len) {
+                    fe_funcsig_return(sig, i)->ty = tys[i];
+                }
+                ty = tys_len == 0 ? FE_TY_VOID : FE_TY_TUPLE;
+            } else {
+                // the callee's results are ours
+                sig = fe_funcsig_new(cconv, refs_len - 2, f->sig->return_len);
+                for_n (i, 0, f->sig->return_len) {
+                    *fe_funcsig_return(sig, i) = *fe_funcsig_return(f->sig, i);
+                }
+            }
+            inst = new_inst(p, kind, ty, refs_len);
+            fe_extra(inst, FeInstCall)->sig = sig;
+        }
+        if (inst == nullptr) {
+            inst = new_inst(p, kind, ty, refs_len);
+        }
+        for_n (i, 0, refs_len) {
+            add_fixup(p, inst, i, refs[i]);
+        }
+        break;
+    case FE_BRANCH:
+        ;
+        u32 cond = parse_ref(p);
+        expect(p, ',');
+        u32 if_true = parse_label(p);
+        expect(p, ',');
+        u32 if_false = parse_label(p);
+        inst = new_inst(p, kind, ty, 1);
+        add_fixup(p, inst, 0, cond);
+        fe_append_end(block, inst);
+        fe_branch_set_true(f, inst, get_block(p, if_true));
+        fe_branch_set_false(f, inst, get_block(p, if_false));
+        break;
+    case FE_JUMP:
+        ;
+        u32 to = parse_label(p);
+        inst = new_inst(p, kind, ty, 0);
+        fe_append_end(block, inst);
+        fe_jump_set_target(f, inst, get_block(p, to));
+        break;
+    case FE_PHI:
+    case FE_MEM_PHI:
+        ;
+        u32 labels[MAX_OPERANDS];
+        skip_space(p);
+        if (is_digit(peek(p))) {
+            do {
+                if (refs_len == MAX_OPERANDS) {
+                    error(p, "too many inputs");
+                }
+                labels[refs_len] = parse_label(p);
+                refs[refs_len] = parse_ref(p);
+                refs_len += 1;
+            } while (accept(p, ','));
+        }
+        inst = new_inst(p, kind, ty, refs_len);
+        // blocks stay in step with the inputs, see fe_phi_add_src
+        usize in_cap = fe_inst_in_cap(inst);
+        FeBlock** blocks = in_cap == 0 ? nullptr : fe_ipool_list_alloc(f->ipool, in_cap);
+        for_n (i, 0, refs_len) {
+            blocks[i] = get_block(p, labels[i]);
+            add_fixup(p, inst, i, refs[i]);
+        }
+        fe_extra(inst, FeInstPhi)->blocks = blocks;
+        break;
+    default:
+        error(p, "can't read '%.*s' instructions", (int)name.len, name.data);
+    }
+
+    if (kind != FE_BRANCH && kind != FE_JUMP) {
+        fe_append_end(block, inst);
+    }
+    if (id != UINT32_MAX) {
+        name_inst(p, inst, id);
+    }
+    end_line(p);
+}
+
+// -------------------------------------
+// functions
+// -------------------------------------
+
+static void finish_func(Parser* p) {
+    FeFunc* f = p->f;
+
+    for_n (i, 0, p->blocks_cap) {
+        if (p->blocks[i] != nullptr && !p->blocks_defined[i]) {
+            error(p, "block %zu: is used but never defined", i);
+        }
+    }
+
+    for_n (i, 0, p->fixups_len) {
+        InputFixup* fixup = &p->fixups[i];
+        if (fixup->id >= p->insts_cap || p->insts[fixup->id] == nullptr) {
+            p->line = fixup->line;
+            p->line_start = p->pos;
+            error(p, "%%%u is never defined", fixup->id);
+        }
+        fe_set_input(f, fixup->inst, fixup->index, p->insts[fixup->id]);
+    }
+
+    // params that didn't get printed were thrown out by some pass
+    // (nothing used them), so they go here too
+    for_n (i, 0, f->sig->param_len) {
+        FeInst* param = f->params[i];
+        bool named = param->id < p->insts_cap && p->insts[param->id] == param;
+        if (!named && param->use_len == 0) {
+            fe_inst_destroy(f, param);
+        }
+    }
+
+    // anything without a name gets an id after all the named ones,
+    // and calls get their param types from what's passed in
+    u32 max_id = 0;
+    for_n (i, 0, p->insts_cap) {
+        if (p->insts[i] != nullptr) {
+            max_id = i + 1;
+        }
+    }
+    u32 max_block_id = 0;
+    for_blocks(block, f) {
+        if (block->id >= max_block_id) {
+            max_block_id = block->id + 1;
+        }
+        for_inst(inst, block) {
+            bool named = inst->id < p->insts_cap && p->insts[inst->id] == inst;
+            if (!named) {
+                inst->id = max_id++;
+            }
+            if (inst->kind == FE_CALL || inst->kind == FE_TAILCALL) {
+                FeFuncSig* sig = fe_extra(inst, FeInstCall)->sig;
+                for_n (n, 0, sig->param_len) {
+                    FeInst* arg = fe_inst_input(inst, n + 2);
+                    if (arg == nullptr) {
+                        continue;
+                    }
+                    fe_funcsig_param(sig, n)->ty = arg->ty;
+                }
+            }
+        }
+    }
+    f->max_id = max_id;
+    f->max_block_id = max_block_id;
+}
+
+static bool ends_block(FeBlock* block) {
+    FeInst* last = fe_inst_prev(block->bookend);
+    return last != block->bookend && fe_inst_has_trait(last->kind, FE_TRAIT_TERMINATOR);
+}
+
+// every block has to end in exactly one terminator, passes count on it
+static void finish_block(Parser* p, FeBlock* block) {
+    if (block == nullptr) {
+        error(p, "function has no blocks");
+    }
+    if (!ends_block(block)) {
+        error(p, "block %u: doesn't end in a terminator", block->id);
+    }
+}
+
+static void parse_func_body(Parser* p) {
+    FeFunc* f = p->f;
+
+    memset(p->insts, 0, p->insts_cap * sizeof(p->insts[0]));
+    memset(p->blocks, 0, p->blocks_cap * sizeof(p->blocks[0]));
+    memset(p->blocks_defined, 0, p->blocks_cap * sizeof(p->blocks_defined[0]));
+    p->fixups_len = 0;
+    p->stack_len = 0;
+    p->root = fe_inst_next(f->entry_block->bookend);
+    p->root_id = UINT32_MAX;
+
+    // stack items come first
+    skip_lines(p);
+    while (peek(p) == 's') {
+        p->pos += 1;
+        u32 index = parse_u32(p);
+        if (index != p->stack_len + 1) {
+            error(p, "stack items have to be in order");
+        }
+        expect(p, ':');
+        FeComplexTy* cty;
+        FeTy ty = parse_ty(p, &cty);
+        FeStackItem* item = fe_stack_append_top(f, fe_stack_item_new(ty, cty));
+        if (p->stack_len == p->stack_cap) {
+            p->stack_cap = p->stack_cap == 0 ? 16 : p->stack_cap * 2;
+            p->stack = fe_realloc(p->stack, p->stack_cap * sizeof(p->stack[0]));
+        }
+        p->stack[p->stack_len++] = item;
+        end_line(p);
+    }
+
+    FeBlock* block = nullptr;
+    while (true) {
+        skip_lines(p);
+        char c = peek(p);
+        if (c == '}') {
+            finish_block(p, block);
+            p->pos += 1;
+            break;
+        }
+        if (c == '\0') {
+            error(p, "unexpected end of input in function body");
+        }
+
+        if (is_digit(c)) {
+            if (block != nullptr) {
+                finish_block(p, block);
+            }
+            u32 label = parse_label(p);
+            if (block == nullptr) {
+                // the first block is the one fe_func_new made
+                grow_blocks(p, label);
+                p->blocks[label] = f->entry_block;
+            }
+            block = get_block(p, label);
+            if (p->blocks_defined[label]) {
+                error(p, "block %u: is already defined", label);
+            }
+            p->blocks_defined[label] = true;
+            block->id = label;
+
+            // blocks made by a forward reference get moved to where they show up
+            if (block != f->last_block && block != f->entry_block) {
+                if (block->list_prev) block->list_prev->list_next = block->list_next;
+                if (block->list_next) block->list_next->list_prev = block->list_prev;
+                block->list_prev = f->last_block;
+                block->list_next = nullptr;
+                f->last_block->list_next = block;
+                f->last_block = block;
+            }
+            end_line(p);
+            continue;
+        }
+
+        if (block == nullptr) {
+            error(p, "instruction outside of a block");
+        }
+        if (ends_block(block)) {
+            error(p, "block %u: already ended", block->id);
+        }
+        parse_inst(p, block);
+    }
+
+    finish_func(p);
+}
+
+static bool parse_func(Parser* p) {
+    skip_lines(p);
+    if (p->pos == p->len) {
+        return false;
+    }
+
+    Word bind_word = parse_word(p);
+    FeSymbolBinding bind;
+    if (word_is(bind_word, "extern")) bind = FE_BIND_EXTERN;
+    else if (word_is(bind_word, "global")) bind = FE_BIND_GLOBAL;
+    else if (word_is(bind_word, "local")) bind = FE_BIND_LOCAL;
+    else if (word_is(bind_word, "weak")) bind = FE_BIND_WEAK;
+    else if (word_is(bind_word, "shared_export")) bind = FE_BIND_SHARED_EXPORT;
+    else if (word_is(bind_word, "shared_import")) bind = FE_BIND_SHARED_IMPORT;
+    else error(p, "expected a binding like 'global' or 'local'");
+
+    if (!accept_word(p, "func")) {
+        error(p, "expected 'func'");
+    }
+    u16 name_len;
+    char* name = parse_string(p, &name_len);
+    FeCallConv cconv = parse_cconv(p);
+
+    FeTy params[MAX_OPERANDS];
+    FeTy returns[MAX_OPERANDS];
+    u16 param_len = parse_ty_list(p, params, MAX_OPERANDS);
+    u16 return_len = 0;
+    skip_space(p);
+    if (peek(p) == '-') {
+        p->pos += 1;
+        expect(p, '>');
+        return_len = parse_ty_list(p, returns, MAX_OPERANDS);
+    }
+
+    FeFuncSig* sig = fe_funcsig_new(cconv, param_len, return_len);
+    for_n (i, 0, param_len) {
+        fe_funcsig_param(sig, i)->ty = params[i];
+    }
+    for_n (i, 0, return_len) {
+        fe_funcsig_return(sig, i)->ty = returns[i];
+    }
+
+    FeSymbol* sym = get_symbol(p, name, name_len, bind);
+    if (sym->kind == FE_SYMKIND_FUNC) {
+        error(p, "function \"%.*s\" is already defined", name_len, fe_compstr_data(sym->name));
+    }
+    sym->bind = bind;
+    p->f = fe_func_new(p->mod, sym, sig, p->ipool, p->vregs);
+
+    // extern functions stop after the signature
+    if (bind != FE_BIND_EXTERN) {
+        expect(p, '{');
+        end_line(p);
+        parse_func_body(p);
+    }
+    return true;
+}
+
+bool fe_parse_ir(FeModule* mod, const char* src, usize len, FeInstPool* ipool, FeVRegBuffer* vregs, FeIrParseError* err) {
+    Parser p = {
+        .src = src,
+        .len = len,
+        .line = 1,
+        .mod = mod,
+        .ipool = ipool,
+        .vregs = vregs,
+        .err = err,
+    };
+
+    // reuse a text section if the module has one
+    for (FeSection* section = mod->sections.first; section != nullptr; section = section->next) {
+        if (section->flags & FE_SECTION_EXECUTABLE) {
+            p.text = section;
+            break;
+        }
+    }
+
+    GROW(p.insts, p.insts_cap, 0);
+    grow_blocks(&p, 0);
+
+    bool ok = true;
+    if (setjmp(p.bail) == 0) {
+        while (parse_func(&p)) {}
+    } else {
+        ok = false;
+    }
+
+    fe_free(p.insts);
+    fe_free(p.blocks);
+    fe_free(p.blocks_defined);
+    fe_free(p.stack);
+    fe_free(p.fixups);
+    return ok;
+}
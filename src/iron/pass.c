@@ -0,0 +1,249 @@
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#include "iron/iron.h"
+
+const FePass fe_pass_local = {
+    .name = "local",
+    .run = fe_opt_local,
+    .invalidates = FE_ANALYSIS_LIVENESS,
+};
+const FePass fe_pass_tdce = {
+    .name = "tdce",
+    .run = fe_opt_tdce,
+    .invalidates = FE_ANALYSIS_LIVENESS,
+};
+// ids aren't part of any analysis
+const FePass fe_pass_compact_ids = {
+    .name = "compact_ids",
+    .run = fe_opt_compact_ids,
+};
+// folds branches
+const FePass fe_pass_sccp = {
+    .name = "sccp",
+    .run = fe_opt_sccp,
+    .invalidates = FE_ANALYSIS_ALL,
+};
+const FePass fe_pass_cfg_simplify = {
+    .name = "cfg_simplify",
+    .run = fe_opt_cfg_simplify,
+    .invalidates = FE_ANALYSIS_ALL,
+};
+// turns self-recursion into a loop
+const FePass fe_pass_tailcall = {
+    .name = "tailcall",
+    .run = fe_opt_tailcall,
+    .invalidates = FE_ANALYSIS_ALL,
+};
+const FePass fe_pass_isel = {
+    .name = "isel",
+    .run = fe_codegen_isel,
+    .invalidates = FE_ANALYSIS_ALL,
+};
+// packs the function into memory in the order the rest of codegen walks it
+const FePass fe_pass_relayout = {
+    .name = "relayout",
+    .run = fe_opt_relayout,
+    .invalidates = FE_ANALYSIS_ALL,
+};
+const FePass fe_pass_vregs = {
+    .name = "vregs",
+    .run = fe_codegen_vregs,
+    .invalidates = FE_ANALYSIS_LIVENESS,
+};
+const FePass fe_pass_regalloc = {
+    .name = "regalloc",
+    .run = fe_regalloc_basic,
+    .required = FE_ANALYSIS_LIVENESS,
+};
+const FePass fe_pass_post_regalloc = {
+    .name = "post_regalloc",
+    .run = fe_opt_post_regalloc,
+    .invalidates = FE_ANALYSIS_LIVENESS,
+};
+
+static const FePass* all_passes[] = {
+    &fe_pass_local,
+    &fe_pass_tdce,
+    &fe_pass_compact_ids,
+    &fe_pass_sccp,
+    &fe_pass_cfg_simplify,
+    &fe_pass_tailcall,
+    &fe_pass_isel,
+    &fe_pass_relayout,
+    &fe_pass_vregs,
+    &fe_pass_regalloc,
+    &fe_pass_post_regalloc,
+};
+
+const FePass* fe_pass_by_name(const char* name) {
+    for_n (i, 0, sizeof(all_passes) / sizeof(all_passes[0])) {
+        if (strcmp(all_passes[i]->name, name) == 0) {
+            return all_passes[i];
+        }
+    }
+    return nullptr;
+}
+
+static f64 now() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (f64)count.QuadPart / (f64)freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (f64)t.tv_sec + (f64)t.tv_nsec * 1e-9;
+#endif
+}
+
+static u32 count_insts(FeFunc* f) {
+    u32 count = 0;
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+void fe_pm_init(FePassManager* pm) {
+    memset(pm, 0, sizeof(*pm));
+    pm->cap = 8;
+    pm->passes = fe_malloc(pm->cap * sizeof(pm->passes[0]));
+    pm->stats_cap = 16;
+    pm->stats = fe_malloc(pm->stats_cap * sizeof(pm->stats[0]));
+}
+
+void fe_pm_destroy(FePassManager* pm) {
+    fe_free(pm->passes);
+    fe_free(pm->stats);
+    *pm = (FePassManager){};
+}
+
+void fe_pm_add(FePassManager* pm, const FePass* pass) {
+    if (pm->len == pm->cap) {
+        pm->cap += pm->cap >> 1;
+        pm->passes = fe_realloc(pm->passes, pm->cap * sizeof(pm->passes[0]));
+    }
+    pm->passes[pm->len++] = pass;
+}
+
+void fe_pm_add_codegen(FePassManager* pm) {
+    fe_pm_add(pm, &fe_pass_isel);
+    fe_pm_add(pm, &fe_pass_tdce);
+    fe_pm_add(pm, &fe_pass_compact_ids);
+    fe_pm_add(pm, &fe_pass_vregs);
+    fe_pm_add(pm, &fe_pass_regalloc);
+    fe_pm_add(pm, &fe_pass_post_regalloc);
+}
+
+void fe_pm_run(FePassManager* pm, FeFunc* f) {
+    for_n (i, 0, pm->len) {
+        const FePass* pass = pm->passes[i];
+        if (pm->stats_len == pm->stats_cap) {
+            pm->stats_cap += pm->stats_cap >> 1;
+            pm->stats = fe_realloc(pm->stats, pm->stats_cap * sizeof(pm->stats[0]));
+        }
+        FePassStats* stats = &pm->stats[pm->stats_len++];
+        stats->pass = pass;
+        stats->index = i;
+        stats->sym = f->sym;
+        stats->insts_before = count_insts(f);
+
+        f64 start = now();
+        fe_analysis_require(f, pass->required);
+        f64 analysis_end = now();
+
+        FeInstPool* pool = f->ipool;
+        usize allocated = pool->allocated;
+        pass->run(f);
+        f64 end = now();
+
+        fe_analysis_invalidate(f, pass->invalidates);
+
+        stats->analysis_time = analysis_end - start;
+        stats->time = end - analysis_end;
+        // a pass that moves the function into a new pool (relayout) might
+        // have freed the old one, everything in the new one is its doing
+        if (f->ipool == pool) {
+            stats->alloc_bytes = pool->allocated - allocated;
+        } else {
+            stats->alloc_bytes = f->ipool->allocated;
+        }
+        stats->insts_after = count_insts(f);
+    }
+}
+
+void fe_pm_run_module(FePassManager* pm, FeModule* mod) {
+    for_funcs(f, mod) {
+        fe_pm_run(pm, f);
+    }
+}
+
+static void write_json_string(FeDataBuffer* db, const char* data, usize len) {
+    fe_db_write8(db, '"');
+    for_n (i, 0, len) {
+        char c = data[i];
+        if (c == '"' || c == '\\') {
+            fe_db_write8(db, '\\');
+            fe_db_write8(db, c);
+        } else if ((u8)c < 0x20) {
+            fe_db_writef(db, "\\u%04x", c);
+        } else {
+            fe_db_write8(db, c);
+        }
+    }
+    fe_db_write8(db, '"');
+}
+
+void fe_pm_dump_json(FePassManager* pm, FeDataBuffer* db) {
+    fe_db_writecstr(db, "{\n  \"runs\": [");
+    for_n (i, 0, pm->stats_len) {
+        FePassStats* stats = &pm->stats[i];
+        fe_db_writecstr(db, i == 0 ? "\n    {\"pass\": " : ",\n    {\"pass\": ");
+        write_json_string(db, stats->pass->name, strlen(stats->pass->name));
+        fe_db_writecstr(db, ", \"func\": ");
+        write_json_string(db, fe_compstr_data(stats->sym->name), stats->sym->name.len);
+        fe_db_writef(db, ", \"time_us\": %.3f, \"analysis_time_us\": %.3f",
+            stats->time * 1e6, stats->analysis_time * 1e6);
+        fe_db_writef(db, ", \"insts_before\": %u, \"insts_after\": %u, \"alloc_bytes\": %zu}",
+            stats->insts_before, stats->insts_after, stats->alloc_bytes);
+    }
+    fe_db_writecstr(db, "\n  ],\n  \"totals\": [");
+
+    // the same pass can show up more than once in a pipeline,
+    // each one gets its own line
+    for_n (p, 0, pm->len) {
+        const FePass* pass = pm->passes[p];
+        usize runs = 0;
+        f64 time = 0;
+        f64 analysis_time = 0;
+        u64 insts_before = 0;
+        u64 insts_after = 0;
+        usize alloc_bytes = 0;
+        for_n (i, 0, pm->stats_len) {
+            FePassStats* stats = &pm->stats[i];
+            if (stats->index != p) {
+                continue;
+            }
+            runs += 1;
+            time += stats->time;
+            analysis_time += stats->analysis_time;
+            insts_before += stats->insts_before;
+            insts_after += stats->insts_after;
+            alloc_bytes += stats->alloc_bytes;
+        }
+        fe_db_writecstr(db, p == 0 ? "\n    {\"pass\": " : ",\n    {\"pass\": ");
+        write_json_string(db, pass->name, strlen(pass->name));
+        fe_db_writef(db, ", \"runs\": %zu, \"time_us\": %.3f, \"analysis_time_us\": %.3f",
+            runs, time * 1e6, analysis_time * 1e6);
+        fe_db_writef(db, ", \"insts_before\": %llu, \"insts_after\": %llu, \"alloc_bytes\": %zu}",
+            (unsigned long long)insts_before, (unsigned long long)insts_after, alloc_bytes);
+    }
+    fe_db_writecstr(db, "\n  ]\n}\n");
+}
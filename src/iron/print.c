@@ -64,6 +64,8 @@ static const char* inst_name[FE__BASE_INST_END] = {
     [FE_IADD] = "iadd",
     [FE_ISUB] = "isub",
     [FE_IMUL] = "imul",
+    [FE_IMULH] = "imulh",
+    [FE_UMULH] = "umulh",
     [FE_IDIV] = "idiv",
     [FE_UDIV] = "udiv",
     [FE_IREM] = "irem",
@@ -91,6 +93,7 @@ static const char* inst_name[FE__BASE_INST_END] = {
     [FE_TRUNC] = "trunc",
     [FE_SIGN_EXT] = "sign-ext",
     [FE_ZERO_EXT] = "zero-ext",
+    [FE_BITCAST] = "bitcast",
     [FE_I2F] = "i2f",
     [FE_F2I] = "f2i",
     [FE_U2F] = "u2f",
@@ -109,6 +112,7 @@ static const char* inst_name[FE__BASE_INST_END] = {
     [FE_MEM_PHI] = "mem-phi",
 
     [FE_CALL] = "call",
+    [FE_TAILCALL] = "tailcall",
 };
 
 // idea stolen from TB lmao
@@ -125,7 +129,7 @@ thread_local static bool should_ansi = true;
 
 static void print_ty(FeDataBuffer* db, FeTy ty, FeComplexTy* cty) {
     if (ty == FE_TY_RECORD) {
-        if (cty != nullptr) {
+        if (cty == nullptr) {
             FE_CRASH("ty is record but no FeComplexTy was provided");
         }
         fe_db_writecstr(db, "{ ");
@@ -141,7 +145,7 @@ static void print_ty(FeDataBuffer* db, FeTy ty, FeComplexTy* cty) {
 
         fe_db_writecstr(db, " }");
     } else if (ty == FE_TY_ARRAY) {
-        if (cty != nullptr) {
+        if (cty == nullptr) {
             FE_CRASH("ty is array but no FeComplexTy was provided");
         }
 
@@ -156,12 +160,13 @@ static void print_ty(FeDataBuffer* db, FeTy ty, FeComplexTy* cty) {
 
 static void print_inst_ty(FeDataBuffer* db, FeInst* inst) {
     if (inst->ty == FE_TY_TUPLE) {
-        usize index = 0;
-        for (FeTy ty = fe_proj_ty(inst, index); ty != FE_TY_VOID; index++, ty = fe_proj_ty(inst, index)) {
+        // calls are the only tuple-producing instructions at the moment
+        usize len = fe_extra(inst, FeInstCall)->sig->return_len;
+        for_n (index, 0, len) {
             if (index != 0) {
                 fe_db_writecstr(db, ", ");
             }
-            fe_db_writecstr(db, ty_name[ty]);
+            fe_db_writecstr(db, ty_name[fe_proj_ty(inst, index)]);
         }
     } else {
         fe_db_writecstr(db, ty_name[inst->ty]);
@@ -221,10 +226,25 @@ const char* fe_ty_name(FeTy ty) {
     return nullptr;
 }
 
+// FE_CCONV_ANY is the default and doesn't get printed
+static const char* cconv_name[] = {
+    [FE_CCONV_SYSV]    = "sysv",
+    [FE_CCONV_STDCALL] = "stdcall",
+    [FE_CCONV_C]       = "c",
+    [FE_CCONV_JACKAL]  = "jackal",
+};
+
+const char* fe_cconv_name(FeCallConv cconv) {
+    if (cconv < sizeof(cconv_name) / sizeof(cconv_name[0])) {
+        return cconv_name[cconv];
+    }
+    return nullptr;
+}
+
 static void print_input_list(FeDataBuffer* db, FeFunc* f, FeInst* inst, usize start_at) {
     for_n(i, start_at, inst->in_len) {
         if (i != start_at) fe_db_writecstr(db, ", ");
-        fe__emit_ir_ref(db, f, inst->inputs[i]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, i));
     }
 }
 
@@ -257,39 +277,44 @@ static void print_inst(FeFunc* f, FeDataBuffer* db, FeInst* inst) {
     case FE__ROOT:
         break;
     case FE_PROJ:
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         fe_db_writef(db, ", %u", fe_extra(inst, FeInstProj)->index);
         break;
     case FE_IADD ... FE_FREM:
         print_input_list(db, f, inst, 0);
         break;
     case FE_MOV ... FE_F2U:
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         break;
     case FE_RETURN:
         ;
         fe_db_writecstr(db, "[");
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         fe_db_writecstr(db, "] ");
         for_n(i, 1, inst->in_len) {
             if (i != 1) fe_db_writecstr(db, ", ");
-            fe__emit_ir_ref(db, f, inst->inputs[i]);
+            fe__emit_ir_ref(db, f, fe_inst_input(inst, i));
         }
         break;
     case FE_CALL:
+    case FE_TAILCALL:
         ;
+        const char* cconv = fe_cconv_name(fe_extra(inst, FeInstCall)->sig->cconv);
+        if (cconv != nullptr) {
+            fe_db_writef(db, "%s ", cconv);
+        }
         fe_db_writecstr(db, "[");
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         fe_db_writecstr(db, "] ");
         for_n(i, 1, inst->in_len) {
             if (i != 1) fe_db_writecstr(db, ", ");
-            fe__emit_ir_ref(db, f, inst->inputs[i]);
+            fe__emit_ir_ref(db, f, fe_inst_input(inst, i));
         }
         break;
     case FE_BRANCH:
         ;
         FeInstBranch* branch = fe_extra(inst);
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         fe_db_writecstr(db, ", ");
         fe__emit_ir_block_label(db, f, branch->if_true);
         fe_db_writecstr(db, ", ");
@@ -301,6 +326,7 @@ static void print_inst(FeFunc* f, FeDataBuffer* db, FeInst* inst) {
         fe__emit_ir_block_label(db, f, jump->to);
         break;
     case FE_PHI:
+    case FE_MEM_PHI:
         ;
         FeInstPhi* phi = fe_extra(inst);
         for_n(i, 0, inst->in_len) {
@@ -308,7 +334,7 @@ static void print_inst(FeFunc* f, FeDataBuffer* db, FeInst* inst) {
                 fe_db_writecstr(db, ", ");
             }
             FeBlock* src_block = phi->blocks[i];
-            FeInst* src = inst->inputs[i];
+            FeInst* src = fe_inst_input(inst, i);
             fe__emit_ir_block_label(db, f, src_block);
             fe_db_writecstr(db, " ");
             fe__emit_ir_ref(db, f, src);
@@ -330,10 +356,10 @@ static void print_inst(FeFunc* f, FeDataBuffer* db, FeInst* inst) {
         ;
         FeInstMemop* load = fe_extra(inst);
         fe_db_writecstr(db, "[");
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         fe_db_writecstr(db, "] ");
 
-        fe__emit_ir_ref(db, f, inst->inputs[1]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 1));
         fe_db_writef(db, " align(%u)", load->align);
         if (load->offset) {
             fe_db_writef(db, " offset(%u) ", load->offset);
@@ -343,11 +369,11 @@ static void print_inst(FeFunc* f, FeDataBuffer* db, FeInst* inst) {
         ;
         FeInstMemop* store = fe_extra(inst);
         fe_db_writecstr(db, "[");
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         fe_db_writecstr(db, "] ");
-        fe__emit_ir_ref(db, f, inst->inputs[1]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 1));
         fe_db_writecstr(db, ", ");
-        fe__emit_ir_ref(db, f, inst->inputs[2]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 2));
         fe_db_writef(db, " align(%u)", store->align);
         if (store->offset) {
             fe_db_writef(db, " offset(%u) ", store->offset);
@@ -356,8 +382,9 @@ static void print_inst(FeFunc* f, FeDataBuffer* db, FeInst* inst) {
     case FE_CONST:
         switch (inst->ty) {
         case FE_TY_BOOL: fe_db_writef(db, "%s", fe_extra(inst, FeInstConst)->val ? "true" : "false"); break;
-        case FE_TY_F64:  fe_db_writef(db, "%lf", (f64)fe_extra(inst, FeInstConst)->val_f64); break;
-        case FE_TY_F32:  fe_db_writef(db, "%lf", (f64)fe_extra(inst, FeInstConst)->val_f32); break;
+        // enough digits to read back the same value
+        case FE_TY_F64:  fe_db_writef(db, "%.17g", (f64)fe_extra(inst, FeInstConst)->val_f64); break;
+        case FE_TY_F32:  fe_db_writef(db, "%.9g", (f64)fe_extra(inst, FeInstConst)->val_f32); break;
         case FE_TY_I64:  fe_db_writef(db, "%llu", (u64)fe_extra(inst, FeInstConst)->val); break;
         case FE_TY_I32:  fe_db_writef(db, "%llu", (u64)(u32)fe_extra(inst, FeInstConst)->val); break;
         case FE_TY_I16:  fe_db_writef(db, "%llu", (u64)(u16)fe_extra(inst, FeInstConst)->val); break;
@@ -375,6 +402,12 @@ static void print_inst(FeFunc* f, FeDataBuffer* db, FeInst* inst) {
         u16 real = vreg->real;
         fe_db_writecstr(db, f->mod->target->reg_name(class, real));
         break;
+    case FE_MEM_BARRIER:
+        fe_db_writecstr(db, "[");
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
+        fe_db_writecstr(db, "]");
+        break;
+    case FE_UNREACHABLE:
     case FE__MACH_RETURN:
         break;
     default:
@@ -397,6 +430,9 @@ void fe_emit_ir_func(FeDataBuffer* db, FeFunc* f, bool fancy) {
 
     // write function signature
     fe_db_writef(db, "func \"%.*s\"", f->sym->name.len, fe_compstr_data(f->sym->name));
+    if (fe_cconv_name(f->sig->cconv) != nullptr) {
+        fe_db_writef(db, " %s", fe_cconv_name(f->sig->cconv));
+    }
     if (f->sig->param_len) {
         fe_db_writecstr(db, " ");
         for_n(i, 0, f->sig->param_len) {
@@ -415,6 +451,7 @@ void fe_emit_ir_func(FeDataBuffer* db, FeFunc* f, bool fancy) {
     }
 
     if (f->sym->bind == FE_BIND_EXTERN) {
+        fe_db_writecstr(db, "\n");
         return;
     }
 
@@ -423,7 +460,7 @@ void fe_emit_ir_func(FeDataBuffer* db, FeFunc* f, bool fancy) {
     
     // write stack frame
     u32 stack_counter = 1;
-    for (FeStackItem* item = f->stack_top; item != nullptr; item = item->next) {
+    for (FeStackItem* item = f->stack_bottom; item != nullptr; item = item->next) {
         item->flags = stack_counter;
         fe_db_writef(db, "    s%d: ", stack_counter);
         print_ty(db, item->ty, item->complex_ty);
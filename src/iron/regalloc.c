@@ -6,96 +6,6 @@ bool is_canon_def(FeVirtualReg* inst_out, FeInst* inst) {
     return (inst->kind == FE__MACH_UPSILON || inst_out->def == inst);
 }
 
-static bool add_live_in(FeBlockLiveness* lv, FeVReg vr) {
-    // check to see if its already in the live-in_set.
-    for_n(i, 0, lv->in_len) {
-        if (lv->in[i] == vr) {
-            return false;
-        }
-    }
-    // vr is not in live-in. add it.
-    if (lv->in_len == lv->in_cap) {
-        lv->in_cap += lv->in_cap >> 1;
-        lv->in = fe_realloc(lv->in, sizeof(lv->in[0]) * lv->in_cap);
-    }
-    lv->in[lv->in_len++] = vr;
-    return true;
-}
-
-static bool add_live_out(FeBlockLiveness* lv, FeVReg vr) {
-    // check to see if its already in the live-out set.
-    for_n(i, 0, lv->out_len) {
-        if (lv->out[i] == vr) {
-            return false;
-        }
-    }
-    // vr is not in live-out. add it.
-    if (lv->out_len == lv->out_cap) {
-        lv->out_cap += lv->out_cap >> 1;
-        lv->out = fe_realloc(lv->out, sizeof(lv->out[0]) * lv->out_cap);
-    }
-    lv->out[lv->out_len++] = vr;
-    return true;
-}
-
-static void calculate_liveness(FeFunc* f) {
-    const FeTarget* t = f->mod->target;
-
-    // make sure cfg is updated.
-
-    // give every basic block a liveness chunk.
-    for_blocks(block, f) {
-        FeBlockLiveness* lv = fe_malloc(sizeof(FeBlockLiveness));
-        memset(lv, 0, sizeof(FeBlockLiveness));
-        lv->block = block;
-        block->live = lv;
-
-        // initialize live-in/live-out vectors
-        lv->in_cap = 16;
-        lv->out_cap = 16;
-        lv->in = fe_malloc(sizeof(lv->in[0]) * lv->in_cap);
-        lv->out = fe_malloc(sizeof(lv->out[0]) * lv->out_cap);
-    }
-    
-    // initialize simple live-ins
-    for_blocks(block, f) {
-        for_inst(inst, block) {
-            if (inst->vr_def == FE_VREG_NONE) continue;
-            
-            FeInst** inputs = inst->inputs;
-            for_n(i, 0, inst->in_len) {
-                FeInst* input = inputs[i];
-                FeVirtualReg* vr = fe_vreg(f->vregs, input->vr_def);
-                if (input->kind == FE__MACH_UPSILON || vr->def_block != block) {
-                    add_live_in(block->live, input->vr_def);
-                }
-            }
-        }
-    }
-
-    // iterate over the blocks, refining liveness until everything is settled
-    bool changed = true;
-    while (changed) {
-        changed = false;
-        // block.live_out = block.live_out U successor0.live_in U successor1.live_in ...
-        for_blocks(block, f) {
-            for_n(succ_i, 0, block->succ_len) {
-                FeBlock* succ = block->succ[succ_i];
-                for_n(i, 0, succ->live->in_len) {
-                    FeVReg succ_live_in = succ->live->in[i];
-                    // add it to block.out
-                    changed |= add_live_out(block->live, succ_live_in);
-                    // if not defined in this block, add it block.in
-                    FeVirtualReg* succ_live_in_vr = fe_vreg(f->vregs, succ_live_in);
-                    if (!succ_live_in_vr->is_phi_out && succ_live_in_vr->def_block != block) {
-                        changed |= add_live_in(block->live, succ_live_in);
-                    }
-                }
-            }
-        }
-    }
-}
-
 typedef struct {
     FeVirtualReg* this;
     
@@ -134,7 +44,7 @@ void fe_regalloc_basic(FeFunc* f) {
     const FeTarget* target = f->mod->target;
     FE_ASSERT(target->num_regclasses == 2); // including the NONE regclass
 
-    calculate_liveness(f);
+    fe_analysis_require(f, FE_ANALYSIS_LIVENESS);
 
     // hints!
     for_blocks(block, f) {
@@ -146,7 +56,7 @@ void fe_regalloc_basic(FeFunc* f) {
             FeVirtualReg* inst_vr = fe_vreg(f->vregs, inst->vr_def);
 
             // hint input and output to each other
-            FeInst* input = inst->inputs[0];
+            FeInst* input = fe_inst_input(inst, 0);
             FeVirtualReg* input_vr = fe_vreg(f->vregs, input->vr_def);
 
             inst_vr->hint = input->vr_def;
@@ -200,7 +110,7 @@ void fe_regalloc_basic(FeFunc* f) {
             
             // start life of inputs
             for_n(i, 0, inst->in_len) {
-                FeInst* inst_input = inst->inputs[i];
+                FeInst* inst_input = fe_inst_input(inst, i);
                 if (inst_input->vr_def != FE_VREG_NONE) {
                     live_now[inst_input->vr_def] = true;
                 }
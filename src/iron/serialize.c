@@ -0,0 +1,1084 @@
+#include <setjmp.h>
+#include <stdlib.h>
+
+#include "common/util.h"
+#include "iron/iron.h"
+
+// binary form of a whole module, for caching IR between runs.
+//
+//     "FeIR" version arch system
+//     strtab:   len, bytes                  names of symbols and sections
+//     sections: len, {name off, name len, flags}
+//     symbols:  len, {name off, name len, section, kind, bind}
+//     types:    len, {record or array}       interned FeComplexTy
+//     sigs:     len, {cconv, params, returns} interned FeFuncSig
+//     funcs:    len, {sym, sig, stack, blocks, insts}
+//
+// a function's instructions go block by block in layout order, each
+// block ends with a zero.
+//
+// everything past the first 8 bytes is an unsigned LEB128 varint unless
+// it's a raw byte (types, kinds of symbols). instruction and block ids
+// are kept as they are. each instruction's id is written as the
+// difference from the one before it, and its inputs as the difference
+// from its own id (zigzagged, plus one so zero can be null), so they're
+// almost always one byte. references into the tables are plain indices,
+// plus one where they can be missing.
+//
+// reading doesn't copy names, symbols and sections point into the
+// buffer, so it can be an mmap'd file that stays mapped.
+
+#define MAGIC "FeIR"
+#define VERSION 1
+
+// what a binop takes up in a pool, most instructions are about that big
+#define TYPICAL_NODE_SIZE (sizeof(FeInst) + sizeof(usize) + 2 * sizeof(FeInstRef) + 2 * sizeof(FeInstUse))
+
+static inline u8* put_varint(u8* p, u64 x) {
+    while (x >= 0x80) {
+        *p++ = (u8)x | 0x80;
+        x >>= 7;
+    }
+    *p++ = (u8)x;
+    return p;
+}
+
+static inline u8* reserve(FeDataBuffer* db, usize more) {
+    if_unlikely (db->cap - db->len < more) {
+        fe_db_reserve(db, more);
+    }
+    return db->at + db->len;
+}
+
+// small negative numbers stay small
+static inline u64 zigzag(i64 x) {
+    return ((u64)x << 1) ^ (u64)(x >> 63);
+}
+
+static inline i64 unzigzag(u64 x) {
+    return (i64)(x >> 1) ^ -(i64)(x & 1);
+}
+
+static inline usize usize_next_pow_2(usize x) {
+    return 1 << ((sizeof(x) * 8) -_Generic(x,
+        unsigned long long: __builtin_clzll(x - 1),
+        unsigned long: __builtin_clzl(x - 1),
+        unsigned int: __builtin_clz(x - 1)));
+}
+
+static inline usize usize_log2(usize x) {
+    return (sizeof(x) * 8 - 1) - _Generic(x,
+        unsigned long long: __builtin_clzll(x),
+        unsigned long: __builtin_clzl(x),
+        unsigned int: __builtin_clz(x));
+}
+
+static inline void write_varint(FeDataBuffer* db, u64 x) {
+    u8* p = reserve(db, 10);
+    db->len = put_varint(p, x) - db->at;
+}
+
+// -------------------------------------
+// tables
+// -------------------------------------
+
+// pointer -> index
+typedef struct {
+    const void** keys;
+    u32* vals;
+    u32 cap; // power of two
+    u32 len;
+} PtrMap;
+
+static inline usize ptr_hash(const void* ptr) {
+    return ((usize)ptr >> 4) * 11400714819323198485ull;
+}
+
+static void ptrmap_init(PtrMap* map, u32 cap) {
+    map->cap = 16;
+    while (map->cap < cap * 2) map->cap *= 2;
+    map->len = 0;
+    map->keys = fe_malloc(map->cap * sizeof(map->keys[0]));
+    map->vals = fe_malloc(map->cap * sizeof(map->vals[0]));
+    memset(map->keys, 0, map->cap * sizeof(map->keys[0]));
+}
+
+static void ptrmap_destroy(PtrMap* map) {
+    fe_free(map->keys);
+    fe_free(map->vals);
+}
+
+static u32* ptrmap_slot(PtrMap* map, const void* key, bool* found) {
+    usize mask = map->cap - 1;
+    for (usize i = ptr_hash(key) & mask;; i = (i + 1) & mask) {
+        if (map->keys[i] == key) {
+            *found = true;
+            return &map->vals[i];
+        }
+        if (map->keys[i] == nullptr) {
+            *found = false;
+            map->keys[i] = key;
+            map->len += 1;
+            return &map->vals[i];
+        }
+    }
+}
+
+static void ptrmap_put(PtrMap* map, const void* key, u32 val) {
+    if (map->len * 2 >= map->cap) {
+        PtrMap bigger;
+        ptrmap_init(&bigger, map->cap);
+        for_n (i, 0, map->cap) {
+            if (map->keys[i] != nullptr) {
+                ptrmap_put(&bigger, map->keys[i], map->vals[i]);
+            }
+        }
+        ptrmap_destroy(map);
+        *map = bigger;
+    }
+    bool found;
+    *ptrmap_slot(map, key, &found) = val;
+}
+
+static bool ptrmap_get(PtrMap* map, const void* key, u32* val) {
+    usize mask = map->cap - 1;
+    for (usize i = ptr_hash(key) & mask; map->keys[i] != nullptr; i = (i + 1) & mask) {
+        if (map->keys[i] == key) {
+            *val = map->vals[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// byte strings -> index, so equal types and sigs only get written once
+typedef struct {
+    FeDataBuffer data; // entries back to back
+    u32* ends;         // entry i ends at data.at[ends[i]]
+    u32 len;
+    u32 cap;
+    u32* table;        // index + 1, zero is empty
+    u32 table_cap;     // power of two
+} Interner;
+
+static void interner_init(Interner* in) {
+    fe_db_init(&in->data, 256);
+    in->len = 0;
+    in->cap = 16;
+    in->ends = fe_malloc(in->cap * sizeof(in->ends[0]));
+    in->table_cap = 32;
+    in->table = fe_malloc(in->table_cap * sizeof(in->table[0]));
+    memset(in->table, 0, in->table_cap * sizeof(in->table[0]));
+}
+
+static void interner_destroy(Interner* in) {
+    fe_db_destroy(&in->data);
+    fe_free(in->ends);
+    fe_free(in->table);
+}
+
+static inline const u8* interner_entry(Interner* in, u32 index, usize* len) {
+    u32 start = index == 0 ? 0 : in->ends[index - 1];
+    *len = in->ends[index] - start;
+    return in->data.at + start;
+}
+
+static usize bytes_hash(const u8* data, usize len) {
+    usize hash = 14695981039346656037ull;
+    for_n (i, 0, len) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static u32 intern(Interner* in, const u8* data, usize len) {
+    usize mask = in->table_cap - 1;
+    usize i = bytes_hash(data, len) & mask;
+    for (; in->table[i] != 0; i = (i + 1) & mask) {
+        usize entry_len;
+        const u8* entry = interner_entry(in, in->table[i] - 1, &entry_len);
+        if (entry_len == len && memcmp(entry, data, len) == 0) {
+            return in->table[i] - 1;
+        }
+    }
+
+    u32 index = in->len++;
+    if (in->len > in->cap) {
+        in->cap *= 2;
+        in->ends = fe_realloc(in->ends, in->cap * sizeof(in->ends[0]));
+    }
+    fe_db_write(&in->data, data, len);
+    in->ends[index] = in->data.len;
+    in->table[i] = index + 1;
+
+    // keep it under half full
+    if (in->len * 2 >= in->table_cap) {
+        fe_free(in->table);
+        in->table_cap *= 2;
+        in->table = fe_malloc(in->table_cap * sizeof(in->table[0]));
+        memset(in->table, 0, in->table_cap * sizeof(in->table[0]));
+        mask = in->table_cap - 1;
+        for_n (e, 0, in->len) {
+            usize entry_len;
+            const u8* entry = interner_entry(in, e, &entry_len);
+            usize j = bytes_hash(entry, entry_len) & mask;
+            while (in->table[j] != 0) j = (j + 1) & mask;
+            in->table[j] = e + 1;
+        }
+    }
+    return index;
+}
+
+static void write_table(FeDataBuffer* db, Interner* in) {
+    write_varint(db, in->len);
+    fe_db_write(db, in->data.at, in->data.len);
+}
+
+// -------------------------------------
+// writing
+// -------------------------------------
+
+typedef struct {
+    FeDataBuffer body;
+    FeDataBuffer strtab;
+
+    Interner types;
+    Interner sigs;
+    const FeFuncSig* last_sig; // calls tend to share their sig
+    u32 last_sig_index;
+
+    PtrMap syms;
+    PtrMap sections;
+} Writer;
+
+static u32 write_string(Writer* w, FeCompactStr str) {
+    u32 offset = w->strtab.len;
+    fe_db_write(&w->strtab, fe_compstr_data(str), str.len);
+    return offset;
+}
+
+static u32 intern_ty(Writer* w, FeTy ty, FeComplexTy* cty);
+
+// zero for no complex type
+static u32 cty_ref(Writer* w, FeTy ty, FeComplexTy* cty) {
+    if (ty != FE_TY_RECORD && ty != FE_TY_ARRAY) {
+        return 0;
+    }
+    return intern_ty(w, ty, cty) + 1;
+}
+
+static u32 intern_ty(Writer* w, FeTy ty, FeComplexTy* cty) {
+    // fields go in first so they come before the types using them
+    FeDataBuffer entry;
+    if (ty == FE_TY_RECORD) {
+        u32 fields_len = cty->record.fields_len;
+        u32* refs = fe_malloc((fields_len + 1) * sizeof(refs[0]));
+        for_n (i, 0, fields_len) {
+            FeRecordField* field = &cty->record.fields[i];
+            refs[i] = cty_ref(w, field->ty, field->complex_ty);
+        }
+        fe_db_init(&entry, 16 + fields_len * 16);
+        fe_db_write8(&entry, FE_TY_RECORD);
+        write_varint(&entry, fields_len);
+        for_n (i, 0, fields_len) {
+            FeRecordField* field = &cty->record.fields[i];
+            write_varint(&entry, field->offset);
+            fe_db_write8(&entry, field->ty);
+            write_varint(&entry, refs[i]);
+        }
+        fe_free(refs);
+    } else {
+        u32 elem_ref = cty_ref(w, cty->array.elem_ty, cty->array.complex_elem_ty);
+        fe_db_init(&entry, 32);
+        fe_db_write8(&entry, FE_TY_ARRAY);
+        write_varint(&entry, cty->array.len);
+        fe_db_write8(&entry, cty->array.elem_ty);
+        write_varint(&entry, elem_ref);
+    }
+    u32 index = intern(&w->types, entry.at, entry.len);
+    fe_db_destroy(&entry);
+    return index;
+}
+
+static u32 intern_sig(Writer* w, const FeFuncSig* sig) {
+    if (sig == w->last_sig) {
+        return w->last_sig_index;
+    }
+    usize param_count = sig->param_len + sig->return_len;
+    u32* refs = fe_malloc((param_count + 1) * sizeof(refs[0]));
+    for_n (i, 0, param_count) {
+        refs[i] = cty_ref(w, sig->params[i].ty, sig->params[i].cty);
+    }
+    FeDataBuffer entry;
+    fe_db_init(&entry, 16 + param_count * 8);
+    fe_db_write8(&entry, sig->cconv);
+    write_varint(&entry, sig->param_len);
+    write_varint(&entry, sig->return_len);
+    for_n (i, 0, param_count) {
+        fe_db_write8(&entry, sig->params[i].ty);
+        write_varint(&entry, refs[i]);
+    }
+    u32 index = intern(&w->sigs, entry.at, entry.len);
+    fe_db_destroy(&entry);
+    fe_free(refs);
+
+    w->last_sig = sig;
+    w->last_sig_index = index;
+    return index;
+}
+
+static void write_func(Writer* w, FeFunc* f) {
+    FeDataBuffer* db = &w->body;
+
+    u32 sym_index;
+    ptrmap_get(&w->syms, f->sym, &sym_index);
+    write_varint(db, sym_index);
+    write_varint(db, intern_sig(w, f->sig));
+    if (f->sym->bind == FE_BIND_EXTERN) {
+        return;
+    }
+
+    // stack items, bottom to top, are referred to by position
+    PtrMap stack;
+    u32 stack_len = 0;
+    for (FeStackItem* item = f->stack_bottom; item != nullptr; item = item->next) {
+        stack_len += 1;
+    }
+    ptrmap_init(&stack, stack_len);
+    write_varint(db, stack_len);
+    stack_len = 0;
+    for (FeStackItem* item = f->stack_bottom; item != nullptr; item = item->next) {
+        fe_db_write8(db, item->ty);
+        write_varint(db, cty_ref(w, item->ty, item->complex_ty));
+        ptrmap_put(&stack, item, stack_len++);
+    }
+
+    // all the block ids up front, so branches can point forward
+    u32 block_count = 0;
+    for_blocks(block, f) {
+        block_count += 1;
+    }
+    write_varint(db, f->max_id);
+    write_varint(db, f->max_block_id);
+    write_varint(db, block_count);
+    for_blocks(block, f) {
+        write_varint(db, block->id);
+    }
+
+    u32 prev_id = 0;
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            // inputs, then phi blocks, then at most a few varints of extra
+            u8* p = reserve(db, 64 + inst->in_len * 10);
+            p = put_varint(p, inst->kind);
+            p = put_varint(p, zigzag((i64)inst->id - prev_id));
+            prev_id = inst->id;
+            *p++ = inst->ty;
+            p = put_varint(p, inst->in_len);
+            FeInstRef* inputs = fe_inst_inputs(inst);
+            for_n (i, 0, inst->in_len) {
+                FeInst* input = fe_inst_at(inputs[i]);
+                p = put_varint(p, input == nullptr ? 0 : zigzag((i64)inst->id - input->id) + 1);
+            }
+
+            switch (inst->kind) {
+            case FE_PROJ:
+                p = put_varint(p, fe_extra(inst, FeInstProj)->index);
+                break;
+            case FE_CONST:
+                p = put_varint(p, fe_extra(inst, FeInstConst)->val);
+                break;
+            case FE_SYM_ADDR:
+                ;
+                u32 sym;
+                if (!ptrmap_get(&w->syms, fe_extra(inst, FeInstSymAddr)->sym, &sym)) {
+                    FE_CRASH("sym-addr to a symbol that isn't in the module");
+                }
+                p = put_varint(p, sym);
+                break;
+            case FE_STACK_ADDR:
+                ;
+                u32 item;
+                ptrmap_get(&stack, fe_extra(inst, FeInstStack)->item, &item);
+                p = put_varint(p, item);
+                break;
+            case FE_LOAD:
+            case FE_STORE:
+            case FE_MEM_BARRIER:
+                ;
+                FeInstMemop* memop = fe_extra(inst);
+                p = put_varint(p, memop->align);
+                p = put_varint(p, memop->offset);
+                p = put_varint(p, memop->alias_space);
+                break;
+            case FE_BRANCH:
+                ;
+                FeInstBranch* branch = fe_extra(inst);
+                p = put_varint(p, branch->if_true->id);
+                p = put_varint(p, branch->if_false->id);
+                break;
+            case FE_JUMP:
+                p = put_varint(p, fe_extra(inst, FeInstJump)->to->id);
+                break;
+            case FE_PHI:
+            case FE_MEM_PHI:
+                ;
+                FeBlock** blocks = fe_extra(inst, FeInstPhi)->blocks;
+                for_n (i, 0, inst->in_len) {
+                    p = put_varint(p, blocks[i]->id);
+                }
+                break;
+            case FE_CALL:
+            case FE_TAILCALL:
+                // this can write more types, so the buffer might move
+                db->len = p - db->at;
+                write_varint(db, intern_sig(w, fe_extra(inst, FeInstCall)->sig));
+                p = db->at + db->len;
+                break;
+            case FE_INLINE_ASM:
+            case FE__MACH_MOV:
+            case FE__MACH_UPSILON:
+            case FE__MACH_REG:
+            case FE__MACH_RETURN:
+            case FE__MACH_STACK_SPILL:
+            case FE__MACH_STACK_RELOAD:
+                FE_CRASH("can't write '%s', only target-independent IR", fe_inst_name(f->mod->target, inst->kind));
+            default:
+                if (inst->kind >= FE__BASE_INST_END) {
+                    FE_CRASH("can't write '%s', only target-independent IR", fe_inst_name(f->mod->target, inst->kind));
+                }
+                break;
+            }
+            db->len = p - db->at;
+        }
+        // there's no inst kind zero
+        write_varint(db, 0);
+    }
+
+    ptrmap_destroy(&stack);
+}
+
+static int sym_name_cmp(const void* a, const void* b) {
+    FeCompactStr a_name = (*(FeSymbol**)a)->name;
+    FeCompactStr b_name = (*(FeSymbol**)b)->name;
+    int cmp = memcmp(fe_compstr_data(a_name), fe_compstr_data(b_name), a_name.len < b_name.len ? a_name.len : b_name.len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (int)a_name.len - (int)b_name.len;
+}
+
+void fe_module_write(FeDataBuffer* db, FeModule* mod) {
+    Writer w = {};
+    fe_db_init(&w.body, 4096);
+    fe_db_init(&w.strtab, 256);
+    interner_init(&w.types);
+    interner_init(&w.sigs);
+    ptrmap_init(&w.sections, 8);
+    ptrmap_init(&w.syms, 64);
+
+    FeDataBuffer head;
+    fe_db_init(&head, 256);
+
+    u32 section_count = 0;
+    for (FeSection* section = mod->sections.first; section != nullptr; section = section->next) {
+        section_count += 1;
+    }
+    write_varint(&head, section_count);
+    section_count = 0;
+    for (FeSection* section = mod->sections.first; section != nullptr; section = section->next) {
+        ptrmap_put(&w.sections, section, section_count++);
+        write_varint(&head, write_string(&w, section->name));
+        write_varint(&head, section->name.len);
+        write_varint(&head, section->flags);
+    }
+
+    // sorted by name, so the same module always gives the same bytes
+    u32 sym_count = 0;
+    FeSymbol** syms = fe_malloc((mod->symtab.cap + 1) * sizeof(syms[0]));
+    for_n (i, 0, mod->symtab.cap) {
+        FeSymbol* sym = mod->symtab.entries[i].sym;
+        // skip empty slots and tombstones
+        if ((usize)sym > 1) {
+            syms[sym_count++] = sym;
+        }
+    }
+    qsort(syms, sym_count, sizeof(syms[0]), sym_name_cmp);
+    write_varint(&head, sym_count);
+    for_n (i, 0, sym_count) {
+        FeSymbol* sym = syms[i];
+        u32 section = UINT32_MAX;
+        if (sym->section != nullptr && !ptrmap_get(&w.sections, sym->section, &section)) {
+            FE_CRASH("symbol '%.*s' is in a section that isn't in the module", sym->name.len, fe_compstr_data(sym->name));
+        }
+        ptrmap_put(&w.syms, sym, i);
+        write_varint(&head, write_string(&w, sym->name));
+        write_varint(&head, sym->name.len);
+        write_varint(&head, sym->section == nullptr ? 0 : section + 1);
+        fe_db_write8(&head, sym->kind);
+        fe_db_write8(&head, sym->bind);
+    }
+    fe_free(syms);
+
+    u32 func_count = 0;
+    for_funcs(f, mod) {
+        func_count += 1;
+    }
+    write_varint(&w.body, func_count);
+    for_funcs(f, mod) {
+        write_func(&w, f);
+    }
+
+    fe_db_reserve(db, 32 + w.strtab.len + head.len + w.types.data.len + w.sigs.data.len + w.body.len);
+    fe_db_write(db, MAGIC, 4);
+    fe_db_write8(db, VERSION);
+    fe_db_write8(db, mod->target->arch);
+    fe_db_write8(db, mod->target->system);
+    fe_db_write8(db, 0);
+    write_varint(db, w.strtab.len);
+    fe_db_write(db, w.strtab.at, w.strtab.len);
+    fe_db_write(db, head.at, head.len);
+    write_table(db, &w.types);
+    write_table(db, &w.sigs);
+    fe_db_write(db, w.body.at, w.body.len);
+
+    fe_db_destroy(&head);
+    fe_db_destroy(&w.body);
+    fe_db_destroy(&w.strtab);
+    interner_destroy(&w.types);
+    interner_destroy(&w.sigs);
+    ptrmap_destroy(&w.sections);
+    ptrmap_destroy(&w.syms);
+}
+
+// -------------------------------------
+// reading
+// -------------------------------------
+
+typedef struct {
+    const u8* at;
+    const u8* end;
+    jmp_buf bail;
+
+    const char* strtab;
+    u32 strtab_len;
+
+    FeSection** sections;
+    u32 sections_len;
+    FeSymbol** syms;
+    u32 syms_len;
+    FeComplexTy** types;
+    u32 types_len;
+    FeFuncSig** sigs;
+    u32 sigs_len;
+
+    // per function, kept around between them
+    FeInst** insts;
+    u32 insts_cap;
+    FeBlock** blocks;
+    u32 blocks_cap;
+    FeStackItem** stack;
+    u32 stack_cap;
+    u32* inputs;
+    usize inputs_cap;
+    u32* use_counts;
+    u32 use_counts_cap;
+} Reader;
+
+[[noreturn]] static void bad(Reader* r) {
+    longjmp(r->bail, 1);
+}
+
+static inline u8 get_byte(Reader* r) {
+    if_unlikely (r->at == r->end) {
+        bad(r);
+    }
+    return *r->at++;
+}
+
+static inline u64 get_varint(Reader* r) {
+    if_likely (r->at != r->end && *r->at < 0x80) {
+        return *r->at++;
+    }
+    u64 x = 0;
+    for (u32 shift = 0; shift < 64; shift += 7) {
+        u8 byte = get_byte(r);
+        x |= (u64)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return x;
+        }
+    }
+    bad(r);
+}
+
+// something that indexes a table of len things
+static inline u32 get_index(Reader* r, u32 len) {
+    u64 index = get_varint(r);
+    if_unlikely (index >= len) {
+        bad(r);
+    }
+    return index;
+}
+
+// a count of things that each take at least a byte
+static inline u32 get_count(Reader* r) {
+    u64 count = get_varint(r);
+    if_unlikely (count > (u64)(r->end - r->at)) {
+        bad(r);
+    }
+    return count;
+}
+
+// FeTy has gaps before and between the vector types,
+// and the rest of iron indexes tables with it
+static const bool ty_exists[FE__TY_END] = {
+    [FE_TY_VOID] = true,
+    [FE_TY_BOOL] = true,
+    [FE_TY_I8] = true,
+    [FE_TY_I16] = true,
+    [FE_TY_I32] = true,
+    [FE_TY_I64] = true,
+    [FE_TY_F32] = true,
+    [FE_TY_F64] = true,
+    [FE_TY_TUPLE] = true,
+    [FE_TY_RECORD] = true,
+    [FE_TY_ARRAY] = true,
+
+    [FE_TY_I8x16] = true,
+    [FE_TY_I16x8] = true,
+    [FE_TY_I32x4] = true,
+    [FE_TY_I64x2] = true,
+    [FE_TY_F32x4] = true,
+    [FE_TY_F64x2] = true,
+
+    [FE_TY_I8x32] = true,
+    [FE_TY_I16x16] = true,
+    [FE_TY_I32x8] = true,
+    [FE_TY_I64x4] = true,
+    [FE_TY_F32x8] = true,
+    [FE_TY_F64x4] = true,
+
+    [FE_TY_I8x64] = true,
+    [FE_TY_I16x32] = true,
+    [FE_TY_I32x16] = true,
+    [FE_TY_I64x8] = true,
+    [FE_TY_F32x16] = true,
+    [FE_TY_F64x8] = true,
+};
+
+static inline bool is_ty(FeTy ty) {
+    return ty < FE__TY_END && ty_exists[ty];
+}
+
+static FeTy get_ty(Reader* r, FeComplexTy** cty) {
+    FeTy ty = get_byte(r);
+    u32 ref = get_index(r, r->types_len + 1);
+    bool complex = ty == FE_TY_RECORD || ty == FE_TY_ARRAY;
+    if_unlikely (complex != (ref != 0) || !is_ty(ty) || (complex && r->types[ref - 1]->ty != ty)) {
+        bad(r);
+    }
+    *cty = ref == 0 ? nullptr : r->types[ref - 1];
+    return ty;
+}
+
+static FeCompactStr get_string(Reader* r) {
+    u32 offset = get_varint(r);
+    u32 len = get_varint(r);
+    if_unlikely (len == 0 || len > UINT16_MAX || (u64)offset + len > r->strtab_len) {
+        bad(r);
+    }
+    return fe_compstr(&r->strtab[offset], len);
+}
+
+static void read_tables(Reader* r, FeModule* mod) {
+    r->strtab_len = get_count(r);
+    r->strtab = (const char*)r->at;
+    r->at += r->strtab_len;
+
+    r->sections_len = get_count(r);
+    r->sections = fe_malloc((r->sections_len + 1) * sizeof(r->sections[0]));
+    for_n (i, 0, r->sections_len) {
+        FeCompactStr name = get_string(r);
+        FeSection* section = fe_section_new(mod, fe_compstr_data(name), name.len, 0);
+        section->flags = get_varint(r);
+        r->sections[i] = section;
+    }
+
+    r->syms_len = get_count(r);
+    r->syms = fe_malloc((r->syms_len + 1) * sizeof(r->syms[0]));
+    for_n (i, 0, r->syms_len) {
+        FeCompactStr name = get_string(r);
+        u32 section = get_index(r, r->sections_len + 1);
+        if (fe_symtab_get(&mod->symtab, fe_compstr_data(name), name.len) != nullptr) {
+            bad(r);
+        }
+        FeSymbol* sym = fe_symbol_new(mod, fe_compstr_data(name), name.len, section == 0 ? nullptr : r->sections[section - 1], 0);
+        sym->kind = get_byte(r);
+        sym->bind = get_byte(r);
+        // the function gets attached when it's read
+        if (sym->kind == FE_SYMKIND_FUNC) {
+            sym->kind = FE_SYMKIND_NONE;
+        }
+        r->syms[i] = sym;
+    }
+
+    r->types_len = 0;
+    u32 types_len = get_count(r);
+    r->types = fe_malloc((types_len + 1) * sizeof(r->types[0]));
+    for_n (i, 0, types_len) {
+        FeTy kind = get_byte(r);
+        FeComplexTy* cty;
+        if (kind == FE_TY_RECORD) {
+            u32 fields_len = get_count(r);
+            // fields can only use types from before this one
+            cty = fe_ty_record_new(fields_len);
+            for_n (f, 0, fields_len) {
+                FeRecordField* field = &cty->record.fields[f];
+                u32 offset = get_varint(r);
+                if (offset > UINT16_MAX) {
+                    bad(r);
+                }
+                field->offset = offset;
+                field->ty = get_ty(r, &field->complex_ty);
+            }
+            r->types[r->types_len++] = cty;
+        } else if (kind == FE_TY_ARRAY) {
+            u32 len = get_varint(r);
+            FeComplexTy* elem_cty;
+            FeTy elem_ty = get_ty(r, &elem_cty);
+            cty = fe_ty_array_new(len, elem_ty, elem_cty);
+            r->types[r->types_len++] = cty;
+        } else {
+            bad(r);
+        }
+    }
+
+    r->sigs_len = 0;
+    u32 sigs_len = get_count(r);
+    r->sigs = fe_malloc((sigs_len + 1) * sizeof(r->sigs[0]));
+    for_n (i, 0, sigs_len) {
+        FeCallConv cconv = get_byte(r);
+        u32 param_len = get_count(r);
+        u32 return_len = get_count(r);
+        if (param_len > UINT16_MAX || return_len > UINT16_MAX) {
+            bad(r);
+        }
+        FeFuncSig* sig = fe_funcsig_new(cconv, param_len, return_len);
+        r->sigs[r->sigs_len++] = sig;
+        for_n (p, 0, param_len + return_len) {
+            sig->params[p].ty = get_ty(r, &sig->params[p].cty);
+        }
+    }
+}
+
+#define GROW(ptr, cap, need) do { \
+    if ((need) > (cap)) { \
+        (cap) = (need); \
+        (ptr) = fe_realloc((ptr), (cap) * sizeof((ptr)[0])); \
+    } \
+} while (0)
+
+static inline FeBlock* get_block(Reader* r, u32 max_block_id) {
+    FeBlock* block = r->blocks[get_index(r, max_block_id)];
+    if_unlikely (block == nullptr) {
+        bad(r);
+    }
+    return block;
+}
+
+static void read_func(Reader* r, FeModule* mod, FeInstPool* ipool, FeVRegBuffer* vregs) {
+    FeSymbol* sym = r->syms[get_index(r, r->syms_len)];
+    FeFuncSig* sig = r->sigs[get_index(r, r->sigs_len)];
+    if (sym->kind != FE_SYMKIND_NONE) {
+        bad(r);
+    }
+    FeFunc* f = fe_func_new(mod, sym, sig, ipool, vregs);
+    if (sym->bind == FE_BIND_EXTERN) {
+        return;
+    }
+
+    u32 stack_len = get_count(r);
+    GROW(r->stack, r->stack_cap, stack_len);
+    for_n (i, 0, stack_len) {
+        FeComplexTy* cty;
+        FeTy ty = get_ty(r, &cty);
+        r->stack[i] = fe_stack_append_top(f, fe_stack_item_new(ty, cty));
+    }
+
+    u32 max_id = get_varint(r);
+    u32 max_block_id = get_varint(r);
+    u32 block_count = get_count(r);
+    if (block_count == 0 || block_count > max_block_id) {
+        bad(r);
+    }
+    // ids can be sparse, but every instruction takes at least four bytes
+    // here, which also keeps a bogus max_id from reserving the world
+    usize inst_estimate = min((usize)max_id, (usize)(r->end - r->at) / 4);
+    fe_ipool_reserve(ipool, inst_estimate * TYPICAL_NODE_SIZE);
+    GROW(r->insts, r->insts_cap, max_id);
+    GROW(r->blocks, r->blocks_cap, max_block_id);
+    memset(r->insts, 0, max_id * sizeof(r->insts[0]));
+    memset(r->blocks, 0, max_block_id * sizeof(r->blocks[0]));
+    for_n (i, 0, block_count) {
+        u32 id = get_index(r, max_block_id);
+        if (r->blocks[id] != nullptr) {
+            bad(r);
+        }
+        FeBlock* block = i == 0 ? f->entry_block : fe_block_new(f);
+        block->id = id;
+        r->blocks[id] = block;
+    }
+
+    FeInst* root = fe_inst_next(f->entry_block->bookend);
+    u32 root_id = UINT32_MAX;
+    usize inputs_len = 0;
+    u32 id = 0;
+    for (FeBlock* block = f->entry_block; block != nullptr; block = block->list_next) {
+        while (true) {
+            FeInstKind kind = get_varint(r);
+            if (kind == 0) {
+                break;
+            }
+            id += unzigzag(get_varint(r));
+            FeTy ty = get_byte(r);
+            u32 in_len = get_count(r);
+            if (kind < FE__ROOT || kind >= FE__BASE_INST_END || !is_ty(ty) || in_len > UINT16_MAX) {
+                bad(r);
+            }
+            if (fe_inst_extra_size_unsafe(kind) == 255) {
+                bad(r);
+            }
+            if (id >= max_id || r->insts[id] != nullptr) {
+                bad(r);
+            }
+
+            // input ids, UINT32_MAX for null
+            if (inputs_len + in_len > r->inputs_cap) {
+                r->inputs_cap = (inputs_len + in_len) * 2;
+                r->inputs = fe_realloc(r->inputs, r->inputs_cap * sizeof(r->inputs[0]));
+            }
+            u32* inputs = &r->inputs[inputs_len];
+            for_n (n, 0, in_len) {
+                u64 input = get_varint(r);
+                inputs[n] = input == 0 ? UINT32_MAX : id - unzigzag(input - 1);
+            }
+            inputs_len += in_len;
+
+            // root and params came with fe_func_new, just put them in place
+            FeInst* inst = nullptr;
+            if (kind == FE__ROOT) {
+                if (block != f->entry_block || root_id != UINT32_MAX || in_len != 0) {
+                    bad(r);
+                }
+                root_id = id;
+                inst = root;
+            } else if (kind == FE_PROJ && in_len == 1 && root_id != UINT32_MAX && inputs[0] == root_id) {
+                inst = f->params[get_index(r, sig->param_len)];
+                if (inst->id < max_id && r->insts[inst->id] == inst) {
+                    bad(r);
+                }
+            }
+            if (inst != nullptr) {
+                fe_inst_remove_from_block(inst);
+                fe_append_end(block, inst);
+                inst->id = id;
+                r->insts[id] = inst;
+                continue;
+            }
+
+            inst = fe_inst_new(f, in_len, fe_inst_extra_size(kind));
+            inst->kind = kind;
+            inst->ty = ty;
+            inst->id = id;
+            r->insts[id] = inst;
+            fe_append_end(block, inst);
+
+            switch (kind) {
+            case FE_PROJ:
+                fe_extra(inst, FeInstProj)->index = get_varint(r);
+                break;
+            case FE_CONST:
+                fe_extra(inst, FeInstConst)->val = get_varint(r);
+                break;
+            case FE_SYM_ADDR:
+                fe_extra(inst, FeInstSymAddr)->sym = r->syms[get_index(r, r->syms_len)];
+                break;
+            case FE_STACK_ADDR:
+                fe_extra(inst, FeInstStack)->item = r->stack[get_index(r, stack_len)];
+                break;
+            case FE_LOAD:
+            case FE_STORE:
+            case FE_MEM_BARRIER:
+                ;
+                FeInstMemop* memop = fe_extra(inst);
+                memop->align = get_varint(r);
+                memop->offset = get_varint(r);
+                memop->alias_space = get_varint(r);
+                break;
+            case FE_BRANCH:
+                ;
+                FeBlock* if_true = get_block(r, max_block_id);
+                FeBlock* if_false = get_block(r, max_block_id);
+                fe_branch_set_true(f, inst, if_true);
+                fe_branch_set_false(f, inst, if_false);
+                break;
+            case FE_JUMP:
+                fe_jump_set_target(f, inst, get_block(r, max_block_id));
+                break;
+            case FE_PHI:
+            case FE_MEM_PHI:
+                ;
+                usize in_cap = fe_inst_in_cap(inst);
+                FeBlock** blocks = in_cap == 0 ? nullptr : fe_ipool_list_alloc(ipool, in_cap);
+                for_n (n, 0, in_len) {
+                    blocks[n] = get_block(r, max_block_id);
+                }
+                fe_extra(inst, FeInstPhi)->blocks = blocks;
+                break;
+            case FE_CALL:
+            case FE_TAILCALL:
+                fe_extra(inst, FeInstCall)->sig = r->sigs[get_index(r, r->sigs_len)];
+                break;
+            case FE__ROOT:
+            case FE_INLINE_ASM:
+            case FE__MACH_MOV:
+            case FE__MACH_UPSILON:
+            case FE__MACH_REG:
+            case FE__MACH_RETURN:
+            case FE__MACH_STACK_SPILL:
+            case FE__MACH_STACK_RELOAD:
+                bad(r);
+            default:
+                break;
+            }
+        }
+    }
+    if (root_id == UINT32_MAX) {
+        bad(r);
+    }
+
+    // params that weren't written were deleted before writing,
+    // they go first so they aren't mistaken for something that was read
+    for_n (i, 0, sig->param_len) {
+        FeInst* param = f->params[i];
+        if (param->id >= max_id || r->insts[param->id] != param) {
+            fe_inst_destroy(f, param);
+        }
+    }
+
+    // inputs can point forward, so they all go in at the end. every
+    // input is checked and counted first, then use lists are sized to
+    // fit and filled in one go, which is a lot cheaper than growing them
+    // an edge at a time. nothing after the counting can bail, so a bad
+    // module never leaves a use list half built.
+    GROW(r->use_counts, r->use_counts_cap, max_id);
+    memset(r->use_counts, 0, max_id * sizeof(r->use_counts[0]));
+    for_n (i, 0, inputs_len) {
+        u32 input_id = r->inputs[i];
+        if (input_id == UINT32_MAX) {
+            continue;
+        }
+        if (input_id >= max_id || r->insts[input_id] == nullptr) {
+            bad(r);
+        }
+        r->use_counts[input_id] += 1;
+        if_unlikely (r->use_counts[input_id] > FE__USE_CAP_MAX) {
+            bad(r);
+        }
+    }
+
+    // the only uses so far are params on root, and those get redone
+    // below. everything else starts out empty with room for two inline,
+    // so only the ones with more than that need looking at
+    root->use_len = 0;
+    for_n (id, 0, max_id) {
+        u32 count = r->use_counts[id];
+        if (count <= 2) {
+            continue;
+        }
+        FeInst* inst = r->insts[id];
+        if (count <= fe_inst_use_cap(inst)) {
+            continue;
+        }
+        if (!fe_inst_uses_inline(inst)) {
+            fe_ipool_list_free(ipool, fe_inst_uses(inst), fe_inst_use_cap(inst));
+        }
+        usize use_cap = usize_next_pow_2(count);
+        inst->uses = fe_inst_ref(fe_ipool_list_alloc(ipool, use_cap));
+        inst->caps = (inst->caps & 0x0F) | (usize_log2(use_cap) - 1) << 4;
+    }
+
+    // the layout is the same order they were read in
+    inputs_len = 0;
+    for_blocks(block, f) {
+        for_inst(inst, block) {
+            FeInstRef* inputs = fe_inst_inputs(inst);
+            for_n (n, 0, inst->in_len) {
+                u32 input_id = r->inputs[inputs_len++];
+                if (input_id == UINT32_MAX) {
+                    inputs[n] = 0;
+                    continue;
+                }
+                FeInst* input = r->insts[input_id];
+                inputs[n] = fe_inst_ref(input);
+                fe_inst_uses(input)[input->use_len++] = (FeInstUse){
+                    .inst = fe_inst_ref(inst),
+                    .idx = n,
+                };
+            }
+        }
+    }
+
+    f->max_id = max_id;
+    f->max_block_id = max_block_id;
+}
+
+FeModule* fe_module_read(const u8* data, usize len, FeInstPool* ipool, FeVRegBuffer* vregs) {
+    if (len < 8 || memcmp(data, MAGIC, 4) != 0 || data[4] != VERSION) {
+        return nullptr;
+    }
+    // fe_make_target crashes on anything else
+    if ((data[5] != FE_ARCH_X64 && data[5] != FE_ARCH_XR17032) || data[6] != FE_SYSTEM_FREESTANDING) {
+        return nullptr;
+    }
+    FeModule* mod = fe_module_new(data[5], data[6]);
+
+    Reader r = {
+        .at = data + 8,
+        .end = data + len,
+    };
+    bool ok = true;
+    if (setjmp(r.bail) == 0) {
+        read_tables(&r, mod);
+        u32 func_count = get_count(&r);
+        for_n (i, 0, func_count) {
+            read_func(&r, mod, ipool, vregs);
+        }
+        if (r.at != r.end) {
+            bad(&r);
+        }
+    } else {
+        ok = false;
+    }
+
+    fe_free(r.sections);
+    fe_free(r.syms);
+    fe_free(r.types);
+    fe_free(r.sigs);
+    fe_free(r.insts);
+    fe_free(r.blocks);
+    fe_free(r.stack);
+    fe_free(r.inputs);
+    fe_free(r.use_counts);
+
+    if (!ok) {
+        // the pool isn't ours, so this has to go one inst at a time
+        while (mod->funcs.first) {
+            fe_func_destroy(mod->funcs.first);
+        }
+        fe_module_destroy(mod);
+        return nullptr;
+    }
+    return mod;
+}
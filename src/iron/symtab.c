@@ -15,7 +15,7 @@ static usize fnv1a(const char* data, u16 len) {
     usize hash = FNV1A_OFFSET_BASIS;
     for_n(i, 0, len) {
         hash *= FNV1A_PRIME;
-        hash ^= data[len];
+        hash ^= data[i];
     }
     return hash;
 }
@@ -45,14 +45,16 @@ void fe_symtab_put(FeSymTab* st, FeSymbol* sym) {
     memset(new_table.entries, 0, sizeof(new_table.entries[0]) * new_table.cap);
 
     for_n(i, 0, st->cap) {
-        FeSymbol* sym = st->entries[i].sym;
-        if ((u64)sym <= TOMBSTONE) {
+        FeSymbol* old = st->entries[i].sym;
+        if ((u64)old <= TOMBSTONE) {
             continue;
         }
-        fe_symtab_put(&new_table, sym);
+        fe_symtab_put(&new_table, old);
     }
     fe_free(st->entries);
     *st = new_table;
+
+    fe_symtab_put(st, sym);
 }
 
 #define fe_symtab_get_compstr(st, compstr) fe_symtab_get(st, fe_compstr_data((compstr)), (compstr).len)
@@ -80,7 +82,7 @@ FeSymbol* fe_symtab_get(FeSymTab* st, const char* data, u16 len) {
 #define fe_symtab_remove_compstr(st, compstr) fe_symtab_remove(st, fe_compstr_data((compstr)), (compstr).len)
 
 void fe_symtab_remove(FeSymTab* st, const char* data, u16 len) {
-usize hash = fnv1a(data, len);
+    usize hash = fnv1a(data, len);
     for_n(i, 0, MAX_SEARCH) {
         usize index = (hash + i) % st->cap;
         FeSymbol* sym = st->entries[index].sym;
@@ -92,8 +94,10 @@ usize hash = fnv1a(data, len);
         }
 
         FeCompactStr name = st->entries[index].name;
+        // leave a tombstone so lookups keep probing past this slot
         if (name.len == len && memcmp(fe_compstr_data(name), data, len) == 0) {
-            memset(&st->entries[index], 0, sizeof(st->entries[index]));
+            st->entries[index].sym = (FeSymbol*)TOMBSTONE;
+            return;
         }
     }
 }
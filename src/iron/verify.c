@@ -15,10 +15,10 @@ static void inst_local_check(FeFunc* f, FeInst* inst) {
         FE_CRASH("inst kind %d is not recognized", inst->kind);
     }
 
-    if ((traits & TERM) && inst->next->kind != FE__BOOKEND) {
+    if ((traits & TERM) && fe_inst_next(inst)->kind != FE__BOOKEND) {
         FE_CRASH("inst %s is a terminator but is not last in block", inst_name);
     }
-    if (!(traits & TERM) && inst->next->kind == FE__BOOKEND) {
+    if (!(traits & TERM) && fe_inst_next(inst)->kind == FE__BOOKEND) {
         FE_CRASH("inst %s is not a terminator but is last in block", inst_name);
     }
 }
@@ -98,7 +98,7 @@ void fe_xr_print_inst(FeDataBuffer* db, FeFunc* f, FeInst* inst) {
         }
         break;
     case XR_ADDI ... XR_JALR:
-        fe__emit_ir_ref(db, f, inst->inputs[0]);
+        fe__emit_ir_ref(db, f, fe_inst_input(inst, 0));
         fe_db_writef(db, ", %u", fe_extra(inst, XrInstImm)->imm);
         break;
     
@@ -89,12 +89,81 @@ static FeInstChain store_returnval(FeFunc* f, FeBlock* exit, usize index, FeInst
     }
 }
 
+// only direct calls know where they're going without a register
+static bool only_direct_callee(FeInst* sym_addr) {
+    for_n (i, 0, sym_addr->use_len) {
+        FeInst* use = FE_USE_PTR(fe_inst_uses(sym_addr)[i]);
+        if (use->kind != FE_TAILCALL || fe_inst_uses(sym_addr)[i].idx != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// everything tail_call below knows how to do
+bool fe_xr_can_tail_call(FeFuncSig* sig) {
+    return (sig->cconv == FE_CCONV_ANY || sig->cconv == FE_CCONV_JACKAL)
+        && sig->param_len <= 4;
+}
+
+static FeInstChain tail_call(FeFunc* f, FeBlock* block, FeInst* inst) {
+    FeFuncSig* sig = fe_extra(inst, FeInstCall)->sig;
+    switch (sig->cconv) {
+    case FE_CCONV_ANY:
+    case FE_CCONV_JACKAL:
+        break;
+    default:
+        FE_CRASH("unsupported cconv");
+    }
+
+    FeInstChain chain = FE_EMPTY_CHAIN;
+
+    // arguments go where the callee expects them
+    for_n (i, 0, sig->param_len) {
+        if (i >= 4) {
+            FE_CRASH("stack args so far unsupported");
+        }
+        static u16 arg_regs[4] = {XR_GPR_A0, XR_GPR_A1, XR_GPR_A2, XR_GPR_A3};
+
+        FeInst* mov = fe_inst_unop(f, sig->params[i].ty, FE__MACH_MOV, fe_inst_input(inst, i + 2));
+        assign_real_reg(f, block, mov, arg_regs[i]);
+        chain = fe_chain_concat(chain, fe_chain_new(mov));
+    }
+
+    // this jump sits where a return's jalr would, so once there's frame
+    // teardown it covers both. it's a jump instead of a jump-and-link,
+    // so the callee returns straight to our caller
+    FeInst* callee = fe_inst_input(inst, 1);
+    if (callee->kind == FE_SYM_ADDR) {
+        // j sym
+        FeInst* j = xr_inst(f, XR_J, 0, sizeof(XrInstImmOrSym));
+        j->ty = FE_TY_VOID;
+        fe_extra(j, XrInstImmOrSym)->sym = fe_extra(callee, FeInstSymAddr)->sym;
+        chain = fe_chain_concat(chain, fe_chain_new(j));
+    } else {
+        // jalr zero, callee, 0
+        FeInst* jalr = xr_inst(f, XR_JALR, 1, sizeof(XrInstImm));
+        jalr->ty = FE_TY_I32;
+        assign_real_reg(f, block, jalr, XR_GPR_ZERO);
+        fe_set_input(f, jalr, 0, callee);
+        fe_extra(jalr, XrInstImm)->imm = 0;
+        chain = fe_chain_concat(chain, fe_chain_new(jalr));
+    }
+
+    // control never comes back here
+    FeInst* mach_ret = fe_inst_new(f, 0, 0);
+    mach_ret->kind = FE__MACH_RETURN;
+    chain = fe_chain_append_end(chain, mach_ret);
+
+    return chain;
+}
+
 FeInstChain fe_xr_isel(FeFunc* f, FeBlock* block, FeInst* inst) {
     switch (inst->kind) {
     case FE__ROOT:
         return FE_EMPTY_CHAIN;
     case FE_PROJ:
-        if (inst->inputs[0]->kind == FE__ROOT) {
+        if (fe_inst_input(inst, 0)->kind == FE__ROOT) {
             // FE_CRASH("select parameter");
 
             // figure out what parameter we're looking at.
@@ -103,17 +172,17 @@ FeInstChain fe_xr_isel(FeFunc* f, FeBlock* block, FeInst* inst) {
         }
         FE_CRASH("unknown proj selection");
     case FE_IADD: {
-        if (is_const_u16(inst->inputs[1])) {
+        if (is_const_u16(fe_inst_input(inst, 1))) {
             FeInst* sel = xr_inst(f, XR_ADDI, 1, sizeof(XrInstImm));
             sel->ty = FE_TY_I32;
-            fe_set_input(f, sel, 0, inst->inputs[0]);
-            fe_extra(sel, XrInstImm)->imm = const_val(inst->inputs[1]);
+            fe_set_input(f, sel, 0, fe_inst_input(inst, 0));
+            fe_extra(sel, XrInstImm)->imm = const_val(fe_inst_input(inst, 1));
             return fe_chain_new(sel);
         }
         FeInst* sel = xr_inst(f, XR_ADD, 2, sizeof(XrInstImm));
         sel->ty = FE_TY_I32;
-        fe_set_input(f, sel, 0, inst->inputs[0]);
-        fe_set_input(f, sel, 0, inst->inputs[1]);
+        fe_set_input(f, sel, 0, fe_inst_input(inst, 0));
+        fe_set_input(f, sel, 0, fe_inst_input(inst, 1));
         return fe_chain_new(sel);
     }
     case FE_CONST: {
@@ -135,7 +204,7 @@ FeInstChain fe_xr_isel(FeFunc* f, FeBlock* block, FeInst* inst) {
         
         // store the return values
         for_n(i, 1, inst->in_len) {
-            FeInstChain retval = store_returnval(f, block, i - 1, inst->inputs[i]);
+            FeInstChain retval = store_returnval(f, block, i - 1, fe_inst_input(inst, i));
             chain = fe_chain_concat(chain, retval);
         }
         
@@ -160,6 +229,14 @@ FeInstChain fe_xr_isel(FeFunc* f, FeBlock* block, FeInst* inst) {
 
         return chain;
     }
+    case FE_SYM_ADDR:
+        if (only_direct_callee(inst)) {
+            // folded into the jump
+            return FE_EMPTY_CHAIN;
+        }
+        FE_CRASH("symbol addresses so far unsupported");
+    case FE_TAILCALL:
+        return tail_call(f, block, inst);
     default:
         FE_CRASH("cannot select from inst %s (%d)", fe_inst_name(f->mod->target, inst->kind), inst->kind);
     }
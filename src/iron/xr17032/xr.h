@@ -150,6 +150,7 @@ typedef enum : u16 {
 } XrGpr;
 
 FeInstChain fe_xr_isel(FeFunc* f, FeBlock* block, FeInst* inst);
+bool fe_xr_can_tail_call(FeFuncSig* sig);
 FeRegClass fe_xr_choose_regclass(FeInstKind kind, FeTy ty);
 void fe_xr_print_inst(FeDataBuffer* db, FeFunc* f, FeInst* inst);
 